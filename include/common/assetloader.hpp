@@ -0,0 +1,93 @@
+#ifndef ASSETLOADER_HPP
+#define ASSETLOADER_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+
+#include <GL/glew.h>
+
+#include "common/parallel.hpp"
+#include "common/texture.hpp"
+#include "common/meshcache.hpp"
+#include "common/meshpool.hpp"
+
+// loads assets in the background : file I/O, decoding, tangents and indexing
+//  run on worker threads, what needs GL is queued for the GL thread which
+//  runs it from processUploads() a little every frame
+struct AssetLoader
+{
+    WorkerPool workers;
+    TextureUploader textureUploader;
+
+    // GL work ready to run, filled by the workers
+    std::mutex uploadMutex;
+    std::deque<std::function<void()> > uploads;
+
+    // assets submitted and not resident (or failed) yet
+    std::atomic<unsigned int> pending;
+};
+
+// assets as the GL thread sees them ; the fields are only written by
+//  processUploads(), so they can be read on the GL thread without locking
+//  an asset must stay alive until it is resident or the loader is stopped
+
+struct TextureAsset
+{
+    GLuint texture;         // 0 until resident
+    bool resident;
+};
+
+struct ShaderAsset
+{
+    GLuint program;         // 0 until resident
+    bool resident;
+};
+
+struct MeshAsset
+{
+    MeshFile file;          // filled on a worker
+    unsigned int poolMesh;  // in the pool it was loaded into
+    bool resident;
+};
+
+// call on the GL thread, the loader creates its unpack buffers
+//  workerCount : 0 uses every core
+void startAssetLoader(AssetLoader &loader, unsigned int workerCount = 0);
+
+// finishes every submitted asset, uploads included, then stops the workers
+//  call on the GL thread
+void stopAssetLoader(AssetLoader &loader);
+
+// start loading an asset ; the future turns true once it is resident and
+//  false if it could not be loaded
+//  don't wait on it from the GL thread, it is processUploads() that completes it
+//  mips : as for loadTexture()
+//  defines : as for CreateProgram()
+//  the mesh goes into pool, which must outlive the loader
+std::future<bool> loadTextureAsync(
+    AssetLoader &loader, const char* path, TextureAsset &asset,
+    const MipSettings &mips = colorMipSettings
+);
+std::future<bool> loadShadersAsync(
+    AssetLoader &loader, const char* vertexPath, const char* fragmentPath, ShaderAsset &asset,
+    const char* defines = NULL
+);
+std::future<bool> loadMeshAsync(
+    AssetLoader &loader, MeshPool &pool, const char* objPath, const char* cachePath, MeshAsset &asset
+);
+
+// run queued uploads on the GL thread until budgetMs is spent (at least one
+//  runs, so loading always progresses) ; returns the number still queued
+size_t processUploads(AssetLoader &loader, double budgetMs);
+
+// number of submitted assets that are not resident or failed yet
+unsigned int pendingAssets(const AssetLoader &loader);
+
+// release the memory of a mesh ; what it put in its pool stays there
+void destroyMeshAsset(MeshAsset &asset);
+
+#endif  // ASSETLOADER_HPP
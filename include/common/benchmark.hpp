@@ -0,0 +1,84 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+// what --bench renders and where the results go
+struct BenchmarkSettings
+{
+    bool enabled;                       // --bench given
+    unsigned int width;
+    unsigned int height;
+    unsigned int samples;
+    unsigned int warmupFrames;          // drawn once everything is resident, not measured
+    unsigned int frames;                // measured
+    std::vector<unsigned int> captures; // measured frames saved as PPM, from 0
+    std::string reportPath;
+    std::string capturePrefix;          // captures are <prefix>_<frame>.ppm
+    unsigned int instances;             // --instances, copies of the mesh on a grid
+    std::string tracePath;              // --trace, with or without --bench, empty for none
+};
+
+// the defaults, then the --bench, --instances and --trace options found in argv
+//  returns false and prints the usage on anything it does not know
+bool parseBenchmarkArguments(int argc, char** argv, BenchmarkSettings &settings);
+
+// times every frame on the CPU and, with timer queries, on the GPU
+//  at most frameLatency frames are queued, like with a swap chain, so the
+//  time between beginFrame() and the end of endFrame() is how long a frame
+//  takes once the pipeline is full, whichever side is the bottleneck
+static const unsigned int frameLatency = 3;
+
+struct FrameTimer
+{
+    GLuint queries[frameLatency];
+    GLsync fences[frameLatency];
+    unsigned int frame;                 // frames begun
+    double frameStart;
+
+    // in ms, one per frame
+    std::vector<double> frameTimes;     // begin to end, waiting for the GPU included
+    std::vector<double> cpuTimes;       // begin to the last GL call of the frame
+    std::vector<double> gpuTimes;       // GL_TIME_ELAPSED, empty without timer queries
+};
+
+// steady clock in seconds, for when there is no GLFW
+double benchmarkTime();
+
+void startFrameTimer(FrameTimer &timer);
+void beginFrame(FrameTimer &timer);
+void endFrame(FrameTimer &timer);
+// waits for the frames in flight and collects their GPU times
+void stopFrameTimer(FrameTimer &timer);
+
+struct TimeSummary
+{
+    double min;
+    double median;
+    double mean;
+    double p95;
+    double p99;
+    double max;
+};
+
+// nearest rank percentiles, all 0 without samples
+TimeSummary summarizeTimes(const std::vector<double> &times);
+
+// the report : settings, renderer, time summaries, per frame counters
+//  (name, value per frame) and whole run metrics (name, value), written
+//  as JSON
+bool writeBenchmarkReport(
+    const BenchmarkSettings &settings,
+    unsigned int samples,
+    double loadTime,
+    const FrameTimer &timer,
+    const std::vector<std::pair<std::string, double> > &counters,
+    const std::vector<std::pair<std::string, double> > &metrics,
+    const std::vector<std::string> &capturePaths
+);
+
+#endif  // BENCHMARK_HPP
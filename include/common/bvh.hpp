@@ -0,0 +1,111 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "common/meshcache.hpp"
+
+// a bounding volume hierarchy over the triangles of an indexed mesh, for
+//  ray casts : picking, visibility, ...
+//  nodes are stored depth first, a node's first child right after it, so
+//  that going down the near side mostly reads memory in order ; 32 bytes
+struct BVHNode
+{
+    glm::vec3 boundsMin;
+    uint32_t offset;            // leaf : first triangle, else : second child
+    glm::vec3 boundsMax;
+    uint32_t count;             // leaf : triangles, 0 for inner nodes
+};
+
+struct BVH
+{
+    std::vector<BVHNode> nodes;         // nodes[0] is the root
+    std::vector<glm::vec3> vertices;    // 3 per triangle, in leaf order
+    std::vector<uint32_t> triangles;    // index in the source of each of them
+    unsigned int depth;                 // of the deepest leaf, the root's is 0
+};
+
+// SAH with binned centroids, the large subtrees built on threadCount
+//  threads, 0 uses every core
+//  indices : 3 per triangle, into positions
+void buildBVH(
+    BVH &bvh,
+    const glm::vec3* positions,
+    const uint32_t* indices,
+    size_t triangleCount,
+    unsigned int threadCount = 0
+);
+
+// every sub-mesh of the full mesh, its first level of detail, triangles
+//  numbered in index buffer order
+void buildBVH(BVH &bvh, const MeshData &mesh, unsigned int threadCount = 0);
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;        // need not be unit length, t is in its units
+    float tMax;                 // hits beyond are ignored
+};
+
+static const uint32_t noTriangle = 0xffffffffu;
+
+struct RayHit
+{
+    float t;
+    uint32_t triangle;          // from BVH::triangles, noTriangle when missed
+    float u, v;                 // barycentrics of vertices 1 and 2
+};
+
+// the closest hit, returns false if there is none
+bool intersectRay(const BVH &bvh, const Ray &ray, RayHit &hit);
+
+// several rays traversing together, best when coherent (from one camera,
+//  neighbouring pixels) ; structure of arrays, count <= rayPacketSize
+//  8 rays : one AVX lane set, two SSE2 ones, the path picked at run time
+static const unsigned int rayPacketSize = 8;
+
+struct RayPacket
+{
+    alignas(32) float originX[rayPacketSize];
+    alignas(32) float originY[rayPacketSize];
+    alignas(32) float originZ[rayPacketSize];
+    alignas(32) float directionX[rayPacketSize];
+    alignas(32) float directionY[rayPacketSize];
+    alignas(32) float directionZ[rayPacketSize];
+    alignas(32) float tMax[rayPacketSize];
+    unsigned int count;
+};
+
+void setPacketRay(RayPacket &packet, unsigned int i, const Ray &ray);
+
+// the closest hit of each ray of the packet
+void intersectPacket(const BVH &bvh, const RayPacket &packet, RayHit hits[rayPacketSize]);
+
+// the ray through a point of the screen, x and y in [-1, 1] from the lower
+//  left corner, starting on the near plane
+Ray screenRay(const glm::mat4 &view, const glm::mat4 &projection, float x, float y);
+
+// a frame of primary rays, width x height, cast one at a time then in
+//  packets of rayPacketSize neighbours, on threadCount threads
+struct RayBenchmark
+{
+    unsigned int rays;          // each way
+    unsigned int hits;
+    double singleMrays;         // millions of rays per second
+    double packetMrays;
+};
+
+RayBenchmark benchmarkRays(
+    const BVH &bvh,
+    const glm::mat4 &view,
+    const glm::mat4 &projection,
+    unsigned int width,
+    unsigned int height,
+    unsigned int threadCount = 0
+);
+
+#endif  // BVH_HPP
@@ -6,7 +6,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 void computeMatricesFromInputs();
+// the matrices of the camera where it stands, without reading any input
+//  aspectRatio : width / height of the framebuffer
+void computeMatricesFromCamera(float aspectRatio);
 glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
 
+// the ray from the near plane through the cursor, in worldspace, for
+//  picking ; direction is unit length
+//  while the mouse looks around the cursor is hidden, the ray then goes
+//  through the center of the view
+void computeCursorRay(glm::vec3 &origin, glm::vec3 &direction);
+
 #endif  // CONTROLS_HPP
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "common/parallel.hpp"
+
+// the 6 planes of a view frustum, normals pointing inside, normalized
+//  a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// the frustum of getProjectionMatrix() * getViewMatrix(), in worldspace
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+// axis aligned boxes as center and half extent, structure of arrays so
+//  that the culling kernel loads several boxes per instruction ; the
+//  arrays are padded to a multiple of cullBatchSize, the widest lanes the
+//  kernel runs (8 boxes with AVX)
+static const size_t cullBatchSize = 8;
+
+struct BoundsSoA
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    size_t count;
+};
+
+void resizeBounds(BoundsSoA &bounds, size_t count);
+void setBounds(BoundsSoA &bounds, size_t i, const glm::vec3 &center, const glm::vec3 &extent);
+void copyBounds(BoundsSoA &bounds, size_t from, size_t to);
+
+// the box around the local box [boundsMin, boundsMax] once transformed
+void transformBox(
+    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model,
+    glm::vec3 &center, glm::vec3 &extent
+);
+
+struct CullStats
+{
+    unsigned int visible;
+    unsigned int culled;
+};
+
+// visible[i] = 1 if box i is at least partly inside the frustum, else 0
+//  conservative : a box outside near a frustum corner may pass
+//  ranges of boxes go to the threads of workers as well as the calling
+//  one, NULL culls them all on the calling thread
+CullStats cullBounds(
+    const BoundsSoA &bounds,
+    const Frustum &frustum,
+    std::vector<unsigned char> &visible,
+    WorkerPool* workers = NULL
+);
+
+#endif  // CULLING_HPP
@@ -0,0 +1,49 @@
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+#include <GL/glew.h>
+
+// a shadow of the GL binding and enable state : every call goes to GL only
+//  when it changes something, the others are counted and dropped
+//  the shadow is only right if all the code binding things goes through
+//  here, on the GL thread ; after foreign GL code call resetGLState()
+
+struct GLStateStats
+{
+    unsigned int issued;        // calls that reached GL
+    unsigned int skipped;       // calls dropped as redundant
+};
+
+// forget everything, the next call of each kind reaches GL
+void resetGLState();
+
+void useProgram(GLuint program);
+
+// unit : 0, 1, ... ; bindTexture() binds on the active unit like glBindTexture
+void activeTexture(GLuint unit);
+void bindTexture(GLenum target, GLuint texture);
+// activeTexture() then bindTexture()
+void bindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+
+// GL_ELEMENT_ARRAY_BUFFER and the vertex attribute arrays are per vertex array
+void bindBuffer(GLenum target, GLuint buffer);
+void bindVertexArray(GLuint vertexArray);
+void enableVertexAttribArray(GLuint index);
+void disableVertexAttribArray(GLuint index);
+
+// glEnable() / glDisable()
+void setCapability(GLenum capability, bool enabled);
+void blendFunc(GLenum source, GLenum destination);
+
+// glDelete*() that also drop the deleted names from the shadow, GL unbinds
+//  them and the name may come back with the next glGen*()
+void deleteProgram(GLuint program);
+void deleteTextures(GLsizei count, const GLuint* textures);
+void deleteBuffers(GLsizei count, const GLuint* buffers);
+void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+
+// calls since the last resetGLStateStats(), e.g. over one frame
+GLStateStats glStateStats();
+void resetGLStateStats();
+
+#endif  // GLSTATE_HPP
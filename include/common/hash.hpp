@@ -0,0 +1,10 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hash of a file's content, what cache files are checked against
+uint64_t hashFileContent(const char* data, size_t size);
+
+#endif  // HASH_HPP
@@ -0,0 +1,71 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include "common/mappedfile.hpp"
+
+// pixel layouts an Image can hold ; no GL types here so that images can be
+//  decoded on any thread and without a context
+enum ImageFormat
+{
+    IMAGE_BGR8,     // 3 bytes per pixel, rows padded to 4 bytes (BMP)
+    IMAGE_RGBA8,    // 4 bytes per pixel (generated mip chains)
+    IMAGE_BC1,      // DXT1, 8 bytes per 4x4 block
+    IMAGE_BC2,      // DXT3, 16 bytes per 4x4 block
+    IMAGE_BC3,      // DXT5, 16 bytes per 4x4 block
+    IMAGE_BC5       // ATI2, two channels (red, green), 16 bytes per 4x4 block
+};
+
+// one mip level, a view into the memory the Image holds
+struct ImageLevel
+{
+    unsigned int width;
+    unsigned int height;
+    size_t size;                // bytes
+    const unsigned char* data;
+};
+
+// a decoded image, level 0 first
+//  the levels point into file (mapped images) or storage (generated ones)
+struct Image
+{
+    ImageFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int rowAlignment;  // of uncompressed rows, for GL_UNPACK_ALIGNMENT
+    std::vector<ImageLevel> levels;
+
+    MappedFile file;
+    std::vector<unsigned char> storage;
+};
+
+// true for the block compressed formats
+bool isCompressedFormat(ImageFormat format);
+
+// bytes of one level of the given size, rounded up to whole blocks or rows
+size_t imageLevelSize(ImageFormat format, unsigned int width, unsigned int height);
+
+// parse a file already in memory, the levels point into data
+//  returns false and prints why if the file is not supported
+bool decodeDDS(const char* data, size_t size, Image &image);
+bool decodeBMP(const char* data, size_t size, Image &image);
+
+// map a .dds or .bmp file and decode it without copying the pixels
+bool loadImage(const char* path, Image &image);
+
+// write a compressed image and all its levels as a .dds file
+bool saveDDS(const char* path, const Image &image);
+
+// write RGB8 pixels, top row first and tightly packed, as a binary .ppm
+bool savePPM(const char* path, const unsigned char* rgb, unsigned int width, unsigned int height);
+
+// level 0 of a BGR8 or RGBA8 image as RGBA8, opaque alpha for BGR8,
+//  tightly packed rows in the same order
+bool convertToRGBA8(const Image &image, std::vector<unsigned char> &out);
+
+// release what loadImage() holds
+void freeImage(Image &image);
+
+#endif  // IMAGE_HPP
@@ -0,0 +1,127 @@
+#ifndef INSTANCING_HPP
+#define INSTANCING_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "common/culling.hpp"
+#include "common/meshcache.hpp"
+
+// what the vertex shader reads per instance, at ATTRIB_INSTANCE_MODEL and
+//  ATTRIB_INSTANCE_NORMAL : the model matrix as the 3 rows of an affine
+//  transform, and the matrix transforming its normals, 84 bytes
+struct InstanceTransform
+{
+    glm::vec4 model[3];
+    glm::vec3 normal[3];        // columns of the inverse transpose
+};
+
+// instances of one mesh, packed in a buffer for glDrawElementsInstanced*()
+//  instances are addressed by handles that stay valid until removed ;
+//  the buffer is dense, a removal moves the last instance into the hole,
+//  and only the range touched since the last upload is sent again
+//  with culling, the visible instances are copied to a second buffer each
+//  frame, grouped by level of detail, unless they all are and all at the
+//  same level
+struct InstanceBuffer
+{
+    GLuint buffer;
+    unsigned int capacity;      // instances the buffer holds
+
+    std::vector<InstanceTransform> transforms;
+    std::vector<glm::mat4> models;          // what the transforms and bounds come from
+    BoundsSoA bounds;                       // in worldspace, packed like the transforms
+    std::vector<float> errorScales;         // largest axis scale of each model
+    glm::vec3 localMin, localMax;           // the mesh's bounds
+    std::vector<unsigned int> handles;      // of each packed instance
+    std::vector<unsigned int> slots;        // packed index of each handle
+    std::vector<unsigned int> freeHandles;
+
+    // packed range [dirtyBegin, dirtyEnd) not uploaded yet
+    unsigned int dirtyBegin;
+    unsigned int dirtyEnd;
+    bool reallocate;            // the buffer is too small, everything goes again
+
+    // what is drawn : buffer or visibleBuffer
+    GLuint drawBuffer;
+    unsigned int drawCount;
+    GLuint attributeBuffer;     // what the attributes were last pointed at
+    unsigned int attributeFirst;            // and from which instance
+
+    // the level of detail of each packed instance, kept from one frame to
+    //  the next for the hysteresis ; the drawn instances of level l are
+    //  [lodFirst[l], lodFirst[l + 1])
+    std::vector<unsigned char> lods;
+    unsigned int lodFirst[maxMeshLODs + 1];
+
+    GLuint visibleBuffer;
+    unsigned int visibleCapacity;
+    std::vector<unsigned char> visible;
+    std::vector<InstanceTransform> visibleTransforms;
+
+    unsigned int uploadedBytes; // since resetInstanceStats()
+};
+
+static const unsigned int invalidInstance = 0xffffffffu;
+
+void initInstanceBuffer(InstanceBuffer &instances, unsigned int capacity = 256);
+void destroyInstanceBuffer(InstanceBuffer &instances);
+
+// returns the handle of the new instance
+unsigned int addInstance(InstanceBuffer &instances, const glm::mat4 &model);
+void removeInstance(InstanceBuffer &instances, unsigned int handle);
+void updateInstance(InstanceBuffer &instances, unsigned int handle, const glm::mat4 &model);
+
+// the local bounds of the mesh every instance is a copy of, for culling
+void setInstanceBounds(InstanceBuffer &instances, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+inline unsigned int instanceCount(const InstanceBuffer &instances)
+{
+    return (unsigned int)instances.transforms.size();
+}
+
+// send what changed since the last upload, before drawing ; every
+//  instance is drawn, at full detail, until cullInstances()
+void uploadInstances(InstanceBuffer &instances);
+
+// how selectInstanceLODs() picks levels : a level is good enough while its
+//  error, projected on screen, stays under threshold pixels
+//  to keep from popping back and forth, an instance goes to a coarser level
+//  under threshold * (1 - hysteresis) only, and keeps its level up to
+//  threshold * (1 + hysteresis)
+struct LODSelection
+{
+    glm::vec3 eye;              // in worldspace
+    float pixelsPerUnit;        // pixels covered by a unit length at distance 1
+    float threshold;
+    float hysteresis;
+};
+
+// the selection for the camera of view and projection (getViewMatrix() and
+//  getProjectionMatrix()), on a viewport height pixels high
+LODSelection makeLODSelection(
+    const glm::mat4 &view, const glm::mat4 &projection, unsigned int height,
+    float threshold, float hysteresis
+);
+
+// the level of detail of mesh every instance is drawn at from now on, the
+//  coarsest its distance to the eye allows ; workers as cullBounds()
+void selectInstanceLODs(
+    InstanceBuffer &instances, const MeshData &mesh, const LODSelection &selection,
+    WorkerPool* workers = NULL
+);
+
+// after uploadInstances(), only the instances whose bounds intersect the
+//  frustum are drawn, each at its level of detail ; workers as cullBounds()
+CullStats cullInstances(InstanceBuffer &instances, const Frustum &frustum, WorkerPool* workers = NULL);
+
+// with the mesh's vertex array bound, point the per instance attributes
+//  at what is drawn, from instance first on, if they are not already
+//  the instances of level l are drawn from first = lodFirst[l]
+void setupInstanceAttributes(InstanceBuffer &instances, unsigned int first = 0);
+
+void resetInstanceStats(InstanceBuffer &instances);
+
+#endif  // INSTANCING_HPP
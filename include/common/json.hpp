@@ -0,0 +1,10 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <stdio.h>
+
+// text as a JSON string, in quotes with quotes, backslashes and control
+//  characters escaped ; NULL is written as ""
+void writeJSONString(FILE* file, const char* text);
+
+#endif  // JSON_HPP
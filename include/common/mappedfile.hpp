@@ -0,0 +1,20 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// a whole file mapped read-only into memory
+//  the mapping is not null-terminated, always use size
+struct MappedFile
+{
+    const char* data;
+    size_t size;
+};
+
+// map the file at path ; returns false if it can't be opened or mapped
+bool mapFile(const char* path, MappedFile& file);
+
+// release a mapping obtained with mapFile()
+void unmapFile(MappedFile& file);
+
+#endif  // MAPPEDFILE_HPP
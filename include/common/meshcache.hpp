@@ -0,0 +1,108 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "common/mappedfile.hpp"
+#include "common/vboindexer.hpp"
+
+// a level of detail of a mesh, the sub-meshes it is drawn with
+struct MeshLOD
+{
+    uint32_t firstSubMesh;
+    uint32_t subMeshCount;
+    uint32_t indexCount;
+    float error;                    // from the full mesh, in the units of positions
+};
+
+// levels built by default, as fractions of the triangles of the full mesh
+static const float defaultLODRatios[] = { 0.5f, 0.25f, 0.1f };
+static const unsigned int defaultLODRatioCount = sizeof(defaultLODRatios) / sizeof(defaultLODRatios[0]);
+static const unsigned int maxMeshLODs = 8;
+
+// an indexed mesh ready to be handed to glBufferData()
+//  the pointers either go into a mapped cache file or into MeshFile::storage
+struct MeshData
+{
+    unsigned int vertexCount;
+    const glm::vec3* positions;
+    const glm::vec2* uvs;
+    const glm::vec3* normals;
+    const glm::vec3* tangents;
+    const glm::vec3* bitangents;
+
+    unsigned int indexSize;         // 2 or 4 bytes
+    unsigned int indexCount;
+    const void* indices;
+
+    // sub-meshes of the full mesh, lods[0] ; the other levels follow them,
+    //  their indices after its own
+    unsigned int subMeshCount;
+    const SubMesh* subMeshes;
+
+    unsigned int lodCount;          // at least 1, at most maxMeshLODs
+    const MeshLOD* lods;
+
+    // the same vertices interleaved in MeshVertexFormat, quantized inside
+    //  the bounds ; this is what gets uploaded
+    unsigned int vertexStride;
+    const void* packedVertices;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// a mesh and whatever holds its memory
+struct MeshFile
+{
+    MappedFile file;                // cache hit : the mapped cache
+    std::vector<char> storage;      // cache miss : the freshly built cache image
+    MeshData mesh;
+};
+
+// serialize the output of the load pipeline into a cache image
+void buildMeshCache(
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    const std::vector<glm::vec3> &vertices,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    const std::vector<glm::vec3> &bitangents,
+    const IndexBuffer &indexBuffer,
+    const std::vector<MeshLOD> &lods,
+    uint64_t lodSettings,
+    std::vector<char> &out_image
+);
+
+// hash of the LOD ratios a cache is built with, a cache built with others is stale
+uint64_t hashLODSettings(const float* ratios, unsigned int count);
+
+// check a cache image against its source and point mesh into it, nothing is copied
+//  returns false if it is damaged, from another version or from another source
+bool readMeshCache(
+    const char* data, size_t size,
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    uint64_t lodSettings,
+    MeshData &mesh
+);
+
+// load an .obj through the binary cache at cachePath
+//  hit  : the cache is mapped and mesh points straight into it
+//  miss : loadOBJ, indexPackedVBO, computeIndexedTangentBasis, buildLODChain,
+//         the meshoptimizer passes and buildIndexBuffer run and the result
+//         is written to cachePath for next time
+//  a level of detail is built for each of the lodRatioCount ratios, at
+//  most maxMeshLODs - 1 of them
+bool loadMeshCached(const char* objPath, const char* cachePath, MeshFile &mesh,
+    const float* lodRatios = defaultLODRatios, unsigned int lodRatioCount = defaultLODRatioCount);
+
+// release what loadMeshCached() holds
+void closeMeshFile(MeshFile &mesh);
+
+#endif  // MESHCACHE_HPP
@@ -0,0 +1,62 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// size of the FIFO post-transform cache the passes below aim at
+static const unsigned int vertexCacheSize = 16;
+
+// what a FIFO post-transform cache does with an index buffer
+struct VertexCacheStats
+{
+    unsigned int triangles;
+    unsigned int vertices;      // distinct vertices referenced
+    unsigned int transformed;   // cache misses
+    float acmr;                 // transformed per triangle : 0.5 at best, 3 at worst
+    float atvr;                 // transformed per distinct vertex : 1 at best
+};
+
+// simulates a FIFO cache of cacheSize entries over indices
+void analyzeVertexCache(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    VertexCacheStats &out,
+    unsigned int cacheSize = vertexCacheSize
+);
+
+// reorders triangles for the post-transform cache (Tipsify, Sander et al. 2007)
+//  out_clusters receives where the order had to restart with a cold cache,
+//  as first triangles ; optimizeOverdraw() can move these clusters around
+void optimizeVertexCache(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    std::vector<unsigned int> &out_indices,
+    std::vector<unsigned int> &out_clusters,
+    unsigned int cacheSize = vertexCacheSize
+);
+
+// reorders the clusters of a cache optimized index buffer so that the ones
+//  facing outwards are drawn first and cover the rest (early-Z)
+//  clusters are split further where it costs at most threshold x the ACMR
+void optimizeOverdraw(
+    std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<unsigned int> &clusters,
+    float threshold = 1.05f,
+    unsigned int cacheSize = vertexCacheSize
+);
+
+// renumbers vertices in the order the index buffer first uses them, so that
+//  vertex fetch walks memory forwards ; unused vertices are dropped
+//  vertex k becomes old vertex out_remap[k], see remapVertexAttribute()
+//  returns the number of vertices left
+size_t optimizeVertexFetch(
+    std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    std::vector<unsigned int> &out_remap
+);
+
+#endif  // MESHOPTIMIZER_HPP
@@ -0,0 +1,112 @@
+#ifndef MESHPOOL_HPP
+#define MESHPOOL_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "common/instancing.hpp"
+#include "common/meshcache.hpp"
+#include "common/shaderprogram.hpp"
+
+// every mesh in one vertex buffer and one index buffer, behind one vertex
+//  array : a mesh is a range of each, so any number of them draw without
+//  rebinding anything, with one glMultiDrawElementsIndirect() where GL has it
+//  meshes are MeshVertexFormat vertices with 16 bit indices, as the mesh
+//  cache writes them ; the pool only grows, a mesh stays until it is destroyed
+
+// a mesh in the pool : its sub-meshes and levels of detail as in MeshData,
+//  their first indices and base vertices relative to the mesh's own
+struct PoolMesh
+{
+    unsigned int baseVertex;    // of the mesh in the vertex buffer
+    unsigned int firstIndex;    // of the mesh in the index buffer
+    std::vector<SubMesh> subMeshes;
+    std::vector<MeshLOD> lods;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+struct MeshPool
+{
+    GLuint vertexArray;         // the vertices and the indices, set up
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    unsigned int vertexCapacity;
+    unsigned int vertexCount;
+    unsigned int indexCapacity;
+    unsigned int indexCount;
+
+    std::vector<PoolMesh> meshes;
+};
+
+static const unsigned int invalidPoolMesh = 0xffffffffu;
+
+void initMeshPool(MeshPool &pool, unsigned int vertexCapacity = 65536, unsigned int indexCapacity = 3 * 65536);
+void destroyMeshPool(MeshPool &pool);
+
+// copy mesh into the pool, growing its buffers if needed, on the GL thread
+//  returns the index of the mesh in pool.meshes, invalidPoolMesh if its
+//  vertices or indices are not what the pool holds
+unsigned int addPoolMesh(MeshPool &pool, const MeshData &mesh);
+
+// what glMultiDrawElementsIndirect() reads, one per draw (GL 4.3)
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// what the vertex shader reads per draw, from the texture buffer bound to
+//  drawDataTextureUnit, at 2 * draw index : the quantization of the mesh
+struct DrawData
+{
+    glm::vec4 positionScale;
+    glm::vec4 positionBias;
+};
+
+// the texture unit the per draw data goes to, after the material's
+static const GLuint drawDataTextureUnit = 3;
+
+// the draws of a frame, for one program ; each draw is a sub-mesh of a pool
+//  mesh and a range of an instance buffer
+//  with indirect draws the commands go to a buffer and the vertex shader
+//  finds its DrawData with gl_DrawIDARB, without (GL 3.3) each command is a
+//  call of its own and the shader is told its draw index by a uniform
+struct DrawList
+{
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> drawData;
+    GLuint commandBuffer;
+    GLuint drawDataBuffer;
+    GLuint drawDataTexture;     // GL_RGBA32F over drawDataBuffer
+    bool indirect;
+};
+
+// glMultiDrawElementsIndirect() and gl_DrawIDARB : GL 4.3 and
+//  GL_ARB_shader_draw_parameters, Mesa's llvmpipe has both
+bool indirectDrawsSupported();
+
+// indirect : whether submitDraws() draws with one call ; the program must be
+//  built with INDIRECT_DRAWS defined then
+void initDrawList(DrawList &list, bool indirect);
+void destroyDrawList(DrawList &list);
+
+// before adding the draws of a frame
+void clearDrawList(DrawList &list);
+
+// a draw per sub-mesh of every level of detail of mesh some instance is
+//  drawn at, after cullInstances() ; returns the number of triangles
+size_t addMeshDraws(DrawList &list, const MeshPool &pool, unsigned int mesh, const InstanceBuffer &instances);
+
+// draw the list, with the program in use and pool.vertexArray bound ; the
+//  per instance attributes must point at instances (setupInstanceAttributes())
+//  firstDrawID : the program's FirstDraw uniform
+void submitDraws(DrawList &list, InstanceBuffer &instances, ShaderProgram &shader, int firstDrawID);
+
+#endif  // MESHPOOL_HPP
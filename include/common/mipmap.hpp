@@ -0,0 +1,46 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+#include "common/image.hpp"
+
+// reconstruction filter used to go from one level to the next
+enum MipFilter
+{
+    MIP_FILTER_BOX,         // 2x2 average, cheapest, a little blurry
+    MIP_FILTER_KAISER,      // Kaiser windowed sinc, 13 source taps a pass, sharp with little ringing
+    MIP_FILTER_LANCZOS      // Lanczos 3, 13 source taps a pass, the sharpest, rings on hard edges
+};
+
+struct MipSettings
+{
+    MipFilter filter;
+    bool srgb;              // colour is sRGB encoded, filter it in linear space
+    bool normalMap;         // rgb holds unit vectors, renormalized on every level
+};
+
+// what loadTexture() uses by default, for colour images ; what suits normal
+//  maps ; and what suits any other data stored as is (specular, masks, ...)
+const MipSettings colorMipSettings = { MIP_FILTER_KAISER, true, false };
+const MipSettings normalMipSettings = { MIP_FILTER_KAISER, false, true };
+const MipSettings linearMipSettings = { MIP_FILTER_KAISER, false, false };
+
+// number of levels down to 1x1
+unsigned int mipLevelCount(unsigned int width, unsigned int height);
+
+// full mip chain of RGBA8 pixels (tightly packed rows in upload order) as an
+//  IMAGE_RGBA8 image, every level in image.storage
+//  rows are spread over threadCount threads (0 := all cores)
+void generateMipmaps(
+    const unsigned char* rgba,
+    unsigned int width,
+    unsigned int height,
+    const MipSettings &settings,
+    Image &image,
+    unsigned int threadCount = 0
+);
+
+// replace a single level uncompressed image (a BMP) by the IMAGE_RGBA8 mip
+//  chain of it and release its file ; false and unchanged for anything else
+bool buildMipmaps(Image &image, const MipSettings &settings, unsigned int threadCount = 0);
+
+#endif  // MIPMAP_HPP
@@ -1,15 +1,52 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <stddef.h>
 #include <vector>
 #include <glm/glm.hpp>
 
-bool loadOBJ(const char* path, 
+// numbers from the last parse, to keep an eye on loader throughput
+struct OBJLoadStats
+{
+    size_t bytes;           // size of the parsed text
+    size_t positions;       // number of "v" records
+    size_t uvs;             // number of "vt" records
+    size_t normals;         // number of "vn" records
+    size_t triangles;       // triangles emitted after triangulation
+    unsigned int threads;   // threads that took part
+    double milliseconds;    // wall time spent parsing
+    double megabytesPerSecond;
+};
+
+// parse an in-memory .obj file into un-indexed triangle lists
+//  supports v, v/vt, v//vn, v/vt/vn corners, negative (relative) indices
+//  and faces with any number of corners (fan triangulated)
+//  missing UVs are set to (0,0), missing normals to the flat face normal
+//  with threadCount != 1 the text is split into line-aligned chunks parsed
+//  in parallel (0 := all cores) ; the output is the same for any thread count
+bool parseOBJ(const char* data, size_t size,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    OBJLoadStats* stats = NULL,
+    unsigned int threadCount = 1
+    );
+
+// memory-map the file at path and parse it with parseOBJ()
+bool loadOBJ(const char* path,
     std::vector<glm::vec3> &out_vertices,
     std::vector<glm::vec2> &out_uvs,
     std::vector<glm::vec3> &out_normals
     );
 
+// same as loadOBJ(), parsed on threadCount threads (0 := all cores)
+bool loadOBJ_parallel(const char* path,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    unsigned int threadCount = 0
+    );
+
 bool loadAssImp(const char* path,
     std::vector<unsigned short> &indices,
     std::vector<glm::vec3> &vertices,
@@ -0,0 +1,41 @@
+#ifndef OFFSCREEN_HPP
+#define OFFSCREEN_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// a GL 3.3 core context without a window or a display, drawing into a
+//  framebuffer object ; EGL on a surfaceless platform, which Mesa provides
+//  with llvmpipe on boxes with no GPU at all
+//  only built with EGL (HAVE_EGL, see the Makefile), elsewhere creation fails
+
+struct OffscreenContext
+{
+    void* display;              // EGLDisplay and EGLContext, EGL stays out of the header
+    void* context;
+    unsigned int width;
+    unsigned int height;
+    unsigned int samples;       // 1 when not multisampled
+
+    GLuint framebuffer;         // what is drawn into, bound after creation
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    GLuint resolveFramebuffer;  // single sampled copy for reading back, 0 without samples
+    GLuint resolveBuffer;
+};
+
+// create the context and make it current, with GLEW initialized and the
+//  framebuffer bound and cleared ; samples : 1 for no multisampling, falls
+//  back to 1 when the implementation has no such mode
+//  returns false and prints why if there is no way to get one
+bool createOffscreenContext(OffscreenContext &offscreen, unsigned int width, unsigned int height, unsigned int samples);
+
+// release the framebuffer and the context
+void destroyOffscreenContext(OffscreenContext &offscreen);
+
+// the colour of what was drawn, RGB8 with the top row first
+//  waits for the frame to finish drawing
+void readOffscreenPixels(OffscreenContext &offscreen, std::vector<unsigned char> &rgb);
+
+#endif  // OFFSCREEN_HPP
@@ -0,0 +1,55 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of threads the machine can run at once, at least 1
+unsigned int hardwareThreadCount();
+
+// call body(begin, end) on blocks of at most grainSize items covering [0, count)
+//  blocks are handed out dynamically to threadCount threads, 0 uses every core
+//  the calling thread takes part and the call returns when all blocks are done
+void parallelFor(
+    size_t count,
+    size_t grainSize,
+    const std::function<void(size_t begin, size_t end)>& body,
+    unsigned int threadCount = 0
+);
+
+// long-lived threads running submitted tasks in submission order
+struct WorkerPool
+{
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+};
+
+// threadCount : 0 uses every core
+void startWorkerPool(WorkerPool &pool, unsigned int threadCount = 0);
+
+// runs the tasks still queued, then joins the threads
+void stopWorkerPool(WorkerPool &pool);
+
+// queue task to run on one of the pool's threads
+void submitTask(WorkerPool &pool, std::function<void()> task);
+
+// parallelFor() on the threads of pool and the calling one, for work done
+//  every frame : no thread is created ; blocks the pool is too busy to pick
+//  up are run by the calling thread, which never waits for a task that has
+//  not started
+void parallelFor(
+    WorkerPool &pool,
+    size_t count,
+    size_t grainSize,
+    const std::function<void(size_t begin, size_t end)>& body
+);
+
+#endif  // PARALLEL_HPP
@@ -0,0 +1,82 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// scoped timers for the CPU, from any thread, and for the GPU, on the GL
+//  thread ; samples go to a lock-free ring that keeps the last
+//  profileCapacity of them, startup included until it wraps, and are
+//  written out as a Chrome trace (chrome://tracing, ui.perfetto.dev)
+//
+//  scopes nest ; names must outlive the program (string literals), details
+//  are copied and may be NULL
+
+static const unsigned int profileCapacity = 1 << 15;    // samples, a power of 2
+
+// ns on the profiler's clock, 0 at its first use
+int64_t profileTime();
+
+// how this thread shows up in the trace, before its first sample
+void setProfilerThreadName(const char* name);
+
+struct ProfileScope
+{
+    const char* name;
+    const char* detail;
+    int64_t start;
+
+    ProfileScope(const char* name, const char* detail = NULL);
+    ~ProfileScope();
+};
+
+// GPU scopes are GL_TIMESTAMP query pairs, so they nest and leave
+//  GL_TIME_ELAPSED to whoever else times frames ; the queries of a frame
+//  are read back by the profileFrame() gpuProfileLatency frames later,
+//  without waiting, results still not available by then are dropped
+static const unsigned int gpuProfileLatency = 2;
+static const unsigned int maxGPUScopes = 64;            // per frame, the next ones are dropped
+
+// on the GL thread, with the context current
+void startGPUProfiler();
+void stopGPUProfiler();
+
+void beginGPUScope(const char* name);
+void endGPUScope();
+
+// once per frame after its last GPU scope : reads back an older frame
+void profileFrame();
+
+struct GPUProfileScope
+{
+    GPUProfileScope(const char* name);
+    ~GPUProfileScope();
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// till the end of the enclosing block
+#define PROFILE_SCOPE(name) \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_SCOPE_DETAIL(name, detail) \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, detail)
+// both the CPU time of the block and the GPU time of what it draws
+#define PROFILE_GPU_SCOPE(name) \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name); \
+    GPUProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+struct ProfilerStats
+{
+    uint64_t recorded;          // samples since the start, overwritten ones included
+    unsigned int gpuDropped;    // GPU scopes lost to a full frame or late results
+};
+
+ProfilerStats profilerStats();
+
+// the samples still in the ring as Chrome trace event JSON
+//  returns false if the file could not be written
+bool writeChromeTrace(const char* path);
+
+#endif  // PROFILER_HPP
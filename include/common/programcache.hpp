@@ -0,0 +1,41 @@
+#ifndef PROGRAMCACHE_HPP
+#define PROGRAMCACHE_HPP
+
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// linked programs kept on disk as glGetProgramBinary() blobs, one file per
+//  key ; a driver update changes the key, and a blob the driver refuses
+//  anyway is compiled again and replaced
+//  everything here runs on the GL thread
+
+struct ProgramCacheStats
+{
+    unsigned int hits;          // programs created from a stored binary
+    unsigned int misses;        // nothing stored for the key, compiled
+    unsigned int rejected;      // stored binary refused by the driver, compiled
+    unsigned int stored;        // binaries written
+};
+
+// where the binaries are kept, created when missing, "shaders/cache" by
+//  default ; NULL turns the cache off
+void setProgramCacheDirectory(const char* path);
+
+// true when the cache is on and the driver can hand out program binaries
+bool programCacheEnabled();
+
+// key of a program : its sources, its defines and the driver building it
+uint64_t programCacheKey(const char* vertex_code, const char* fragment_code, const char* defines);
+
+// a linked program from the binary stored for key, 0 when there is none or
+//  the driver does not take it
+GLuint loadProgramBinary(uint64_t key);
+
+// store the binary of a linked program, which must have been linked with
+//  GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+bool storeProgramBinary(uint64_t key, GLuint program);
+
+ProgramCacheStats programCacheStats();
+
+#endif  // PROGRAMCACHE_HPP
@@ -0,0 +1,109 @@
+#ifndef SCENEGRAPH_HPP
+#define SCENEGRAPH_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "common/instancing.hpp"
+#include "common/parallel.hpp"
+
+// a transform hierarchy, each field of the nodes in an array of its own
+//  nodes are kept breadth first : the roots, then their children, then
+//  theirs, so every level is a range and a parent comes before its children,
+//  which are contiguous ; adding nodes breaks the order until the next update
+//  an update recomputes the world matrices of the nodes set since the last
+//  one and of everything below them, walking only those subtrees, shared
+//  out between threads ; nodes are addressed by handles, their index moves
+struct SceneGraph
+{
+    // local transform : translation * rotation * scale
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;       // unit quaternions
+    std::vector<glm::vec3> scales;
+    std::vector<unsigned int> parents;      // index of each node's parent, noParent for roots
+    std::vector<glm::mat4> worlds;          // parent's world * local
+    std::vector<unsigned int> instances;    // the instance drawn where each node is, or invalidInstance
+
+    // the children of node i are [firstChildren[i], firstChildren[i + 1]),
+    //  the nodes of level l [levelFirst[l], levelFirst[l + 1])
+    std::vector<unsigned int> firstChildren;
+    std::vector<unsigned int> levelFirst;
+
+    // a bit per node, set since the last update, which clears them
+    std::vector<uint64_t> dirty;
+    bool sorted;                // breadth first, firstChildren and levelFirst are right
+
+    std::vector<unsigned int> handles;      // of each node
+    std::vector<unsigned int> slots;        // index of each handle
+
+    // handles of the nodes the last update moved, subtree after subtree
+    std::vector<unsigned int> changed;
+
+    // kept between updates for their memory : the set nodes with no set
+    //  node above them, and where the handles of each subtree start in
+    //  changed, one more for the end
+    std::vector<unsigned int> roots;
+    std::vector<unsigned int> rootOffsets;
+};
+
+static const unsigned int noParent = 0xffffffffu;
+
+void initSceneGraph(SceneGraph &graph, unsigned int capacity = 0);
+void destroySceneGraph(SceneGraph &graph);
+
+inline unsigned int sceneNodeCount(const SceneGraph &graph)
+{
+    return (unsigned int)graph.parents.size();
+}
+
+// returns the handle of the new node, under parent (a handle, or noParent
+//  for a root) ; its world is right after the next update
+unsigned int addSceneNode(
+    SceneGraph &graph, unsigned int parent,
+    const glm::vec3 &translation,
+    const glm::quat &rotation = glm::quat(1.f, 0.f, 0.f, 0.f),
+    const glm::vec3 &scale = glm::vec3(1.f)
+);
+
+void setSceneNodeTransform(
+    SceneGraph &graph, unsigned int handle,
+    const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale
+);
+void setSceneNodeTranslation(SceneGraph &graph, unsigned int handle, const glm::vec3 &translation);
+
+// as of the last update
+inline const glm::mat4 &sceneNodeWorld(const SceneGraph &graph, unsigned int handle)
+{
+    return graph.worlds[graph.slots[handle]];
+}
+
+// an instance of instances that updateSceneInstances() moves with the node,
+//  from the next update on
+void attachInstance(SceneGraph &graph, unsigned int handle, unsigned int instance);
+
+// the world matrices of the nodes set since the last update and of their
+//  descendants, which go to graph.changed ; the subtrees, and the levels of
+//  big ones, are shared with the threads of workers, NULL updates
+//  everything on the calling thread
+void updateSceneGraph(SceneGraph &graph, WorkerPool* workers = NULL);
+
+// the instances attached to the nodes the last update moved get their new
+//  model matrices, before uploadInstances() and cullInstances()
+void updateSceneInstances(const SceneGraph &graph, InstanceBuffer &instances);
+
+// an update of a tree of nodeCount nodes, 8 children each, after
+//  dirtyFraction of them were set ; the best of a few runs
+struct SceneBenchmark
+{
+    unsigned int nodes;
+    unsigned int dirty;         // nodes set
+    unsigned int updated;       // nodes recomputed, the dirty ones and below
+    double updateMs;
+};
+
+SceneBenchmark benchmarkSceneUpdate(unsigned int nodeCount, float dirtyFraction, WorkerPool* workers = NULL);
+
+#endif  // SCENEGRAPH_HPP
@@ -1,6 +1,32 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
+#include <string>
+
+// defines : preprocessor lines put right after #version in both shaders,
+//  e.g. "#define USE_SPECULAR 1\n" ; NULL for none
+GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path, const char* defines = NULL);
+
+// the two halves of LoadShaders() : reading the files needs no GL context,
+//  compiling needs the GL thread ; the names are only used in messages
+bool ReadShaderFile(const char* file_path, std::string& code);
+
+// a program from the binary cache, or compiled and then stored in it
+GLuint CreateProgram(
+    const char* vertex_code,
+    const char* fragment_code,
+    const char* vertex_name,
+    const char* fragment_name,
+    const char* defines = NULL
+);
+
+// always compiles, the binary is kept retrievable when the cache is on
+GLuint CompileShaders(
+    const char* vertex_code,
+    const char* fragment_code,
+    const char* vertex_name,
+    const char* fragment_name,
+    const char* defines = NULL
+);
 
 #endif  // SHADER_HPP
\ No newline at end of file
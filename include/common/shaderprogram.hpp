@@ -0,0 +1,88 @@
+#ifndef SHADERPROGRAM_HPP
+#define SHADERPROGRAM_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// what a linked program exposes, read back once with the glGetActive*()
+//  queries so that nothing is looked up by name while drawing
+
+struct ShaderUniform
+{
+    std::string name;           // arrays as "name[0]"
+    GLint location;             // -1 inside uniform blocks
+    GLenum type;
+    GLint size;                 // array length, 1 for plain uniforms
+    GLint blockIndex;           // -1 outside uniform blocks
+
+    // last value sent, in ShaderProgram::values
+    size_t valueOffset;
+    size_t valueSize;
+    bool known;                 // false until a value was sent
+};
+
+struct ShaderAttribute
+{
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+struct ShaderUniformBlock
+{
+    std::string name;
+    GLuint index;
+    GLint dataSize;             // bytes the buffer bound to it must hold
+};
+
+// a program and its reflection ; uniforms are addressed by their index in
+//  uniforms, which findUniform() gives once
+struct ShaderProgram
+{
+    GLuint program;
+    std::vector<ShaderUniform> uniforms;
+    std::vector<ShaderAttribute> attributes;
+    std::vector<ShaderUniformBlock> uniformBlocks;
+    std::vector<unsigned char> values;
+
+    // glUniform*() calls made and avoided since resetUniformStats()
+    unsigned int uploads;
+    unsigned int skipped;
+};
+
+// reflect a linked program, the ShaderProgram owns it from then on
+//  returns false if it did not link
+bool initShaderProgram(ShaderProgram &shader, GLuint program);
+
+// LoadShaders() then initShaderProgram()
+bool loadShaderProgram(ShaderProgram &shader, const char* vertex_file_path, const char* fragment_file_path, const char* defines = NULL);
+
+void destroyShaderProgram(ShaderProgram &shader);
+
+// index in uniforms, attributes or uniformBlocks, -1 when the program has no
+//  such active variable (the compiler may have removed it)
+int findUniform(const ShaderProgram &shader, const char* name);
+int findAttribute(const ShaderProgram &shader, const char* name);
+int findUniformBlock(const ShaderProgram &shader, const char* name);
+
+// point a sampler uniform at a texture unit, once after creation
+bool bindSampler(ShaderProgram &shader, const char* name, GLint unit);
+
+// send a uniform of the program in use, unless it already holds value
+//  uniform : from findUniform(), -1 is ignored, and so is a uniform of a
+//  GL type the value can't set, e.g. a float for an int or a sampler
+void setUniform(ShaderProgram &shader, int uniform, GLint value);
+void setUniform(ShaderProgram &shader, int uniform, float value);
+void setUniform(ShaderProgram &shader, int uniform, const glm::vec3 &value);
+void setUniform(ShaderProgram &shader, int uniform, const glm::vec4 &value);
+void setUniform(ShaderProgram &shader, int uniform, const glm::mat3 &value);
+void setUniform(ShaderProgram &shader, int uniform, const glm::mat4 &value);
+
+void resetUniformStats(ShaderProgram &shader);
+
+#endif  // SHADERPROGRAM_HPP
@@ -0,0 +1,40 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// vector units the kernels can use, each level includes the ones before it
+enum SIMDLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX,
+    SIMD_AVX2
+};
+
+// the best level this cpu runs, capped by setSIMDLevel
+SIMDLevel simdLevel();
+
+// caps simdLevel, to compare the paths against each other ; call it before
+//  starting work that may read the level
+void setSIMDLevel(SIMDLevel level);
+
+// SIMD_DISPATCH : x86 with gcc or clang, where AVX code is compiled next to
+//  the SSE2 baseline and picked at run time from simdLevel
+//  code between SIMD_BEGIN_AVX / SIMD_BEGIN_AVX2 and SIMD_END may use those
+//  instructions, it must only run when simdLevel says so
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+
+#define SIMD_DISPATCH 1
+
+#if defined(__clang__)
+#define SIMD_BEGIN_AVX _Pragma("clang attribute push (__attribute__((target(\"avx\"))), apply_to = function)")
+#define SIMD_BEGIN_AVX2 _Pragma("clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)")
+#define SIMD_END _Pragma("clang attribute pop")
+#else
+#define SIMD_BEGIN_AVX _Pragma("GCC push_options") _Pragma("GCC target(\"avx\")")
+#define SIMD_BEGIN_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+#define SIMD_END _Pragma("GCC pop_options")
+#endif
+
+#endif
+
+#endif  // SIMD_HPP
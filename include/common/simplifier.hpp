@@ -0,0 +1,58 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// how much a unit of attribute difference (UV, normal or tangent) weighs
+//  against a unit of squared distance, in a mesh scaled to a unit box
+static const float simplifyAttributeWeight = 0.5f;
+
+// reduces an indexed mesh by collapsing edges, cheapest first by quadric
+//  error (Garland and Heckbert 1997), until at most targetIndexCount
+//  indices are left or nothing can collapse
+//  - a vertex only ever collapses onto a neighbour, vertices are neither
+//    moved nor created : the result indexes the same vertex arrays
+//  - collapsing a vertex onto one with other attributes costs their
+//    difference times attributeWeight, on top of the quadric error
+//  - vertices on open borders and where attribute seams meet are locked,
+//    vertices on a seam only move along it, both sides together
+//  - collapses that would flip a triangle or fold the surface are skipped
+//  returns the geometric error, how far from the original surface the
+//  result may be, in the units of positions
+float simplifyMesh(
+    const std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    size_t targetIndexCount,
+    std::vector<unsigned int> &out_indices,
+    float attributeWeight = simplifyAttributeWeight
+);
+
+// one level of detail of a mesh
+struct LODLevel
+{
+    std::vector<unsigned int> indices;
+    float error;                // from the full mesh, in the units of positions
+};
+
+// a chain of levels : level 0 is the full mesh, level i + 1 keeps about
+//  ratios[i] of its triangles ; each level is simplified from the one
+//  before, ratios decreasing, the chain ends early when a level no longer
+//  gets simpler
+void buildLODChain(
+    const std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    const float* ratios,
+    unsigned int ratioCount,
+    std::vector<LODLevel> &out_levels
+);
+
+#endif  // SIMPLIFIER_HPP
@@ -4,6 +4,11 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+// per-triangle tangent and bitangent for a non-indexed triangle list,
+//  the tangent orthogonalized against each vertex normal
+//  runs 8 triangles at once on AVX2 cpus, 4 on SSE2 (any x86-64), picked at
+//  run time from simdLevel()
+//  threadCount : 1 := serial, 0 := all cores ; the result doesn't depend on it
 void computeTangentBasis(
     // inputs
     std::vector<glm::vec3>& vertices,
@@ -11,6 +16,27 @@ void computeTangentBasis(
     std::vector<glm::vec3>& normals,
     // outputs
     std::vector<glm::vec3>& tangents,
+    std::vector<glm::vec3>& bitangents,
+    unsigned int threadCount = 1
+);
+
+// tangent frames for an indexed mesh, following the MikkTSpace rules :
+//  - each triangle's UV tangent is projected on the vertex normal and summed
+//    weighted by the triangle's angle at that vertex
+//  - a vertex shared by triangles of opposite UV winding (mirrored UVs) is
+//    split, the copy is appended and indices are updated
+//  - triangles with degenerate UVs don't vote, their vertices get a tangent
+//    from their neighbours or any vector orthogonal to the normal
+//  out tangents are unit length and orthogonal to the normal, bitangents
+//  are +-cross(normal, tangent)
+void computeIndexedTangentBasis(
+    // inputs, vertices may be added
+    std::vector<unsigned int>& indices,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    // outputs
+    std::vector<glm::vec3>& tangents,
     std::vector<glm::vec3>& bitangents
 );
 
@@ -0,0 +1,68 @@
+#ifndef TEXCOMPRESS_HPP
+#define TEXCOMPRESS_HPP
+
+#include <stddef.h>
+
+#include "common/image.hpp"
+
+// how hard the block encoders look for good endpoints
+enum CompressQuality
+{
+    COMPRESS_FAST,      // bounding box endpoints
+    COMPRESS_NORMAL,    // principal axis endpoints, one least squares refit
+    COMPRESS_BEST       // principal axis and bounding box, refit until it stops improving
+};
+
+//
+// blocks : 4x4 RGBA8 pixels, row by row, 64 bytes ; compressed blocks are
+//  8 bytes (BC1, BC4) or 16 bytes (BC3, BC5)
+
+void encodeBC1Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality);
+
+// one channel (0 = red ... 3 = alpha) into a BC4 block, the half of BC3 and BC5
+void encodeBC4Block(const unsigned char* rgba, unsigned int channel, unsigned char* out, CompressQuality quality);
+
+// colour in BC1 with alpha in BC4 (BC3), or red and green in two BC4 (BC5)
+void encodeBC3Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality);
+void encodeBC5Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality);
+
+// back to 4x4 RGBA8 ; BC5 gives blue 0 and alpha 255, BC1 and BC3 alpha as stored
+void decodeBlock(ImageFormat format, const unsigned char* block, unsigned char* rgba);
+
+//
+// whole images : RGBA8 pixels, tightly packed rows in upload order
+
+// compress one level, block rows are spread over threadCount threads (0 := all cores)
+//  out receives imageLevelSize(format, width, height) bytes
+void compressLevel(
+    const unsigned char* rgba,
+    unsigned int width,
+    unsigned int height,
+    ImageFormat format,
+    CompressQuality quality,
+    unsigned char* out,
+    unsigned int threadCount = 0
+);
+
+void decompressLevel(
+    const unsigned char* blocks,
+    unsigned int width,
+    unsigned int height,
+    ImageFormat format,
+    unsigned char* rgba
+);
+
+// peak signal to noise ratio over the first channelCount channels, in dB
+double computePSNR(const unsigned char* a, const unsigned char* b, size_t pixelCount, unsigned int channelCount);
+
+// every level of an IMAGE_RGBA8 mip chain (from generateMipmaps()) compressed
+//  into image.storage ; format : IMAGE_BC1, IMAGE_BC3 or IMAGE_BC5
+bool compressImage(
+    const Image &source,
+    ImageFormat format,
+    CompressQuality quality,
+    Image &image,
+    unsigned int threadCount = 0
+);
+
+#endif  // TEXCOMPRESS_HPP
@@ -1,8 +1,19 @@
 #ifndef TEXT2D_HPP
 #define TEXT2D_HPP
 
-void initText2D(const char* texturePath);
+#include <stddef.h>
+
+struct AssetLoader;
+
+// with a loader the font texture loads in the background
+void initText2D(const char* texturePath, AssetLoader* loader = NULL);
+// queues the text for flushText2D(), in the [0..800][0..600] screen
+//  a call that asks for the same as the same call the frame before
+//  reuses what it made then
 void printText2D(const char* text, int x, int y, int size);
+// draws the text queued since the last flush, one call for the font,
+//  nothing until the font is resident
+void flushText2D();
 void cleanupText2D();
 
 # endif // TEXT2D_HPP
\ No newline at end of file
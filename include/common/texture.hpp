@@ -1,16 +1,45 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
-#include <stdio.h>
-#include <stdlib.h>         // used for malloc()
-#include <string.h>         // used for strncmp()
+#include <stddef.h>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "common/image.hpp"
+#include "common/mipmap.hpp"
+
+// streams texture data through a ring of pixel unpack buffers : the copy
+//  into a buffer returns at once and the transfer to the texture runs while
+//  the caller goes on with other work
+struct TextureUploader
+{
+    std::vector<GLuint> buffers;
+    std::vector<GLsync> fences;     // last transfer reading from each buffer
+    size_t bufferSize;
+    unsigned int next;
+};
+
+void initTextureUploader(TextureUploader &uploader, unsigned int bufferCount = 3, size_t bufferSize = 4 << 20);
+
+// waits for pending transfers and deletes the buffers
+void destroyTextureUploader(TextureUploader &uploader);
+
+// create a texture holding every level of image
+//  without uploader the levels are uploaded straight from the image memory
+//  uncompressed images get trilinear filtering, the driver generates the
+//  mipmaps of those that come with a single level
+GLuint createTexture(const Image &image, TextureUploader* uploader = NULL);
+
+// loadImage(), buildMipmaps() with mips, then createTexture()
+//  mips only matter for uncompressed images, DDS files bring their levels
+GLuint loadTexture(const char* imagepath, TextureUploader* uploader = NULL,
+    const MipSettings &mips = colorMipSettings);
+
 // load a .bmp file using this custom loader
 GLuint loadBMP(const char* imagepath);
 
 GLuint loadDDS(const char* imagepath);
 
-#endif  // TEXTURE_HPP
\ No newline at end of file
+#endif  // TEXTURE_HPP
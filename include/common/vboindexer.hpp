@@ -1,10 +1,53 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+#include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
 #include <glm/glm.hpp>
 
+// how the indexer decides that two input vertices are the same
+enum WeldMode
+{
+    WELD_EXACT,     // bitwise equal position, UV and normal (hash table)
+    WELD_NEAR       // every component within 0.01 (spatial grid)
+};
+
+// finds for every input vertex the unique vertex it is merged into
+//  unique vertices are numbered in order of first appearance, returns their count
+//  threadCount : 1 := serial, 0 := all cores ; the result doesn't depend on it
+size_t weldVertices(
+    const std::vector<glm::vec3> &in_vertices,
+    const std::vector<glm::vec2> &in_uvs,
+    const std::vector<glm::vec3> &in_normals,
+    WeldMode mode,
+    std::vector<unsigned int> &out_remap,
+    unsigned int threadCount = 1
+);
+
+// hash and equality of one fixed-size record, see weldRecords()
+typedef uint64_t (*RecordHash)(const void* record);
+typedef bool (*RecordEqual)(const void* a, const void* b);
+
+// hash of a block of bytes, for RecordHash implementations
+uint64_t hashBytes(const void* data, size_t size);
+
+// same as weldVertices() with WELD_EXACT, for count records of stride bytes
+//  compared with hash and equal, e.g. the packed vertices of a VertexFormat
+size_t weldRecords(
+    const void* records,
+    size_t stride,
+    size_t count,
+    RecordHash hash,
+    RecordEqual equal,
+    std::vector<unsigned int> &out_remap,
+    unsigned int threadCount = 1
+);
+
+// merges bitwise identical vertices
+//  the 16-bit version complains when the mesh has more than 65536 vertices,
+//  index into unsigned int and go through buildIndexBuffer() instead
 void indexVBO(
     std::vector<glm::vec3> &in_vertices,
     std::vector<glm::vec2> &in_uvs,
@@ -13,9 +56,23 @@ void indexVBO(
     std::vector<unsigned short> &out_indices,
     std::vector<glm::vec3> &out_vertices,
     std::vector<glm::vec2> &out_uvs,
-    std::vector<glm::vec3> &out_normals
+    std::vector<glm::vec3> &out_normals,
+    unsigned int threadCount = 1
+);
+
+void indexVBO(
+    std::vector<glm::vec3> &in_vertices,
+    std::vector<glm::vec2> &in_uvs,
+    std::vector<glm::vec3> &in_normals,
+
+    std::vector<unsigned int> &out_indices,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    unsigned int threadCount = 1
 );
 
+// merges near vertices and sums the tangents and bitangents of merged ones
 void indexVBO_TBN(
     std::vector<glm::vec3> &in_vertices,
     std::vector<glm::vec2> &in_uvs,
@@ -28,8 +85,98 @@ void indexVBO_TBN(
     std::vector<glm::vec2> &out_uvs,
     std::vector<glm::vec3> &out_normals,
     std::vector<glm::vec3> &out_tangents,
-    std::vector<glm::vec3> &out_bitangents
+    std::vector<glm::vec3> &out_bitangents,
+    unsigned int threadCount = 1
 );
 
+void indexVBO_TBN(
+    std::vector<glm::vec3> &in_vertices,
+    std::vector<glm::vec2> &in_uvs,
+    std::vector<glm::vec3> &in_normals,
+    std::vector<glm::vec3> &in_tangents,
+    std::vector<glm::vec3> &in_bitangents,
+
+    std::vector<unsigned int> &out_indices,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    std::vector<glm::vec3> &out_tangents,
+    std::vector<glm::vec3> &out_bitangents,
+    unsigned int threadCount = 1
+);
+
+// a range of the index buffer drawn with one glDrawElementsBaseVertex()
+//  its indices are relative to baseVertex
+struct SubMesh
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int baseVertex;
+    unsigned int vertexCount;
+};
+
+// index data as it is uploaded
+struct IndexBuffer
+{
+    unsigned int indexSize;                 // 2 or 4 bytes per index
+    std::vector<unsigned short> indices16;  // filled when indexSize == 2
+    std::vector<unsigned int> indices32;    // filled when indexSize == 4
+    std::vector<SubMesh> subMeshes;         // at least one, covering all indices
+    // first sub-mesh of every index list given to buildIndexBuffer(), one
+    //  entry when there was a single list
+    std::vector<unsigned int> rangeSubMeshes;
+    // when not empty, vertex k of the uploaded buffers is old vertex vertexRemap[k]
+    //  apply it to every attribute with remapVertexAttribute()
+    std::vector<unsigned int> vertexRemap;
+
+    const void* data() const
+    {
+        return indexSize == 2 ? (const void*)indices16.data() : (const void*)indices32.data();
+    }
+    size_t count() const
+    {
+        return indexSize == 2 ? indices16.size() : indices32.size();
+    }
+};
+
+// picks the index width for a mesh of vertexCount vertices :
+//  - 16-bit when every vertex can be addressed with it
+//  - otherwise with split16, 16-bit sub-meshes of at most 65536 vertices each,
+//    vertices shared by two sub-meshes are duplicated through vertexRemap
+//  - otherwise 32-bit
+void buildIndexBuffer(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    bool split16,
+    IndexBuffer &out
+);
+
+// the same for several index lists one after the other over the same
+//  vertices, e.g. the levels of detail of a mesh : ranges holds the first
+//  index of every list, ranges[0] == 0, and no sub-mesh straddles two lists
+void buildIndexBuffer(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    bool split16,
+    const std::vector<unsigned int> &ranges,
+    IndexBuffer &out
+);
+
+// reorders (and duplicates) one vertex attribute as given by IndexBuffer::vertexRemap
+template <typename T>
+void remapVertexAttribute(std::vector<T> &attribute, const std::vector<unsigned int> &remap)
+{
+    if (remap.empty())
+    {
+        return;
+    }
+    std::vector<T> remapped(remap.size());
+    for (size_t i = 0; i < remap.size(); i++)
+    {
+        remapped[i] = attribute[remap[i]];
+    }
+    attribute.swap(remapped);
+}
+
 
-#endif  // VBOINDEXER_HPP
\ No newline at end of file
+#endif  // VBOINDEXER_HPP
@@ -0,0 +1,421 @@
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "common/glstate.hpp"
+#include "common/vboindexer.hpp"
+
+// attribute locations shared by every format and the shaders
+enum VertexAttributeLocation
+{
+    ATTRIB_POSITION     = 0,
+    ATTRIB_UV           = 1,
+    ATTRIB_NORMAL       = 2,
+    ATTRIB_TANGENT      = 3,
+    ATTRIB_BITANGENT    = 4,
+
+    // per instance, see common/instancing.hpp
+    ATTRIB_INSTANCE_MODEL   = 5,    // 3 rows, 5 to 7
+    ATTRIB_INSTANCE_NORMAL  = 8     // 3 columns, 8 to 10
+};
+
+// one full precision vertex, what every format is encoded from
+struct VertexSource
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+};
+
+// what quantized attributes are relative to
+struct VertexQuantization
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // position = positionBias() + positionScale() * normalized position
+    glm::vec3 positionScale() const { return boundsMax - boundsMin; }
+    glm::vec3 positionBias() const { return boundsMin; }
+};
+
+//
+// encoding helpers
+
+// IEEE half float, round to nearest even
+uint16_t packHalf(float value);
+float unpackHalf(uint16_t value);
+
+// octahedral mapping of a unit vector onto [-1,1]^2
+glm::vec2 octEncode(const glm::vec3 &n);
+glm::vec3 octDecode(const glm::vec2 &e);
+
+int16_t packSnorm16(float value);
+uint16_t packUnorm16(float value);
+
+// x, y, z in 10 bits, w in 2 bits, all signed normalized (GL_INT_2_10_10_10_REV)
+uint32_t packSnorm2_10_10_10(float x, float y, float z, float w);
+
+//
+// attribute encodings
+//  every attribute has a Storage type (a multiple of 4 bytes), a shader
+//  location, an id for format signatures, encode() and setup()
+
+struct UShort4  { uint16_t v[4]; };
+struct Short2   { int16_t v[2]; };
+struct Half2    { uint16_t v[2]; };
+struct Packed1010102 { uint32_t v; };
+
+// 3 x float position, 12 bytes
+struct PositionF32
+{
+    typedef glm::vec3 Storage;
+    enum { location = ATTRIB_POSITION, id = 1 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out = v.position;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// 3 x 16-bit normalized position inside the mesh bounds, 8 bytes
+//  the shader scales it back with VertexQuantization::positionScale()/Bias()
+struct PositionU16N
+{
+    typedef UShort4 Storage;
+    enum { location = ATTRIB_POSITION, id = 2 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &q)
+    {
+        glm::vec3 extent = q.positionScale();
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            float t = extent[k] > 0.f ? (v.position[k] - q.boundsMin[k]) / extent[k] : 0.f;
+            out.v[k] = packUnorm16(t);
+        }
+        out.v[3] = 0;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offset);
+    }
+};
+
+// 2 x float UV, 8 bytes
+struct UVF32
+{
+    typedef glm::vec2 Storage;
+    enum { location = ATTRIB_UV, id = 3 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out = v.uv;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// 2 x half float UV, 4 bytes
+struct UVHalf
+{
+    typedef Half2 Storage;
+    enum { location = ATTRIB_UV, id = 4 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out.v[0] = packHalf(v.uv.x);
+        out.v[1] = packHalf(v.uv.y);
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// 3 x float normal, 12 bytes
+struct NormalF32
+{
+    typedef glm::vec3 Storage;
+    enum { location = ATTRIB_NORMAL, id = 5 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out = v.normal;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// octahedral normal in 2 x 16-bit snorm, 4 bytes
+struct NormalOct16
+{
+    typedef Short2 Storage;
+    enum { location = ATTRIB_NORMAL, id = 6 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        glm::vec2 e = octEncode(v.normal);
+        out.v[0] = packSnorm16(e.x);
+        out.v[1] = packSnorm16(e.y);
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 2, GL_SHORT, GL_TRUE, stride, (void*)offset);
+    }
+};
+
+// 3 x float tangent, 12 bytes ; use together with BitangentF32
+struct TangentF32
+{
+    typedef glm::vec3 Storage;
+    enum { location = ATTRIB_TANGENT, id = 7 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out = v.tangent;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// 3 x float bitangent, 12 bytes
+struct BitangentF32
+{
+    typedef glm::vec3 Storage;
+    enum { location = ATTRIB_BITANGENT, id = 8 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        out = v.bitangent;
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+// tangent frame in 4 bytes : octahedral tangent in x and y (10 bits each),
+//  handedness in w ; the shader rebuilds bitangent = w * cross(normal, tangent)
+struct TangentFrame
+{
+    typedef Packed1010102 Storage;
+    enum { location = ATTRIB_TANGENT, id = 9 };
+
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &)
+    {
+        // same gram-schmidt as computeTangentBasis, merged tangents are sums
+        glm::vec3 t = v.tangent - v.normal * glm::dot(v.normal, v.tangent);
+        float len = glm::length(t);
+        t = len > 0.f ? t / len : glm::vec3(1.f, 0.f, 0.f);
+        float handedness = glm::dot(glm::cross(v.normal, t), v.bitangent) < 0.f ? -1.f : 1.f;
+
+        glm::vec2 e = octEncode(t);
+        out.v = packSnorm2_10_10_10(e.x, e.y, 0.f, handedness);
+    }
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glVertexAttribPointer(location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+    }
+};
+
+//
+// the packed struct : the storage of every attribute, in order
+
+template <typename... Attributes>
+struct VertexStorage;
+
+template <typename Last>
+struct VertexStorage<Last>
+{
+    typename Last::Storage value;
+};
+
+template <typename First, typename... Rest>
+struct VertexStorage<First, Rest...>
+{
+    typename First::Storage value;
+    VertexStorage<Rest...> rest;
+};
+
+// compile-time walk over the attribute list
+template <typename... Attributes>
+struct VertexAttributeList;
+
+template <>
+struct VertexAttributeList<>
+{
+    static const size_t size = 0;
+
+    template <typename Storage>
+    static void encode(Storage &, const VertexSource &, const VertexQuantization &) {}
+    static void enable(GLsizei, size_t) {}
+    static void disable() {}
+    static uint32_t signature(uint32_t s) { return s; }
+};
+
+template <typename First, typename... Rest>
+struct VertexAttributeList<First, Rest...>
+{
+    static const size_t size = sizeof(typename First::Storage) + VertexAttributeList<Rest...>::size;
+
+    template <typename Storage>
+    static void encode(Storage &out, const VertexSource &v, const VertexQuantization &q)
+    {
+        First::encode(out.value, v, q);
+        encodeRest(out, v, q);
+    }
+
+    static void enable(GLsizei stride, size_t offset)
+    {
+        enableVertexAttribArray(First::location);
+        First::setup(stride, offset);
+        VertexAttributeList<Rest...>::enable(stride, offset + sizeof(typename First::Storage));
+    }
+
+    static void disable()
+    {
+        disableVertexAttribArray(First::location);
+        VertexAttributeList<Rest...>::disable();
+    }
+
+    static uint32_t signature(uint32_t s)
+    {
+        return VertexAttributeList<Rest...>::signature(s * 31 + First::id);
+    }
+
+private:
+    // the last attribute has no rest member
+    static void encodeRest(VertexStorage<First> &, const VertexSource &, const VertexQuantization &) {}
+
+    template <typename Storage>
+    static void encodeRest(Storage &out, const VertexSource &v, const VertexQuantization &q)
+    {
+        VertexAttributeList<Rest...>::encode(out.rest, v, q);
+    }
+};
+
+// an interleaved vertex layout built from attribute encodings, e.g.
+//  VertexFormat<PositionU16N, UVHalf, NormalOct16, TangentFrame>
+template <typename... Attributes>
+struct VertexFormat
+{
+    typedef VertexStorage<Attributes...> Vertex;
+    typedef VertexAttributeList<Attributes...> List;
+
+    // attribute offsets are summed up from the storage sizes, so no padding allowed
+    static_assert(sizeof(Vertex) == List::size, "vertex attributes must not need padding");
+
+    static void encode(Vertex &out, const VertexSource &v, const VertexQuantization &q)
+    {
+        // padding inside attributes is zeroed, so equal vertices are equal bytes
+        memset(&out, 0, sizeof(Vertex));
+        List::encode(out, v, q);
+    }
+
+    // glEnableVertexAttribArray + glVertexAttribPointer for every attribute,
+    //  with the vertex buffer bound to GL_ARRAY_BUFFER ; offset is where the
+    //  first vertex starts in the buffer
+    static void enableAttributes(size_t offset = 0)
+    {
+        List::enable((GLsizei)sizeof(Vertex), offset);
+    }
+
+    static void disableAttributes()
+    {
+        List::disable();
+    }
+
+    // identifies the layout, e.g. to invalidate caches holding packed vertices
+    static uint32_t signature()
+    {
+        return List::signature((uint32_t)sizeof(Vertex));
+    }
+
+    // what the indexer uses to weld packed vertices
+    static uint64_t hash(const void* vertex)
+    {
+        return hashBytes(vertex, sizeof(Vertex));
+    }
+    static bool equal(const void* a, const void* b)
+    {
+        return memcmp(a, b, sizeof(Vertex)) == 0;
+    }
+};
+
+// encode count vertices given as separate full precision arrays
+//  tangents and bitangents may be NULL for formats without them
+template <typename Format>
+void packVertices(
+    size_t count,
+    const glm::vec3* positions,
+    const glm::vec2* uvs,
+    const glm::vec3* normals,
+    const glm::vec3* tangents,
+    const glm::vec3* bitangents,
+    const VertexQuantization &quantization,
+    std::vector<typename Format::Vertex> &out_vertices
+)
+{
+    out_vertices.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        VertexSource v;
+        v.position = positions[i];
+        v.uv = uvs[i];
+        v.normal = normals[i];
+        v.tangent = tangents ? tangents[i] : glm::vec3(0.f);
+        v.bitangent = bitangents ? bitangents[i] : glm::vec3(0.f);
+        Format::encode(out_vertices[i], v, quantization);
+    }
+}
+
+// index already packed vertices, merging the ones that encode to the same bytes
+//  out_indices gets the welded vertices in the order they first appear
+template <typename Format>
+void indexPackedVBO(
+    const std::vector<typename Format::Vertex> &in_vertices,
+    std::vector<unsigned int> &out_indices,
+    std::vector<typename Format::Vertex> &out_vertices,
+    unsigned int threadCount = 1
+)
+{
+    std::vector<unsigned int> remap;
+    size_t count = weldRecords(in_vertices.data(), sizeof(typename Format::Vertex), in_vertices.size(),
+        Format::hash, Format::equal, remap, threadCount);
+
+    size_t base = out_vertices.size();
+    out_vertices.resize(base + count);
+    out_indices.reserve(out_indices.size() + in_vertices.size());
+    for (size_t i = 0; i < in_vertices.size(); i++)
+    {
+        out_vertices[base + remap[i]] = in_vertices[i];
+        out_indices.push_back((unsigned int)(base + remap[i]));
+    }
+}
+
+// what meshes are uploaded with : 20 bytes per vertex instead of 56
+typedef VertexFormat<PositionU16N, UVHalf, NormalOct16, TangentFrame> MeshVertexFormat;
+
+// the part of it known before the tangent frame, what the corners of a mesh
+//  are welded on : corners the GPU can't tell apart become one vertex
+typedef VertexFormat<PositionU16N, UVHalf, NormalOct16> MeshWeldFormat;
+
+#endif  // VERTEXFORMAT_HPP
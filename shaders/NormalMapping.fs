@@ -14,7 +14,6 @@ uniform sampler2D DiffuseTextureSampler;
 uniform sampler2D NormalTextureSampler;
 uniform sampler2D SpecularTextureSampler;
 uniform mat4 MV;
-uniform mat3 MV3x3;
 uniform vec3 LightPosition_worldspace;
 
 void main()
@@ -30,9 +29,12 @@ void main()
 
     // local normal, in tangentspace.
     //  V tex coord is inverted because normal map is in TGA for better quality
-    vec3 TextureNormal_tangentspace = normalize(
-        texture(NormalTextureSampler, vec2(UV.x, -UV.y)).rgb * 2.0 - 1.0
-        );
+    //  only X and Y are stored (BC5), Z is rebuilt from the unit length
+    vec2 TextureNormalXY = texture(NormalTextureSampler, vec2(UV.x, -UV.y)).rg * 2.0 - 1.0;
+    vec3 TextureNormal_tangentspace = normalize(vec3(
+        TextureNormalXY,
+        sqrt(max(0.0, 1.0 - dot(TextureNormalXY, TextureNormalXY)))
+        ));
 
     // distance to the light
     float distance = length(LightPosition_worldspace - Position_worldspace);
@@ -1,11 +1,27 @@
 #version 330 core
 
+// INDIRECT_DRAWS : drawn by glMultiDrawElementsIndirect(), each draw of the
+//  call finds its data with gl_DrawIDARB ; otherwise one draw per call, and
+//  FirstDraw says which (see common/meshpool.hpp)
+#ifdef INDIRECT_DRAWS
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_ID gl_DrawIDARB
+#else
+#define DRAW_ID 0
+#endif
+
 // input vertex data, different for all executions of this shader
-layout(location = 0) in vec3 vertexPosition_modelspace;
+//  packed by MeshVertexFormat (see common/vertexformat.hpp)
+layout(location = 0) in vec3 vertexPosition_normalized;     // inside the mesh bounds
 layout(location = 1) in vec2 vertexUV;
-layout(location = 2) in vec3 vertexNormal_modelspace;
-layout(location = 3) in vec3 vertexTangent_modelspace;
-layout(location = 4) in vec3 vertexBitangent_modelspace;
+layout(location = 2) in vec2 vertexNormal_octahedral;
+layout(location = 3) in vec4 vertexTangentFrame;            // octahedral tangent, handedness in w
+
+// input instance data, one per copy of the mesh (see common/instancing.hpp)
+layout(location = 5) in vec4 instanceModelRow0;            // model matrix, affine, by rows
+layout(location = 6) in vec4 instanceModelRow1;
+layout(location = 7) in vec4 instanceModelRow2;
+layout(location = 8) in mat3 instanceNormalMatrix;          // inverse transpose of the model's 3x3
 
 // output data ; will be interpolated for each fragment
 out vec2 UV;
@@ -13,38 +29,67 @@ out vec3 Position_worldspace;
 out vec3 LightDirection_tangentspace;
 out vec3 EyeDirection_tangentspace;
 
-// values that stay constant for the whole mesh
-uniform mat4 MVP;
+// values that stay constant for all the instances
+uniform mat4 VP;
 uniform mat4 V;
-uniform mat4 M;
-uniform mat3 MV3x3;
 uniform vec3 LightPosition_worldspace;
 
+// values that stay constant for a draw : the quantization of its mesh, as
+//  2 texels per draw
+uniform samplerBuffer DrawDataSampler;
+uniform int FirstDraw;
+
+// unit vector from its octahedral encoding
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main()
 {
-    // output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * vec4(vertexPosition_modelspace, 1);
+    // the draw's data
+    int draw = FirstDraw + DRAW_ID;
+    vec3 PositionScale = texelFetch(DrawDataSampler, 2 * draw).xyz;
+    vec3 PositionBias = texelFetch(DrawDataSampler, 2 * draw + 1).xyz;
+
+    // unpack the vertex
+    vec3 vertexPosition_modelspace = PositionBias + PositionScale * vertexPosition_normalized;
+    vec3 vertexNormal_modelspace = octDecode(vertexNormal_octahedral);
+    vec3 vertexTangent_modelspace = octDecode(vertexTangentFrame.xy);
+    vec3 vertexBitangent_modelspace = sign(vertexTangentFrame.w) * cross(vertexNormal_modelspace, vertexTangent_modelspace);
 
     // position of the vertex, in worldspace : M * position
-    Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
+    vec4 position = vec4(vertexPosition_modelspace, 1);
+    Position_worldspace = vec3(
+        dot(instanceModelRow0, position),
+        dot(instanceModelRow1, position),
+        dot(instanceModelRow2, position));
+
+    // output position of the vertex, in clip space : VP * M * position
+    gl_Position = VP * vec4(Position_worldspace, 1);
 
     // vector that goes from the vertex to the camera, in camera space
     //  in camera space, the camera is at the origin (0,0,0)
-    vec3 vertexPosition_modelspace = (V * M * vec4(vertexPosition_modelspace, 1)).xyz;
-    vec3 EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_modelspace;
+    vec3 vertexPosition_cameraspace = (V * vec4(Position_worldspace, 1)).xyz;
+    vec3 EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;
 
     // vector that goes from the vertex to the light, in camera space.
-    //  M is ommited because it's identity
+    //  the light is in worldspace already
     vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
     vec3 LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
 
     // UV of the vertex. no special space for this one
     UV = vertexUV;
 
-    // model to camera = ModelView
-    vec3 vertexTangent_cameraspace = MV3x3 * vertexTangent_modelspace;
-    vec3 vertexBitangent_cameraspace = MV3x3 * vertexBitangent_modelspace;
-    vec3 vertexNormal_cameraspace = MV3x3 * vertexNormal_modelspace;
+    // model to camera : the instance's normal matrix, then the view's
+    //  rotation ; the tangents are renormalized in case of scaling
+    mat3 MV3x3 = mat3(V) * instanceNormalMatrix;
+    vec3 vertexTangent_cameraspace = normalize(MV3x3 * vertexTangent_modelspace);
+    vec3 vertexBitangent_cameraspace = normalize(MV3x3 * vertexBitangent_modelspace);
+    vec3 vertexNormal_cameraspace = normalize(MV3x3 * vertexNormal_modelspace);
 
     // You can use dot products instead of building this matrix and transposing it. See References for details.
     mat3 TBN = transpose(mat3(
@@ -1,20 +1,26 @@
 #version 330 core
 
-// input vertex data, different for all executions of this shader
-layout(location = 0) in vec2 vertexPosition_screenspace;
-layout(location = 1) in vec2 vertexUV;
+// input instance data, one per character
+layout(location = 0) in vec2 glyphPosition_screenspace;    // lower left corner
+layout(location = 1) in vec2 glyphSizeAndCode;
 
 // output data ; will be interpolated for each fragment
 out vec2 UV;
 
 void main()
 {
+    // the quad's corners as a triangle strip : (0,0) (1,0) (0,1) (1,1)
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 vertexPosition_screenspace = glyphPosition_screenspace + corner * glyphSizeAndCode.x;
+
     // output position of the vertex, in clip space
     //  map [0..800][0..600] to [-1..1][-1..1]
     vec2 vertexPosition_homogeneousspace = vertexPosition_screenspace - vec2(400, 300); // [0..800][0..600] -> [-400..400][-300..300]
     vertexPosition_homogeneousspace /= vec2(400, 300);
     gl_Position = vec4(vertexPosition_homogeneousspace, 0, 1);
 
-    //UV of the vertex. No special space for this one
-    UV = vertexUV;
-}
\ No newline at end of file
+    // 16x16 glyphs, the texture's rows from the top
+    int code = int(glyphSizeAndCode.y);
+    vec2 glyph = vec2(code % 16, code / 16) / 16.0;
+    UV = glyph + vec2(corner.x, 1.0 - corner.y) / 16.0;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "common/assetloader.hpp"
+#include "common/glstate.hpp"
+#include "common/mipmap.hpp"
+#include "common/shader.hpp"
+
+typedef std::shared_ptr<std::promise<bool> > AssetPromise;
+
+// hand GL work over to the GL thread
+static void queueUpload(AssetLoader &loader, std::function<void()> upload)
+{
+    std::lock_guard<std::mutex> lock(loader.uploadMutex);
+    loader.uploads.push_back(std::move(upload));
+}
+
+// an asset is done, resident or failed
+static void finishAsset(AssetLoader &loader, const AssetPromise &promise, bool res)
+{
+    promise->set_value(res);
+    loader.pending--;
+}
+
+void startAssetLoader(AssetLoader &loader, unsigned int workerCount)
+{
+    loader.pending = 0;
+    initTextureUploader(loader.textureUploader);
+    startWorkerPool(loader.workers, workerCount);
+}
+
+void stopAssetLoader(AssetLoader &loader)
+{
+    // workers may still queue uploads, keep draining until nothing is left
+    while (pendingAssets(loader) > 0)
+    {
+        if (processUploads(loader, 1e9) == 0 && pendingAssets(loader) > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    stopWorkerPool(loader.workers);
+    destroyTextureUploader(loader.textureUploader);
+}
+
+std::future<bool> loadTextureAsync(
+    AssetLoader &loader, const char* path, TextureAsset &asset,
+    const MipSettings &mips
+)
+{
+    asset.texture = 0;
+    asset.resident = false;
+    AssetPromise promise = std::make_shared<std::promise<bool> >();
+    std::future<bool> future = promise->get_future();
+    loader.pending++;
+
+    std::string imagePath(path);
+    AssetLoader* owner = &loader;
+    TextureAsset* target = &asset;
+    MipSettings settings = mips;
+    submitTask(loader.workers, [owner, target, promise, imagePath, settings]()
+    {
+        // map and parse on the worker
+        std::shared_ptr<Image> image = std::make_shared<Image>();
+        if (!loadImage(imagePath.c_str(), *image))
+        {
+            finishAsset(*owner, promise, false);
+            return;
+        }
+        // mips of uncompressed images too, the workers are already busy
+        //  in parallel so the chain is built on this one
+        buildMipmaps(*image, settings, 1);
+        // the texture itself on the GL thread
+        queueUpload(*owner, [owner, target, promise, image]()
+        {
+            target->texture = createTexture(*image, &owner->textureUploader);
+            target->resident = target->texture != 0;
+            freeImage(*image);
+            finishAsset(*owner, promise, target->resident);
+        });
+    });
+    return future;
+}
+
+std::future<bool> loadShadersAsync(
+    AssetLoader &loader, const char* vertexPath, const char* fragmentPath, ShaderAsset &asset,
+    const char* defines
+)
+{
+    asset.program = 0;
+    asset.resident = false;
+    AssetPromise promise = std::make_shared<std::promise<bool> >();
+    std::future<bool> future = promise->get_future();
+    loader.pending++;
+
+    std::string vertexName(vertexPath);
+    std::string fragmentName(fragmentPath);
+    std::string defineLines(defines ? defines : "");
+    AssetLoader* owner = &loader;
+    ShaderAsset* target = &asset;
+    submitTask(loader.workers, [owner, target, promise, vertexName, fragmentName, defineLines]()
+    {
+        std::shared_ptr<std::string> vertexCode = std::make_shared<std::string>();
+        std::shared_ptr<std::string> fragmentCode = std::make_shared<std::string>();
+        if (!ReadShaderFile(vertexName.c_str(), *vertexCode) ||
+            !ReadShaderFile(fragmentName.c_str(), *fragmentCode))
+        {
+            finishAsset(*owner, promise, false);
+            return;
+        }
+        queueUpload(*owner, [owner, target, promise, vertexCode, fragmentCode, vertexName, fragmentName, defineLines]()
+        {
+            target->program = CreateProgram(
+                vertexCode->c_str(), fragmentCode->c_str(),
+                vertexName.c_str(), fragmentName.c_str(),
+                defineLines.empty() ? NULL : defineLines.c_str());
+            GLint linked = GL_FALSE;
+            glGetProgramiv(target->program, GL_LINK_STATUS, &linked);
+            target->resident = linked == GL_TRUE;
+            finishAsset(*owner, promise, target->resident);
+        });
+    });
+    return future;
+}
+
+std::future<bool> loadMeshAsync(
+    AssetLoader &loader, MeshPool &pool, const char* objPath, const char* cachePath, MeshAsset &asset
+)
+{
+    asset.poolMesh = invalidPoolMesh;
+    asset.resident = false;
+    AssetPromise promise = std::make_shared<std::promise<bool> >();
+    std::future<bool> future = promise->get_future();
+    loader.pending++;
+
+    std::string obj(objPath);
+    std::string cache(cachePath);
+    AssetLoader* owner = &loader;
+    MeshPool* meshes = &pool;
+    MeshAsset* target = &asset;
+    submitTask(loader.workers, [owner, meshes, target, promise, obj, cache]()
+    {
+        // parse, tangents and indexing, or the cache, on the worker
+        if (!loadMeshCached(obj.c_str(), cache.c_str(), target->file))
+        {
+            finishAsset(*owner, promise, false);
+            return;
+        }
+        queueUpload(*owner, [owner, meshes, target, promise]()
+        {
+            // appended to the pool's buffers, the draws then find it there
+            target->poolMesh = addPoolMesh(*meshes, target->file.mesh);
+            target->resident = target->poolMesh != invalidPoolMesh;
+            finishAsset(*owner, promise, target->resident);
+        });
+    });
+    return future;
+}
+
+size_t processUploads(AssetLoader &loader, double budgetMs)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::function<void()> upload;
+        {
+            std::lock_guard<std::mutex> lock(loader.uploadMutex);
+            if (loader.uploads.empty())
+            {
+                return 0;
+            }
+            upload = std::move(loader.uploads.front());
+            loader.uploads.pop_front();
+        }
+        upload();
+
+        double elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - startTime).count();
+        if (elapsed >= budgetMs)
+        {
+            std::lock_guard<std::mutex> lock(loader.uploadMutex);
+            return loader.uploads.size();
+        }
+    }
+}
+
+unsigned int pendingAssets(const AssetLoader &loader)
+{
+    return loader.pending.load();
+}
+
+void destroyMeshAsset(MeshAsset &asset)
+{
+    // the cache mapping the sub-meshes are read from
+    closeMeshFile(asset.file);
+    asset.resident = false;
+}
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "common/benchmark.hpp"
+#include "common/json.hpp"
+
+static void usage()
+{
+    printf("usage : TinyGLSL [--bench [--size WxH] [--samples n] [--warmup n] [--frames n]\n");
+    printf("            [--capture f,f,...] [--capture-prefix prefix] [--report file.json]]\n");
+    printf("          [--instances n] [--trace file.json]\n");
+    printf("  --bench           render offscreen, without a window or a display, and\n");
+    printf("                    write the frame times as JSON instead of showing them\n");
+    printf("  --size WxH        framebuffer size (default 640x480)\n");
+    printf("  --samples n       samples per pixel (default 4, as the window)\n");
+    printf("  --warmup n        frames drawn before measuring, once loaded (default 30)\n");
+    printf("  --frames n        frames measured (default 300)\n");
+    printf("  --capture f,...   measured frames to save as PPM, from 0\n");
+    printf("  --capture-prefix  captures are <prefix>_<frame>.ppm (default bench)\n");
+    printf("  --report file     where the JSON goes (default bench.json)\n");
+    printf("  --instances n     copies of the mesh drawn, on a grid (default 1)\n");
+    printf("  --trace file      profiling scopes, startup included, as a Chrome trace\n");
+    printf("                    written on exit, for chrome://tracing or ui.perfetto.dev\n");
+}
+
+static bool parseCount(const char* text, unsigned int &value)
+{
+    char* end = NULL;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != 0 || parsed < 0)
+    {
+        return false;
+    }
+    value = (unsigned int)parsed;
+    return true;
+}
+
+static bool parseCaptures(const char* text, std::vector<unsigned int> &captures)
+{
+    while (*text)
+    {
+        char* end = NULL;
+        long frame = strtol(text, &end, 10);
+        if (end == text || frame < 0 || (*end != ',' && *end != 0))
+        {
+            return false;
+        }
+        captures.push_back((unsigned int)frame);
+        text = *end == ',' ? end + 1 : end;
+    }
+    std::sort(captures.begin(), captures.end());
+    return true;
+}
+
+bool parseBenchmarkArguments(int argc, char** argv, BenchmarkSettings &settings)
+{
+    settings.enabled = false;
+    settings.width = 640;
+    settings.height = 480;
+    settings.samples = 4;
+    settings.warmupFrames = 30;
+    settings.frames = 300;
+    settings.captures.clear();
+    settings.reportPath = "bench.json";
+    settings.capturePrefix = "bench";
+    settings.instances = 1;
+    settings.tracePath.clear();
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = true;
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            settings.enabled = true;
+            continue;
+        }
+        else if (value == NULL)
+            ok = false;
+        else if (strcmp(argv[i], "--size") == 0)
+            ok = sscanf(value, "%ux%u", &settings.width, &settings.height) == 2 &&
+                 settings.width > 0 && settings.height > 0;
+        else if (strcmp(argv[i], "--samples") == 0)
+            ok = parseCount(value, settings.samples);
+        else if (strcmp(argv[i], "--warmup") == 0)
+            ok = parseCount(value, settings.warmupFrames);
+        else if (strcmp(argv[i], "--frames") == 0)
+            ok = parseCount(value, settings.frames) && settings.frames > 0;
+        else if (strcmp(argv[i], "--capture") == 0)
+            ok = parseCaptures(value, settings.captures);
+        else if (strcmp(argv[i], "--capture-prefix") == 0)
+            settings.capturePrefix = value;
+        else if (strcmp(argv[i], "--report") == 0)
+            settings.reportPath = value;
+        else if (strcmp(argv[i], "--instances") == 0)
+            ok = parseCount(value, settings.instances) && settings.instances > 0;
+        else if (strcmp(argv[i], "--trace") == 0)
+            settings.tracePath = value;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            usage();
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+double benchmarkTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void startFrameTimer(FrameTimer &timer)
+{
+    // timer queries are core in 3.3, but may count nothing
+    GLint counterBits = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &counterBits);
+    if (counterBits > 0)
+    {
+        glGenQueries(frameLatency, timer.queries);
+    }
+    else
+    {
+        memset(timer.queries, 0, sizeof(timer.queries));
+    }
+    memset(timer.fences, 0, sizeof(timer.fences));
+    timer.frame = 0;
+    timer.frameStart = 0.0;
+    timer.frameTimes.clear();
+    timer.cpuTimes.clear();
+    timer.gpuTimes.clear();
+}
+
+// wait until the frame in slot is drawn, then read its GPU time
+static void finishSlot(FrameTimer &timer, unsigned int slot)
+{
+    if (timer.fences[slot] == 0)
+    {
+        return;
+    }
+    while (glClientWaitSync(timer.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED)
+    {
+    }
+    glDeleteSync(timer.fences[slot]);
+    timer.fences[slot] = 0;
+
+    if (timer.queries[slot] != 0)
+    {
+        // done with the frame, so no waiting here
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timer.queries[slot], GL_QUERY_RESULT, &elapsed);
+        timer.gpuTimes.push_back(elapsed / 1e6);
+    }
+}
+
+void beginFrame(FrameTimer &timer)
+{
+    timer.frameStart = benchmarkTime();
+    unsigned int slot = timer.frame % frameLatency;
+    if (timer.queries[slot] != 0)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, timer.queries[slot]);
+    }
+}
+
+void endFrame(FrameTimer &timer)
+{
+    unsigned int slot = timer.frame % frameLatency;
+    if (timer.queries[slot] != 0)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    timer.cpuTimes.push_back((benchmarkTime() - timer.frameStart) * 1000.0);
+    timer.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    timer.frame++;
+
+    // the next frame reuses the oldest slot, that frame must be drawn by now
+    finishSlot(timer, timer.frame % frameLatency);
+    timer.frameTimes.push_back((benchmarkTime() - timer.frameStart) * 1000.0);
+}
+
+void stopFrameTimer(FrameTimer &timer)
+{
+    for (unsigned int i = 0; i < frameLatency; i++)
+    {
+        finishSlot(timer, (timer.frame + i) % frameLatency);
+    }
+    if (timer.queries[0] != 0)
+    {
+        glDeleteQueries(frameLatency, timer.queries);
+        memset(timer.queries, 0, sizeof(timer.queries));
+    }
+}
+
+// nearest rank : the smallest value with at least p percent of the sorted
+//  samples at or below it
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+TimeSummary summarizeTimes(const std::vector<double> &times)
+{
+    TimeSummary summary = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if (times.empty())
+    {
+        return summary;
+    }
+    std::vector<double> sorted(times);
+    std::sort(sorted.begin(), sorted.end());
+    size_t count = sorted.size();
+
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += sorted[i];
+    }
+    summary.min = sorted[0];
+    summary.median = percentile(sorted, 50.0);
+    summary.mean = sum / count;
+    summary.p95 = percentile(sorted, 95.0);
+    summary.p99 = percentile(sorted, 99.0);
+    summary.max = sorted[count - 1];
+    return summary;
+}
+
+static void writeSummary(FILE* file, const char* name, const std::vector<double> &times, bool last)
+{
+    TimeSummary summary = summarizeTimes(times);
+    fprintf(file, "    \"%s\": { \"count\": %u, \"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, "
+        "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+        name, (unsigned int)times.size(), summary.min, summary.median, summary.mean,
+        summary.p95, summary.p99, summary.max, last ? "" : ",");
+}
+
+bool writeBenchmarkReport(
+    const BenchmarkSettings &settings,
+    unsigned int samples,
+    double loadTime,
+    const FrameTimer &timer,
+    const std::vector<std::pair<std::string, double> > &counters,
+    const std::vector<std::pair<std::string, double> > &metrics,
+    const std::vector<std::string> &capturePaths)
+{
+    FILE* file = fopen(settings.reportPath.c_str(), "w");
+    if (file == NULL)
+    {
+        printf("Could not write %s\n", settings.reportPath.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": ");
+    writeJSONString(file, (const char*)glGetString(GL_RENDERER));
+    fprintf(file, ",\n  \"version\": ");
+    writeJSONString(file, (const char*)glGetString(GL_VERSION));
+    fprintf(file, ",\n  \"width\": %u,\n  \"height\": %u,\n  \"samples\": %u,\n",
+        settings.width, settings.height, samples);
+    fprintf(file, "  \"warmupFrames\": %u,\n  \"frames\": %u,\n", settings.warmupFrames, settings.frames);
+    fprintf(file, "  \"instances\": %u,\n", settings.instances);
+    fprintf(file, "  \"loadMs\": %.3f,\n", loadTime * 1000.0);
+
+    // in ms
+    fprintf(file, "  \"times\": {\n");
+    writeSummary(file, "frame", timer.frameTimes, false);
+    writeSummary(file, "cpu", timer.cpuTimes, false);
+    writeSummary(file, "gpu", timer.gpuTimes, true);
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"perFrame\": {");
+    for (size_t i = 0; i < counters.size(); i++)
+    {
+        fprintf(file, "%s\n    ", i > 0 ? "," : "");
+        writeJSONString(file, counters[i].first.c_str());
+        fprintf(file, ": %.2f", counters[i].second);
+    }
+    fprintf(file, "\n  },\n");
+
+    fprintf(file, "  \"metrics\": {");
+    for (size_t i = 0; i < metrics.size(); i++)
+    {
+        fprintf(file, "%s\n    ", i > 0 ? "," : "");
+        writeJSONString(file, metrics[i].first.c_str());
+        fprintf(file, ": %.3f", metrics[i].second);
+    }
+    fprintf(file, "\n  },\n");
+
+    fprintf(file, "  \"captures\": [");
+    for (size_t i = 0; i < capturePaths.size(); i++)
+    {
+        fprintf(file, "%s", i > 0 ? ", " : "");
+        writeJSONString(file, capturePaths[i].c_str());
+    }
+    fprintf(file, "]\n}\n");
+
+    bool ok = ferror(file) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        printf("Could not write %s\n", settings.reportPath.c_str());
+    }
+    return ok;
+}
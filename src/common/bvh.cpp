@@ -0,0 +1,723 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+#include "common/simd.hpp"
+#include "common/bvh.hpp"
+
+// SAH : centroid bins per axis, and what a leaf may hold
+static const unsigned int bvhBinCount = 16;
+static const unsigned int maxLeafTriangles = 8;
+// traversing a node costs about as much as testing a triangle
+static const float traversalCost = 1.f;
+// rays more parallel to a triangle than this miss it
+static const float minTriangleDeterminant = 1e-12f;
+
+// subtrees this large are built on a thread of their own, down to this depth
+static const size_t parallelBuildTriangles = 16 * 1024;
+static const unsigned int parallelBuildDepth = 4;
+
+// nodes a traversal keeps on its own stack, deeper trees get one on the heap
+static const unsigned int traversalStackSize = 64;
+
+//
+// build
+
+struct TriangleRef
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 centroid;
+    uint32_t triangle;
+};
+
+struct BuildNode
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    size_t begin;               // in the refs, leaves only
+    size_t count;
+    std::unique_ptr<BuildNode> children[2];
+    size_t nodeCount;           // in the subtree, this one included
+};
+
+static inline float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+    glm::vec3 d = glm::max(boundsMax - boundsMin, glm::vec3(0.f));
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+struct Bin
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    size_t count;
+
+    Bin() : boundsMin(FLT_MAX), boundsMax(-FLT_MAX), count(0) {}
+};
+
+static std::unique_ptr<BuildNode> buildNode(std::vector<TriangleRef> &refs, size_t begin, size_t end, unsigned int depth)
+{
+    std::unique_ptr<BuildNode> node(new BuildNode());
+    node->begin = begin;
+    node->count = end - begin;
+    node->nodeCount = 1;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+    for (size_t i = begin; i < end; i++)
+    {
+        boundsMin = glm::min(boundsMin, refs[i].boundsMin);
+        boundsMax = glm::max(boundsMax, refs[i].boundsMax);
+        centroidMin = glm::min(centroidMin, refs[i].centroid);
+        centroidMax = glm::max(centroidMax, refs[i].centroid);
+    }
+    node->boundsMin = boundsMin;
+    node->boundsMax = boundsMax;
+
+    size_t count = end - begin;
+    if (count <= 1)
+    {
+        return node;
+    }
+
+    // the cheapest split between bins, over the 3 axes
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned int bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.f)
+        {
+            continue;
+        }
+        float scale = bvhBinCount / extent;
+
+        Bin bins[bvhBinCount];
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned int b = std::min((unsigned int)((refs[i].centroid[axis] - centroidMin[axis]) * scale), bvhBinCount - 1);
+            bins[b].boundsMin = glm::min(bins[b].boundsMin, refs[i].boundsMin);
+            bins[b].boundsMax = glm::max(bins[b].boundsMax, refs[i].boundsMax);
+            bins[b].count++;
+        }
+
+        // areas and counts left of each split from the left, then the right
+        //  side from the right
+        float leftArea[bvhBinCount - 1];
+        size_t leftCount[bvhBinCount - 1];
+        Bin left;
+        for (unsigned int s = 0; s < bvhBinCount - 1; s++)
+        {
+            left.boundsMin = glm::min(left.boundsMin, bins[s].boundsMin);
+            left.boundsMax = glm::max(left.boundsMax, bins[s].boundsMax);
+            left.count += bins[s].count;
+            leftArea[s] = surfaceArea(left.boundsMin, left.boundsMax);
+            leftCount[s] = left.count;
+        }
+        Bin right;
+        for (unsigned int s = bvhBinCount - 1; s > 0; s--)
+        {
+            right.boundsMin = glm::min(right.boundsMin, bins[s].boundsMin);
+            right.boundsMax = glm::max(right.boundsMax, bins[s].boundsMax);
+            right.count += bins[s].count;
+            if (leftCount[s - 1] == 0 || right.count == 0)
+            {
+                continue;
+            }
+            float cost = leftArea[s - 1] * leftCount[s - 1] + surfaceArea(right.boundsMin, right.boundsMax) * right.count;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = s;
+            }
+        }
+    }
+
+    // a leaf when nothing splits, or when splitting does not pay
+    float leafCost = surfaceArea(boundsMin, boundsMax) * count;
+    float splitCost = traversalCost * surfaceArea(boundsMin, boundsMax) + bestCost;
+    if (bestAxis < 0 && count > maxLeafTriangles)
+    {
+        // identical centroids : halves, whatever the cost
+        size_t middle = begin + count / 2;
+        node->children[0] = buildNode(refs, begin, middle, depth + 1);
+        node->children[1] = buildNode(refs, middle, end, depth + 1);
+        node->nodeCount += node->children[0]->nodeCount + node->children[1]->nodeCount;
+        return node;
+    }
+    if (bestAxis < 0 || (count <= maxLeafTriangles && splitCost >= leafCost))
+    {
+        return node;
+    }
+
+    float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+    float scale = bvhBinCount / extent;
+    float axisMin = centroidMin[bestAxis];
+    TriangleRef* middle = std::partition(refs.data() + begin, refs.data() + end, [&](const TriangleRef &ref)
+    {
+        unsigned int b = std::min((unsigned int)((ref.centroid[bestAxis] - axisMin) * scale), bvhBinCount - 1);
+        return b < bestSplit;
+    });
+    size_t split = middle - refs.data();
+
+    if (count >= parallelBuildTriangles && depth < parallelBuildDepth)
+    {
+        parallelFor(2, 1, [&](size_t child, size_t)
+        {
+            node->children[child] = child == 0 ?
+                buildNode(refs, begin, split, depth + 1) :
+                buildNode(refs, split, end, depth + 1);
+        }, 2);
+    }
+    else
+    {
+        node->children[0] = buildNode(refs, begin, split, depth + 1);
+        node->children[1] = buildNode(refs, split, end, depth + 1);
+    }
+    node->nodeCount += node->children[0]->nodeCount + node->children[1]->nodeCount;
+    return node;
+}
+
+// depth first, the first child right after its parent
+static void flattenNode(BVH &bvh, const BuildNode &node, uint32_t index, uint32_t &next, unsigned int depth)
+{
+    BVHNode &out = bvh.nodes[index];
+    out.boundsMin = node.boundsMin;
+    out.boundsMax = node.boundsMax;
+    if (!node.children[0])
+    {
+        out.offset = (uint32_t)node.begin;
+        out.count = (uint32_t)node.count;
+        bvh.depth = std::max(bvh.depth, depth);
+        return;
+    }
+    uint32_t first = next++;
+    flattenNode(bvh, *node.children[0], first, next, depth + 1);
+    uint32_t second = next++;
+    bvh.nodes[index].offset = second;
+    bvh.nodes[index].count = 0;
+    flattenNode(bvh, *node.children[1], second, next, depth + 1);
+}
+
+// a traversal stack for bvh : at most one node waits per level of the
+//  path to the current one, so the depth of the tree is enough
+struct TraversalStack
+{
+    uint32_t local[traversalStackSize];
+    std::vector<uint32_t> deep;
+
+    uint32_t* reserve(const BVH &bvh)
+    {
+        if (bvh.depth <= traversalStackSize)
+        {
+            return local;
+        }
+        deep.resize(bvh.depth);
+        return deep.data();
+    }
+};
+
+void buildBVH(
+    BVH &bvh,
+    const glm::vec3* positions,
+    const uint32_t* indices,
+    size_t triangleCount,
+    unsigned int threadCount
+)
+{
+    PROFILE_SCOPE("buildBVH");
+    bvh.nodes.clear();
+    bvh.vertices.clear();
+    bvh.triangles.clear();
+    bvh.depth = 0;
+
+    std::vector<TriangleRef> refs(triangleCount);
+    parallelFor(triangleCount, 64 * 1024, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const glm::vec3 &a = positions[indices[3 * i]];
+            const glm::vec3 &b = positions[indices[3 * i + 1]];
+            const glm::vec3 &c = positions[indices[3 * i + 2]];
+            refs[i].boundsMin = glm::min(a, glm::min(b, c));
+            refs[i].boundsMax = glm::max(a, glm::max(b, c));
+            refs[i].centroid = 0.5f * (refs[i].boundsMin + refs[i].boundsMax);
+            refs[i].triangle = (uint32_t)i;
+        }
+    }, threadCount);
+
+    if (triangleCount == 0)
+    {
+        // an empty root, every ray misses it
+        BVHNode root;
+        root.boundsMin = glm::vec3(FLT_MAX);
+        root.boundsMax = glm::vec3(-FLT_MAX);
+        root.offset = 0;
+        root.count = 0;
+        bvh.nodes.push_back(root);
+        return;
+    }
+
+    std::unique_ptr<BuildNode> root = buildNode(refs, 0, triangleCount, 0);
+    bvh.nodes.resize(root->nodeCount);
+    uint32_t next = 1;
+    flattenNode(bvh, *root, 0, next, 0);
+
+    // the triangles in the order the leaves reference them
+    bvh.vertices.resize(3 * triangleCount);
+    bvh.triangles.resize(triangleCount);
+    parallelFor(triangleCount, 64 * 1024, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            uint32_t triangle = refs[i].triangle;
+            bvh.triangles[i] = triangle;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                bvh.vertices[3 * i + k] = positions[indices[3 * triangle + k]];
+            }
+        }
+    }, threadCount);
+}
+
+void buildBVH(BVH &bvh, const MeshData &mesh, unsigned int threadCount)
+{
+    // absolute 32-bit indices of the full mesh, whatever the sub-meshes and
+    //  the index size ; the other levels of detail come after its indices
+    unsigned int indexCount = mesh.lods[0].indexCount;
+    std::vector<uint32_t> indices(indexCount);
+    for (unsigned int s = 0; s < mesh.subMeshCount; s++)
+    {
+        const SubMesh &subMesh = mesh.subMeshes[s];
+        for (unsigned int i = 0; i < subMesh.indexCount; i++)
+        {
+            size_t index = subMesh.firstIndex + i;
+            uint32_t vertex = mesh.indexSize == 2 ?
+                ((const uint16_t*)mesh.indices)[index] :
+                ((const uint32_t*)mesh.indices)[index];
+            indices[index] = vertex + subMesh.baseVertex;
+        }
+    }
+    buildBVH(bvh, mesh.positions, indices.data(), indexCount / 3, threadCount);
+}
+
+//
+// single rays
+
+// entry distance into the box, FLT_MAX when missed or farther than tMax
+static inline float intersectBox(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax)
+{
+    glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+    glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+// Moller-Trumbore, both sides
+static inline bool intersectTriangle(
+    const glm::vec3* v, const glm::vec3 &origin, const glm::vec3 &direction,
+    float tMax, float &t, float &u, float &w)
+{
+    glm::vec3 e1 = v[1] - v[0];
+    glm::vec3 e2 = v[2] - v[0];
+    glm::vec3 p = glm::cross(direction, e2);
+    float determinant = glm::dot(e1, p);
+    if (fabsf(determinant) < minTriangleDeterminant)
+    {
+        return false;
+    }
+    float inverse = 1.f / determinant;
+    glm::vec3 s = origin - v[0];
+    u = glm::dot(s, p) * inverse;
+    if (u < 0.f || u > 1.f)
+    {
+        return false;
+    }
+    glm::vec3 q = glm::cross(s, e1);
+    w = glm::dot(direction, q) * inverse;
+    if (w < 0.f || u + w > 1.f)
+    {
+        return false;
+    }
+    t = glm::dot(e2, q) * inverse;
+    return t >= 0.f && t < tMax;
+}
+
+static inline glm::vec3 inverseOf(const glm::vec3 &direction)
+{
+    // a zero component gives an infinite slab, which is what it is
+    return glm::vec3(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+}
+
+bool intersectRay(const BVH &bvh, const Ray &ray, RayHit &hit)
+{
+    hit.t = ray.tMax;
+    hit.triangle = noTriangle;
+    hit.u = hit.v = 0.f;
+
+    glm::vec3 inverseDirection = inverseOf(ray.direction);
+    if (intersectBox(bvh.nodes[0], ray.origin, inverseDirection, hit.t) == FLT_MAX)
+    {
+        return false;
+    }
+
+    // nodes still to visit, the nearest on top
+    TraversalStack traversal;
+    uint32_t* stack = traversal.reserve(bvh);
+    unsigned int depth = 0;
+    uint32_t index = 0;
+    while (true)
+    {
+        const BVHNode &node = bvh.nodes[index];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            {
+                float t, u, w;
+                if (intersectTriangle(&bvh.vertices[3 * i], ray.origin, ray.direction, hit.t, t, u, w))
+                {
+                    hit.t = t;
+                    hit.triangle = i;
+                    hit.u = u;
+                    hit.v = w;
+                }
+            }
+        }
+        else
+        {
+            uint32_t first = index + 1;
+            uint32_t second = node.offset;
+            float firstT = intersectBox(bvh.nodes[first], ray.origin, inverseDirection, hit.t);
+            float secondT = intersectBox(bvh.nodes[second], ray.origin, inverseDirection, hit.t);
+            if (secondT < firstT)
+            {
+                std::swap(first, second);
+                std::swap(firstT, secondT);
+            }
+            if (firstT != FLT_MAX)
+            {
+                if (secondT != FLT_MAX)
+                {
+                    stack[depth++] = second;
+                }
+                index = first;
+                continue;
+            }
+        }
+        if (depth == 0)
+        {
+            break;
+        }
+        index = stack[--depth];
+    }
+
+    if (hit.triangle == noTriangle)
+    {
+        return false;
+    }
+    hit.triangle = bvh.triangles[hit.triangle];
+    return true;
+}
+
+//
+// lanes : a few rays side by side, one float per ray
+//  the packet kernel below is written once against this interface
+
+struct ScalarLanes
+{
+    typedef float Value;
+    typedef bool Mask;
+    enum { width = 1 };
+
+    static Value load(const float* p) { return *p; }
+    static void store(float* p, Value v) { *p = v; }
+    static Value set1(float v) { return v; }
+    static Value add(Value a, Value b) { return a + b; }
+    static Value sub(Value a, Value b) { return a - b; }
+    static Value mul(Value a, Value b) { return a * b; }
+    static Value div(Value a, Value b) { return a / b; }
+    static Value min(Value a, Value b) { return a < b ? a : b; }
+    static Value max(Value a, Value b) { return a > b ? a : b; }
+    static Value abs(Value a) { return fabsf(a); }
+    static Value select(Mask m, Value a, Value b) { return m ? a : b; }
+    static Mask lessEqual(Value a, Value b) { return a <= b; }
+    static Mask less(Value a, Value b) { return a < b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static bool any(Mask m) { return m; }
+};
+
+#if defined(__SSE2__)
+
+struct WideLanes
+{
+    typedef __m128 Value;
+    typedef __m128 Mask;
+    enum { width = 4 };
+
+    static Value load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, Value v) { _mm_storeu_ps(p, v); }
+    static Value set1(float v) { return _mm_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+    static Value div(Value a, Value b) { return _mm_div_ps(a, b); }
+    static Value min(Value a, Value b) { return _mm_min_ps(a, b); }
+    static Value max(Value a, Value b) { return _mm_max_ps(a, b); }
+    static Value abs(Value a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    static Value select(Mask m, Value a, Value b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static Mask lessEqual(Value a, Value b) { return _mm_cmple_ps(a, b); }
+    static Mask less(Value a, Value b) { return _mm_cmplt_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static bool any(Mask m) { return _mm_movemask_ps(m) != 0; }
+};
+
+#else
+
+// no vector unit the compiler targets
+typedef ScalarLanes WideLanes;
+
+#endif
+
+// the packet as the kernel reads it : reciprocal directions precomputed,
+//  the closest hit so far per ray
+struct PacketState
+{
+    alignas(32) float inverseX[rayPacketSize];
+    alignas(32) float inverseY[rayPacketSize];
+    alignas(32) float inverseZ[rayPacketSize];
+    alignas(32) float t[rayPacketSize];
+    alignas(32) float u[rayPacketSize];
+    alignas(32) float v[rayPacketSize];
+    alignas(32) float triangle[rayPacketSize];  // leaf order index, its bits in a float
+};
+
+// selects move bits, so a float can carry an index exactly
+static inline float indexBits(uint32_t index)
+{
+    float bits;
+    memcpy(&bits, &index, sizeof(bits));
+    return bits;
+}
+
+static inline uint32_t bitsIndex(float bits)
+{
+    uint32_t index;
+    memcpy(&index, &bits, sizeof(index));
+    return index;
+}
+
+// in a namespace of its own, the AVX copy would find these ones too
+//  through its arguments
+namespace baseline
+{
+#include "packetkernel.inl"
+}
+
+#if defined(SIMD_DISPATCH)
+
+// 8 rays at once, only called where the cpu has AVX
+SIMD_BEGIN_AVX
+namespace avx
+{
+
+struct WideLanes
+{
+    typedef __m256 Value;
+    typedef __m256 Mask;
+    enum { width = 8 };
+
+    static Value load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, Value v) { _mm256_storeu_ps(p, v); }
+    static Value set1(float v) { return _mm256_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm256_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+    static Value div(Value a, Value b) { return _mm256_div_ps(a, b); }
+    static Value min(Value a, Value b) { return _mm256_min_ps(a, b); }
+    static Value max(Value a, Value b) { return _mm256_max_ps(a, b); }
+    static Value abs(Value a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static Value select(Mask m, Value a, Value b) { return _mm256_blendv_ps(b, a, m); }
+    static Mask lessEqual(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static Mask less(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+};
+
+#include "packetkernel.inl"
+
+}
+SIMD_END
+
+#endif
+
+void setPacketRay(RayPacket &packet, unsigned int i, const Ray &ray)
+{
+    packet.originX[i] = ray.origin.x;
+    packet.originY[i] = ray.origin.y;
+    packet.originZ[i] = ray.origin.z;
+    packet.directionX[i] = ray.direction.x;
+    packet.directionY[i] = ray.direction.y;
+    packet.directionZ[i] = ray.direction.z;
+    packet.tMax[i] = ray.tMax;
+}
+
+void intersectPacket(const BVH &bvh, const RayPacket &packet, RayHit hits[rayPacketSize])
+{
+    // the unused lanes are rays that cannot hit anything
+    RayPacket padded;
+    const RayPacket* rays = &packet;
+    if (packet.count < rayPacketSize)
+    {
+        padded = packet;
+        for (unsigned int i = packet.count; i < rayPacketSize; i++)
+        {
+            Ray none = { glm::vec3(0.f), glm::vec3(1.f), -1.f };
+            setPacketRay(padded, i, none);
+        }
+        rays = &padded;
+    }
+
+    PacketState state;
+    for (unsigned int i = 0; i < rayPacketSize; i++)
+    {
+        state.inverseX[i] = 1.f / rays->directionX[i];
+        state.inverseY[i] = 1.f / rays->directionY[i];
+        state.inverseZ[i] = 1.f / rays->directionZ[i];
+        state.t[i] = rays->tMax[i];
+        state.u[i] = state.v[i] = 0.f;
+        state.triangle[i] = indexBits(noTriangle);
+    }
+
+    SIMDLevel level = simdLevel();
+#if defined(SIMD_DISPATCH)
+    if (level >= SIMD_AVX)
+    {
+        avx::packetTraverse<avx::WideLanes>(bvh, *rays, state);
+    }
+    else
+#endif
+    if (level >= SIMD_SSE2)
+    {
+        baseline::packetTraverse<WideLanes>(bvh, *rays, state);
+    }
+    else
+    {
+        baseline::packetTraverse<ScalarLanes>(bvh, *rays, state);
+    }
+
+    for (unsigned int i = 0; i < rayPacketSize; i++)
+    {
+        uint32_t triangle = bitsIndex(state.triangle[i]);
+        hits[i].t = state.t[i];
+        hits[i].u = state.u[i];
+        hits[i].v = state.v[i];
+        hits[i].triangle = triangle == noTriangle ? noTriangle : bvh.triangles[triangle];
+    }
+}
+
+Ray screenRay(const glm::mat4 &view, const glm::mat4 &projection, float x, float y)
+{
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.f, 1.f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.f, 1.f);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    Ray ray;
+    ray.origin = glm::vec3(nearPoint);
+    ray.direction = glm::normalize(glm::vec3(farPoint) - ray.origin);
+    ray.tMax = glm::length(glm::vec3(farPoint) - ray.origin);
+    return ray;
+}
+
+RayBenchmark benchmarkRays(
+    const BVH &bvh,
+    const glm::mat4 &view,
+    const glm::mat4 &projection,
+    unsigned int width,
+    unsigned int height,
+    unsigned int threadCount
+)
+{
+    PROFILE_SCOPE("benchmarkRays");
+
+    // the rays of every pixel center, rows of rayPacketSize neighbours
+    unsigned int packetsPerRow = (width + rayPacketSize - 1) / rayPacketSize;
+    std::vector<RayPacket> packets(packetsPerRow * height);
+    parallelFor(height, 16, [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; y++)
+        {
+            for (unsigned int p = 0; p < packetsPerRow; p++)
+            {
+                RayPacket &packet = packets[y * packetsPerRow + p];
+                packet.count = std::min(rayPacketSize, width - p * rayPacketSize);
+                for (unsigned int i = 0; i < packet.count; i++)
+                {
+                    unsigned int x = p * rayPacketSize + i;
+                    Ray ray = screenRay(view, projection,
+                        2.f * (x + 0.5f) / width - 1.f, 2.f * (y + 0.5f) / height - 1.f);
+                    setPacketRay(packet, i, ray);
+                }
+            }
+        }
+    }, threadCount);
+
+    RayBenchmark result;
+    result.rays = width * height;
+
+    std::atomic<unsigned int> hits(0);
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(packets.size(), 256, [&](size_t begin, size_t end)
+    {
+        unsigned int found = 0;
+        for (size_t p = begin; p < end; p++)
+        {
+            const RayPacket &packet = packets[p];
+            for (unsigned int i = 0; i < packet.count; i++)
+            {
+                Ray ray = {
+                    glm::vec3(packet.originX[i], packet.originY[i], packet.originZ[i]),
+                    glm::vec3(packet.directionX[i], packet.directionY[i], packet.directionZ[i]),
+                    packet.tMax[i]
+                };
+                RayHit hit;
+                found += intersectRay(bvh, ray, hit) ? 1 : 0;
+            }
+        }
+        hits += found;
+    }, threadCount);
+    double single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.hits = hits;
+
+    start = std::chrono::steady_clock::now();
+    parallelFor(packets.size(), 256, [&](size_t begin, size_t end)
+    {
+        RayHit packetHits[rayPacketSize];
+        for (size_t p = begin; p < end; p++)
+        {
+            intersectPacket(bvh, packets[p], packetHits);
+        }
+    }, threadCount);
+    double packet = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.singleMrays = single > 0.0 ? result.rays / single * 1e-6 : 0.0;
+    result.packetMrays = packet > 0.0 ? result.rays / packet * 1e-6 : 0.0;
+    return result;
+}
@@ -1,4 +1,5 @@
 #include "common/controls.hpp"
+#include "common/profiler.hpp"
 
 extern GLFWwindow* window;
 
@@ -28,8 +29,59 @@ float speed = 3.f;  // 3 units per second
 float mouseSpeed = 0.005f;
 
 
+// the camera's frame from its angles
+static void cameraAxes(glm::vec3 &direction, glm::vec3 &right, glm::vec3 &up)
+{
+    // direction : spherical coord to cartesian coord conversion
+    direction = glm::vec3(
+        cos(verticalAngle) * sin(horizontalAngle),
+        sin(verticalAngle),
+        cos(verticalAngle) * cos(horizontalAngle)
+    );
+
+    // right vector
+    right = glm::vec3(
+        sin(horizontalAngle - 3.14f/2.f),
+        0,                                  // always horizontal
+        cos(horizontalAngle - 3.14f/2.f)
+    );
+
+    // up vector
+    up = glm::cross(right, direction);
+}
+
+static void updateMatrices(const glm::vec3 &direction, const glm::vec3 &up, float aspectRatio)
+{
+    // Now GLFW3 requires setting a callback for this
+    float FoV = initialFoV;
+
+    // projection matrix : 45˚ FoV, display range : 0.1 unit <-> 100 units
+    ProjectionMatrix = glm::perspective(
+        glm::radians(FoV),  // fovy
+        aspectRatio,        // aspect ratio
+        0.1f,               // near
+        100.f               // far
+    );
+
+    // camera matrix
+    ViewMatrix = glm::lookAt(
+        position,               // camera is here
+        position + direction,   // and looks here
+        up                      // head is up
+    );
+}
+
+void computeMatricesFromCamera(float aspectRatio)
+{
+    PROFILE_SCOPE("computeMatricesFromCamera");
+    glm::vec3 direction, right, up;
+    cameraAxes(direction, right, up);
+    updateMatrices(direction, up, aspectRatio);
+}
+
 void computeMatricesFromInputs()
 {
+    PROFILE_SCOPE("computeMatricesFromInputs");
     // glfwGetTime is called only once, the first time this function is called
     static double lastTime = glfwGetTime();
 
@@ -48,22 +100,8 @@ void computeMatricesFromInputs()
     horizontalAngle += mouseSpeed * float(1024/2 - xpos);
     verticalAngle   += mouseSpeed * float( 768/2 - ypos);
 
-    // direction : spherical coord to cartesian coord conversion
-    glm::vec3 direction(
-        cos(verticalAngle) * sin(horizontalAngle),
-        sin(verticalAngle),
-        cos(verticalAngle) * cos(horizontalAngle)
-    );
-
-    // right vector
-    glm::vec3 right = glm::vec3(
-        sin(horizontalAngle - 3.14f/2.f),
-        0,                                  // always horizontal
-        cos(horizontalAngle - 3.14f/2.f)
-    );
-
-    // up vector
-    glm::vec3 up = glm::cross(right, direction);
+    glm::vec3 direction, right, up;
+    cameraAxes(direction, right, up);
 
     // move forward
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
@@ -90,24 +128,29 @@ void computeMatricesFromInputs()
         position -= up * deltaTime * speed;
     }
 
-    // Now GLFW3 requires setting a callback for this
-    float FoV = initialFoV;
-
-    // projection matrix : 45˚ FoV, 4:3 ratio, display range : 0.1 unit <-> 100 units
-    ProjectionMatrix = glm::perspective(
-        glm::radians(FoV),  // fovy
-        4.f / 3.f,          // aspect ratio
-        0.1f,               // near
-        100.f               // far
-    );
-
-    // camera matrix
-    ViewMatrix = glm::lookAt(
-        position,               // camera is here
-        position + direction,   // and looks here
-        up                      // head is up
-    );
+    updateMatrices(direction, up, 4.f / 3.f);
 
     // for the next frame, the last time will be now
     lastTime = currentTime;
-}
\ No newline at end of file
+}
+void computeCursorRay(glm::vec3 &origin, glm::vec3 &direction)
+{
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double xpos = width / 2.0;
+    double ypos = height / 2.0;
+    if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+    {
+        glfwGetCursorPos(window, &xpos, &ypos);
+    }
+
+    // window coordinates go down from the top left corner
+    float x = width > 0 ? float(2.0 * xpos / width - 1.0) : 0.f;
+    float y = height > 0 ? float(1.0 - 2.0 * ypos / height) : 0.f;
+
+    glm::mat4 inverse = glm::inverse(ProjectionMatrix * ViewMatrix);
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.f, 1.f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.f, 1.f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
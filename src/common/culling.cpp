@@ -0,0 +1,211 @@
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+#include "common/simd.hpp"
+#include "common/culling.hpp"
+
+// boxes handled by one parallel block, a multiple of cullBatchSize
+static const size_t cullBlockSize = 4 * 1024;
+
+Frustum extractFrustum(const glm::mat4 &viewProjection)
+{
+    // rows of the matrix, glm is column major
+    glm::vec4 rows[4];
+    for (unsigned int r = 0; r < 4; r++)
+    {
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+    }
+
+    // -w <= x, y, z <= w in clip space
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // left
+    frustum.planes[1] = rows[3] - rows[0];  // right
+    frustum.planes[2] = rows[3] + rows[1];  // bottom
+    frustum.planes[3] = rows[3] - rows[1];  // top
+    frustum.planes[4] = rows[3] + rows[2];  // near
+    frustum.planes[5] = rows[3] - rows[2];  // far
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        float length = glm::length(glm::vec3(frustum.planes[i]));
+        if (length > 0.f)
+        {
+            frustum.planes[i] /= length;
+        }
+    }
+    return frustum;
+}
+
+void resizeBounds(BoundsSoA &bounds, size_t count)
+{
+    size_t padded = (count + cullBatchSize - 1) / cullBatchSize * cullBatchSize;
+    bounds.centerX.resize(padded, 0.f);
+    bounds.centerY.resize(padded, 0.f);
+    bounds.centerZ.resize(padded, 0.f);
+    bounds.extentX.resize(padded, 0.f);
+    bounds.extentY.resize(padded, 0.f);
+    bounds.extentZ.resize(padded, 0.f);
+    bounds.count = count;
+}
+
+void setBounds(BoundsSoA &bounds, size_t i, const glm::vec3 &center, const glm::vec3 &extent)
+{
+    bounds.centerX[i] = center.x;
+    bounds.centerY[i] = center.y;
+    bounds.centerZ[i] = center.z;
+    bounds.extentX[i] = extent.x;
+    bounds.extentY[i] = extent.y;
+    bounds.extentZ[i] = extent.z;
+}
+
+void copyBounds(BoundsSoA &bounds, size_t from, size_t to)
+{
+    bounds.centerX[to] = bounds.centerX[from];
+    bounds.centerY[to] = bounds.centerY[from];
+    bounds.centerZ[to] = bounds.centerZ[from];
+    bounds.extentX[to] = bounds.extentX[from];
+    bounds.extentY[to] = bounds.extentY[from];
+    bounds.extentZ[to] = bounds.extentZ[from];
+}
+
+void transformBox(
+    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model,
+    glm::vec3 &center, glm::vec3 &extent
+)
+{
+    glm::vec3 localCenter = 0.5f * (boundsMin + boundsMax);
+    glm::vec3 localExtent = 0.5f * (boundsMax - boundsMin);
+    center = glm::vec3(model * glm::vec4(localCenter, 1.f));
+    // each axis of the new box gets the absolute contribution of every
+    //  transformed local axis
+    glm::mat3 linear = glm::mat3(model);
+    for (unsigned int r = 0; r < 3; r++)
+    {
+        extent[r] = fabsf(linear[0][r]) * localExtent.x +
+                    fabsf(linear[1][r]) * localExtent.y +
+                    fabsf(linear[2][r]) * localExtent.z;
+    }
+}
+
+//
+// lanes : a few boxes side by side, one float per box
+//  the kernel below is written once against this interface
+
+struct ScalarLanes
+{
+    typedef float Value;
+    enum { width = 1 };
+
+    static Value load(const float* p) { return *p; }
+    static Value set1(float v) { return v; }
+    static Value add(Value a, Value b) { return a + b; }
+    static Value mul(Value a, Value b) { return a * b; }
+    // bit k set when lane k of v is below 0
+    static unsigned int negativeMask(Value v) { return v < 0.f ? 1u : 0u; }
+};
+
+#if defined(__SSE2__)
+
+struct WideLanes
+{
+    typedef __m128 Value;
+    enum { width = 4 };
+
+    static Value load(const float* p) { return _mm_loadu_ps(p); }
+    static Value set1(float v) { return _mm_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+    static unsigned int negativeMask(Value v)
+    {
+        return (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(v, _mm_setzero_ps()));
+    }
+};
+
+#else
+
+// no vector unit the compiler targets
+typedef ScalarLanes WideLanes;
+
+#endif
+
+#include "cullkernel.inl"
+
+#if defined(SIMD_DISPATCH)
+
+// 8 boxes at once, only called where the cpu has AVX
+SIMD_BEGIN_AVX
+namespace avx
+{
+
+struct WideLanes
+{
+    typedef __m256 Value;
+    enum { width = 8 };
+
+    static Value load(const float* p) { return _mm256_loadu_ps(p); }
+    static Value set1(float v) { return _mm256_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm256_add_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+    static unsigned int negativeMask(Value v)
+    {
+        return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+};
+
+#include "cullkernel.inl"
+
+}
+SIMD_END
+
+#endif
+
+CullStats cullBounds(
+    const BoundsSoA &bounds,
+    const Frustum &frustum,
+    std::vector<unsigned char> &visible,
+    WorkerPool* workers
+)
+{
+    PROFILE_SCOPE("cullBounds");
+    visible.resize(bounds.count);
+
+    std::atomic<unsigned int> visibleCount(0);
+    SIMDLevel level = simdLevel();
+    auto cullBlock = [&](size_t begin, size_t end)
+    {
+#if defined(SIMD_DISPATCH)
+        if (level >= SIMD_AVX)
+        {
+            visibleCount += avx::cullRange<avx::WideLanes>(bounds, frustum, visible.data(), begin, end);
+            return;
+        }
+#endif
+        if (level >= SIMD_SSE2)
+        {
+            visibleCount += cullRange<WideLanes>(bounds, frustum, visible.data(), begin, end);
+        }
+        else
+        {
+            visibleCount += cullRange<ScalarLanes>(bounds, frustum, visible.data(), begin, end);
+        }
+    };
+    if (workers)
+    {
+        parallelFor(*workers, bounds.count, cullBlockSize, cullBlock);
+    }
+    else
+    {
+        cullBlock(0, bounds.count);
+    }
+
+    CullStats stats;
+    stats.visible = visibleCount;
+    stats.culled = (unsigned int)bounds.count - stats.visible;
+    return stats;
+}
@@ -0,0 +1,56 @@
+// culling kernel against a lanes type, see culling.cpp
+//  included there once for the baseline lanes and once more inside an AVX
+//  region, so no include guard and no includes of its own
+
+// boxes [begin, end), begin a multiple of the lane width ; the last lanes
+//  may read past end, into the padding ; returns the visible ones
+template <typename L>
+static unsigned int cullRange(
+    const BoundsSoA &bounds, const Frustum &frustum,
+    unsigned char* visible, size_t begin, size_t end)
+{
+    // the planes and their absolute normals, broadcast once
+    typename L::Value nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (unsigned int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = frustum.planes[p];
+        nx[p] = L::set1(plane.x);
+        ny[p] = L::set1(plane.y);
+        nz[p] = L::set1(plane.z);
+        nw[p] = L::set1(plane.w);
+        ax[p] = L::set1(fabsf(plane.x));
+        ay[p] = L::set1(fabsf(plane.y));
+        az[p] = L::set1(fabsf(plane.z));
+    }
+
+    unsigned int count = 0;
+    for (size_t i = begin; i < end; i += L::width)
+    {
+        typename L::Value cx = L::load(&bounds.centerX[i]);
+        typename L::Value cy = L::load(&bounds.centerY[i]);
+        typename L::Value cz = L::load(&bounds.centerZ[i]);
+        typename L::Value ex = L::load(&bounds.extentX[i]);
+        typename L::Value ey = L::load(&bounds.extentY[i]);
+        typename L::Value ez = L::load(&bounds.extentZ[i]);
+
+        // outside as soon as the box is entirely behind one plane :
+        //  distance of the center + projected radius < 0
+        unsigned int outside = 0;
+        for (unsigned int p = 0; p < 6; p++)
+        {
+            typename L::Value distance = L::add(L::add(L::mul(nx[p], cx), L::mul(ny[p], cy)),
+                                                L::add(L::mul(nz[p], cz), nw[p]));
+            typename L::Value radius = L::add(L::add(L::mul(ax[p], ex), L::mul(ay[p], ey)), L::mul(az[p], ez));
+            outside |= L::negativeMask(L::add(distance, radius));
+        }
+
+        size_t lanes = std::min<size_t>(L::width, bounds.count - i);
+        for (size_t k = 0; k < lanes; k++)
+        {
+            unsigned char inside = (outside >> k) & 1 ? 0 : 1;
+            visible[i + k] = inside;
+            count += inside;
+        }
+    }
+    return count;
+}
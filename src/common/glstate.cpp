@@ -0,0 +1,356 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "common/glstate.hpp"
+
+// a shadow value GL can't have : the next call always goes through
+static const GLuint unknownName = 0xffffffffu;
+
+// texture units and attribute arrays beyond these are passed through
+static const unsigned int trackedTextureUnits = 32;
+static const unsigned int trackedAttributes = 32;
+
+static const GLenum trackedTextureTargets[] = {
+    GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER
+};
+static const unsigned int textureTargetCount = sizeof(trackedTextureTargets) / sizeof(GLenum);
+
+// GL_ELEMENT_ARRAY_BUFFER is not here, it belongs to the vertex array
+static const GLenum trackedBufferTargets[] = {
+    GL_ARRAY_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_PACK_BUFFER, GL_UNIFORM_BUFFER,
+    GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_TEXTURE_BUFFER
+};
+static const unsigned int bufferTargetCount = sizeof(trackedBufferTargets) / sizeof(GLenum);
+
+static const GLenum trackedCapabilities[] = {
+    GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+    GL_POLYGON_OFFSET_FILL, GL_MULTISAMPLE, GL_FRAMEBUFFER_SRGB, GL_PRIMITIVE_RESTART
+};
+static const unsigned int capabilityCount = sizeof(trackedCapabilities) / sizeof(GLenum);
+
+// what a vertex array object holds
+struct VertexArrayState
+{
+    GLuint elementBuffer;
+    uint32_t known;             // attribute arrays whose state is known
+    uint32_t enabled;
+};
+
+struct GLState
+{
+    GLuint program;
+    GLuint activeUnit;
+    GLuint textures[trackedTextureUnits][textureTargetCount];
+    GLuint buffers[bufferTargetCount];
+    GLuint vertexArray;
+    std::unordered_map<GLuint, VertexArrayState> vertexArrays;
+    int capabilities[capabilityCount];      // -1 unknown, 0 disabled, 1 enabled
+    GLenum blendSource;
+    GLenum blendDestination;
+
+    GLStateStats stats;
+};
+
+static GLState state;
+
+static int findTarget(const GLenum* targets, unsigned int count, GLenum target)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (targets[i] == target)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// the shadow of the vertex array bound now, NULL while it is unknown
+static VertexArrayState* currentVertexArray()
+{
+    if (state.vertexArray == unknownName)
+    {
+        return NULL;
+    }
+    std::unordered_map<GLuint, VertexArrayState>::iterator found = state.vertexArrays.find(state.vertexArray);
+    if (found == state.vertexArrays.end())
+    {
+        VertexArrayState unknown = { unknownName, 0, 0 };
+        found = state.vertexArrays.insert(std::make_pair(state.vertexArray, unknown)).first;
+    }
+    return &found->second;
+}
+
+// true when value differs from the shadow, which then takes it
+template <typename T>
+static bool changes(T &shadow, T value)
+{
+    if (shadow == value)
+    {
+        state.stats.skipped++;
+        return false;
+    }
+    shadow = value;
+    state.stats.issued++;
+    return true;
+}
+
+void resetGLState()
+{
+    state.program = unknownName;
+    state.activeUnit = unknownName;
+    for (unsigned int unit = 0; unit < trackedTextureUnits; unit++)
+    {
+        for (unsigned int target = 0; target < textureTargetCount; target++)
+        {
+            state.textures[unit][target] = unknownName;
+        }
+    }
+    for (unsigned int target = 0; target < bufferTargetCount; target++)
+    {
+        state.buffers[target] = unknownName;
+    }
+    state.vertexArray = unknownName;
+    state.vertexArrays.clear();
+    for (unsigned int i = 0; i < capabilityCount; i++)
+    {
+        state.capabilities[i] = -1;
+    }
+    state.blendSource = unknownName;
+    state.blendDestination = unknownName;
+}
+
+// everything unknown before the first call
+static const bool stateInitialized = (resetGLState(), true);
+
+void useProgram(GLuint program)
+{
+    if (changes(state.program, program))
+    {
+        glUseProgram(program);
+    }
+}
+
+void activeTexture(GLuint unit)
+{
+    if (changes(state.activeUnit, unit))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+}
+
+void bindTexture(GLenum target, GLuint texture)
+{
+    int slot = findTarget(trackedTextureTargets, textureTargetCount, target);
+    if (slot < 0 || state.activeUnit >= trackedTextureUnits)
+    {
+        // untracked, and whatever it replaced is unknown now
+        if (slot >= 0)
+        {
+            for (unsigned int unit = 0; unit < trackedTextureUnits; unit++)
+            {
+                state.textures[unit][slot] = unknownName;
+            }
+        }
+        state.stats.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (changes(state.textures[state.activeUnit][slot], texture))
+    {
+        glBindTexture(target, texture);
+    }
+}
+
+void bindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+{
+    int slot = findTarget(trackedTextureTargets, textureTargetCount, target);
+    // don't switch units for nothing
+    if (slot >= 0 && unit < trackedTextureUnits && state.textures[unit][slot] == texture)
+    {
+        state.stats.skipped++;
+        return;
+    }
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void bindBuffer(GLenum target, GLuint buffer)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        VertexArrayState* vertexArray = currentVertexArray();
+        if (vertexArray == NULL)
+        {
+            state.stats.issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+        if (changes(vertexArray->elementBuffer, buffer))
+        {
+            glBindBuffer(target, buffer);
+        }
+        return;
+    }
+
+    int slot = findTarget(trackedBufferTargets, bufferTargetCount, target);
+    if (slot < 0)
+    {
+        state.stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (changes(state.buffers[slot], buffer))
+    {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void bindVertexArray(GLuint vertexArray)
+{
+    if (changes(state.vertexArray, vertexArray))
+    {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+static void setVertexAttribArray(GLuint index, bool enabled)
+{
+    VertexArrayState* vertexArray = currentVertexArray();
+    if (vertexArray != NULL && index < trackedAttributes)
+    {
+        uint32_t bit = 1u << index;
+        if ((vertexArray->known & bit) && ((vertexArray->enabled & bit) != 0) == enabled)
+        {
+            state.stats.skipped++;
+            return;
+        }
+        vertexArray->known |= bit;
+        vertexArray->enabled = enabled ? vertexArray->enabled | bit : vertexArray->enabled & ~bit;
+    }
+    state.stats.issued++;
+    if (enabled)
+    {
+        glEnableVertexAttribArray(index);
+    }
+    else
+    {
+        glDisableVertexAttribArray(index);
+    }
+}
+
+void enableVertexAttribArray(GLuint index)
+{
+    setVertexAttribArray(index, true);
+}
+
+void disableVertexAttribArray(GLuint index)
+{
+    setVertexAttribArray(index, false);
+}
+
+void setCapability(GLenum capability, bool enabled)
+{
+    int slot = findTarget(trackedCapabilities, capabilityCount, capability);
+    if (slot < 0 || changes(state.capabilities[slot], enabled ? 1 : 0))
+    {
+        if (slot < 0)
+        {
+            state.stats.issued++;
+        }
+        if (enabled)
+        {
+            glEnable(capability);
+        }
+        else
+        {
+            glDisable(capability);
+        }
+    }
+}
+
+void blendFunc(GLenum source, GLenum destination)
+{
+    if (state.blendSource == source && state.blendDestination == destination)
+    {
+        state.stats.skipped++;
+        return;
+    }
+    state.blendSource = source;
+    state.blendDestination = destination;
+    state.stats.issued++;
+    glBlendFunc(source, destination);
+}
+
+void deleteProgram(GLuint program)
+{
+    // a program in use is only deleted once it is not anymore, nothing to forget
+    glDeleteProgram(program);
+}
+
+void deleteTextures(GLsizei count, const GLuint* textures)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (unsigned int unit = 0; unit < trackedTextureUnits; unit++)
+        {
+            for (unsigned int target = 0; target < textureTargetCount; target++)
+            {
+                if (state.textures[unit][target] == textures[i])
+                {
+                    state.textures[unit][target] = 0;
+                }
+            }
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
+void deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (unsigned int target = 0; target < bufferTargetCount; target++)
+        {
+            if (state.buffers[target] == buffers[i])
+            {
+                state.buffers[target] = 0;
+            }
+        }
+        // GL only detaches it from the bound vertex array
+        std::unordered_map<GLuint, VertexArrayState>::iterator it;
+        for (it = state.vertexArrays.begin(); it != state.vertexArrays.end(); ++it)
+        {
+            if (it->second.elementBuffer == buffers[i])
+            {
+                it->second.elementBuffer = it->first == state.vertexArray ? 0 : unknownName;
+            }
+        }
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        if (state.vertexArray == vertexArrays[i])
+        {
+            state.vertexArray = 0;
+        }
+        state.vertexArrays.erase(vertexArrays[i]);
+    }
+    glDeleteVertexArrays(count, vertexArrays);
+}
+
+GLStateStats glStateStats()
+{
+    return state.stats;
+}
+
+void resetGLStateStats()
+{
+    state.stats.issued = 0;
+    state.stats.skipped = 0;
+}
@@ -0,0 +1,40 @@
+#include <string.h>
+
+#include "common/hash.hpp"
+
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hashFileContent(const char* data, size_t size)
+{
+    // four independent lanes of 8-byte words keep the multipliers busy
+    uint64_t lanes[4] = {
+        0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+        0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL ^ size
+    };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * k, sizeof(word));
+            lanes[k] = (lanes[k] ^ (word * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+            lanes[k] = (lanes[k] << 31) | (lanes[k] >> 33);
+        }
+    }
+
+    uint64_t h = mix64(lanes[0]) ^ mix64(lanes[1] + 1) ^ mix64(lanes[2] + 2) ^ mix64(lanes[3] + 3);
+    for (; i < size; i++)
+    {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return mix64(h);
+}
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "common/image.hpp"
+#include "common/profiler.hpp"
+
+// DDS fourCC codes
+static const uint32_t FOURCC_DXT1 = 0x31545844;     // "DXT1"
+static const uint32_t FOURCC_DXT3 = 0x33545844;     // "DXT3"
+static const uint32_t FOURCC_DXT5 = 0x35545844;     // "DXT5"
+static const uint32_t FOURCC_ATI2 = 0x32495441;     // "ATI2"
+static const uint32_t FOURCC_BC5U = 0x55354342;     // "BC5U"
+
+// DDS_HEADER flags : caps, height, width, pixel format, mip count, linear size
+static const uint32_t ddsHeaderFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+// DDS_PIXELFORMAT flags : fourCC
+static const uint32_t ddsPixelFormatFourCC = 0x4;
+// dwCaps : texture, mipmap, complex
+static const uint32_t ddsCaps = 0x1000 | 0x400000 | 0x8;
+
+// magic + DDS_HEADER
+//  https://msdn.microsoft.com/en-us/library/bb943982.aspx
+static const size_t ddsHeaderSize = 4 + 124;
+
+// little endian fields of file headers, whatever their alignment
+static inline uint32_t readU32(const char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void writeU32(char* p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint16_t readU16(const char* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool isCompressedFormat(ImageFormat format)
+{
+    return format != IMAGE_BGR8 && format != IMAGE_RGBA8;
+}
+
+size_t imageLevelSize(ImageFormat format, unsigned int width, unsigned int height)
+{
+    switch (format)
+    {
+    case IMAGE_BGR8:
+        // rows are padded to 4 bytes
+        return (((size_t)width * 3 + 3) & ~(size_t)3) * height;
+    case IMAGE_RGBA8:
+        return (size_t)width * height * 4;
+    case IMAGE_BC1:
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+    case IMAGE_BC2:
+    case IMAGE_BC3:
+    case IMAGE_BC5:
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+    }
+    return 0;
+}
+
+bool decodeDDS(const char* data, size_t size, Image &image)
+{
+    image.levels.clear();
+    if (size < ddsHeaderSize || strncmp(data, "DDS ", 4) != 0)
+    {
+        printf("Not a correct DDS file\n");
+        return false;
+    }
+
+    const char* header = data + 4;
+    unsigned int height      = readU32(header + 8);
+    unsigned int width       = readU32(header + 12);
+    unsigned int mipMapCount = readU32(header + 24);
+    uint32_t fourCC          = readU32(header + 80);     // in DDS_PIXELFORMAT
+
+    switch (fourCC)
+    {
+    case FOURCC_DXT1:
+        image.format = IMAGE_BC1;
+        break;
+    case FOURCC_DXT3:
+        image.format = IMAGE_BC2;
+        break;
+    case FOURCC_DXT5:
+        image.format = IMAGE_BC3;
+        break;
+    case FOURCC_ATI2:
+    case FOURCC_BC5U:
+        image.format = IMAGE_BC5;
+        break;
+    default:
+        printf("No known format\n");
+        return false;
+    }
+    if (width == 0 || height == 0)
+    {
+        printf("Empty DDS image\n");
+        return false;
+    }
+
+    image.width = width;
+    image.height = height;
+    image.rowAlignment = 1;
+    if (mipMapCount == 0)
+    {
+        mipMapCount = 1;
+    }
+
+    // every level straight from the mapping, sized from the block layout
+    size_t offset = ddsHeaderSize;
+    for (unsigned int level = 0; level < mipMapCount; level++)
+    {
+        size_t levelSize = imageLevelSize(image.format, width, height);
+        if (levelSize > size - offset)
+        {
+            printf("DDS file is truncated, keeping %u of %u levels\n",
+                (unsigned int)image.levels.size(), mipMapCount);
+            break;
+        }
+
+        ImageLevel view = { width, height, levelSize, (const unsigned char*)data + offset };
+        image.levels.push_back(view);
+        offset += levelSize;
+
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+        // deal with non-power-of-two textures
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return !image.levels.empty();
+}
+
+bool decodeBMP(const char* data, size_t size, Image &image)
+{
+    image.levels.clear();
+
+    // a BMP file always begins with "BM" and a 54-bytes header
+    //  check https://en.wikipedia.org/wiki/BMP_file_format#Bitmap_file_header
+    if (size < 54 || data[0] != 'B' || data[1] != 'M')
+    {
+        printf("Not a correct BMP file (1)\n");
+        return false;
+    }
+    // make sure this is an uncompressed 24 bpp file
+    if (readU32(data + 0x1E) != 0)
+    {
+        printf("Not a correct BMP file (2)\n");
+        return false;
+    }
+    if (readU16(data + 0x1C) != 24)
+    {
+        printf("Not a correct BMP file (3)\n");
+        return false;
+    }
+
+    // read the information about the image
+    size_t dataPos = readU32(data + 0x0A);                  // offset, i.e. starting address
+    unsigned int width = readU32(data + 0x12);              // bitmap width in pixel
+    int32_t height = (int32_t)readU32(data + 0x16);         // bitmap height in pixel
+    if (dataPos == 0)
+    {
+        dataPos = 54;   // BMP header is done that way
+    }
+    // top-down bitmaps would come out upside down
+    if (width == 0 || height <= 0)
+    {
+        printf("Not a correct BMP file (4)\n");
+        return false;
+    }
+
+    image.format = IMAGE_BGR8;
+    image.width = width;
+    image.height = (unsigned int)height;
+    image.rowAlignment = 4;
+
+    // rows are bottom-up, as OpenGL expects them
+    size_t levelSize = imageLevelSize(IMAGE_BGR8, image.width, image.height);
+    if (dataPos > size || levelSize > size - dataPos)
+    {
+        printf("BMP file is truncated\n");
+        return false;
+    }
+    ImageLevel view = { image.width, image.height, levelSize, (const unsigned char*)data + dataPos };
+    image.levels.push_back(view);
+    return true;
+}
+
+bool loadImage(const char* path, Image &image)
+{
+    PROFILE_SCOPE_DETAIL("loadImage", path);
+    printf("Reading image %s\n", path);
+    image.levels.clear();
+    image.storage.clear();
+    if (!mapFile(path, image.file))
+    {
+        printf("%s could not be opened. Are you in the right directory?\n", path);
+        return false;
+    }
+
+    bool res;
+    if (image.file.size >= 4 && strncmp(image.file.data, "DDS ", 4) == 0)
+    {
+        res = decodeDDS(image.file.data, image.file.size, image);
+    }
+    else
+    {
+        res = decodeBMP(image.file.data, image.file.size, image);
+    }
+
+    if (!res)
+    {
+        freeImage(image);
+    }
+    return res;
+}
+
+bool saveDDS(const char* path, const Image &image)
+{
+    uint32_t fourCC;
+    switch (image.format)
+    {
+    case IMAGE_BC1:
+        fourCC = FOURCC_DXT1;
+        break;
+    case IMAGE_BC2:
+        fourCC = FOURCC_DXT3;
+        break;
+    case IMAGE_BC3:
+        fourCC = FOURCC_DXT5;
+        break;
+    case IMAGE_BC5:
+        fourCC = FOURCC_ATI2;
+        break;
+    default:
+        printf("Only compressed images can be saved as DDS\n");
+        return false;
+    }
+    if (image.levels.empty())
+    {
+        return false;
+    }
+
+    char header[ddsHeaderSize];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "DDS ", 4);
+    char* h = header + 4;
+    writeU32(h + 0, 124);                                   // dwSize
+    writeU32(h + 4, ddsHeaderFlags);
+    writeU32(h + 8, image.height);
+    writeU32(h + 12, image.width);
+    writeU32(h + 16, (uint32_t)image.levels[0].size);       // dwPitchOrLinearSize
+    writeU32(h + 24, (uint32_t)image.levels.size());        // dwMipMapCount
+    writeU32(h + 72, 32);                                   // DDS_PIXELFORMAT dwSize
+    writeU32(h + 76, ddsPixelFormatFourCC);
+    writeU32(h + 80, fourCC);
+    writeU32(h + 104, ddsCaps);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("%s could not be written\n", path);
+        return false;
+    }
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (unsigned int level = 0; ok && level < image.levels.size(); level++)
+    {
+        const ImageLevel &view = image.levels[level];
+        ok = fwrite(view.data, 1, view.size, file) == view.size;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        printf("%s could not be written\n", path);
+        remove(path);
+    }
+    return ok;
+}
+
+bool savePPM(const char* path, const unsigned char* rgb, unsigned int width, unsigned int height)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("%s could not be written\n", path);
+        return false;
+    }
+    size_t size = (size_t)width * height * 3;
+    bool ok = fprintf(file, "P6\n%u %u\n255\n", width, height) > 0;
+    ok = ok && fwrite(rgb, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        printf("%s could not be written\n", path);
+        remove(path);
+    }
+    return ok;
+}
+
+bool convertToRGBA8(const Image &image, std::vector<unsigned char> &out)
+{
+    if (image.levels.empty() || isCompressedFormat(image.format))
+    {
+        return false;
+    }
+    const ImageLevel &level = image.levels[0];
+    if (image.format == IMAGE_RGBA8)
+    {
+        out.assign(level.data, level.data + level.size);
+        return true;
+    }
+
+    size_t pitch = imageLevelSize(IMAGE_BGR8, level.width, 1);
+    out.resize((size_t)level.width * level.height * 4);
+    for (unsigned int y = 0; y < level.height; y++)
+    {
+        const unsigned char* src = level.data + y * pitch;
+        unsigned char* dst = &out[(size_t)y * level.width * 4];
+        for (unsigned int x = 0; x < level.width; x++)
+        {
+            dst[x * 4 + 0] = src[x * 3 + 2];
+            dst[x * 4 + 1] = src[x * 3 + 1];
+            dst[x * 4 + 2] = src[x * 3 + 0];
+            dst[x * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+void freeImage(Image &image)
+{
+    image.levels.clear();
+    unmapFile(image.file);
+    std::vector<unsigned char>().swap(image.storage);
+}
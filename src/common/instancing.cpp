@@ -0,0 +1,380 @@
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+
+#include "common/glstate.hpp"
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+#include "common/vertexformat.hpp"
+#include "common/instancing.hpp"
+
+// instances handled by one parallel block of selectInstanceLODs()
+static const size_t lodBlockSize = 4 * 1024;
+
+// every instance drawn from the packed buffer at level 0
+static void drawAllAtFullDetail(InstanceBuffer &instances)
+{
+    instances.drawBuffer = instances.buffer;
+    instances.drawCount = instanceCount(instances);
+    instances.lodFirst[0] = 0;
+    for (unsigned int l = 1; l <= maxMeshLODs; l++)
+    {
+        instances.lodFirst[l] = instances.drawCount;
+    }
+}
+
+void initInstanceBuffer(InstanceBuffer &instances, unsigned int capacity)
+{
+    glGenBuffers(1, &instances.buffer);
+    glGenBuffers(1, &instances.visibleBuffer);
+    instances.capacity = std::max(capacity, 1u);
+    instances.visibleCapacity = 0;
+    instances.transforms.clear();
+    instances.models.clear();
+    resizeBounds(instances.bounds, 0);
+    instances.errorScales.clear();
+    instances.lods.clear();
+    instances.localMin = instances.localMax = glm::vec3(0.f);
+    instances.handles.clear();
+    instances.slots.clear();
+    instances.freeHandles.clear();
+    instances.dirtyBegin = 0;
+    instances.dirtyEnd = 0;
+    instances.reallocate = true;
+    drawAllAtFullDetail(instances);
+    instances.attributeBuffer = 0;
+    instances.attributeFirst = 0;
+    instances.uploadedBytes = 0;
+}
+
+void destroyInstanceBuffer(InstanceBuffer &instances)
+{
+    deleteBuffers(1, &instances.buffer);
+    deleteBuffers(1, &instances.visibleBuffer);
+    instances.buffer = 0;
+    instances.visibleBuffer = 0;
+    instances.transforms.clear();
+    instances.models.clear();
+    resizeBounds(instances.bounds, 0);
+    instances.errorScales.clear();
+    instances.lods.clear();
+    instances.handles.clear();
+    instances.slots.clear();
+    instances.freeHandles.clear();
+}
+
+// the transform and the bounds of the instance in slot
+static void setInstance(InstanceBuffer &instances, unsigned int slot, const glm::mat4 &model)
+{
+    instances.models[slot] = model;
+
+    // glm is column major : row r is model[c][r] for each column c
+    InstanceTransform &transform = instances.transforms[slot];
+    for (unsigned int r = 0; r < 3; r++)
+    {
+        transform.model[r] = glm::vec4(model[0][r], model[1][r], model[2][r], model[3][r]);
+    }
+    glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(model)));
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        transform.normal[c] = normal[c];
+    }
+
+    glm::vec3 center, extent;
+    transformBox(instances.localMin, instances.localMax, model, center, extent);
+    setBounds(instances.bounds, slot, center, extent);
+
+    // errors of the mesh grow with its largest axis
+    float scale = 0.f;
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        glm::vec3 axis(model[c]);
+        scale = std::max(scale, glm::dot(axis, axis));
+    }
+    instances.errorScales[slot] = sqrtf(scale);
+}
+
+static void markDirty(InstanceBuffer &instances, unsigned int slot)
+{
+    if (instances.dirtyBegin == instances.dirtyEnd)
+    {
+        instances.dirtyBegin = slot;
+        instances.dirtyEnd = slot + 1;
+    }
+    else
+    {
+        instances.dirtyBegin = std::min(instances.dirtyBegin, slot);
+        instances.dirtyEnd = std::max(instances.dirtyEnd, slot + 1);
+    }
+}
+
+unsigned int addInstance(InstanceBuffer &instances, const glm::mat4 &model)
+{
+    unsigned int handle;
+    if (!instances.freeHandles.empty())
+    {
+        handle = instances.freeHandles.back();
+        instances.freeHandles.pop_back();
+    }
+    else
+    {
+        handle = (unsigned int)instances.slots.size();
+        instances.slots.push_back(invalidInstance);
+    }
+
+    unsigned int slot = instanceCount(instances);
+    instances.slots[handle] = slot;
+    instances.handles.push_back(handle);
+    instances.transforms.push_back(InstanceTransform());
+    instances.models.push_back(model);
+    instances.errorScales.push_back(1.f);
+    instances.lods.push_back(0);
+    resizeBounds(instances.bounds, slot + 1);
+    setInstance(instances, slot, model);
+
+    if (slot >= instances.capacity)
+    {
+        instances.reallocate = true;
+    }
+    markDirty(instances, slot);
+    return handle;
+}
+
+void removeInstance(InstanceBuffer &instances, unsigned int handle)
+{
+    if (handle >= instances.slots.size() || instances.slots[handle] == invalidInstance)
+    {
+        return;
+    }
+    unsigned int slot = instances.slots[handle];
+    unsigned int last = instanceCount(instances) - 1;
+    if (slot != last)
+    {
+        // the last instance fills the hole
+        instances.transforms[slot] = instances.transforms[last];
+        instances.models[slot] = instances.models[last];
+        instances.errorScales[slot] = instances.errorScales[last];
+        instances.lods[slot] = instances.lods[last];
+        copyBounds(instances.bounds, last, slot);
+        instances.handles[slot] = instances.handles[last];
+        instances.slots[instances.handles[slot]] = slot;
+        markDirty(instances, slot);
+    }
+    instances.transforms.pop_back();
+    instances.models.pop_back();
+    instances.errorScales.pop_back();
+    instances.lods.pop_back();
+    resizeBounds(instances.bounds, last);
+    instances.handles.pop_back();
+    instances.slots[handle] = invalidInstance;
+    instances.freeHandles.push_back(handle);
+
+    // nothing past the end needs to go
+    instances.dirtyEnd = std::min(instances.dirtyEnd, last);
+    if (instances.dirtyBegin >= instances.dirtyEnd)
+    {
+        instances.dirtyBegin = instances.dirtyEnd = 0;
+    }
+}
+
+void updateInstance(InstanceBuffer &instances, unsigned int handle, const glm::mat4 &model)
+{
+    if (handle >= instances.slots.size() || instances.slots[handle] == invalidInstance)
+    {
+        return;
+    }
+    unsigned int slot = instances.slots[handle];
+    setInstance(instances, slot, model);
+    markDirty(instances, slot);
+}
+
+void setInstanceBounds(InstanceBuffer &instances, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+    instances.localMin = boundsMin;
+    instances.localMax = boundsMax;
+    for (unsigned int slot = 0; slot < instanceCount(instances); slot++)
+    {
+        glm::vec3 center, extent;
+        transformBox(boundsMin, boundsMax, instances.models[slot], center, extent);
+        setBounds(instances.bounds, slot, center, extent);
+    }
+}
+
+// replace the content of buffer with count transforms, growing it by half
+//  again when they do not fit, so that adding one at a time stays linear
+static void specifyInstances(GLuint buffer, unsigned int &capacity, const InstanceTransform* transforms, unsigned int count)
+{
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+    while (capacity < count)
+    {
+        capacity += std::max(capacity / 2, 1u);
+    }
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceTransform), NULL, GL_DYNAMIC_DRAW);
+    if (count > 0)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceTransform), transforms);
+    }
+}
+
+void uploadInstances(InstanceBuffer &instances)
+{
+    unsigned int count = instanceCount(instances);
+    drawAllAtFullDetail(instances);
+
+    if (instances.reallocate)
+    {
+        specifyInstances(instances.buffer, instances.capacity, instances.transforms.data(), count);
+        instances.uploadedBytes += count * sizeof(InstanceTransform);
+        instances.reallocate = false;
+    }
+    else if (instances.dirtyBegin < instances.dirtyEnd)
+    {
+        unsigned int dirty = instances.dirtyEnd - instances.dirtyBegin;
+        bindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+        glBufferSubData(GL_ARRAY_BUFFER,
+            instances.dirtyBegin * sizeof(InstanceTransform),
+            dirty * sizeof(InstanceTransform),
+            &instances.transforms[instances.dirtyBegin]);
+        instances.uploadedBytes += dirty * sizeof(InstanceTransform);
+    }
+    instances.dirtyBegin = instances.dirtyEnd = 0;
+}
+
+LODSelection makeLODSelection(
+    const glm::mat4 &view, const glm::mat4 &projection, unsigned int height,
+    float threshold, float hysteresis
+)
+{
+    LODSelection selection;
+    selection.eye = glm::vec3(glm::inverse(view)[3]);
+    // projection[1][1] is 1 / tan(fov / 2) : a unit at distance 1 covers
+    //  that much of half the viewport
+    selection.pixelsPerUnit = projection[1][1] * height * 0.5f;
+    selection.threshold = threshold;
+    selection.hysteresis = hysteresis;
+    return selection;
+}
+
+void selectInstanceLODs(
+    InstanceBuffer &instances, const MeshData &mesh, const LODSelection &selection,
+    WorkerPool* workers
+)
+{
+    PROFILE_SCOPE("selectInstanceLODs");
+    const BoundsSoA &bounds = instances.bounds;
+    unsigned int lodCount = std::min(mesh.lodCount, maxMeshLODs);
+    float coarser = selection.threshold * (1.f - selection.hysteresis);
+    float finer = selection.threshold * (1.f + selection.hysteresis);
+    auto selectBlock = [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            // distance to the sphere around the box, 0 inside
+            glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+            glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+            float distance = glm::length(center - selection.eye) - glm::length(extent);
+            if (distance <= 0.f)
+            {
+                instances.lods[i] = 0;
+                continue;
+            }
+
+            // pixels covered by a unit of mesh error
+            float pixels = instances.errorScales[i] * selection.pixelsPerUnit / distance;
+            unsigned int level = std::min((unsigned int)instances.lods[i], lodCount - 1);
+            while (level + 1 < lodCount && mesh.lods[level + 1].error * pixels < coarser)
+            {
+                level++;
+            }
+            while (level > 0 && mesh.lods[level].error * pixels > finer)
+            {
+                level--;
+            }
+            instances.lods[i] = (unsigned char)level;
+        }
+    };
+    if (workers)
+    {
+        parallelFor(*workers, instanceCount(instances), lodBlockSize, selectBlock);
+    }
+    else
+    {
+        selectBlock(0, instanceCount(instances));
+    }
+}
+
+CullStats cullInstances(InstanceBuffer &instances, const Frustum &frustum, WorkerPool* workers)
+{
+    CullStats stats = cullBounds(instances.bounds, frustum, instances.visible, workers);
+
+    // the visible instances of every level
+    unsigned int count = instanceCount(instances);
+    unsigned int levelCounts[maxMeshLODs] = {};
+    for (unsigned int i = 0; i < count; i++)
+    {
+        levelCounts[instances.lods[i]] += instances.visible[i];
+    }
+    instances.lodFirst[0] = 0;
+    for (unsigned int l = 0; l < maxMeshLODs; l++)
+    {
+        instances.lodFirst[l + 1] = instances.lodFirst[l] + levelCounts[l];
+    }
+    if (stats.culled == 0 && (count == 0 || levelCounts[instances.lods[0]] == count))
+    {
+        // all of them, as they are in the buffer
+        instances.drawBuffer = instances.buffer;
+        instances.drawCount = stats.visible;
+        return stats;
+    }
+
+    // orphaned every frame, the frames in flight keep their storage
+    instances.visibleTransforms.resize(stats.visible);
+    unsigned int next[maxMeshLODs];
+    std::copy(instances.lodFirst, instances.lodFirst + maxMeshLODs, next);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (instances.visible[i])
+        {
+            instances.visibleTransforms[next[instances.lods[i]]++] = instances.transforms[i];
+        }
+    }
+    specifyInstances(instances.visibleBuffer, instances.visibleCapacity, instances.visibleTransforms.data(), stats.visible);
+    instances.uploadedBytes += stats.visible * sizeof(InstanceTransform);
+    instances.drawBuffer = instances.visibleBuffer;
+    instances.drawCount = stats.visible;
+    return stats;
+}
+
+// the per instance attributes read drawBuffer from instance first on
+void setupInstanceAttributes(InstanceBuffer &instances, unsigned int first)
+{
+    if (instances.attributeBuffer == instances.drawBuffer && instances.attributeFirst == first)
+    {
+        return;
+    }
+    instances.attributeBuffer = instances.drawBuffer;
+    instances.attributeFirst = first;
+
+    bindBuffer(GL_ARRAY_BUFFER, instances.drawBuffer);
+    GLsizei stride = sizeof(InstanceTransform);
+    size_t base = (size_t)first * stride;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        GLuint model = ATTRIB_INSTANCE_MODEL + i;
+        enableVertexAttribArray(model);
+        glVertexAttribPointer(model, 4, GL_FLOAT, GL_FALSE, stride,
+            (void*)(base + offsetof(InstanceTransform, model) + i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(model, 1);
+
+        GLuint normal = ATTRIB_INSTANCE_NORMAL + i;
+        enableVertexAttribArray(normal);
+        glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, stride,
+            (void*)(base + offsetof(InstanceTransform, normal) + i * sizeof(glm::vec3)));
+        glVertexAttribDivisor(normal, 1);
+    }
+}
+
+void resetInstanceStats(InstanceBuffer &instances)
+{
+    instances.uploadedBytes = 0;
+}
@@ -0,0 +1,22 @@
+#include "common/json.hpp"
+
+void writeJSONString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text ? text : ""; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
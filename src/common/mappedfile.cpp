@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/mappedfile.hpp"
+
+bool mapFile(const char* path, MappedFile& file)
+{
+    file.data = NULL;
+    file.size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // mmap() refuses zero-length mappings, an empty file is still a valid file
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // we mostly stream through files front to back
+    madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file.data = (const char*)addr;
+    file.size = (size_t)st.st_size;
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if (file.data != NULL)
+    {
+        munmap((void*)file.data, file.size);
+    }
+    file.data = NULL;
+    file.size = 0;
+}
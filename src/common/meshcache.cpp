@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "common/hash.hpp"
+#include "common/objloader.hpp"
+#include "common/profiler.hpp"
+#include "common/tangentspace.hpp"
+#include "common/meshoptimizer.hpp"
+#include "common/simplifier.hpp"
+#include "common/vertexformat.hpp"
+#include "common/meshcache.hpp"
+
+// bump whenever the layout or the load pipeline output changes
+static const uint32_t meshCacheVersion = 5;
+static const char meshCacheMagic[4] = {'T', 'G', 'M', 'C'};
+// written natively, a cache from a machine with another byte order is rejected
+static const uint32_t meshCacheByteOrder = 0x01020304;
+// sections start on this boundary so the arrays are usable in place
+static const size_t meshCacheAlignment = 16;
+
+enum MeshCacheSection
+{
+    SECTION_POSITIONS,
+    SECTION_UVS,
+    SECTION_NORMALS,
+    SECTION_TANGENTS,
+    SECTION_BITANGENTS,
+    SECTION_INDICES,
+    SECTION_SUBMESHES,
+    SECTION_PACKED_VERTICES,
+    SECTION_LODS,
+    SECTION_COUNT
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t lodSettings;       // hashLODSettings()
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    uint32_t subMeshCount;
+    uint32_t lodCount;
+    uint32_t vertexFormat;      // MeshVertexFormat::signature()
+    uint32_t vertexStride;
+
+    float boundsMin[3];
+    float boundsMax[3];
+
+    // byte offset and size of every section, from the start of the file
+    uint64_t sectionOffset[SECTION_COUNT];
+    uint64_t sectionSize[SECTION_COUNT];
+};
+
+uint64_t hashLODSettings(const float* ratios, unsigned int count)
+{
+    return hashFileContent((const char*)ratios, count * sizeof(float));
+}
+
+static inline size_t alignUp(size_t value)
+{
+    return (value + meshCacheAlignment - 1) & ~(meshCacheAlignment - 1);
+}
+
+void buildMeshCache(
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    const std::vector<glm::vec3> &vertices,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    const std::vector<glm::vec3> &bitangents,
+    const IndexBuffer &indexBuffer,
+    const std::vector<MeshLOD> &lods,
+    uint64_t lodSettings,
+    std::vector<char> &out_image
+)
+{
+    typedef MeshVertexFormat::Vertex PackedVertex;
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+    header.version = meshCacheVersion;
+    header.byteOrder = meshCacheByteOrder;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.lodSettings = lodSettings;
+    header.vertexCount = (uint32_t)vertices.size();
+    header.indexCount = (uint32_t)indexBuffer.count();
+    header.indexSize = indexBuffer.indexSize;
+    header.subMeshCount = (uint32_t)indexBuffer.subMeshes.size();
+    header.lodCount = (uint32_t)lods.size();
+    header.vertexFormat = MeshVertexFormat::signature();
+    header.vertexStride = sizeof(PackedVertex);
+
+    // bounding box of the mesh
+    glm::vec3 boundsMin(0.f), boundsMax(0.f);
+    if (!vertices.empty())
+    {
+        boundsMin = boundsMax = vertices[0];
+    }
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, vertices[i]);
+        boundsMax = glm::max(boundsMax, vertices[i]);
+    }
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        header.boundsMin[k] = boundsMin[k];
+        header.boundsMax[k] = boundsMax[k];
+    }
+
+    // the interleaved vertices that get uploaded, quantized inside the bounds
+    VertexQuantization quantization = { boundsMin, boundsMax };
+    std::vector<PackedVertex> packed;
+    packVertices<MeshVertexFormat>(vertices.size(),
+        vertices.data(), uvs.data(), normals.data(), tangents.data(), bitangents.data(),
+        quantization, packed);
+
+    const void* sections[SECTION_COUNT] = {
+        vertices.data(), uvs.data(), normals.data(), tangents.data(), bitangents.data(),
+        indexBuffer.data(), indexBuffer.subMeshes.data(), packed.data(), lods.data()
+    };
+    header.sectionSize[SECTION_POSITIONS]  = vertices.size() * sizeof(glm::vec3);
+    header.sectionSize[SECTION_UVS]        = uvs.size() * sizeof(glm::vec2);
+    header.sectionSize[SECTION_NORMALS]    = normals.size() * sizeof(glm::vec3);
+    header.sectionSize[SECTION_TANGENTS]   = tangents.size() * sizeof(glm::vec3);
+    header.sectionSize[SECTION_BITANGENTS] = bitangents.size() * sizeof(glm::vec3);
+    header.sectionSize[SECTION_INDICES]    = indexBuffer.count() * indexBuffer.indexSize;
+    header.sectionSize[SECTION_SUBMESHES]  = indexBuffer.subMeshes.size() * sizeof(SubMesh);
+    header.sectionSize[SECTION_PACKED_VERTICES] = packed.size() * sizeof(PackedVertex);
+    header.sectionSize[SECTION_LODS]       = lods.size() * sizeof(MeshLOD);
+
+    size_t offset = alignUp(sizeof(MeshCacheHeader));
+    for (unsigned int s = 0; s < SECTION_COUNT; s++)
+    {
+        header.sectionOffset[s] = offset;
+        offset = alignUp(offset + header.sectionSize[s]);
+    }
+
+    out_image.assign(offset, 0);
+    memcpy(&out_image[0], &header, sizeof(header));
+    for (unsigned int s = 0; s < SECTION_COUNT; s++)
+    {
+        if (header.sectionSize[s] > 0)
+        {
+            memcpy(&out_image[header.sectionOffset[s]], sections[s], header.sectionSize[s]);
+        }
+    }
+}
+
+// whether the count indices from first are all below limit
+static bool indicesBelow(const char* indices, uint32_t indexSize, uint32_t first, uint32_t count, uint32_t limit)
+{
+    if (indexSize == 2)
+    {
+        const uint16_t* index = (const uint16_t*)indices + first;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (index[i] >= limit)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    const uint32_t* index = (const uint32_t*)indices + first;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (index[i] >= limit)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readMeshCache(
+    const char* data, size_t size,
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    uint64_t lodSettings,
+    MeshData &mesh
+)
+{
+    if (size < sizeof(MeshCacheHeader))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, meshCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != meshCacheVersion ||
+        header.byteOrder != meshCacheByteOrder ||
+        header.headerSize != sizeof(MeshCacheHeader))
+    {
+        printf("Mesh cache has an unknown format or version\n");
+        return false;
+    }
+    if (header.vertexFormat != MeshVertexFormat::signature() ||
+        header.vertexStride != sizeof(MeshVertexFormat::Vertex))
+    {
+        printf("Mesh cache was built for another vertex format\n");
+        return false;
+    }
+    if (header.sourceHash != sourceHash || header.sourceSize != sourceSize)
+    {
+        printf("Mesh cache is out of date\n");
+        return false;
+    }
+    if (header.lodSettings != lodSettings)
+    {
+        printf("Mesh cache was built with other levels of detail\n");
+        return false;
+    }
+
+    // every section has to have the expected size and be inside the file
+    const uint64_t expected[SECTION_COUNT] = {
+        (uint64_t)header.vertexCount * sizeof(glm::vec3),
+        (uint64_t)header.vertexCount * sizeof(glm::vec2),
+        (uint64_t)header.vertexCount * sizeof(glm::vec3),
+        (uint64_t)header.vertexCount * sizeof(glm::vec3),
+        (uint64_t)header.vertexCount * sizeof(glm::vec3),
+        (uint64_t)header.indexCount * header.indexSize,
+        (uint64_t)header.subMeshCount * sizeof(SubMesh),
+        (uint64_t)header.vertexCount * header.vertexStride,
+        (uint64_t)header.lodCount * sizeof(MeshLOD)
+    };
+    if ((header.indexSize != 2 && header.indexSize != 4) ||
+        header.lodCount == 0 || header.lodCount > maxMeshLODs)
+    {
+        printf("Mesh cache is damaged\n");
+        return false;
+    }
+    for (unsigned int s = 0; s < SECTION_COUNT; s++)
+    {
+        if (header.sectionSize[s] != expected[s] ||
+            header.sectionOffset[s] % meshCacheAlignment != 0 ||
+            header.sectionOffset[s] > size ||
+            header.sectionSize[s] > size - header.sectionOffset[s])
+        {
+            printf("Mesh cache is damaged\n");
+            return false;
+        }
+    }
+
+    // the levels are consecutive runs of sub-meshes, the full mesh first, and
+    //  the sub-meshes consecutive runs of indices, each into its own vertices
+    const MeshLOD* lods = (const MeshLOD*)(data + header.sectionOffset[SECTION_LODS]);
+    const SubMesh* subMeshes = (const SubMesh*)(data + header.sectionOffset[SECTION_SUBMESHES]);
+    const char* indices = data + header.sectionOffset[SECTION_INDICES];
+    uint32_t nextSubMesh = 0;
+    uint32_t nextIndex = 0;
+    for (unsigned int l = 0; l < header.lodCount; l++)
+    {
+        if (lods[l].firstSubMesh != nextSubMesh ||
+            lods[l].subMeshCount > header.subMeshCount - nextSubMesh)
+        {
+            printf("Mesh cache is damaged\n");
+            return false;
+        }
+        uint32_t lodIndexCount = 0;
+        for (uint32_t s = nextSubMesh; s < nextSubMesh + lods[l].subMeshCount; s++)
+        {
+            const SubMesh &subMesh = subMeshes[s];
+            if (subMesh.firstIndex != nextIndex ||
+                subMesh.indexCount % 3 != 0 ||
+                subMesh.indexCount > header.indexCount - nextIndex ||
+                subMesh.vertexCount > header.vertexCount ||
+                subMesh.baseVertex > header.vertexCount - subMesh.vertexCount ||
+                !indicesBelow(indices, header.indexSize, subMesh.firstIndex, subMesh.indexCount, subMesh.vertexCount))
+            {
+                printf("Mesh cache is damaged\n");
+                return false;
+            }
+            nextIndex += subMesh.indexCount;
+            lodIndexCount += subMesh.indexCount;
+        }
+        if (lods[l].indexCount != lodIndexCount)
+        {
+            printf("Mesh cache is damaged\n");
+            return false;
+        }
+        nextSubMesh += lods[l].subMeshCount;
+    }
+    if (nextSubMesh != header.subMeshCount || nextIndex != header.indexCount)
+    {
+        printf("Mesh cache is damaged\n");
+        return false;
+    }
+
+    mesh.vertexCount = header.vertexCount;
+    mesh.positions  = (const glm::vec3*)(data + header.sectionOffset[SECTION_POSITIONS]);
+    mesh.uvs        = (const glm::vec2*)(data + header.sectionOffset[SECTION_UVS]);
+    mesh.normals    = (const glm::vec3*)(data + header.sectionOffset[SECTION_NORMALS]);
+    mesh.tangents   = (const glm::vec3*)(data + header.sectionOffset[SECTION_TANGENTS]);
+    mesh.bitangents = (const glm::vec3*)(data + header.sectionOffset[SECTION_BITANGENTS]);
+    mesh.indexSize = header.indexSize;
+    mesh.indexCount = header.indexCount;
+    mesh.indices = indices;
+    mesh.subMeshCount = lods[0].subMeshCount;
+    mesh.subMeshes = subMeshes;
+    mesh.lodCount = header.lodCount;
+    mesh.lods = lods;
+    mesh.vertexStride = header.vertexStride;
+    mesh.packedVertices = data + header.sectionOffset[SECTION_PACKED_VERTICES];
+    mesh.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mesh.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+// write through a temporary file, a crash never leaves half a cache behind
+static bool writeMeshCacheFile(const char* cachePath, const std::vector<char> &image)
+{
+    std::string temporaryPath = std::string(cachePath) + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporaryPath.c_str(), cachePath) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadMeshCached(const char* objPath, const char* cachePath, MeshFile &mesh,
+    const float* lodRatios, unsigned int lodRatioCount)
+{
+    PROFILE_SCOPE_DETAIL("loadMeshCached", objPath);
+    auto startTime = std::chrono::steady_clock::now();
+    mesh.file.data = NULL;
+    mesh.file.size = 0;
+    mesh.storage.clear();
+
+    MappedFile source;
+    if (!mapFile(objPath, source))
+    {
+        printf("Impossible to open %s\n", objPath);
+        return false;
+    }
+    uint64_t sourceHash = hashFileContent(source.data, source.size);
+    uint64_t sourceSize = source.size;
+    lodRatioCount = std::min(lodRatioCount, maxMeshLODs - 1);
+    uint64_t lodSettings = hashLODSettings(lodRatios, lodRatioCount);
+
+    // hit : the mesh is used right from the mapping
+    if (mapFile(cachePath, mesh.file))
+    {
+        if (readMeshCache(mesh.file.data, mesh.file.size, sourceHash, sourceSize, lodSettings, mesh.mesh))
+        {
+            unmapFile(source);
+            printf("Loaded %s from cache %s in %.2f ms\n", objPath, cachePath,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+            return true;
+        }
+        unmapFile(mesh.file);
+    }
+
+    // miss : run the whole pipeline
+    printf("Mesh cache miss for %s\n", objPath);
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    bool res = parseOBJ(source.data, source.size, vertices, uvs, normals, NULL, 0);
+    unmapFile(source);
+    if (!res)
+    {
+        return false;
+    }
+
+    // index VBO on the packed corners, quantized inside the bounds of the
+    //  mesh ; each welded vertex keeps the full precision attributes of its
+    //  first corner, the per-corner arrays are dropped right after
+    VertexQuantization cornerQuantization = { glm::vec3(0.f), glm::vec3(0.f) };
+    if (!vertices.empty())
+    {
+        cornerQuantization.boundsMin = cornerQuantization.boundsMax = vertices[0];
+    }
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        cornerQuantization.boundsMin = glm::min(cornerQuantization.boundsMin, vertices[i]);
+        cornerQuantization.boundsMax = glm::max(cornerQuantization.boundsMax, vertices[i]);
+    }
+    std::vector<MeshWeldFormat::Vertex> corners;
+    packVertices<MeshWeldFormat>(vertices.size(), vertices.data(), uvs.data(), normals.data(), NULL, NULL,
+        cornerQuantization, corners);
+
+    std::vector<unsigned int> indices;
+    std::vector<MeshWeldFormat::Vertex> welded;
+    indexPackedVBO<MeshWeldFormat>(corners, indices, welded, 0);    // weld on all cores
+    std::vector<MeshWeldFormat::Vertex>().swap(corners);
+
+    std::vector<glm::vec3> indexed_vertices;
+    std::vector<glm::vec2> indexed_uvs;
+    std::vector<glm::vec3> indexed_normals;
+    indexed_vertices.reserve(welded.size());
+    indexed_uvs.reserve(welded.size());
+    indexed_normals.reserve(welded.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (indices[i] == indexed_vertices.size())  // first corner of that vertex
+        {
+            indexed_vertices.push_back(vertices[i]);
+            indexed_uvs.push_back(uvs[i]);
+            indexed_normals.push_back(normals[i]);
+        }
+    }
+    std::vector<MeshWeldFormat::Vertex>().swap(welded);
+    std::vector<glm::vec3>().swap(vertices);
+    std::vector<glm::vec2>().swap(uvs);
+    std::vector<glm::vec3>().swap(normals);
+
+    // calculate tangent basis on the indexed mesh
+    std::vector<glm::vec3> indexed_tangents;
+    std::vector<glm::vec3> indexed_bitangents;
+    computeIndexedTangentBasis(
+        indices, indexed_vertices, indexed_uvs, indexed_normals,
+        indexed_tangents, indexed_bitangents
+        );
+
+    // levels of detail, simplified from each other
+    std::vector<LODLevel> levels;
+    buildLODChain(indices, indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents,
+        lodRatios, lodRatioCount, levels);
+    std::vector<unsigned int>().swap(indices);
+
+    // every level's triangles in post-transform cache order, then clusters
+    //  against overdraw ; the levels go one after the other, the full mesh
+    //  first, then vertices in the order they are fetched
+    VertexCacheStats before, after;
+    analyzeVertexCache(levels[0].indices, indexed_vertices.size(), before);
+    std::vector<unsigned int> ranges;
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        std::vector<unsigned int> clusters;
+        std::vector<unsigned int> optimized;
+        optimizeVertexCache(levels[l].indices, indexed_vertices.size(), optimized, clusters);
+        optimizeOverdraw(optimized, indexed_vertices, clusters);
+        if (l == 0)
+        {
+            analyzeVertexCache(optimized, indexed_vertices.size(), after);
+            printf("Vertex cache : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u clusters)\n",
+                before.acmr, after.acmr, before.atvr, after.atvr, (unsigned int)clusters.size());
+        }
+        else
+        {
+            printf("LOD %u : %u triangles, error %g\n", (unsigned int)l,
+                (unsigned int)(optimized.size() / 3), levels[l].error);
+        }
+        ranges.push_back((unsigned int)indices.size());
+        indices.insert(indices.end(), optimized.begin(), optimized.end());
+    }
+    std::vector<unsigned int> fetchRemap;
+    optimizeVertexFetch(indices, indexed_vertices.size(), fetchRemap);
+    remapVertexAttribute(indexed_vertices, fetchRemap);
+    remapVertexAttribute(indexed_uvs, fetchRemap);
+    remapVertexAttribute(indexed_normals, fetchRemap);
+    remapVertexAttribute(indexed_tangents, fetchRemap);
+    remapVertexAttribute(indexed_bitangents, fetchRemap);
+
+    // large meshes are split into sub-meshes that still fit in 16-bit indices
+    IndexBuffer indexBuffer;
+    buildIndexBuffer(indices, indexed_vertices.size(), true, ranges, indexBuffer);
+    remapVertexAttribute(indexed_vertices, indexBuffer.vertexRemap);
+    remapVertexAttribute(indexed_uvs, indexBuffer.vertexRemap);
+    remapVertexAttribute(indexed_normals, indexBuffer.vertexRemap);
+    remapVertexAttribute(indexed_tangents, indexBuffer.vertexRemap);
+    remapVertexAttribute(indexed_bitangents, indexBuffer.vertexRemap);
+
+    std::vector<MeshLOD> lods(levels.size());
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        unsigned int end = l + 1 < levels.size() ? indexBuffer.rangeSubMeshes[l + 1] : (unsigned int)indexBuffer.subMeshes.size();
+        lods[l].firstSubMesh = indexBuffer.rangeSubMeshes[l];
+        lods[l].subMeshCount = end - lods[l].firstSubMesh;
+        lods[l].indexCount = (uint32_t)levels[l].indices.size();
+        lods[l].error = levels[l].error;
+    }
+
+    // the in-memory image is used as is, the disk copy is only for next time
+    buildMeshCache(sourceHash, sourceSize,
+        indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents, indexed_bitangents,
+        indexBuffer, lods, lodSettings, mesh.storage);
+    if (!writeMeshCacheFile(cachePath, mesh.storage))
+    {
+        printf("Could not write mesh cache %s\n", cachePath);
+    }
+
+    res = readMeshCache(mesh.storage.data(), mesh.storage.size(), sourceHash, sourceSize, lodSettings, mesh.mesh);
+    printf("Built %s in %.2f ms\n", objPath,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    return res;
+}
+
+void closeMeshFile(MeshFile &mesh)
+{
+    unmapFile(mesh.file);
+    std::vector<char>().swap(mesh.storage);
+}
@@ -0,0 +1,363 @@
+#include <math.h>
+#include <algorithm>
+
+#include "common/meshoptimizer.hpp"
+
+// marks a vertex that has no new index yet
+static const unsigned int noVertex = 0xffffffffu;
+
+// FIFO cache simulated with timestamps : a vertex is in the cache while
+//  fewer than cacheSize misses happened since it was loaded
+struct CacheSimulator
+{
+    std::vector<unsigned int> timestamps;
+    unsigned int time;
+    unsigned int cacheSize;
+
+    CacheSimulator(size_t vertexCount, unsigned int size)
+        : timestamps(vertexCount, 0), time(size + 1), cacheSize(size)
+    {
+    }
+
+    // returns true on a miss
+    bool access(unsigned int v)
+    {
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            return true;
+        }
+        return false;
+    }
+
+    // start over with a cold cache
+    void flush()
+    {
+        time += cacheSize + 1;
+    }
+};
+
+void analyzeVertexCache(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    VertexCacheStats &out,
+    unsigned int cacheSize
+)
+{
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+
+    out.triangles = (unsigned int)(indices.size() / 3);
+    out.vertices = 0;
+    out.transformed = 0;
+    for (size_t i = 0; i < out.triangles * 3; i++)
+    {
+        unsigned int v = indices[i];
+        if (cache.access(v))
+        {
+            out.transformed++;
+        }
+        if (!referenced[v])
+        {
+            referenced[v] = true;
+            out.vertices++;
+        }
+    }
+    out.acmr = out.triangles ? (float)out.transformed / out.triangles : 0.f;
+    out.atvr = out.vertices ? (float)out.transformed / out.vertices : 0.f;
+}
+
+//
+// Tipsify
+
+// triangles around each vertex, as offsets into one array
+struct VertexAdjacency
+{
+    std::vector<unsigned int> offsets;      // vertexCount + 1
+    std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    VertexAdjacency &adjacency
+)
+{
+    size_t triangleCount = indices.size() / 3;
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacency.offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+
+    adjacency.triangles.resize(triangleCount * 3);
+    std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacency.triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+}
+
+void optimizeVertexCache(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    std::vector<unsigned int> &out_indices,
+    std::vector<unsigned int> &out_clusters,
+    unsigned int cacheSize
+)
+{
+    size_t triangleCount = indices.size() / 3;
+    out_indices.clear();
+    out_indices.reserve(triangleCount * 3);
+    out_clusters.clear();
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    VertexAdjacency adjacency;
+    buildAdjacency(indices, vertexCount, adjacency);
+
+    // triangles not emitted yet, per vertex
+    std::vector<unsigned int> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    deadEnd.reserve(triangleCount * 3);
+
+    unsigned int time = cacheSize + 1;
+    unsigned int cursor = 0;     // next vertex in input order, to restart from
+
+    // the first vertex of the first triangle is a cold start too
+    unsigned int fanning = indices[0];
+    out_clusters.push_back(0);
+
+    while (true)
+    {
+        // emit every triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++)
+        {
+            unsigned int t = adjacency.triangles[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+            emitted[t] = true;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                out_indices.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // next fanning vertex : the one that stays longest in the cache
+        //  once its remaining triangles are emitted
+        unsigned int next = noVertex;
+        int bestPriority = -1;
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            unsigned int v = candidates[c];
+            if (liveTriangles[v] == 0)
+            {
+                continue;
+            }
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+            {
+                priority = (int)(time - cacheTime[v]);
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // dead end : a recently used vertex, else restart in input order
+        while (next == noVertex && !deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+            {
+                next = v;
+            }
+        }
+        if (next == noVertex)
+        {
+            while (cursor < vertexCount && liveTriangles[cursor] == 0)
+            {
+                cursor++;
+            }
+            if (cursor == vertexCount)
+            {
+                break;
+            }
+            next = cursor;
+            out_clusters.push_back((unsigned int)(out_indices.size() / 3));
+        }
+        fanning = next;
+    }
+}
+
+//
+// overdraw
+
+void optimizeOverdraw(
+    std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<unsigned int> &clusters,
+    float threshold,
+    unsigned int cacheSize
+)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty())
+    {
+        return;
+    }
+
+    // split the hard clusters where the local ACMR is already within
+    //  threshold of the whole cluster's, each piece then starts cold
+    std::vector<unsigned int> bounds;
+    CacheSimulator cache(positions.size(), cacheSize);
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        unsigned int first = clusters[c];
+        unsigned int last = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)triangleCount;
+
+        cache.flush();
+        unsigned int misses = 0;
+        for (unsigned int i = first * 3; i < last * 3; i++)
+        {
+            misses += cache.access(indices[i]) ? 1 : 0;
+        }
+        float limit = threshold * (float)misses / (float)(last - first);
+
+        bounds.push_back(first);
+        cache.flush();
+        misses = 0;
+        unsigned int start = first;
+        for (unsigned int t = first; t < last; t++)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                misses += cache.access(indices[t * 3 + k]) ? 1 : 0;
+            }
+            if (t + 1 < last && (float)misses <= limit * (float)(t + 1 - start))
+            {
+                bounds.push_back(t + 1);
+                cache.flush();
+                misses = 0;
+                start = t + 1;
+            }
+        }
+    }
+    bounds.push_back((unsigned int)triangleCount);
+
+    // area weighted centroid of the mesh
+    glm::vec3 meshCentroid(0.f);
+    float meshArea = 0.f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3 &p0 = positions[indices[t * 3 + 0]];
+        const glm::vec3 &p1 = positions[indices[t * 3 + 1]];
+        const glm::vec3 &p2 = positions[indices[t * 3 + 2]];
+        float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        meshCentroid += (p0 + p1 + p2) * (area / 3.f);
+        meshArea += area;
+    }
+    if (meshArea > 0.f)
+    {
+        meshCentroid /= meshArea;
+    }
+
+    // clusters that face away from the center are likely to occlude the others
+    size_t clusterCount = bounds.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.f), normal(0.f);
+        float area = 0.f;
+        for (unsigned int t = bounds[c]; t < bounds[c + 1]; t++)
+        {
+            const glm::vec3 &p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3 &p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3 &p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.f);
+            normal += n;
+            area += a;
+        }
+        float length = glm::length(normal);
+        if (area > 0.f && length > 0.f)
+        {
+            sortKey[c] = glm::dot(centroid / area - meshCentroid, normal / length);
+        }
+        else
+        {
+            sortKey[c] = 0.f;
+        }
+    }
+
+    std::vector<unsigned int> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        order[c] = (unsigned int)c;
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&sortKey](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(triangleCount * 3);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        sorted.insert(sorted.end(),
+            indices.begin() + bounds[order[c]] * 3,
+            indices.begin() + bounds[order[c] + 1] * 3);
+    }
+    indices.swap(sorted);
+}
+
+//
+// vertex fetch
+
+size_t optimizeVertexFetch(
+    std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    std::vector<unsigned int> &out_remap
+)
+{
+    std::vector<unsigned int> newIndex(vertexCount, noVertex);
+    out_remap.clear();
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        if (newIndex[v] == noVertex)
+        {
+            newIndex[v] = (unsigned int)out_remap.size();
+            out_remap.push_back(v);
+        }
+        indices[i] = newIndex[v];
+    }
+    return out_remap.size();
+}
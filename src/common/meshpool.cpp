@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "common/meshpool.hpp"
+#include "common/glstate.hpp"
+#include "common/profiler.hpp"
+#include "common/vertexformat.hpp"
+
+typedef MeshVertexFormat::Vertex PoolVertex;
+
+// the attributes and the indices of the vertex array, on its current buffers
+static void setupPoolVertexArray(MeshPool &pool)
+{
+    bindVertexArray(pool.vertexArray);
+    bindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+    MeshVertexFormat::enableAttributes();
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+}
+
+// a bigger buffer with the first usedBytes of buffer, which is deleted
+//  through the copy targets, the vertex array is left alone
+static GLuint growBuffer(GLuint buffer, size_t usedBytes, size_t bytes)
+{
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+    if (usedBytes > 0)
+    {
+        bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+    }
+    deleteBuffers(1, &buffer);
+    return grown;
+}
+
+// half again as much, and at least needed
+static unsigned int grownCapacity(unsigned int capacity, unsigned int needed)
+{
+    return std::max(needed, capacity + capacity / 2);
+}
+
+void initMeshPool(MeshPool &pool, unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+    pool.vertexCapacity = std::max(vertexCapacity, 1u);
+    pool.indexCapacity = std::max(indexCapacity, 1u);
+    pool.vertexCount = 0;
+    pool.indexCount = 0;
+    pool.meshes.clear();
+
+    glGenBuffers(1, &pool.vertexBuffer);
+    bindBuffer(GL_COPY_WRITE_BUFFER, pool.vertexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (size_t)pool.vertexCapacity * sizeof(PoolVertex), NULL, GL_STATIC_DRAW);
+    glGenBuffers(1, &pool.indexBuffer);
+    bindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (size_t)pool.indexCapacity * sizeof(uint16_t), NULL, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &pool.vertexArray);
+    setupPoolVertexArray(pool);
+}
+
+void destroyMeshPool(MeshPool &pool)
+{
+    deleteVertexArrays(1, &pool.vertexArray);
+    deleteBuffers(1, &pool.vertexBuffer);
+    deleteBuffers(1, &pool.indexBuffer);
+    pool.vertexArray = 0;
+    pool.vertexBuffer = 0;
+    pool.indexBuffer = 0;
+    pool.vertexCount = pool.vertexCapacity = 0;
+    pool.indexCount = pool.indexCapacity = 0;
+    pool.meshes.clear();
+}
+
+unsigned int addPoolMesh(MeshPool &pool, const MeshData &mesh)
+{
+    if (mesh.vertexStride != sizeof(PoolVertex) || mesh.indexSize != sizeof(uint16_t))
+    {
+        printf("Mesh pool : %u byte vertices and %u byte indices, expected %u and %u\n",
+            mesh.vertexStride, mesh.indexSize, (unsigned int)sizeof(PoolVertex), (unsigned int)sizeof(uint16_t));
+        return invalidPoolMesh;
+    }
+
+    bool grown = false;
+    if (pool.vertexCount + mesh.vertexCount > pool.vertexCapacity)
+    {
+        pool.vertexCapacity = grownCapacity(pool.vertexCapacity, pool.vertexCount + mesh.vertexCount);
+        pool.vertexBuffer = growBuffer(pool.vertexBuffer,
+            (size_t)pool.vertexCount * sizeof(PoolVertex), (size_t)pool.vertexCapacity * sizeof(PoolVertex));
+        grown = true;
+    }
+    if (pool.indexCount + mesh.indexCount > pool.indexCapacity)
+    {
+        pool.indexCapacity = grownCapacity(pool.indexCapacity, pool.indexCount + mesh.indexCount);
+        pool.indexBuffer = growBuffer(pool.indexBuffer,
+            (size_t)pool.indexCount * sizeof(uint16_t), (size_t)pool.indexCapacity * sizeof(uint16_t));
+        grown = true;
+    }
+    if (grown)
+    {
+        // the old buffers are gone, the vertex array points at the new ones
+        setupPoolVertexArray(pool);
+    }
+
+    bindBuffer(GL_COPY_WRITE_BUFFER, pool.vertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)pool.vertexCount * sizeof(PoolVertex),
+        (size_t)mesh.vertexCount * sizeof(PoolVertex), mesh.packedVertices);
+    bindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)pool.indexCount * sizeof(uint16_t),
+        (size_t)mesh.indexCount * sizeof(uint16_t), mesh.indices);
+
+    PoolMesh added;
+    added.baseVertex = pool.vertexCount;
+    added.firstIndex = pool.indexCount;
+    // every level's sub-meshes, not only the full mesh's
+    unsigned int subMeshCount = 0;
+    for (unsigned int l = 0; l < mesh.lodCount; l++)
+    {
+        subMeshCount = std::max(subMeshCount, mesh.lods[l].firstSubMesh + mesh.lods[l].subMeshCount);
+    }
+    added.subMeshes.assign(mesh.subMeshes, mesh.subMeshes + subMeshCount);
+    added.lods.assign(mesh.lods, mesh.lods + std::min(mesh.lodCount, maxMeshLODs));
+    added.boundsMin = mesh.boundsMin;
+    added.boundsMax = mesh.boundsMax;
+    pool.meshes.push_back(added);
+
+    pool.vertexCount += mesh.vertexCount;
+    pool.indexCount += mesh.indexCount;
+    return (unsigned int)pool.meshes.size() - 1;
+}
+
+bool indirectDrawsSupported()
+{
+    return GLEW_VERSION_4_3 && GLEW_ARB_shader_draw_parameters;
+}
+
+void initDrawList(DrawList &list, bool indirect)
+{
+    list.indirect = indirect;
+    list.commands.clear();
+    list.drawData.clear();
+    list.commandBuffer = 0;
+    if (indirect)
+    {
+        glGenBuffers(1, &list.commandBuffer);
+    }
+
+    // never empty, a texture buffer over no storage reads nothing defined
+    glGenBuffers(1, &list.drawDataBuffer);
+    bindBuffer(GL_TEXTURE_BUFFER, list.drawDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(DrawData), NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &list.drawDataTexture);
+    bindTextureUnit(drawDataTextureUnit, GL_TEXTURE_BUFFER, list.drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, list.drawDataBuffer);
+}
+
+void destroyDrawList(DrawList &list)
+{
+    deleteTextures(1, &list.drawDataTexture);
+    deleteBuffers(1, &list.drawDataBuffer);
+    if (list.commandBuffer != 0)
+    {
+        deleteBuffers(1, &list.commandBuffer);
+    }
+    list.drawDataTexture = 0;
+    list.drawDataBuffer = 0;
+    list.commandBuffer = 0;
+    list.commands.clear();
+    list.drawData.clear();
+}
+
+void clearDrawList(DrawList &list)
+{
+    list.commands.clear();
+    list.drawData.clear();
+}
+
+size_t addMeshDraws(DrawList &list, const MeshPool &pool, unsigned int mesh, const InstanceBuffer &instances)
+{
+    const PoolMesh &poolMesh = pool.meshes[mesh];
+    // positions are quantized inside the mesh bounds
+    VertexQuantization quantization = { poolMesh.boundsMin, poolMesh.boundsMax };
+    DrawData data;
+    data.positionScale = glm::vec4(quantization.positionScale(), 0.f);
+    data.positionBias = glm::vec4(quantization.positionBias(), 0.f);
+
+    size_t triangles = 0;
+    for (unsigned int l = 0; l < poolMesh.lods.size(); l++)
+    {
+        unsigned int first = instances.lodFirst[l];
+        unsigned int count = instances.lodFirst[l + 1] - first;
+        if (count == 0)
+        {
+            continue;
+        }
+        const MeshLOD &lod = poolMesh.lods[l];
+        for (unsigned int i = lod.firstSubMesh; i < lod.firstSubMesh + lod.subMeshCount; i++)
+        {
+            const SubMesh &subMesh = poolMesh.subMeshes[i];
+            DrawElementsIndirectCommand command;
+            command.count = subMesh.indexCount;
+            command.instanceCount = count;
+            command.firstIndex = poolMesh.firstIndex + subMesh.firstIndex;
+            command.baseVertex = (GLint)(poolMesh.baseVertex + subMesh.baseVertex);
+            command.baseInstance = first;
+            list.commands.push_back(command);
+            list.drawData.push_back(data);
+        }
+        triangles += (size_t)lod.indexCount / 3 * count;
+    }
+    return triangles;
+}
+
+void submitDraws(DrawList &list, InstanceBuffer &instances, ShaderProgram &shader, int firstDrawID)
+{
+    PROFILE_SCOPE("submitDraws");
+    if (list.commands.empty())
+    {
+        return;
+    }
+
+    // orphaned every frame, the draws of the frame before may still read it
+    bindBuffer(GL_TEXTURE_BUFFER, list.drawDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, list.drawData.size() * sizeof(DrawData), list.drawData.data(), GL_STREAM_DRAW);
+    bindTextureUnit(drawDataTextureUnit, GL_TEXTURE_BUFFER, list.drawDataTexture);
+
+    if (list.indirect)
+    {
+        // the base instance of each command moves the per instance
+        //  attributes, gl_DrawIDARB finds the draw data
+        setupInstanceAttributes(instances);
+        setUniform(shader, firstDrawID, 0);
+        bindBuffer(GL_DRAW_INDIRECT_BUFFER, list.commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, list.commands.size() * sizeof(DrawElementsIndirectCommand),
+            list.commands.data(), GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES,                   // mode
+            GL_UNSIGNED_SHORT,              // type
+            (void*)0,                       // indirect buffer offset
+            (GLsizei)list.commands.size(),  // draws
+            0                               // tightly packed
+            );
+        return;
+    }
+
+    // no base instance in 3.3, the attributes move to the draw's instances
+    //  instead, and no draw ID, the uniform says which draw it is
+    for (size_t i = 0; i < list.commands.size(); i++)
+    {
+        const DrawElementsIndirectCommand &command = list.commands[i];
+        setupInstanceAttributes(instances, command.baseInstance);
+        setUniform(shader, firstDrawID, (GLint)i);
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES,           // mode
+            command.count,          // count
+            GL_UNSIGNED_SHORT,      // type
+            (void*)((size_t)command.firstIndex * sizeof(uint16_t)),    // element array buffer offset
+            command.instanceCount,  // instances
+            command.baseVertex      // added to every index
+            );
+    }
+}
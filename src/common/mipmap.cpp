@@ -0,0 +1,398 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/parallel.hpp"
+#include "common/mipmap.hpp"
+
+// rows handled by one parallel block
+static const size_t mipBlockRows = 16;
+
+// filter radius in destination pixels, and the Kaiser window shape
+static const float windowedRadius = 3.f;
+static const float kaiserAlpha = 4.f;
+
+//
+// filters, x in destination pixels
+
+static float sinc(float x)
+{
+    if (fabsf(x) < 1e-5f)
+    {
+        return 1.f;
+    }
+    x *= (float)M_PI;
+    return sinf(x) / x;
+}
+
+// modified Bessel function of the first kind, order 0
+static float besselI0(float x)
+{
+    float sum = 1.f, term = 1.f;
+    float halfX = x * 0.5f;
+    for (unsigned int k = 1; k < 32; k++)
+    {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-7f)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+static float filterRadius(MipFilter filter)
+{
+    return filter == MIP_FILTER_BOX ? 0.5f : windowedRadius;
+}
+
+static float evaluateFilter(MipFilter filter, float x)
+{
+    x = fabsf(x);
+    switch (filter)
+    {
+    case MIP_FILTER_BOX:
+        return x <= 0.5f ? 1.f : 0.f;
+    case MIP_FILTER_KAISER:
+    {
+        if (x >= windowedRadius)
+        {
+            return 0.f;
+        }
+        float t = x / windowedRadius;
+        return sinc(x) * besselI0(kaiserAlpha * sqrtf(1.f - t * t)) / besselI0(kaiserAlpha);
+    }
+    case MIP_FILTER_LANCZOS:
+        return x < windowedRadius ? sinc(x) * sinc(x / windowedRadius) : 0.f;
+    }
+    return 0.f;
+}
+
+// the same number of taps for every destination pixel, source indices
+//  clamped to the edges and weights summing to 1
+struct FilterTaps
+{
+    unsigned int tapCount;
+    std::vector<unsigned int> indices;  // destination pixel * tapCount + tap
+    std::vector<float> weights;
+};
+
+static void buildFilterTaps(MipFilter filter, unsigned int sourceSize, unsigned int size, FilterTaps &taps)
+{
+    float scale = (float)sourceSize / (float)size;
+    float support = filterRadius(filter) * scale;
+    taps.tapCount = (unsigned int)ceilf(support * 2.f) + 1;
+    taps.indices.resize((size_t)size * taps.tapCount);
+    taps.weights.resize((size_t)size * taps.tapCount);
+
+    for (unsigned int i = 0; i < size; i++)
+    {
+        float center = (i + 0.5f) * scale;
+        int first = (int)floorf(center - support);
+        float total = 0.f;
+        for (unsigned int t = 0; t < taps.tapCount; t++)
+        {
+            int source = first + (int)t;
+            float w = evaluateFilter(filter, (source + 0.5f - center) / scale);
+            source = source < 0 ? 0 : (source >= (int)sourceSize ? (int)sourceSize - 1 : source);
+            taps.indices[i * taps.tapCount + t] = (unsigned int)source;
+            taps.weights[i * taps.tapCount + t] = w;
+            total += w;
+        }
+        for (unsigned int t = 0; t < taps.tapCount; t++)
+        {
+            taps.weights[i * taps.tapCount + t] /= total;
+        }
+    }
+}
+
+//
+// colour spaces
+
+static float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+}
+
+static inline unsigned char quantize(float v)
+{
+    v = v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+    return (unsigned char)(v * 255.f + 0.5f);
+}
+
+// RGBA8 to the float RGBA the filters work on
+static void decodePixels(const unsigned char* rgba, size_t pixelCount, const MipSettings &settings, float* out)
+{
+    float table[256];
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        if (settings.normalMap)
+            table[i] = i / 127.5f - 1.f;
+        else if (settings.srgb)
+            table[i] = srgbToLinear(i / 255.f);
+        else
+            table[i] = i / 255.f;
+    }
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        out[i * 4 + 0] = table[rgba[i * 4 + 0]];
+        out[i * 4 + 1] = table[rgba[i * 4 + 1]];
+        out[i * 4 + 2] = table[rgba[i * 4 + 2]];
+        out[i * 4 + 3] = rgba[i * 4 + 3] / 255.f;     // alpha is always linear
+    }
+}
+
+static void encodePixels(const float* pixels, size_t pixelCount, const MipSettings &settings, unsigned char* out)
+{
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        const float* p = pixels + i * 4;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            if (settings.normalMap)
+                out[i * 4 + k] = quantize(p[k] * 0.5f + 0.5f);
+            else if (settings.srgb)
+                out[i * 4 + k] = quantize(linearToSRGB(p[k] < 0.f ? 0.f : p[k]));
+            else
+                out[i * 4 + k] = quantize(p[k]);
+        }
+        out[i * 4 + 3] = quantize(p[3]);
+    }
+}
+
+//
+// the two passes of a level
+
+// dst pixel = sum of taps source pixels, RGBA at once
+static void filterRowHorizontal(const float* source, const FilterTaps &taps, unsigned int width, float* dst)
+{
+    for (unsigned int x = 0; x < width; x++)
+    {
+        const unsigned int* indices = &taps.indices[(size_t)x * taps.tapCount];
+        const float* weights = &taps.weights[(size_t)x * taps.tapCount];
+#if defined(__SSE2__)
+        __m128 sum = _mm_setzero_ps();
+        for (unsigned int t = 0; t < taps.tapCount; t++)
+        {
+            __m128 p = _mm_loadu_ps(source + (size_t)indices[t] * 4);
+            sum = _mm_add_ps(sum, _mm_mul_ps(p, _mm_set1_ps(weights[t])));
+        }
+        _mm_storeu_ps(dst + (size_t)x * 4, sum);
+#else
+        float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+        for (unsigned int t = 0; t < taps.tapCount; t++)
+        {
+            const float* p = source + (size_t)indices[t] * 4;
+            for (unsigned int k = 0; k < 4; k++)
+            {
+                sum[k] += p[k] * weights[t];
+            }
+        }
+        memcpy(dst + (size_t)x * 4, sum, sizeof(sum));
+#endif
+    }
+}
+
+// dst row = weighted sum of whole rows, floatCount floats each
+static void filterRowVertical(const float* const* rows, const float* weights, unsigned int tapCount, size_t floatCount, float* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= floatCount; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (unsigned int t = 0; t < tapCount; t++)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(weights[t])));
+        }
+        _mm_storeu_ps(dst + i, sum);
+    }
+#endif
+    for (; i < floatCount; i++)
+    {
+        float sum = 0.f;
+        for (unsigned int t = 0; t < tapCount; t++)
+        {
+            sum += rows[t][i] * weights[t];
+        }
+        dst[i] = sum;
+    }
+}
+
+// keep the values the next level starts from meaningful : unit normals,
+//  no ringing below 0 or above 1
+static void fixupRow(float* pixels, unsigned int width, const MipSettings &settings)
+{
+    for (unsigned int x = 0; x < width; x++)
+    {
+        float* p = pixels + (size_t)x * 4;
+        if (settings.normalMap)
+        {
+            float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            if (len > 0.f)
+            {
+                p[0] /= len; p[1] /= len; p[2] /= len;
+            }
+            else
+            {
+                p[0] = 0.f; p[1] = 0.f; p[2] = 1.f;
+            }
+        }
+        else
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                p[k] = p[k] < 0.f ? 0.f : (p[k] > 1.f ? 1.f : p[k]);
+            }
+        }
+        p[3] = p[3] < 0.f ? 0.f : (p[3] > 1.f ? 1.f : p[3]);
+    }
+}
+
+static void downsample(
+    const std::vector<float> &source,
+    unsigned int sourceWidth,
+    unsigned int sourceHeight,
+    unsigned int width,
+    unsigned int height,
+    const MipSettings &settings,
+    std::vector<float> &out,
+    unsigned int threadCount
+)
+{
+    FilterTaps horizontal, vertical;
+    buildFilterTaps(settings.filter, sourceWidth, width, horizontal);
+    buildFilterTaps(settings.filter, sourceHeight, height, vertical);
+
+    // every source row narrowed first, then the rows combined
+    std::vector<float> narrow((size_t)width * sourceHeight * 4);
+    parallelFor(sourceHeight, mipBlockRows, [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; y++)
+        {
+            filterRowHorizontal(&source[y * sourceWidth * 4], horizontal, width, &narrow[y * width * 4]);
+        }
+    }, threadCount);
+
+    out.resize((size_t)width * height * 4);
+    parallelFor(height, mipBlockRows, [&](size_t begin, size_t end)
+    {
+        std::vector<const float*> rows(vertical.tapCount);
+        for (size_t y = begin; y < end; y++)
+        {
+            for (unsigned int t = 0; t < vertical.tapCount; t++)
+            {
+                rows[t] = &narrow[(size_t)vertical.indices[y * vertical.tapCount + t] * width * 4];
+            }
+            float* dst = &out[y * width * 4];
+            filterRowVertical(rows.data(), &vertical.weights[y * vertical.tapCount], vertical.tapCount, (size_t)width * 4, dst);
+            fixupRow(dst, width, settings);
+        }
+    }, threadCount);
+}
+
+unsigned int mipLevelCount(unsigned int width, unsigned int height)
+{
+    unsigned int count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        count++;
+    }
+    return count;
+}
+
+void generateMipmaps(
+    const unsigned char* rgba,
+    unsigned int width,
+    unsigned int height,
+    const MipSettings &settings,
+    Image &image,
+    unsigned int threadCount
+)
+{
+    unsigned int levelCount = mipLevelCount(width, height);
+    image.format = IMAGE_RGBA8;
+    image.width = width;
+    image.height = height;
+    image.rowAlignment = 4;
+    image.file.data = NULL;
+    image.file.size = 0;
+    image.levels.resize(levelCount);
+
+    // layout first, the level views must not move afterwards
+    size_t total = 0;
+    unsigned int w = width, h = height;
+    for (unsigned int level = 0; level < levelCount; level++)
+    {
+        ImageLevel view = { w, h, imageLevelSize(IMAGE_RGBA8, w, h), NULL };
+        image.levels[level] = view;
+        total += view.size;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    image.storage.resize(total);
+    size_t offset = 0;
+    for (unsigned int level = 0; level < levelCount; level++)
+    {
+        image.levels[level].data = &image.storage[offset];
+        offset += image.levels[level].size;
+    }
+    memcpy(&image.storage[0], rgba, image.levels[0].size);
+
+    // every level from the float one above it, so rounding never accumulates
+    //  each is encoded as soon as it is made and only the level above it is
+    //  kept, so at most two float levels are alive at a time
+    std::vector<float> above((size_t)width * height * 4);
+    std::vector<float> current;
+    decodePixels(rgba, (size_t)width * height, settings, above.data());
+    for (unsigned int level = 1; level < levelCount; level++)
+    {
+        const ImageLevel &source = image.levels[level - 1];
+        const ImageLevel &view = image.levels[level];
+        downsample(above, source.width, source.height, view.width, view.height,
+            settings, current, threadCount);
+
+        // back to 8 bits, the sRGB encode mostly
+        parallelFor(view.height, mipBlockRows, [&](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; y++)
+            {
+                encodePixels(&current[y * view.width * 4], view.width, settings,
+                    (unsigned char*)view.data + y * view.width * 4);
+            }
+        }, threadCount);
+        above.swap(current);
+        std::vector<float>().swap(current);
+    }
+}
+
+bool buildMipmaps(Image &image, const MipSettings &settings, unsigned int threadCount)
+{
+    if (image.levels.size() != 1 || isCompressedFormat(image.format))
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> rgba;
+    if (!convertToRGBA8(image, rgba))
+    {
+        return false;
+    }
+    unsigned int width = image.width;
+    unsigned int height = image.height;
+    freeImage(image);
+    generateMipmaps(rgba.data(), width, height, settings, image, threadCount);
+    return true;
+}
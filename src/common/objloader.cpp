@@ -1,116 +1,692 @@
 #include <stdio.h>
+#include <math.h>
 #include <string>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
 
+#include <common/mappedfile.hpp>
 #include <common/objloader.hpp>
+#include <common/parallel.hpp>
+#include <common/profiler.hpp>
 
-bool loadOBJ(const char* path, 
-    std::vector<glm::vec3> &out_vertices,
-    std::vector<glm::vec2> &out_uvs,
-    std::vector<glm::vec3> &out_normals
-    )
+// one corner of a face, zero-based indices into the v/vt/vn arrays
+//  -1 means the attribute was not given for this corner
+struct OBJCorner
 {
-    printf("Loading OBJ file %s...\n", path);
+    int v;
+    int vt;
+    int vn;
+};
+
+// record counts of a range of the file
+//  also used as write offsets when parsing it
+struct OBJCounts
+{
+    size_t positions;
+    size_t uvs;
+    size_t normals;
+    size_t triangles;
+};
 
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> temp_vertices;
-    std::vector<glm::vec2> temp_uvs;
-    std::vector<glm::vec3> temp_normals;
+// exact powers of ten, anything in here turns a mantissa into a correctly rounded double
+static const double powersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-    FILE* file = fopen(path, "r");
-    if (file == NULL)
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
     {
-        printf("Impossible to open the file!\n");
-        getchar();
-        return false;
+        p++;
     }
+    return p;
+}
+
+// returns the first character of the next line
+static inline const char* skipLine(const char* p, const char* end)
+{
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    return eol ? eol + 1 : end;
+}
 
-    while(true)
+// hand written replacement for strtof(), no locale and no null terminator needed
+//  returns NULL if there is no number at p
+static const char* parseFloat(const char* p, const char* end, float &out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
     {
-        char lineHeader[128];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
+        negative = (*p == '-');
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+
+    // integer part ; digits past what fits in the mantissa only scale it
+    for (; p < end && isDigit(*p); p++, any = true)
+    {
+        if (digits < 19)
         {
-            break;
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    // fractional part
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && isDigit(*p); p++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
         }
+    }
 
-        // parse lineHeader
-        if (strcmp(lineHeader, "v") == 0)   // if equal
+    if (!any)
+    {
+        return NULL;
+    }
+
+    // exponent
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
         {
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            temp_vertices.push_back(vertex);
+            negativeExponent = (*q == '-');
+            q++;
+        }
+        if (q < end && isDigit(*q))
+        {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++)
+            {
+                if (e < 10000) e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
         }
-        else if (strcmp(lineHeader, "vt") == 0)
+    }
+
+    double value = (double)mantissa;
+    if (mantissa != 0)
+    {
+        if (exponent < 0 && exponent >= -22)
         {
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            uv.y = -uv.y; // invert V coord since we will only use DDS texture, which are inverted
-            temp_uvs.push_back(uv);
+            value /= powersOfTen[-exponent];
         }
-        else if (strcmp(lineHeader, "vn") == 0)
+        else if (exponent > 0 && exponent <= 22)
         {
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            temp_normals.push_back(normal);
+            value *= powersOfTen[exponent];
         }
-        else if (strcmp(lineHeader, "f") == 0)
+        else if (exponent != 0)
         {
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", 
-                &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                &vertexIndex[1], &uvIndex[1], &normalIndex[1], 
-                &vertexIndex[2], &uvIndex[2], &normalIndex[2]
-                );
-            if (matches != 9)
+            value *= pow(10.0, exponent);
+        }
+    }
+
+    out = (float)(negative ? -value : value);
+    return p;
+}
+
+// parse a signed OBJ index ; returns NULL if there is no number at p or
+//  if it does not fit in an int
+static inline const char* parseIndex(const char* p, const char* end, long &out)
+{
+    bool negative = false;
+    if (p < end && *p == '-')
+    {
+        negative = true;
+        p++;
+    }
+    if (p >= end || !isDigit(*p))
+    {
+        return NULL;
+    }
+
+    long value = 0;
+    for (; p < end && isDigit(*p); p++)
+    {
+        long digit = *p - '0';
+        if (value > (0x7fffffffL - digit) / 10)
+        {
+            return NULL;
+        }
+        value = value * 10 + digit;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+// turn an index as written in the file into a zero-based one
+//  positive indices are 1-based, negative ones count back from the last record
+//  0, and negative ones before the first record, are invalid in OBJ : they
+//  are flagged as out of range, never as -1
+static inline int resolveIndex(long index, size_t count)
+{
+    if (index > 0)
+    {
+        return (int)(index - 1);
+    }
+    long resolved = (long)count + index;
+    return index < 0 && resolved >= 0 ? (int)resolved : -2;
+}
+
+// kind of record a line holds
+enum OBJRecord
+{
+    OBJ_OTHER,
+    OBJ_POSITION,
+    OBJ_UV,
+    OBJ_NORMAL,
+    OBJ_FACE
+};
+
+// classify the line starting at p ; on return p points after the keyword
+static inline OBJRecord classifyLine(const char* &p, const char* end)
+{
+    p = skipBlanks(p, end);
+    if (end - p < 2)
+    {
+        return OBJ_OTHER;
+    }
+
+    if (p[0] == 'v')
+    {
+        if (isBlank(p[1]))
+        {
+            p += 1;
+            return OBJ_POSITION;
+        }
+        if (end - p >= 3 && isBlank(p[2]))
+        {
+            if (p[1] == 't')
+            {
+                p += 2;
+                return OBJ_UV;
+            }
+            if (p[1] == 'n')
+            {
+                p += 2;
+                return OBJ_NORMAL;
+            }
+        }
+    }
+    else if (p[0] == 'f' && isBlank(p[1]))
+    {
+        p += 1;
+        return OBJ_FACE;
+    }
+    return OBJ_OTHER;
+}
+
+// number of whitespace separated words before the end of the line
+static inline size_t countWords(const char* p, const char* end)
+{
+    size_t words = 0;
+    while (true)
+    {
+        p = skipBlanks(p, end);
+        if (p >= end || *p == '\n' || *p == '#')
+        {
+            return words;
+        }
+        words++;
+        while (p < end && !isBlank(*p) && *p != '\n')
+        {
+            p++;
+        }
+    }
+}
+
+// first pass : count the records of [p, end) so every output can be sized once
+static void countOBJRecords(const char* p, const char* end, OBJCounts &counts)
+{
+    counts.positions = 0;
+    counts.uvs = 0;
+    counts.normals = 0;
+    counts.triangles = 0;
+
+    while (p < end)
+    {
+        switch (classifyLine(p, end))
+        {
+        case OBJ_POSITION:  counts.positions++;  break;
+        case OBJ_UV:        counts.uvs++;        break;
+        case OBJ_NORMAL:    counts.normals++;    break;
+        case OBJ_FACE:
+            {
+                size_t corners = countWords(p, end);
+                if (corners >= 3)
+                {
+                    counts.triangles += corners - 2;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+        p = skipLine(p, end);
+    }
+}
+
+// print where the parser gave up
+static void reportOBJError(const char* begin, const char* at, const char* what)
+{
+    unsigned int line = 1;
+    for (const char* c = begin; c < at; c++)
+    {
+        if (*c == '\n') line++;
+    }
+    printf("OBJ parse error at line %u: %s\n", line, what);
+}
+
+// second pass : parse the records of [p, end) into pre-sized arrays
+//  base holds the number of records that come before p in the file,
+//  it is used both as write offset and to resolve relative indices
+static bool parseOBJRecords(const char* begin, const char* p, const char* end,
+    const OBJCounts &base,
+    glm::vec3* positions,
+    glm::vec2* uvs,
+    glm::vec3* normals,
+    OBJCorner* corners
+    )
+{
+    OBJCounts at = base;
+
+    while (p < end)
+    {
+        const char* line = p;
+        switch (classifyLine(p, end))
+        {
+        case OBJ_POSITION:
+            {
+                glm::vec3 &vertex = positions[at.positions++];
+                if (!(p = parseFloat(skipBlanks(p, end), end, vertex.x)) ||
+                    !(p = parseFloat(skipBlanks(p, end), end, vertex.y)) ||
+                    !(p = parseFloat(skipBlanks(p, end), end, vertex.z)))
+                {
+                    reportOBJError(begin, line, "malformed vertex");
+                    return false;
+                }
+            }
+            break;
+
+        case OBJ_UV:
+            {
+                glm::vec2 &uv = uvs[at.uvs++];
+                if (!(p = parseFloat(skipBlanks(p, end), end, uv.x)))
+                {
+                    reportOBJError(begin, line, "malformed texture coordinate");
+                    return false;
+                }
+                // 1D texture coordinates leave v out
+                const char* v = parseFloat(skipBlanks(p, end), end, uv.y);
+                if (v)
+                {
+                    p = v;
+                }
+                else
+                {
+                    uv.y = 0.f;
+                }
+                uv.y = -uv.y; // invert V coord since we will only use DDS texture, which are inverted
+            }
+            break;
+
+        case OBJ_NORMAL:
+            {
+                glm::vec3 &normal = normals[at.normals++];
+                if (!(p = parseFloat(skipBlanks(p, end), end, normal.x)) ||
+                    !(p = parseFloat(skipBlanks(p, end), end, normal.y)) ||
+                    !(p = parseFloat(skipBlanks(p, end), end, normal.z)))
+                {
+                    reportOBJError(begin, line, "malformed normal");
+                    return false;
+                }
+            }
+            break;
+
+        case OBJ_FACE:
+            {
+                // fan triangulation : (0, k-1, k) for every corner k >= 2
+                OBJCorner first = {0, 0, 0};
+                OBJCorner previous = {0, 0, 0};
+                unsigned int cornerCount = 0;
+
+                while (true)
+                {
+                    p = skipBlanks(p, end);
+                    if (p >= end || *p == '\n' || *p == '#')
+                    {
+                        break;
+                    }
+
+                    // v, v/vt, v//vn or v/vt/vn
+                    long v = 0, vt = 0, vn = 0;
+                    bool hasUV = false, hasNormal = false;
+                    p = parseIndex(p, end, v);
+                    if (p && p < end && *p == '/')
+                    {
+                        p++;
+                        if (p < end && *p != '/')
+                        {
+                            p = parseIndex(p, end, vt);
+                            hasUV = true;
+                        }
+                        if (p && p < end && *p == '/')
+                        {
+                            p = parseIndex(p + 1, end, vn);
+                            hasNormal = true;
+                        }
+                    }
+                    if (!p || (p < end && !isBlank(*p) && *p != '\n'))
+                    {
+                        reportOBJError(begin, line, "malformed face");
+                        return false;
+                    }
+
+                    OBJCorner corner;
+                    corner.v  = resolveIndex(v, at.positions);
+                    corner.vt = hasUV ? resolveIndex(vt, at.uvs) : -1;
+                    corner.vn = hasNormal ? resolveIndex(vn, at.normals) : -1;
+
+                    if (cornerCount == 0)
+                    {
+                        first = corner;
+                    }
+                    else if (cornerCount >= 2)
+                    {
+                        OBJCorner* triangle = &corners[3 * at.triangles++];
+                        triangle[0] = first;
+                        triangle[1] = previous;
+                        triangle[2] = corner;
+                    }
+                    previous = corner;
+                    cornerCount++;
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+        p = skipLine(p, end);
+    }
+    return true;
+}
+
+// last pass : fetch the attributes of the triangles [first, last)
+static bool expandOBJTriangles(size_t first, size_t last,
+    const OBJCounts &total,
+    const glm::vec3* positions,
+    const glm::vec2* uvs,
+    const glm::vec3* normals,
+    const OBJCorner* corners,
+    glm::vec3* out_vertices,
+    glm::vec2* out_uvs,
+    glm::vec3* out_normals
+    )
+{
+    for (size_t t = first; t < last; t++)
+    {
+        const OBJCorner* triangle = &corners[3 * t];
+
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            const OBJCorner &c = triangle[k];
+            // negative values are out of range too once seen as unsigned
+            if ((size_t)(unsigned int)c.v >= total.positions ||
+                (c.vt != -1 && (size_t)(unsigned int)c.vt >= total.uvs) ||
+                (c.vn != -1 && (size_t)(unsigned int)c.vn >= total.normals))
             {
-                printf("File can't be read by our simple parser\n");
-                fclose(file);
+                printf("OBJ face %lu references a missing vertex\n", (unsigned long)t);
                 return false;
             }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices    .push_back(uvIndex[0]);
-            uvIndices    .push_back(uvIndex[1]);
-            uvIndices    .push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
+
+            out_vertices[3 * t + k] = positions[c.v];
+            out_uvs[3 * t + k] = c.vt != -1 ? uvs[c.vt] : glm::vec2(0.f, 0.f);
         }
-        else 
+
+        // without normals in the file, fall back to the flat face normal
+        glm::vec3 faceNormal(0.f, 0.f, 0.f);
+        if (triangle[0].vn == -1 || triangle[1].vn == -1 || triangle[2].vn == -1)
         {
-            // probably a comment, eat up the rest of the line
-            char stupidBuffer[1000];
-            fgets(stupidBuffer, 1000, file);
+            glm::vec3 n = glm::cross(
+                out_vertices[3 * t + 1] - out_vertices[3 * t + 0],
+                out_vertices[3 * t + 2] - out_vertices[3 * t + 0]
+                );
+            float len = glm::length(n);
+            if (len > 0.f)
+            {
+                faceNormal = n / len;
+            }
+        }
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            out_normals[3 * t + k] = triangle[k].vn != -1 ? normals[triangle[k].vn] : faceNormal;
         }
     }
+    return true;
+}
 
-    // for each vertex of each triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++) 
+// split [data, data + size) into about chunkCount ranges that start on a new line
+static void splitOBJChunks(const char* data, size_t size, size_t chunkCount,
+    std::vector<const char*> &bounds
+    )
+{
+    const char* end = data + size;
+    bounds.clear();
+    bounds.push_back(data);
+    for (size_t i = 1; i < chunkCount; i++)
     {
-        // get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
+        const char* at = data + size / chunkCount * i;
+        if (at <= bounds.back())
+        {
+            continue;
+        }
+        // a chunk owns every line that starts inside it
+        at = skipLine(at - 1, end);
+        if (at < end && at > bounds.back())
+        {
+            bounds.push_back(at);
+        }
+    }
+    bounds.push_back(end);
+}
 
-        // get the attributes thanks to the index
-        glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-        glm::vec2 uv = temp_uvs[uvIndex - 1];
-        glm::vec3 normal = temp_normals[normalIndex - 1];
+bool parseOBJ(const char* data, size_t size,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    OBJLoadStats* stats,
+    unsigned int threadCount
+    )
+{
+    PROFILE_SCOPE("parseOBJ");
+    auto startTime = std::chrono::steady_clock::now();
 
-        // put the attributes in buffers
-        out_vertices.push_back(vertex);
-        out_uvs     .push_back(uv);
-        out_normals .push_back(normal);
+    if (threadCount == 0)
+    {
+        threadCount = hardwareThreadCount();
+    }
+
+    // several chunks per thread so a slow one doesn't hold the others back,
+    //  but not so small that the bookkeeping shows up
+    const size_t minChunkSize = 256 * 1024;
+    size_t chunkCount = 1;
+    if (threadCount > 1)
+    {
+        chunkCount = size / minChunkSize;
+        if (chunkCount > 8 * (size_t)threadCount) chunkCount = 8 * (size_t)threadCount;
+        if (chunkCount < 1) chunkCount = 1;
+    }
+
+    std::vector<const char*> bounds;
+    splitOBJChunks(data, size, chunkCount, bounds);
+    chunkCount = bounds.size() - 1;
+
+    // count everything first, so nothing has to grow while parsing
+    std::vector<OBJCounts> chunkCounts(chunkCount);
+    parallelFor(chunkCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; c++)
+        {
+            countOBJRecords(bounds[c], bounds[c + 1], chunkCounts[c]);
+        }
+    }, threadCount);
+
+    // prefix sums : where each chunk writes, and how many records come before it
+    std::vector<OBJCounts> chunkBases(chunkCount);
+    OBJCounts total = {0, 0, 0, 0};
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        chunkBases[c] = total;
+        total.positions += chunkCounts[c].positions;
+        total.uvs       += chunkCounts[c].uvs;
+        total.normals   += chunkCounts[c].normals;
+        total.triangles += chunkCounts[c].triangles;
+    }
+
+    // plain new[] : no point in zeroing what is about to be overwritten
+    std::unique_ptr<glm::vec3[]> temp_vertices(new glm::vec3[total.positions]);
+    std::unique_ptr<glm::vec2[]> temp_uvs(new glm::vec2[total.uvs]);
+    std::unique_ptr<glm::vec3[]> temp_normals(new glm::vec3[total.normals]);
+    std::unique_ptr<OBJCorner[]> corners(new OBJCorner[3 * total.triangles]);
+
+    std::atomic<bool> ok(true);
+    parallelFor(chunkCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last && ok; c++)
+        {
+            if (!parseOBJRecords(data, bounds[c], bounds[c + 1], chunkBases[c],
+                    temp_vertices.get(), temp_uvs.get(), temp_normals.get(), corners.get()))
+            {
+                ok = false;
+            }
+        }
+    }, threadCount);
+    if (!ok)
+    {
+        return false;
+    }
+
+    // append, like the fscanf based loader used to
+    size_t offset = out_vertices.size();
+    size_t count = 3 * total.triangles;
+    out_vertices.resize(offset + count);
+    out_uvs     .resize(offset + count);
+    out_normals .resize(offset + count);
+
+    const size_t trianglesPerBlock = 64 * 1024;
+    parallelFor(total.triangles, trianglesPerBlock, [&](size_t first, size_t last)
+    {
+        if (ok && !expandOBJTriangles(first, last, total,
+                temp_vertices.get(), temp_uvs.get(), temp_normals.get(), corners.get(),
+                out_vertices.data() + offset, out_uvs.data() + offset, out_normals.data() + offset))
+        {
+            ok = false;
+        }
+    }, threadCount);
+    if (!ok)
+    {
+        out_vertices.resize(offset);
+        out_uvs     .resize(offset);
+        out_normals .resize(offset);
+        return false;
+    }
+
+    if (stats)
+    {
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - startTime).count();
+        stats->bytes = size;
+        stats->positions = total.positions;
+        stats->uvs = total.uvs;
+        stats->normals = total.normals;
+        stats->triangles = total.triangles;
+        stats->threads = threadCount < chunkCount ? threadCount : (unsigned int)chunkCount;
+        stats->milliseconds = ms;
+        stats->megabytesPerSecond = ms > 0.0 ? (size / (1024.0 * 1024.0)) / (ms / 1000.0) : 0.0;
     }
-    fclose(file);
-    
     return true;
 }
 
+// map the file, parse it and print how fast that went
+static bool loadOBJFile(const char* path,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    unsigned int threadCount
+    )
+{
+    printf("Loading OBJ file %s...\n", path);
+
+    MappedFile file;
+    if (!mapFile(path, file))
+    {
+        printf("Impossible to open the file!\n");
+        getchar();
+        return false;
+    }
+
+    OBJLoadStats stats;
+    bool res = parseOBJ(file.data, file.size, out_vertices, out_uvs, out_normals, &stats, threadCount);
+    unmapFile(file);
+
+    if (res)
+    {
+        printf("Parsed %lu triangles, %.2f MB in %.2f ms on %u thread(s) (%.1f MB/s)\n",
+            (unsigned long)stats.triangles, stats.bytes / (1024.0 * 1024.0),
+            stats.milliseconds, stats.threads, stats.megabytesPerSecond);
+    }
+    return res;
+}
+
+bool loadOBJ(const char* path,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals
+    )
+{
+    return loadOBJFile(path, out_vertices, out_uvs, out_normals, 1);
+}
+
+bool loadOBJ_parallel(const char* path,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    unsigned int threadCount
+    )
+{
+    return loadOBJFile(path, out_vertices, out_uvs, out_normals, threadCount);
+}
+
 bool loadAssImp(const char* path,
     std::vector<unsigned short> &indices,
     std::vector<glm::vec3> &vertices,
@@ -119,4 +695,4 @@ bool loadAssImp(const char* path,
     )
 {
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "common/glstate.hpp"
+#include "common/offscreen.hpp"
+
+#ifdef HAVE_EGL
+
+static bool hasExtension(const char* extensions, const char* name)
+{
+    if (extensions == NULL)
+    {
+        return false;
+    }
+    size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found; found = strstr(found + 1, name))
+    {
+        if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static EGLDisplay openDisplay()
+{
+    // the surfaceless platform needs no X, Wayland or DRM device
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+        {
+            return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// the color and depth buffers, multisampled or not ; false if incomplete
+static bool createFramebuffer(OffscreenContext &offscreen, unsigned int samples)
+{
+    glGenFramebuffers(1, &offscreen.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+
+    GLuint renderbuffers[2];
+    glGenRenderbuffers(2, renderbuffers);
+    offscreen.colorBuffer = renderbuffers[0];
+    offscreen.depthBuffer = renderbuffers[1];
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreen.colorBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_RGBA8, offscreen.width, offscreen.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreen.depthBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH_COMPONENT24, offscreen.width, offscreen.height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen.colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen.depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    offscreen.resolveFramebuffer = 0;
+    offscreen.resolveBuffer = 0;
+    if (complete && samples > 1)
+    {
+        // where the samples are averaged before reading them back, like a
+        //  window does before presenting
+        glGenFramebuffers(1, &offscreen.resolveFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen.resolveFramebuffer);
+        glGenRenderbuffers(1, &offscreen.resolveBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, offscreen.resolveBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, offscreen.width, offscreen.height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen.resolveBuffer);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    offscreen.samples = samples > 1 ? samples : 1;
+    return complete;
+}
+
+static void deleteFramebuffer(OffscreenContext &offscreen)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLuint framebuffers[2] = { offscreen.framebuffer, offscreen.resolveFramebuffer };
+    GLuint renderbuffers[3] = { offscreen.colorBuffer, offscreen.depthBuffer, offscreen.resolveBuffer };
+    glDeleteFramebuffers(2, framebuffers);
+    glDeleteRenderbuffers(3, renderbuffers);
+    offscreen.framebuffer = 0;
+    offscreen.resolveFramebuffer = 0;
+}
+
+bool createOffscreenContext(OffscreenContext &offscreen, unsigned int width, unsigned int height, unsigned int samples)
+{
+    offscreen.display = NULL;
+    offscreen.context = NULL;
+    offscreen.width = width;
+    offscreen.height = height;
+
+    EGLDisplay display = openDisplay();
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        fprintf(stderr, "Failed to open an EGL display\n");
+        return false;
+    }
+    if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+    {
+        fprintf(stderr, "EGL %d.%d can't make a context current without a surface\n", major, minor);
+        eglTerminate(display);
+        return false;
+    }
+
+    // the surfaceless platform may have no config with a surface type
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = NULL;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    // the same context the window asks GLFW for
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = EGL_NO_CONTEXT;
+    if (eglBindAPI(EGL_OPENGL_API))
+    {
+        context = eglCreateContext(display, configCount > 0 ? config : NULL, EGL_NO_CONTEXT, contextAttributes);
+    }
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        fprintf(stderr, "Failed to create an OpenGL 3.3 core context on EGL %d.%d\n", major, minor);
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+        return false;
+    }
+    offscreen.display = display;
+    offscreen.context = context;
+
+    glewExperimental = true; // Needed for core profile
+    GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // a GLX build of GLEW finds no X display, but the GL entry points are loaded
+    if (glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        glewStatus = GLEW_OK;
+    }
+#endif
+    if (glewStatus != GLEW_OK)
+    {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        destroyOffscreenContext(offscreen);
+        return false;
+    }
+    // glewInit() may leave an error behind on core contexts
+    glGetError();
+
+    if (!createFramebuffer(offscreen, samples))
+    {
+        deleteFramebuffer(offscreen);
+        if (samples <= 1 || !createFramebuffer(offscreen, 1))
+        {
+            fprintf(stderr, "Failed to create a %ux%u framebuffer\n", width, height);
+            destroyOffscreenContext(offscreen);
+            return false;
+        }
+        printf("No %ux multisampling, rendering with one sample\n", samples);
+    }
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    printf("Offscreen %ux%u, %u samples : %s, OpenGL %s\n", width, height, offscreen.samples,
+        (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    return true;
+}
+
+void destroyOffscreenContext(OffscreenContext &offscreen)
+{
+    if (offscreen.display == NULL)
+    {
+        return;
+    }
+    if (offscreen.framebuffer != 0)
+    {
+        deleteFramebuffer(offscreen);
+    }
+    eglMakeCurrent((EGLDisplay)offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext((EGLDisplay)offscreen.display, (EGLContext)offscreen.context);
+    eglTerminate((EGLDisplay)offscreen.display);
+    offscreen.display = NULL;
+    offscreen.context = NULL;
+}
+
+#else   // HAVE_EGL
+
+bool createOffscreenContext(OffscreenContext &offscreen, unsigned int width, unsigned int height, unsigned int samples)
+{
+    offscreen.display = NULL;
+    offscreen.context = NULL;
+    offscreen.width = width;
+    offscreen.height = height;
+    offscreen.samples = samples;
+    offscreen.framebuffer = 0;
+    fprintf(stderr, "Built without EGL, there is no offscreen context\n");
+    return false;
+}
+
+void destroyOffscreenContext(OffscreenContext &offscreen)
+{
+    offscreen.display = NULL;
+    offscreen.context = NULL;
+}
+
+#endif  // HAVE_EGL
+
+void readOffscreenPixels(OffscreenContext &offscreen, std::vector<unsigned char> &rgb)
+{
+    unsigned int width = offscreen.width;
+    unsigned int height = offscreen.height;
+    rgb.resize((size_t)width * height * 3);
+
+    if (offscreen.resolveFramebuffer != 0)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, offscreen.resolveFramebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen.resolveFramebuffer);
+    }
+    else
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen.framebuffer);
+    }
+
+    // into client memory, tightly packed, bottom row first as GL has it
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    std::vector<unsigned char> flipped(rgb.size());
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, flipped.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+
+    size_t rowSize = (size_t)width * 3;
+    for (unsigned int y = 0; y < height; y++)
+    {
+        memcpy(&rgb[y * rowSize], &flipped[(height - 1 - y) * rowSize], rowSize);
+    }
+}
@@ -0,0 +1,146 @@
+// packet kernels against a lanes type, see bvh.cpp
+//  included there once for the baseline lanes and once more inside an AVX
+//  region, so no include guard and no includes of its own
+
+// does any ray of the packet enter the box before its closest hit
+template <typename L>
+static bool packetHitsBox(const BVHNode &node, const RayPacket &packet, const PacketState &state)
+{
+    for (unsigned int i = 0; i < rayPacketSize; i += L::width)
+    {
+        typename L::Value ox = L::load(packet.originX + i);
+        typename L::Value oy = L::load(packet.originY + i);
+        typename L::Value oz = L::load(packet.originZ + i);
+        typename L::Value ix = L::load(state.inverseX + i);
+        typename L::Value iy = L::load(state.inverseY + i);
+        typename L::Value iz = L::load(state.inverseZ + i);
+
+        typename L::Value x0 = L::mul(L::sub(L::set1(node.boundsMin.x), ox), ix);
+        typename L::Value x1 = L::mul(L::sub(L::set1(node.boundsMax.x), ox), ix);
+        typename L::Value y0 = L::mul(L::sub(L::set1(node.boundsMin.y), oy), iy);
+        typename L::Value y1 = L::mul(L::sub(L::set1(node.boundsMax.y), oy), iy);
+        typename L::Value z0 = L::mul(L::sub(L::set1(node.boundsMin.z), oz), iz);
+        typename L::Value z1 = L::mul(L::sub(L::set1(node.boundsMax.z), oz), iz);
+
+        typename L::Value enter = L::max(L::max(L::min(x0, x1), L::min(y0, y1)), L::max(L::min(z0, z1), L::set1(0.f)));
+        typename L::Value exit = L::min(L::min(L::max(x0, x1), L::max(y0, y1)), L::min(L::max(z0, z1), L::load(state.t + i)));
+        if (L::any(L::lessEqual(enter, exit)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moller-Trumbore for every ray of the packet against one triangle
+template <typename L>
+static void packetHitsTriangle(const glm::vec3* vertices, uint32_t index, const RayPacket &packet, PacketState &state)
+{
+    glm::vec3 e1 = vertices[1] - vertices[0];
+    glm::vec3 e2 = vertices[2] - vertices[0];
+    typename L::Value e1x = L::set1(e1.x), e1y = L::set1(e1.y), e1z = L::set1(e1.z);
+    typename L::Value e2x = L::set1(e2.x), e2y = L::set1(e2.y), e2z = L::set1(e2.z);
+    typename L::Value zero = L::set1(0.f);
+    typename L::Value one = L::set1(1.f);
+    typename L::Value minDeterminant = L::set1(minTriangleDeterminant);
+
+    for (unsigned int i = 0; i < rayPacketSize; i += L::width)
+    {
+        typename L::Value dx = L::load(packet.directionX + i);
+        typename L::Value dy = L::load(packet.directionY + i);
+        typename L::Value dz = L::load(packet.directionZ + i);
+
+        // p = direction x e2
+        typename L::Value px = L::sub(L::mul(dy, e2z), L::mul(dz, e2y));
+        typename L::Value py = L::sub(L::mul(dz, e2x), L::mul(dx, e2z));
+        typename L::Value pz = L::sub(L::mul(dx, e2y), L::mul(dy, e2x));
+        typename L::Value determinant = L::add(L::add(L::mul(e1x, px), L::mul(e1y, py)), L::mul(e1z, pz));
+        typename L::Value inverse = L::div(one, determinant);
+
+        // s = origin - v0
+        typename L::Value sx = L::sub(L::load(packet.originX + i), L::set1(vertices[0].x));
+        typename L::Value sy = L::sub(L::load(packet.originY + i), L::set1(vertices[0].y));
+        typename L::Value sz = L::sub(L::load(packet.originZ + i), L::set1(vertices[0].z));
+        typename L::Value u = L::mul(L::add(L::add(L::mul(sx, px), L::mul(sy, py)), L::mul(sz, pz)), inverse);
+
+        // q = s x e1
+        typename L::Value qx = L::sub(L::mul(sy, e1z), L::mul(sz, e1y));
+        typename L::Value qy = L::sub(L::mul(sz, e1x), L::mul(sx, e1z));
+        typename L::Value qz = L::sub(L::mul(sx, e1y), L::mul(sy, e1x));
+        typename L::Value v = L::mul(L::add(L::add(L::mul(dx, qx), L::mul(dy, qy)), L::mul(dz, qz)), inverse);
+        typename L::Value t = L::mul(L::add(L::add(L::mul(e2x, qx), L::mul(e2y, qy)), L::mul(e2z, qz)), inverse);
+
+        // rays nearly parallel to the triangle miss it, as in
+        //  intersectTriangle()
+        typename L::Value closest = L::load(state.t + i);
+        typename L::Mask hit = L::both(
+            L::both(L::lessEqual(minDeterminant, L::abs(determinant)),
+                    L::both(L::lessEqual(zero, u), L::lessEqual(zero, v))),
+            L::both(L::lessEqual(L::add(u, v), one),
+                    L::both(L::lessEqual(zero, t), L::less(t, closest))));
+        if (!L::any(hit))
+        {
+            continue;
+        }
+        L::store(state.t + i, L::select(hit, t, closest));
+        L::store(state.u + i, L::select(hit, u, L::load(state.u + i)));
+        L::store(state.v + i, L::select(hit, v, L::load(state.v + i)));
+        L::store(state.triangle + i, L::select(hit, L::set1(indexBits(index)), L::load(state.triangle + i)));
+    }
+}
+
+// the closest hits of the packet in the tree, into state
+template <typename L>
+static void packetTraverse(const BVH &bvh, const RayPacket &packet, PacketState &state)
+{
+    // the children are visited in the order the packet's first ray meets
+    //  them, a good guess for coherent rays
+    glm::vec3 origin(packet.originX[0], packet.originY[0], packet.originZ[0]);
+    glm::vec3 inverseDirection(state.inverseX[0], state.inverseY[0], state.inverseZ[0]);
+
+    TraversalStack traversal;
+    uint32_t* stack = traversal.reserve(bvh);
+    unsigned int depth = 0;
+    uint32_t index = 0;
+    bool visit = packetHitsBox<L>(bvh.nodes[0], packet, state);
+    while (visit)
+    {
+        const BVHNode &node = bvh.nodes[index];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            {
+                packetHitsTriangle<L>(&bvh.vertices[3 * i], i, packet, state);
+            }
+        }
+        else
+        {
+            uint32_t first = index + 1;
+            uint32_t second = node.offset;
+            if (intersectBox(bvh.nodes[second], origin, inverseDirection, FLT_MAX) <
+                intersectBox(bvh.nodes[first], origin, inverseDirection, FLT_MAX))
+            {
+                std::swap(first, second);
+            }
+            bool firstHit = packetHitsBox<L>(bvh.nodes[first], packet, state);
+            bool secondHit = packetHitsBox<L>(bvh.nodes[second], packet, state);
+            if (firstHit || secondHit)
+            {
+                if (firstHit && secondHit)
+                {
+                    stack[depth++] = second;
+                }
+                index = firstHit ? first : second;
+                continue;
+            }
+        }
+
+        // the hits found meanwhile may have put the next node out of reach
+        visit = false;
+        while (depth > 0 && !visit)
+        {
+            index = stack[--depth];
+            visit = packetHitsBox<L>(bvh.nodes[index], packet, state);
+        }
+    }
+}
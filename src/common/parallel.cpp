@@ -0,0 +1,222 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+
+unsigned int hardwareThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void parallelFor(
+    size_t count,
+    size_t grainSize,
+    const std::function<void(size_t begin, size_t end)>& body,
+    unsigned int threadCount
+)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (grainSize == 0)
+    {
+        grainSize = 1;
+    }
+
+    size_t blockCount = (count + grainSize - 1) / grainSize;
+    if (threadCount == 0)
+    {
+        threadCount = hardwareThreadCount();
+    }
+    if (threadCount > blockCount)
+    {
+        threadCount = (unsigned int)blockCount;
+    }
+
+    // nothing to share, don't pay for spawning threads
+    if (threadCount <= 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    // every worker grabs the next free block until there is none left
+    std::atomic<size_t> nextBlock(0);
+    auto worker = [&]()
+    {
+        while (true)
+        {
+            size_t block = nextBlock.fetch_add(1);
+            if (block >= blockCount)
+            {
+                return;
+            }
+            size_t begin = block * grainSize;
+            size_t end = begin + grainSize < count ? begin + grainSize : count;
+            body(begin, end);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned int i = 1; i < threadCount; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (unsigned int i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
+
+static void workerLoop(WorkerPool &pool, unsigned int index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", index);
+    setProfilerThreadName(name);
+
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.wake.wait(lock, [&pool]() { return pool.stopping || !pool.tasks.empty(); });
+            if (pool.tasks.empty())
+            {
+                return;     // stopping and drained
+            }
+            task = std::move(pool.tasks.front());
+            pool.tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void startWorkerPool(WorkerPool &pool, unsigned int threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = hardwareThreadCount();
+    }
+    pool.stopping = false;
+    pool.threads.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        pool.threads.push_back(std::thread(workerLoop, std::ref(pool), i));
+    }
+}
+
+void stopWorkerPool(WorkerPool &pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (unsigned int i = 0; i < pool.threads.size(); i++)
+    {
+        pool.threads[i].join();
+    }
+    pool.threads.clear();
+}
+
+void submitTask(WorkerPool &pool, std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.tasks.push_back(std::move(task));
+    }
+    pool.wake.notify_one();
+}
+
+// a parallelFor() on a pool, shared with the tasks that may start after it
+//  returned ; body is only called while blocks are left, so while it lives
+struct PoolLoop
+{
+    std::atomic<size_t> nextBlock;
+    size_t blockCount;
+    size_t count;
+    size_t grainSize;
+    const std::function<void(size_t begin, size_t end)>* body;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t doneBlocks;
+};
+
+// grab blocks until there is none left
+static void runPoolLoop(PoolLoop &loop)
+{
+    size_t done = 0;
+    while (true)
+    {
+        size_t block = loop.nextBlock.fetch_add(1);
+        if (block >= loop.blockCount)
+        {
+            break;
+        }
+        size_t begin = block * loop.grainSize;
+        size_t end = begin + loop.grainSize < loop.count ? begin + loop.grainSize : loop.count;
+        (*loop.body)(begin, end);
+        done++;
+    }
+    if (done > 0)
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.doneBlocks += done;
+        if (loop.doneBlocks == loop.blockCount)
+        {
+            loop.finished.notify_all();
+        }
+    }
+}
+
+void parallelFor(
+    WorkerPool &pool,
+    size_t count,
+    size_t grainSize,
+    const std::function<void(size_t begin, size_t end)>& body
+)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (grainSize == 0)
+    {
+        grainSize = 1;
+    }
+
+    size_t blockCount = (count + grainSize - 1) / grainSize;
+    size_t helperCount = pool.threads.size() < blockCount - 1 ? pool.threads.size() : blockCount - 1;
+    if (helperCount == 0)
+    {
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<PoolLoop> loop = std::make_shared<PoolLoop>();
+    loop->nextBlock = 0;
+    loop->blockCount = blockCount;
+    loop->count = count;
+    loop->grainSize = grainSize;
+    loop->body = &body;
+    loop->doneBlocks = 0;
+    for (size_t i = 0; i < helperCount; i++)
+    {
+        submitTask(pool, [loop]() { runPoolLoop(*loop); });
+    }
+    runPoolLoop(*loop);
+
+    // only the blocks other threads already took are waited for
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->finished.wait(lock, [&loop]() { return loop->doneBlocks == loop->blockCount; });
+}
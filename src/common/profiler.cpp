@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/profiler.hpp"
+#include "common/json.hpp"
+
+// one finished scope ; sequence is a seqlock : odd while written, then
+//  2 * (index + 1) once the sample of that ring index is complete
+struct ProfileSample
+{
+    std::atomic<uint64_t> sequence;
+    const char* name;
+    char detail[48];
+    int64_t start;              // ns, on the profiler's clock
+    int64_t end;
+    uint32_t thread;
+};
+
+static ProfileSample ring[profileCapacity];
+static std::atomic<uint64_t> writeIndex(0);
+
+// thread 0 is the GPU, CPU threads count from 1 in the order they record
+static const uint32_t gpuThread = 0;
+static std::atomic<uint32_t> nextThread(1);
+static std::mutex threadNamesMutex;
+static std::vector<std::string> threadNames(1, "GPU");
+
+static const std::chrono::steady_clock::time_point profileEpoch = std::chrono::steady_clock::now();
+
+int64_t profileTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - profileEpoch).count();
+}
+
+static uint32_t currentThread()
+{
+    static thread_local uint32_t thread = 0;
+    if (thread == 0)
+    {
+        thread = nextThread++;
+        std::lock_guard<std::mutex> lock(threadNamesMutex);
+        if (threadNames.size() <= thread)
+        {
+            threadNames.resize(thread + 1);
+        }
+    }
+    return thread;
+}
+
+void setProfilerThreadName(const char* name)
+{
+    uint32_t thread = currentThread();
+    std::lock_guard<std::mutex> lock(threadNamesMutex);
+    threadNames[thread] = name;
+}
+
+// no lock : every writer owns the slot of the index it took, and the
+//  reader skips slots that change under it
+static void recordSample(const char* name, const char* detail, int64_t start, int64_t end, uint32_t thread)
+{
+    uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+    ProfileSample &sample = ring[index & (profileCapacity - 1)];
+    sample.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    sample.name = name;
+    if (detail != NULL)
+    {
+        strncpy(sample.detail, detail, sizeof(sample.detail) - 1);
+        sample.detail[sizeof(sample.detail) - 1] = 0;
+    }
+    else
+    {
+        sample.detail[0] = 0;
+    }
+    sample.start = start;
+    sample.end = end;
+    sample.thread = thread;
+
+    sample.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+ProfileScope::ProfileScope(const char* name, const char* detail)
+    : name(name), detail(detail), start(profileTime())
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+    recordSample(name, detail, start, profileTime(), currentThread());
+}
+
+// what the GPU scopes of one frame wrote
+struct GPUFrame
+{
+    GLuint queries[2 * maxGPUScopes];       // begin and end of each scope
+    const char* names[maxGPUScopes];
+    unsigned int count;
+};
+
+static const unsigned int maxGPUDepth = 16;
+
+// the frame being recorded and the gpuProfileLatency ones before it, whose
+//  queries may still be in flight
+static const unsigned int gpuFrameSlots = gpuProfileLatency + 1;
+
+static struct
+{
+    bool started;
+    GPUFrame frames[gpuFrameSlots];
+    unsigned int frame;                     // the one being recorded
+    unsigned int stack[maxGPUDepth];        // open scopes, maxGPUScopes when dropped
+    unsigned int depth;
+    unsigned int dropped;
+} gpu;
+
+void startGPUProfiler()
+{
+    for (unsigned int i = 0; i < gpuFrameSlots; i++)
+    {
+        glGenQueries(2 * maxGPUScopes, gpu.frames[i].queries);
+        gpu.frames[i].count = 0;
+    }
+    gpu.frame = 0;
+    gpu.depth = 0;
+    gpu.dropped = 0;
+    gpu.started = true;
+}
+
+void beginGPUScope(const char* name)
+{
+    if (!gpu.started)
+    {
+        return;
+    }
+    GPUFrame &frame = gpu.frames[gpu.frame];
+    unsigned int scope = maxGPUScopes;
+    if (frame.count < maxGPUScopes && gpu.depth < maxGPUDepth)
+    {
+        scope = frame.count++;
+        frame.names[scope] = name;
+        glQueryCounter(frame.queries[2 * scope], GL_TIMESTAMP);
+    }
+    else
+    {
+        gpu.dropped++;
+    }
+    if (gpu.depth < maxGPUDepth)
+    {
+        gpu.stack[gpu.depth] = scope;
+    }
+    gpu.depth++;
+}
+
+void endGPUScope()
+{
+    if (!gpu.started || gpu.depth == 0)
+    {
+        return;
+    }
+    gpu.depth--;
+    if (gpu.depth < maxGPUDepth && gpu.stack[gpu.depth] < maxGPUScopes)
+    {
+        GPUFrame &frame = gpu.frames[gpu.frame];
+        glQueryCounter(frame.queries[2 * gpu.stack[gpu.depth] + 1], GL_TIMESTAMP);
+    }
+}
+
+// the results of a frame as samples on the CPU clock, if they are there
+static void readGPUFrame(GPUFrame &frame, bool wait)
+{
+    if (frame.count == 0)
+    {
+        return;
+    }
+    // timestamps land in order, the last end is the last to be written
+    GLint available = GL_FALSE;
+    if (!wait)
+    {
+        glGetQueryObjectiv(frame.queries[2 * frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (!wait && available != GL_TRUE)
+    {
+        gpu.dropped += frame.count;
+        frame.count = 0;
+        return;
+    }
+
+    // from GPU time to the profiler's clock, measured now : the offset
+    //  drifts slowly so it does not matter that the frame is older
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    int64_t offset = profileTime() - gpuNow;
+
+    for (unsigned int i = 0; i < frame.count; i++)
+    {
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+        recordSample(frame.names[i], NULL, (int64_t)begin + offset, (int64_t)end + offset, gpuThread);
+    }
+    frame.count = 0;
+}
+
+void profileFrame()
+{
+    if (!gpu.started)
+    {
+        return;
+    }
+    // scopes left open are closed by the frame
+    while (gpu.depth > 0)
+    {
+        endGPUScope();
+    }
+    // the next frame records where the oldest one was, gpuProfileLatency
+    //  frames before the one just ended ; it is read first
+    gpu.frame = (gpu.frame + 1) % gpuFrameSlots;
+    readGPUFrame(gpu.frames[gpu.frame], false);
+}
+
+void stopGPUProfiler()
+{
+    if (!gpu.started)
+    {
+        return;
+    }
+    while (gpu.depth > 0)
+    {
+        endGPUScope();
+    }
+    // the last frames are waited for, nothing runs after them anyway
+    for (unsigned int i = 1; i <= gpuFrameSlots; i++)
+    {
+        readGPUFrame(gpu.frames[(gpu.frame + i) % gpuFrameSlots], true);
+    }
+    for (unsigned int i = 0; i < gpuFrameSlots; i++)
+    {
+        glDeleteQueries(2 * maxGPUScopes, gpu.frames[i].queries);
+    }
+    gpu.started = false;
+}
+
+GPUProfileScope::GPUProfileScope(const char* name)
+{
+    beginGPUScope(name);
+}
+
+GPUProfileScope::~GPUProfileScope()
+{
+    endGPUScope();
+}
+
+ProfilerStats profilerStats()
+{
+    ProfilerStats stats;
+    stats.recorded = writeIndex.load();
+    stats.gpuDropped = gpu.dropped;
+    return stats;
+}
+
+bool writeChromeTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Could not write %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    {
+        std::lock_guard<std::mutex> lock(threadNamesMutex);
+        for (size_t i = 0; i < threadNames.size(); i++)
+        {
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+                i > 0 ? ",\n" : "", (unsigned int)i);
+            if (threadNames[i].empty())
+            {
+                fprintf(file, "\"thread %u\"}}", (unsigned int)i);
+            }
+            else
+            {
+                writeJSONString(file, threadNames[i].c_str());
+                fprintf(file, "}}");
+            }
+        }
+    }
+
+    // the samples still in the ring, oldest first ; those being written or
+    //  overwritten meanwhile are skipped
+    uint64_t end = writeIndex.load(std::memory_order_acquire);
+    uint64_t begin = end > profileCapacity ? end - profileCapacity : 0;
+    unsigned int written = 0;
+    for (uint64_t index = begin; index < end; index++)
+    {
+        ProfileSample &slot = ring[index & (profileCapacity - 1)];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * index + 2)
+        {
+            continue;
+        }
+        const char* name = slot.name;
+        char detail[sizeof(slot.detail)];
+        memcpy(detail, slot.detail, sizeof(detail));
+        detail[sizeof(detail) - 1] = 0;
+        int64_t start = slot.start;
+        int64_t finish = slot.end;
+        uint32_t thread = slot.thread;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        // complete events, in us
+        fprintf(file, ",\n{\"name\": ");
+        writeJSONString(file, name);
+        fprintf(file, ", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+            thread == gpuThread ? "gpu" : "cpu", thread, start / 1000.0, (finish - start) / 1000.0);
+        if (detail[0] != 0)
+        {
+            fprintf(file, ", \"args\": {\"detail\": ");
+            writeJSONString(file, detail);
+            fprintf(file, "}");
+        }
+        fprintf(file, "}");
+        written++;
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = ferror(file) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (ok)
+    {
+        printf("Trace of %u samples written to %s\n", written, path);
+    }
+    else
+    {
+        printf("Could not write %s\n", path);
+    }
+    return ok;
+}
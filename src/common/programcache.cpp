@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "common/glstate.hpp"
+#include "common/hash.hpp"
+#include "common/mappedfile.hpp"
+#include "common/programcache.hpp"
+
+// bump whenever the file layout changes
+static const uint32_t programCacheVersion = 1;
+static const char programCacheMagic[4] = {'T', 'G', 'P', 'B'};
+
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;               // the file name can collide, this can't
+    uint32_t binaryFormat;
+    uint32_t binarySize;
+};
+
+static std::string cacheDirectory = "shaders/cache";
+static bool cacheDisabled = false;
+static ProgramCacheStats stats = { 0, 0, 0, 0 };
+
+void setProgramCacheDirectory(const char* path)
+{
+    cacheDisabled = path == NULL;
+    cacheDirectory = path ? path : "";
+}
+
+bool programCacheEnabled()
+{
+    if (cacheDisabled || !GLEW_ARB_get_program_binary)
+    {
+        return false;
+    }
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+static std::string cachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return cacheDirectory + name;
+}
+
+uint64_t programCacheKey(const char* vertex_code, const char* fragment_code, const char* defines)
+{
+    // every part ends with a 0, "ab" + "c" and "a" + "bc" don't collide
+    const char* parts[] = {
+        (const char*)glGetString(GL_VENDOR),
+        (const char*)glGetString(GL_RENDERER),
+        (const char*)glGetString(GL_VERSION),
+        (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION),
+        defines, vertex_code, fragment_code
+    };
+    std::string text;
+    for (unsigned int i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        if (parts[i] != NULL)
+        {
+            text += parts[i];
+        }
+        text += '\0';
+    }
+    return hashFileContent(text.data(), text.size());
+}
+
+GLuint loadProgramBinary(uint64_t key)
+{
+    MappedFile file;
+    if (!mapFile(cachePath(key).c_str(), file))
+    {
+        stats.misses++;
+        return 0;
+    }
+
+    ProgramCacheHeader header;
+    if (file.size < sizeof(header))
+    {
+        unmapFile(file);
+        stats.misses++;
+        return 0;
+    }
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, programCacheMagic, 4) != 0 ||
+        header.version != programCacheVersion ||
+        header.key != key ||
+        header.binarySize != file.size - sizeof(header))
+    {
+        unmapFile(file);
+        stats.misses++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, file.data + sizeof(header), header.binarySize);
+    unmapFile(file);
+
+    // the driver may refuse a binary for reasons of its own, e.g. an update
+    //  that kept the version string
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        deleteProgram(program);
+        stats.rejected++;
+        return 0;
+    }
+    stats.hits++;
+    return program;
+}
+
+bool storeProgramBinary(uint64_t key, GLuint program)
+{
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+    {
+        return false;
+    }
+
+    std::vector<char> image(sizeof(ProgramCacheHeader) + size);
+    ProgramCacheHeader header;
+    memcpy(header.magic, programCacheMagic, 4);
+    header.version = programCacheVersion;
+    header.key = key;
+    GLenum binaryFormat = 0;
+    GLsizei length = 0;
+    glGetProgramBinary(program, size, &length, &binaryFormat, &image[sizeof(header)]);
+    if (length <= 0)
+    {
+        return false;
+    }
+    header.binaryFormat = binaryFormat;
+    header.binarySize = (uint32_t)length;
+    memcpy(&image[0], &header, sizeof(header));
+    image.resize(sizeof(header) + length);
+
+    if (mkdir(cacheDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        printf("Could not create the program cache %s\n", cacheDirectory.c_str());
+        return false;
+    }
+
+    // write through a temporary file, a crash never leaves half a binary behind
+    std::string path = cachePath(key);
+    std::string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    stats.stored++;
+    return true;
+}
+
+ProgramCacheStats programCacheStats()
+{
+    return stats;
+}
@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#include "common/scenegraph.hpp"
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+
+// nodes per block of an update : subtrees up to this size are updated
+//  whole by one thread, the levels of bigger ones are split in such blocks
+static const unsigned int sceneUpdateGrain = 4 * 1024;
+// subtrees per block, most of them are a few nodes
+static const size_t sceneRootGrain = 256;
+
+// bits [begin, end) of a word, begin < end <= 64
+static inline uint64_t bitRange(unsigned int begin, unsigned int end)
+{
+    uint64_t below = end < 64 ? (uint64_t(1) << end) - 1 : ~uint64_t(0);
+    return below & ~((uint64_t(1) << begin) - 1);
+}
+
+static inline void markNode(SceneGraph &graph, unsigned int node)
+{
+    graph.dirty[node >> 6] |= uint64_t(1) << (node & 63);
+}
+
+template <typename T>
+static void permute(std::vector<T> &values, const std::vector<unsigned int> &order)
+{
+    std::vector<T> sorted(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        sorted[i] = values[order[i]];
+    }
+    values.swap(sorted);
+}
+
+// back to breadth first order : the roots in the order they were added, then
+//  the children of each node in that order ; parents always come before
+//  their children already, so a node's level is known when it is reached
+static void sortSceneGraph(SceneGraph &graph)
+{
+    unsigned int count = sceneNodeCount(graph);
+
+    // the children of each node, in the order they were added
+    std::vector<unsigned int> childStart(count + 1, 0);
+    std::vector<unsigned int> order;
+    order.reserve(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (graph.parents[i] == noParent)
+        {
+            order.push_back(i);
+        }
+        else
+        {
+            childStart[graph.parents[i] + 1]++;
+        }
+    }
+    for (unsigned int i = 0; i < count; i++)
+    {
+        childStart[i + 1] += childStart[i];
+    }
+    std::vector<unsigned int> children(count);
+    std::vector<unsigned int> fill(childStart.begin(), childStart.end() - 1);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (graph.parents[i] != noParent)
+        {
+            children[fill[graph.parents[i]]++] = i;
+        }
+    }
+
+    // breadth first : order grows behind k
+    graph.firstChildren.resize(count + 1);
+    for (unsigned int k = 0; k < order.size(); k++)
+    {
+        unsigned int node = order[k];
+        graph.firstChildren[k] = (unsigned int)order.size();
+        order.insert(order.end(), children.begin() + childStart[node], children.begin() + childStart[node + 1]);
+    }
+    graph.firstChildren[count] = count;
+
+    std::vector<unsigned int> newIndex(count);
+    for (unsigned int k = 0; k < count; k++)
+    {
+        newIndex[order[k]] = k;
+    }
+
+    // levels don't decrease along the order, each one starts where it grows
+    std::vector<unsigned int> levels(count);
+    graph.levelFirst.assign(1, 0);
+    for (unsigned int k = 0; k < count; k++)
+    {
+        unsigned int parent = graph.parents[order[k]];
+        levels[k] = parent == noParent ? 0 : levels[newIndex[parent]] + 1;
+        if (levels[k] == graph.levelFirst.size())
+        {
+            graph.levelFirst.push_back(k);
+        }
+    }
+    graph.levelFirst.push_back(count);
+
+    std::vector<uint64_t> dirty(graph.dirty.size(), 0);
+    std::vector<unsigned int> parents(count);
+    for (unsigned int k = 0; k < count; k++)
+    {
+        unsigned int node = order[k];
+        unsigned int parent = graph.parents[node];
+        parents[k] = parent == noParent ? noParent : newIndex[parent];
+        if (graph.dirty[node >> 6] & (uint64_t(1) << (node & 63)))
+        {
+            dirty[k >> 6] |= uint64_t(1) << (k & 63);
+        }
+    }
+    graph.parents.swap(parents);
+    graph.dirty.swap(dirty);
+
+    permute(graph.translations, order);
+    permute(graph.rotations, order);
+    permute(graph.scales, order);
+    permute(graph.worlds, order);
+    permute(graph.instances, order);
+    permute(graph.handles, order);
+    for (unsigned int k = 0; k < count; k++)
+    {
+        graph.slots[graph.handles[k]] = k;
+    }
+    graph.sorted = true;
+}
+
+// parent's world * translation * rotation * scale, only the affine part
+//  is multiplied
+static inline void computeWorld(SceneGraph &graph, unsigned int node)
+{
+    const glm::quat &q = graph.rotations[node];
+    const glm::vec3 &s = graph.scales[node];
+    const glm::vec3 &t = graph.translations[node];
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    glm::vec3 axisX = s.x * glm::vec3(1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy));
+    glm::vec3 axisY = s.y * glm::vec3(2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx));
+    glm::vec3 axisZ = s.z * glm::vec3(2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy));
+
+    glm::mat4 &world = graph.worlds[node];
+    unsigned int parent = graph.parents[node];
+    if (parent == noParent)
+    {
+        world = glm::mat4(glm::vec4(axisX, 0.f), glm::vec4(axisY, 0.f), glm::vec4(axisZ, 0.f), glm::vec4(t, 1.f));
+        return;
+    }
+    const glm::mat4 &p = graph.worlds[parent];
+    world[0] = p[0] * axisX.x + p[1] * axisX.y + p[2] * axisX.z;
+    world[1] = p[0] * axisY.x + p[1] * axisY.y + p[2] * axisY.z;
+    world[2] = p[0] * axisZ.x + p[1] * axisZ.y + p[2] * axisZ.z;
+    world[3] = p[0] * t.x + p[1] * t.y + p[2] * t.z + p[3];
+}
+
+// clears the bits of nodes [first, end)
+static void clearNodes(SceneGraph &graph, unsigned int first, unsigned int end)
+{
+    for (unsigned int word = first >> 6; word <= (end - 1) >> 6; word++)
+    {
+        unsigned int base = word * 64;
+        graph.dirty[word] &= ~bitRange(std::max(first, base) - base, std::min(end, base + 64) - base);
+    }
+}
+
+// the world matrices of the subtree of root, a level at a time ; its
+//  handles go to changed from offset on
+static void updateSubtree(SceneGraph &graph, unsigned int root, unsigned int offset)
+{
+    unsigned int first = root;
+    unsigned int end = root + 1;
+    while (first < end)
+    {
+        for (unsigned int node = first; node < end; node++)
+        {
+            computeWorld(graph, node);
+            graph.changed[offset++] = graph.handles[node];
+        }
+        // the children of a range of nodes are a range
+        first = graph.firstChildren[first];
+        end = graph.firstChildren[end];
+    }
+}
+
+void initSceneGraph(SceneGraph &graph, unsigned int capacity)
+{
+    destroySceneGraph(graph);
+    graph.translations.reserve(capacity);
+    graph.rotations.reserve(capacity);
+    graph.scales.reserve(capacity);
+    graph.parents.reserve(capacity);
+    graph.worlds.reserve(capacity);
+    graph.instances.reserve(capacity);
+    graph.handles.reserve(capacity);
+    graph.slots.reserve(capacity);
+}
+
+void destroySceneGraph(SceneGraph &graph)
+{
+    graph.translations.clear();
+    graph.rotations.clear();
+    graph.scales.clear();
+    graph.parents.clear();
+    graph.worlds.clear();
+    graph.instances.clear();
+    graph.firstChildren.clear();
+    graph.levelFirst.clear();
+    graph.dirty.clear();
+    graph.sorted = true;
+    graph.handles.clear();
+    graph.slots.clear();
+    graph.changed.clear();
+    graph.roots.clear();
+    graph.rootOffsets.clear();
+}
+
+unsigned int addSceneNode(
+    SceneGraph &graph, unsigned int parent,
+    const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale
+)
+{
+    unsigned int parentIndex = noParent;
+    if (parent != noParent)
+    {
+        if (parent >= graph.slots.size())
+        {
+            printf("Scene graph : no node %u to add a child to\n", parent);
+            return noParent;
+        }
+        parentIndex = graph.slots[parent];
+    }
+
+    unsigned int node = sceneNodeCount(graph);
+    unsigned int handle = (unsigned int)graph.slots.size();
+    graph.translations.push_back(translation);
+    graph.rotations.push_back(rotation);
+    graph.scales.push_back(scale);
+    graph.parents.push_back(parentIndex);
+    graph.worlds.push_back(glm::mat4(1.f));
+    graph.instances.push_back(invalidInstance);
+    graph.handles.push_back(handle);
+    graph.slots.push_back(node);
+    graph.dirty.resize((node + 64) / 64, 0);
+    markNode(graph, node);
+    graph.sorted = false;
+    return handle;
+}
+
+void setSceneNodeTransform(
+    SceneGraph &graph, unsigned int handle,
+    const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale
+)
+{
+    unsigned int node = graph.slots[handle];
+    graph.translations[node] = translation;
+    graph.rotations[node] = rotation;
+    graph.scales[node] = scale;
+    markNode(graph, node);
+}
+
+void setSceneNodeTranslation(SceneGraph &graph, unsigned int handle, const glm::vec3 &translation)
+{
+    unsigned int node = graph.slots[handle];
+    graph.translations[node] = translation;
+    markNode(graph, node);
+}
+
+void attachInstance(SceneGraph &graph, unsigned int handle, unsigned int instance)
+{
+    unsigned int node = graph.slots[handle];
+    graph.instances[node] = instance;
+    markNode(graph, node);
+}
+
+void updateSceneGraph(SceneGraph &graph, WorkerPool* workers)
+{
+    PROFILE_SCOPE("updateSceneGraph");
+    graph.changed.clear();
+    if (!graph.sorted)
+    {
+        sortSceneGraph(graph);
+    }
+
+    // the set nodes no other set node is above, in node order ; clearing
+    //  the bits of each one's subtree as it is found skips the set nodes
+    //  below it, and leaves nothing set for the next update
+    graph.roots.clear();
+    graph.rootOffsets.clear();
+    unsigned int total = 0;
+    for (size_t word = 0; word < graph.dirty.size(); word++)
+    {
+        while (graph.dirty[word] != 0)
+        {
+            unsigned int root = (unsigned int)word * 64 + __builtin_ctzll(graph.dirty[word]);
+            graph.roots.push_back(root);
+            graph.rootOffsets.push_back(total);
+            for (unsigned int first = root, end = root + 1; first < end; )
+            {
+                clearNodes(graph, first, end);
+                total += end - first;
+                unsigned int childFirst = graph.firstChildren[first];
+                end = graph.firstChildren[end];
+                first = childFirst;
+            }
+        }
+    }
+    graph.rootOffsets.push_back(total);
+    graph.changed.resize(total);
+
+    // the subtrees don't overlap : small ones are shared out whole, big
+    //  ones a level at a time, each level shared out
+    SceneGraph* scene = &graph;
+    auto updateSubtrees = [scene](size_t begin, size_t end)
+    {
+        for (size_t r = begin; r < end; r++)
+        {
+            unsigned int offset = scene->rootOffsets[r];
+            if (scene->rootOffsets[r + 1] - offset <= sceneUpdateGrain)
+            {
+                updateSubtree(*scene, scene->roots[r], offset);
+            }
+        }
+    };
+    if (workers)
+    {
+        parallelFor(*workers, graph.roots.size(), sceneRootGrain, updateSubtrees);
+    }
+    else
+    {
+        updateSubtrees(0, graph.roots.size());
+    }
+
+    for (size_t r = 0; r < graph.roots.size(); r++)
+    {
+        unsigned int offset = graph.rootOffsets[r];
+        if (graph.rootOffsets[r + 1] - offset <= sceneUpdateGrain)
+        {
+            continue;
+        }
+        for (unsigned int first = graph.roots[r], end = first + 1; first < end; )
+        {
+            auto updateNodes = [scene, first, offset](size_t begin, size_t stop)
+            {
+                for (size_t k = begin; k < stop; k++)
+                {
+                    computeWorld(*scene, first + (unsigned int)k);
+                    scene->changed[offset + k] = scene->handles[first + k];
+                }
+            };
+            // a level of fewer than sceneUpdateGrain nodes stays on this thread
+            if (workers)
+            {
+                parallelFor(*workers, end - first, sceneUpdateGrain, updateNodes);
+            }
+            else
+            {
+                updateNodes(0, end - first);
+            }
+            offset += end - first;
+            unsigned int childFirst = graph.firstChildren[first];
+            end = graph.firstChildren[end];
+            first = childFirst;
+        }
+    }
+}
+
+void updateSceneInstances(const SceneGraph &graph, InstanceBuffer &instances)
+{
+    PROFILE_SCOPE("updateSceneInstances");
+    for (size_t i = 0; i < graph.changed.size(); i++)
+    {
+        unsigned int node = graph.slots[graph.changed[i]];
+        if (graph.instances[node] != invalidInstance)
+        {
+            updateInstance(instances, graph.instances[node], graph.worlds[node]);
+        }
+    }
+}
+
+SceneBenchmark benchmarkSceneUpdate(unsigned int nodeCount, float dirtyFraction, WorkerPool* workers)
+{
+    SceneBenchmark result = { nodeCount, 0, 0, 0.0 };
+    if (nodeCount == 0)
+    {
+        return result;
+    }
+
+    // added breadth first, so handles are indices
+    SceneGraph graph;
+    initSceneGraph(graph, nodeCount);
+    glm::quat turn = glm::angleAxis(0.1f, glm::vec3(0.f, 1.f, 0.f));
+    for (unsigned int i = 0; i < nodeCount; i++)
+    {
+        addSceneNode(graph, i == 0 ? noParent : (i - 1) / 8, glm::vec3(1.f, 0.f, 0.f), turn);
+    }
+    updateSceneGraph(graph, workers);
+
+    result.dirty = std::max((unsigned int)(nodeCount * dirtyFraction), 1u);
+    result.updateMs = 1e30;
+    uint32_t random = 12345;
+    for (unsigned int run = 0; run < 5; run++)
+    {
+        for (unsigned int i = 0; i < result.dirty; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+            unsigned int node = random % nodeCount;
+            setSceneNodeTranslation(graph, node, graph.translations[node] + glm::vec3(0.f, 0.01f, 0.f));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        updateSceneGraph(graph, workers);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.updateMs = std::min(result.updateMs, ms);
+        result.updated = (unsigned int)graph.changed.size();
+    }
+    destroySceneGraph(graph);
+    return result;
+}
@@ -10,46 +10,118 @@
 #include <GL/glew.h>
 
 #include "common/shader.hpp"
+#include "common/profiler.hpp"
+#include "common/programcache.hpp"
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) 
+// code with the defines right after its #version line, which must stay first
+static std::string InsertDefines(const char* code, const char* defines)
 {
-    //
-    // CREATE the SHADERS
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+    std::string result(code);
+    if (defines == NULL || defines[0] == '\0')
+    {
+        return result;
+    }
+    size_t position = 0;
+    size_t version = result.find("#version");
+    if (version != std::string::npos)
+    {
+        size_t end = result.find('\n', version);
+        position = end == std::string::npos ? result.size() : end + 1;
+    }
+    std::string block(defines);
+    if (block[block.size() - 1] != '\n')
+    {
+        block += '\n';
+    }
+    result.insert(position, block);
+    return result;
+}
 
-    // READ the VERTEX SHADER code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if (VertexShaderStream.is_open()) {
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
+bool ReadShaderFile(const char* file_path, std::string& code)
+{
+    std::ifstream ShaderStream(file_path, std::ios::in);
+    if (!ShaderStream.is_open()) {
+        printf("Impossible to open %s. Are you in the right directory?\n", file_path);
+        return false;
     }
-    else {
-        printf("Impossible to open %s. Are you in the right directory?\n", vertex_file_path);
+    std::stringstream sstr;
+    sstr << ShaderStream.rdbuf();
+    code = sstr.str();
+    ShaderStream.close();
+    return true;
+}
+
+GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path, const char* defines)
+{
+    PROFILE_SCOPE_DETAIL("LoadShaders", vertex_file_path);
+    // READ the SHADER code from the files
+    std::string VertexShaderCode;
+    if (!ReadShaderFile(vertex_file_path, VertexShaderCode)) {
         getchar();
         return 0;
     }
-
-    // READ the FRAGMENT SHADER code from the file
     std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if (FragmentShaderStream.is_open()) {
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
+    ReadShaderFile(fragment_file_path, FragmentShaderCode);
+
+    return CreateProgram(
+        VertexShaderCode.c_str(), FragmentShaderCode.c_str(),
+        vertex_file_path, fragment_file_path, defines);
+}
+
+GLuint CreateProgram(
+    const char* vertex_code,
+    const char* fragment_code,
+    const char* vertex_name,
+    const char* fragment_name,
+    const char* defines
+)
+{
+    if (!programCacheEnabled())
+    {
+        return CompileShaders(vertex_code, fragment_code, vertex_name, fragment_name, defines);
     }
 
+    uint64_t key = programCacheKey(vertex_code, fragment_code, defines);
+    GLuint ProgramID = loadProgramBinary(key);
+    if (ProgramID != 0)
+    {
+        printf("Loaded program %s + %s from the cache\n", vertex_name, fragment_name);
+        return ProgramID;
+    }
+
+    ProgramID = CompileShaders(vertex_code, fragment_code, vertex_name, fragment_name, defines);
+    GLint Result = GL_FALSE;
+    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+    if (Result == GL_TRUE && !storeProgramBinary(key, ProgramID))
+    {
+        printf("Could not store program %s + %s in the cache\n", vertex_name, fragment_name);
+    }
+    return ProgramID;
+}
+
+GLuint CompileShaders(
+    const char* vertex_code,
+    const char* fragment_code,
+    const char* vertex_name,
+    const char* fragment_name,
+    const char* defines
+)
+{
+    std::string VertexCode = InsertDefines(vertex_code, defines);
+    std::string FragmentCode = InsertDefines(fragment_code, defines);
+
+    //
+    // CREATE the SHADERS
+    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
     GLint Result = GL_FALSE;
     int InfoLogLength;
 
     //
     // COMPILE Vertex Shader
-    printf("Compiling shader: %s\n", vertex_file_path);
-    char const* VertexSourcePointer = VertexShaderCode.c_str();
+    printf("Compiling shader: %s\n", vertex_name);
+    char const* VertexSourcePointer = VertexCode.c_str();
     glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
     glCompileShader(VertexShaderID);
 
@@ -64,8 +136,8 @@ GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path)
 
     //
     // COMPILE Fragment Shader
-    printf("Compiling shader: %s\n", fragment_file_path);
-    char const* FragmentSourcePointer = FragmentShaderCode.c_str();
+    printf("Compiling shader: %s\n", fragment_name);
+    char const* FragmentSourcePointer = FragmentCode.c_str();
     glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
     glCompileShader(FragmentShaderID);
 
@@ -83,6 +155,11 @@ GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path)
     GLuint ProgramID = glCreateProgram();
     glAttachShader(ProgramID, VertexShaderID);
     glAttachShader(ProgramID, FragmentShaderID);
+    if (programCacheEnabled())
+    {
+        // or the driver may not keep what glGetProgramBinary() needs
+        glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(ProgramID);
 
     // CHECK the PROGRAM
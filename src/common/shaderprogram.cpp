@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "common/glstate.hpp"
+#include "common/shaderprogram.hpp"
+#include "common/shader.hpp"
+
+// bytes of one value of a uniform type ; samplers are texture unit numbers
+static size_t uniformTypeSize(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT:              return 4;
+    case GL_FLOAT_VEC2:         return 8;
+    case GL_FLOAT_VEC3:         return 12;
+    case GL_FLOAT_VEC4:         return 16;
+    case GL_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_BOOL_VEC2:          return 8;
+    case GL_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_BOOL_VEC3:          return 12;
+    case GL_INT_VEC4:
+    case GL_UNSIGNED_INT_VEC4:
+    case GL_BOOL_VEC4:          return 16;
+    case GL_FLOAT_MAT2:         return 16;
+    case GL_FLOAT_MAT3:         return 36;
+    case GL_FLOAT_MAT4:         return 64;
+    case GL_FLOAT_MAT2x3:
+    case GL_FLOAT_MAT3x2:       return 24;
+    case GL_FLOAT_MAT2x4:
+    case GL_FLOAT_MAT4x2:       return 32;
+    case GL_FLOAT_MAT3x4:
+    case GL_FLOAT_MAT4x3:       return 48;
+    default:                    return 4;   // int, uint, bool and the samplers
+    }
+}
+
+static bool isSamplerType(GLenum type)
+{
+    switch (type)
+    {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_2D_RECT_SHADOW:
+    case GL_INT_SAMPLER_1D:
+    case GL_INT_SAMPLER_2D:
+    case GL_INT_SAMPLER_3D:
+    case GL_INT_SAMPLER_CUBE:
+    case GL_INT_SAMPLER_1D_ARRAY:
+    case GL_INT_SAMPLER_2D_ARRAY:
+    case GL_INT_SAMPLER_2D_MULTISAMPLE:
+    case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D_RECT:
+    case GL_UNSIGNED_INT_SAMPLER_1D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_3D:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE:
+    case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+    case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// whether the glUniform*() call for a value of valueType may set a uniform
+//  of type : the exact type, the bools of the same size, and for ints the
+//  samplers
+static bool uniformAccepts(GLenum type, GLenum valueType)
+{
+    switch (valueType)
+    {
+    case GL_INT:        return type == GL_INT || type == GL_BOOL || isSamplerType(type);
+    case GL_FLOAT:      return type == GL_FLOAT || type == GL_BOOL;
+    case GL_FLOAT_VEC3: return type == GL_FLOAT_VEC3 || type == GL_BOOL_VEC3;
+    case GL_FLOAT_VEC4: return type == GL_FLOAT_VEC4 || type == GL_BOOL_VEC4;
+    default:            return type == valueType;
+    }
+}
+
+bool initShaderProgram(ShaderProgram &shader, GLuint program)
+{
+    shader.program = program;
+    shader.uniforms.clear();
+    shader.attributes.clear();
+    shader.uniformBlocks.clear();
+    shader.values.clear();
+    shader.uploads = 0;
+    shader.skipped = 0;
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        return false;
+    }
+
+    GLint count = 0;
+    GLint maxLength = 0;
+    std::vector<char> name;
+
+    // uniforms, and where their last value is kept
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    size_t valueOffset = 0;
+    for (GLint i = 0; i < count; i++)
+    {
+        ShaderUniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(program, i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, name.data());
+        uniform.name.assign(name.data(), length);
+        uniform.location = glGetUniformLocation(program, uniform.name.c_str());
+        GLuint index = (GLuint)i;
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &uniform.blockIndex);
+        uniform.valueOffset = valueOffset;
+        uniform.valueSize = uniform.location >= 0 ? uniformTypeSize(uniform.type) * uniform.size : 0;
+        uniform.known = false;
+        valueOffset += uniform.valueSize;
+        shader.uniforms.push_back(uniform);
+    }
+    shader.values.resize(valueOffset);
+
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+        ShaderAttribute attribute;
+        GLsizei length = 0;
+        glGetActiveAttrib(program, i, (GLsizei)name.size(), &length, &attribute.size, &attribute.type, name.data());
+        attribute.name.assign(name.data(), length);
+        attribute.location = glGetAttribLocation(program, attribute.name.c_str());
+        shader.attributes.push_back(attribute);
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+        ShaderUniformBlock block;
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, i, (GLsizei)name.size(), &length, name.data());
+        block.name.assign(name.data(), length);
+        block.index = (GLuint)i;
+        glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+        shader.uniformBlocks.push_back(block);
+    }
+
+    printf("Program %u : %u uniforms, %u attributes, %u uniform blocks\n", program,
+        (unsigned int)shader.uniforms.size(), (unsigned int)shader.attributes.size(),
+        (unsigned int)shader.uniformBlocks.size());
+    return true;
+}
+
+bool loadShaderProgram(ShaderProgram &shader, const char* vertex_file_path, const char* fragment_file_path, const char* defines)
+{
+    GLuint program = LoadShaders(vertex_file_path, fragment_file_path, defines);
+    if (!initShaderProgram(shader, program))
+    {
+        deleteProgram(program);
+        shader.program = 0;
+        return false;
+    }
+    return true;
+}
+
+void destroyShaderProgram(ShaderProgram &shader)
+{
+    deleteProgram(shader.program);
+    shader.program = 0;
+    shader.uniforms.clear();
+    shader.attributes.clear();
+    shader.uniformBlocks.clear();
+    shader.values.clear();
+}
+
+int findUniform(const ShaderProgram &shader, const char* name)
+{
+    for (size_t i = 0; i < shader.uniforms.size(); i++)
+    {
+        const std::string &uniform = shader.uniforms[i].name;
+        // "name" finds the array "name[0]" too
+        if (uniform == name ||
+            (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0 &&
+             uniform.compare(0, uniform.size() - 3, name) == 0))
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int findAttribute(const ShaderProgram &shader, const char* name)
+{
+    for (size_t i = 0; i < shader.attributes.size(); i++)
+    {
+        if (shader.attributes[i].name == name)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int findUniformBlock(const ShaderProgram &shader, const char* name)
+{
+    for (size_t i = 0; i < shader.uniformBlocks.size(); i++)
+    {
+        if (shader.uniformBlocks[i].name == name)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// true when value differs from what the uniform holds, which it then
+//  remembers ; counts the upload or the skip
+//  valueType : the GL type of value, a uniform of another type is left alone
+static bool updateValue(ShaderProgram &shader, int uniform, GLenum valueType, const void* value, size_t size)
+{
+    if (uniform < 0 || uniform >= (int)shader.uniforms.size())
+    {
+        return false;
+    }
+    ShaderUniform &target = shader.uniforms[uniform];
+    if (size > target.valueSize || !uniformAccepts(target.type, valueType))
+    {
+        // a block member, or not the type of the uniform
+        return false;
+    }
+    unsigned char* stored = &shader.values[target.valueOffset];
+    if (target.known && memcmp(stored, value, size) == 0)
+    {
+        shader.skipped++;
+        return false;
+    }
+    memcpy(stored, value, size);
+    target.known = true;
+    shader.uploads++;
+    return true;
+}
+
+bool bindSampler(ShaderProgram &shader, const char* name, GLint unit)
+{
+    int uniform = findUniform(shader, name);
+    if (uniform < 0)
+    {
+        return false;
+    }
+    useProgram(shader.program);
+    setUniform(shader, uniform, unit);
+    return true;
+}
+
+void setUniform(ShaderProgram &shader, int uniform, GLint value)
+{
+    if (updateValue(shader, uniform, GL_INT, &value, sizeof(value)))
+    {
+        glUniform1i(shader.uniforms[uniform].location, value);
+    }
+}
+
+void setUniform(ShaderProgram &shader, int uniform, float value)
+{
+    if (updateValue(shader, uniform, GL_FLOAT, &value, sizeof(value)))
+    {
+        glUniform1f(shader.uniforms[uniform].location, value);
+    }
+}
+
+void setUniform(ShaderProgram &shader, int uniform, const glm::vec3 &value)
+{
+    if (updateValue(shader, uniform, GL_FLOAT_VEC3, &value[0], sizeof(value)))
+    {
+        glUniform3fv(shader.uniforms[uniform].location, 1, &value[0]);
+    }
+}
+
+void setUniform(ShaderProgram &shader, int uniform, const glm::vec4 &value)
+{
+    if (updateValue(shader, uniform, GL_FLOAT_VEC4, &value[0], sizeof(value)))
+    {
+        glUniform4fv(shader.uniforms[uniform].location, 1, &value[0]);
+    }
+}
+
+void setUniform(ShaderProgram &shader, int uniform, const glm::mat3 &value)
+{
+    if (updateValue(shader, uniform, GL_FLOAT_MAT3, &value[0][0], sizeof(value)))
+    {
+        glUniformMatrix3fv(shader.uniforms[uniform].location, 1, GL_FALSE, &value[0][0]);
+    }
+}
+
+void setUniform(ShaderProgram &shader, int uniform, const glm::mat4 &value)
+{
+    if (updateValue(shader, uniform, GL_FLOAT_MAT4, &value[0][0], sizeof(value)))
+    {
+        glUniformMatrix4fv(shader.uniforms[uniform].location, 1, GL_FALSE, &value[0][0]);
+    }
+}
+
+void resetUniformStats(ShaderProgram &shader)
+{
+    shader.uploads = 0;
+    shader.skipped = 0;
+}
@@ -0,0 +1,38 @@
+#include <atomic>
+
+#include "common/simd.hpp"
+
+static SIMDLevel detectSIMDLevel()
+{
+#if defined(SIMD_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("avx"))
+    {
+        return SIMD_AVX;
+    }
+#endif
+#if defined(__SSE2__)
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+static std::atomic<int> simdCap(SIMD_AVX2);
+
+SIMDLevel simdLevel()
+{
+    // cpuid once, on first use
+    static const SIMDLevel detected = detectSIMDLevel();
+    int cap = simdCap.load(std::memory_order_relaxed);
+    return detected < cap ? detected : SIMDLevel(cap);
+}
+
+void setSIMDLevel(SIMDLevel level)
+{
+    simdCap.store(level, std::memory_order_relaxed);
+}
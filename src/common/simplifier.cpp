@@ -0,0 +1,564 @@
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "common/profiler.hpp"
+#include "common/simplifier.hpp"
+#include "common/vboindexer.hpp"
+
+// collapses whose triangle normal turns by more than about 80 degrees
+//  (cosine below this) are rejected as flips
+static const double minCosine = 0.2;
+
+// a sum of squared distances to planes, each weighted by the area of its
+//  triangle : the symmetric 4x4 matrix [A b ; b c] of the quadric form
+struct Quadric
+{
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+static void planeQuadric(Quadric &q, const glm::vec3 &n, double d, double w)
+{
+    q.a00 = w * n.x * n.x;
+    q.a11 = w * n.y * n.y;
+    q.a22 = w * n.z * n.z;
+    q.a01 = w * n.x * n.y;
+    q.a02 = w * n.x * n.z;
+    q.a12 = w * n.y * n.z;
+    q.b0 = w * n.x * d;
+    q.b1 = w * n.y * d;
+    q.b2 = w * n.z * d;
+    q.c = w * d * d;
+    q.weight = w;
+}
+
+static void addQuadric(Quadric &q, const Quadric &r)
+{
+    q.a00 += r.a00;
+    q.a11 += r.a11;
+    q.a22 += r.a22;
+    q.a01 += r.a01;
+    q.a02 += r.a02;
+    q.a12 += r.a12;
+    q.b0 += r.b0;
+    q.b1 += r.b1;
+    q.b2 += r.b2;
+    q.c += r.c;
+    q.weight += r.weight;
+}
+
+// weighted sum of squared distances from p to the planes
+static double quadricError(const Quadric &q, const glm::vec3 &p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+        2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+        2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    // rounding can take it slightly below zero
+    return e > 0.0 ? e : 0.0;
+}
+
+static uint64_t hashPosition(const void* record)
+{
+    return hashBytes(record, sizeof(glm::vec3));
+}
+
+static bool samePosition(const void* a, const void* b)
+{
+    return memcmp(a, b, sizeof(glm::vec3)) == 0;
+}
+
+// the attributes of a vertex, each possibly empty
+struct Attributes
+{
+    const std::vector<glm::vec2> &uvs;
+    const std::vector<glm::vec3> &normals;
+    const std::vector<glm::vec3> &tangents;
+};
+
+// squared difference of the attributes of two vertices
+static double attributeDistance(const Attributes &attributes, unsigned int a, unsigned int b)
+{
+    double d = 0.0;
+    if (!attributes.uvs.empty())
+    {
+        glm::vec2 e = attributes.uvs[a] - attributes.uvs[b];
+        d += glm::dot(e, e);
+    }
+    if (!attributes.normals.empty())
+    {
+        glm::vec3 e = attributes.normals[a] - attributes.normals[b];
+        d += glm::dot(e, e);
+    }
+    if (!attributes.tangents.empty())
+    {
+        glm::vec3 e = attributes.tangents[a] - attributes.tangents[b];
+        d += glm::dot(e, e);
+    }
+    return d;
+}
+
+// vertex from moves onto vertex to, its triangles follow ; on a seam, the
+//  vertex on the other side moves with it
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    double cost;
+
+    bool operator<(const Collapse &other) const
+    {
+        return cost < other.cost;
+    }
+};
+
+// the working state : triangles over vertices, and corners, the distinct
+//  positions, that vertices on an attribute seam share
+struct SimplifyState
+{
+    std::vector<unsigned int> triangles;    // 3 vertices each
+    std::vector<unsigned char> removed;     // per triangle
+    std::vector<unsigned int> corner;       // per vertex
+    std::vector<glm::vec3> cornerPosition;  // scaled to a unit box
+    std::vector<Quadric> quadrics;          // per corner
+    std::vector<unsigned char> locked;      // per corner
+    std::vector<double> vertexArea;         // area around every vertex
+
+    // live triangles around every corner, rebuilt every pass
+    std::vector<unsigned int> firstTriangle;
+    std::vector<unsigned int> cornerTriangles;
+
+    std::vector<unsigned int> mark;         // per corner, see canCollapse()
+    std::vector<unsigned int> partner;      // per vertex, see canCollapse()
+    std::vector<unsigned int> partnerMark;  // per vertex
+    unsigned int stamp;
+};
+
+static void buildAdjacency(SimplifyState &state)
+{
+    size_t cornerCount = state.cornerPosition.size();
+    state.firstTriangle.assign(cornerCount + 1, 0);
+    for (size_t t = 0; t < state.removed.size(); t++)
+    {
+        if (state.removed[t])
+        {
+            continue;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            state.firstTriangle[state.corner[state.triangles[t * 3 + k]] + 1]++;
+        }
+    }
+    for (size_t c = 0; c < cornerCount; c++)
+    {
+        state.firstTriangle[c + 1] += state.firstTriangle[c];
+    }
+    state.cornerTriangles.resize(state.firstTriangle[cornerCount]);
+    std::vector<unsigned int> fill(state.firstTriangle.begin(), state.firstTriangle.end() - 1);
+    for (size_t t = 0; t < state.removed.size(); t++)
+    {
+        if (state.removed[t])
+        {
+            continue;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            state.cornerTriangles[fill[state.corner[state.triangles[t * 3 + k]]]++] = (unsigned int)t;
+        }
+    }
+}
+
+static glm::vec3 triangleNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+// whether corner a can move onto corner b, each vertex of a onto its
+//  partner, the vertex of b it shares an edge with :
+//  - every vertex of a needs a partner, which keeps the two sides of a
+//    seam apart : a seam corner only moves along its seam
+//  - the corners around both must be the ones across their shared
+//    triangles, or the surface would fold onto itself
+//  - no triangle that moves may turn over
+static bool canCollapse(SimplifyState &state, unsigned int a, unsigned int b)
+{
+    unsigned int stamp = ++state.stamp;
+    unsigned int shared = 0;
+    for (unsigned int i = state.firstTriangle[a]; i < state.firstTriangle[a + 1]; i++)
+    {
+        const unsigned int* t = &state.triangles[state.cornerTriangles[i] * 3];
+        int ka = -1, kb = -1;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int c = state.corner[t[k]];
+            state.mark[c] = stamp;
+            ka = c == a ? k : ka;
+            kb = c == b ? k : kb;
+        }
+        if (kb >= 0)
+        {
+            state.partner[t[ka]] = t[kb];
+            state.partnerMark[t[ka]] = stamp;
+            shared++;
+        }
+    }
+
+    for (unsigned int i = state.firstTriangle[a]; i < state.firstTriangle[a + 1]; i++)
+    {
+        const unsigned int* t = &state.triangles[state.cornerTriangles[i] * 3];
+        bool hasB = false;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int c = state.corner[t[k]];
+            if (c == a && state.partnerMark[t[k]] != stamp)
+            {
+                return false;
+            }
+            hasB = hasB || c == b;
+        }
+        if (hasB)
+        {
+            continue;
+        }
+
+        // the triangle once a is moved onto b
+        glm::vec3 p[3], q[3];
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int c = state.corner[t[k]];
+            p[k] = state.cornerPosition[c];
+            q[k] = state.cornerPosition[c == a ? b : c];
+        }
+        glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+        glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+        double lengths = sqrt((double)glm::dot(before, before) * glm::dot(after, after));
+        if (lengths == 0.0 || glm::dot(before, after) < minCosine * lengths)
+        {
+            return false;
+        }
+    }
+
+    unsigned int common = 0;
+    for (unsigned int i = state.firstTriangle[b]; i < state.firstTriangle[b + 1]; i++)
+    {
+        const unsigned int* t = &state.triangles[state.cornerTriangles[i] * 3];
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int c = state.corner[t[k]];
+            if (c != a && c != b && state.mark[c] == stamp)
+            {
+                // counted once
+                state.mark[c] = 0;
+                common++;
+            }
+        }
+    }
+    return common <= shared;
+}
+
+float simplifyMesh(
+    const std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    size_t targetIndexCount,
+    std::vector<unsigned int> &out_indices,
+    float attributeWeight
+)
+{
+    PROFILE_SCOPE("simplifyMesh");
+    SimplifyState state;
+    Attributes attributes = { uvs, normals, tangents };
+    size_t vertexCount = positions.size();
+    size_t cornerCount = weldRecords(positions.data(), sizeof(glm::vec3), vertexCount,
+        hashPosition, samePosition, state.corner);
+
+    // errors are computed in a unit box, so attributeWeight means the same
+    //  for every mesh, and scaled back at the end
+    glm::vec3 boxMin = positions.empty() ? glm::vec3(0.0f) : positions[0];
+    glm::vec3 boxMax = boxMin;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        boxMin = glm::min(boxMin, positions[v]);
+        boxMax = glm::max(boxMax, positions[v]);
+    }
+    glm::vec3 extent = boxMax - boxMin;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    float invScale = scale > 0.0f ? 1.0f / scale : 1.0f;
+    state.cornerPosition.resize(cornerCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        state.cornerPosition[state.corner[v]] = positions[v] * invScale;
+    }
+
+    // triangles with two vertices at one position are dropped right away
+    for (size_t i = 0; i + 3 <= indices.size(); i += 3)
+    {
+        unsigned int c0 = state.corner[indices[i]];
+        unsigned int c1 = state.corner[indices[i + 1]];
+        unsigned int c2 = state.corner[indices[i + 2]];
+        if (c0 != c1 && c1 != c2 && c2 != c0)
+        {
+            state.triangles.insert(state.triangles.end(), &indices[i], &indices[i] + 3);
+        }
+    }
+    size_t triangleCount = state.triangles.size() / 3;
+    state.removed.assign(triangleCount, 0);
+
+    // locked corners : on an edge that isn't shared by exactly two triangles
+    //  (open borders and non-manifold edges), or where attribute seams meet ;
+    //  a seam corner, two vertices on either side of a seam that goes on,
+    //  can still move along it
+    std::vector<unsigned char> used(vertexCount, 0);
+    std::vector<unsigned int> cornerVertices(cornerCount, 0);
+    std::vector<std::pair<uint64_t, uint64_t> > edges(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = state.triangles[t * 3 + k];
+            unsigned int w = state.triangles[t * 3 + (k + 1) % 3];
+            if (!used[v])
+            {
+                used[v] = 1;
+                cornerVertices[state.corner[v]]++;
+            }
+            unsigned int a = state.corner[v];
+            unsigned int b = state.corner[w];
+            edges[t * 3 + k].first = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            edges[t * 3 + k].second = ((uint64_t)std::min(v, w) << 32) | std::max(v, w);
+        }
+    }
+    std::vector<unsigned int> seamEdges(cornerCount, 0);
+    state.locked.assign(cornerCount, 0);
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); )
+    {
+        size_t run = i + 1;
+        while (run < edges.size() && edges[run].first == edges[i].first)
+        {
+            run++;
+        }
+        unsigned int a = (unsigned int)(edges[i].first >> 32);
+        unsigned int b = (unsigned int)(edges[i].first & 0xffffffffu);
+        if (run - i != 2)
+        {
+            state.locked[a] = 1;
+            state.locked[b] = 1;
+        }
+        else if (edges[i].second != edges[i + 1].second)
+        {
+            // the triangles on either side have other vertices
+            seamEdges[a]++;
+            seamEdges[b]++;
+        }
+        i = run;
+    }
+    for (size_t c = 0; c < cornerCount; c++)
+    {
+        bool seam = cornerVertices[c] == 2 && seamEdges[c] == 2;
+        if (cornerVertices[c] > 1 && !seam)
+        {
+            state.locked[c] = 1;
+        }
+    }
+
+    // the planes of its triangles on every corner, a third of their area on
+    //  every vertex
+    Quadric zero;
+    memset(&zero, 0, sizeof(zero));
+    state.quadrics.assign(cornerCount, zero);
+    state.vertexArea.assign(vertexCount, 0.0);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const unsigned int* v = &state.triangles[t * 3];
+        const glm::vec3 &p0 = state.cornerPosition[state.corner[v[0]]];
+        glm::vec3 n = triangleNormal(p0,
+            state.cornerPosition[state.corner[v[1]]], state.cornerPosition[state.corner[v[2]]]);
+        float length = glm::length(n);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        n /= length;
+        Quadric q;
+        planeQuadric(q, n, -glm::dot(n, p0), length * 0.5);
+        for (int k = 0; k < 3; k++)
+        {
+            addQuadric(state.quadrics[state.corner[v[k]]], q);
+            state.vertexArea[v[k]] += length / 6.0;
+        }
+    }
+
+    state.mark.assign(cornerCount, 0);
+    state.partner.assign(vertexCount, 0);
+    state.partnerMark.assign(vertexCount, 0);
+    state.stamp = 0;
+    std::vector<unsigned char> dirty(cornerCount);
+    std::vector<Collapse> collapses;
+    size_t liveTriangles = triangleCount;
+    size_t targetTriangles = targetIndexCount / 3;
+    while (liveTriangles > targetTriangles)
+    {
+        buildAdjacency(state);
+
+        // every half-edge a -> b of a triangle, when a is unlocked : an edge
+        //  between two triangles goes both ways, one per triangle ; edges
+        //  on one triangle only are on a border, locked
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (state.removed[t])
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = state.triangles[t * 3 + k];
+                unsigned int b = state.triangles[t * 3 + (k + 1) % 3];
+                if (!state.locked[state.corner[a]])
+                {
+                    Collapse collapse;
+                    collapse.from = a;
+                    collapse.to = b;
+                    collapse.cost =
+                        quadricError(state.quadrics[state.corner[a]], state.cornerPosition[state.corner[b]]) +
+                        attributeWeight * state.vertexArea[a] * attributeDistance(attributes, a, b);
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        if (collapses.empty())
+        {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // a pass takes the cheapest collapses, a few times as many as are
+        //  still needed since most get skipped in a locked neighbourhood :
+        //  past that, costs get stale as neighbours move
+        size_t needed = (liveTriangles - targetTriangles + 1) / 2;
+        double limit = collapses[std::min(collapses.size() - 1, needed * 6)].cost;
+        std::fill(dirty.begin(), dirty.end(), 0);
+        size_t applied = 0;
+        for (size_t i = 0; i < collapses.size() && liveTriangles > targetTriangles; i++)
+        {
+            const Collapse &collapse = collapses[i];
+            // unless none of the cheap ones could go
+            if (collapse.cost > limit && applied > 0)
+            {
+                break;
+            }
+            unsigned int a = state.corner[collapse.from];
+            unsigned int b = state.corner[collapse.to];
+            if (dirty[a] || dirty[b] || !canCollapse(state, a, b))
+            {
+                continue;
+            }
+
+            for (unsigned int j = state.firstTriangle[a]; j < state.firstTriangle[a + 1]; j++)
+            {
+                unsigned int t = state.cornerTriangles[j];
+                unsigned int* v = &state.triangles[t * 3];
+                bool degenerate = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    if (state.corner[v[k]] == a)
+                    {
+                        if (state.vertexArea[v[k]] > 0.0)
+                        {
+                            // once per vertex
+                            state.vertexArea[state.partner[v[k]]] += state.vertexArea[v[k]];
+                            state.vertexArea[v[k]] = 0.0;
+                        }
+                        v[k] = state.partner[v[k]];
+                    }
+                    else
+                    {
+                        degenerate = degenerate || state.corner[v[k]] == b;
+                    }
+                    // the neighbourhood waits for the next pass, with fresh costs
+                    dirty[state.corner[v[k]]] = 1;
+                }
+                if (degenerate)
+                {
+                    state.removed[t] = 1;
+                    liveTriangles--;
+                }
+            }
+            addQuadric(state.quadrics[b], state.quadrics[a]);
+            applied++;
+        }
+        if (applied == 0)
+        {
+            break;
+        }
+    }
+
+    // the error left on the corners still used, an RMS distance to the
+    //  planes they absorbed
+    double error = 0.0;
+    out_indices.clear();
+    out_indices.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (state.removed[t])
+        {
+            continue;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = state.triangles[t * 3 + k];
+            const Quadric &q = state.quadrics[state.corner[v]];
+            if (q.weight > 0.0)
+            {
+                error = std::max(error, quadricError(q, state.cornerPosition[state.corner[v]]) / q.weight);
+            }
+            out_indices.push_back(v);
+        }
+    }
+    return (float)sqrt(error) * (scale > 0.0f ? scale : 1.0f);
+}
+
+void buildLODChain(
+    const std::vector<unsigned int> &indices,
+    const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec3> &tangents,
+    const float* ratios,
+    unsigned int ratioCount,
+    std::vector<LODLevel> &out_levels
+)
+{
+    PROFILE_SCOPE("buildLODChain");
+    out_levels.clear();
+    out_levels.resize(1);
+    out_levels[0].indices = indices;
+    out_levels[0].error = 0.0f;
+
+    size_t triangleCount = indices.size() / 3;
+    for (unsigned int i = 0; i < ratioCount; i++)
+    {
+        size_t target = (size_t)(triangleCount * ratios[i]) * 3;
+        if (target >= out_levels.back().indices.size())
+        {
+            continue;
+        }
+        LODLevel level;
+        float error = simplifyMesh(out_levels.back().indices, positions, uvs, normals, tangents,
+            target, level.indices);
+        if (level.indices.size() >= out_levels.back().indices.size())
+        {
+            break;
+        }
+        // measured from the level before, so errors add up
+        level.error = out_levels.back().error + error;
+        out_levels.push_back(level);
+    }
+}
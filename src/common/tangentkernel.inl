@@ -0,0 +1,138 @@
+// tangent kernel against a lanes type, see tangentspace.cpp
+//  included there once for the baseline lanes and once more inside an AVX2
+//  region, so no include guard and no includes of its own
+
+// a vec3 per lane, structure of arrays
+template <typename L>
+struct Vec3Lanes
+{
+    typename L::Value x, y, z;
+};
+
+template <typename L>
+static inline Vec3Lanes<L> loadVec3(const glm::vec3* first, size_t stride)
+{
+    const float* base = &first->x;
+    stride *= 3;
+    Vec3Lanes<L> v = { L::load(base, stride), L::load(base + 1, stride), L::load(base + 2, stride) };
+    return v;
+}
+
+template <typename L>
+static inline void storeVec3(glm::vec3* first, size_t stride, const Vec3Lanes<L> &v)
+{
+    float* base = &first->x;
+    stride *= 3;
+    L::store(base, stride, v.x);
+    L::store(base + 1, stride, v.y);
+    L::store(base + 2, stride, v.z);
+}
+
+template <typename L>
+static inline Vec3Lanes<L> sub3(const Vec3Lanes<L> &a, const Vec3Lanes<L> &b)
+{
+    Vec3Lanes<L> v = { L::sub(a.x, b.x), L::sub(a.y, b.y), L::sub(a.z, b.z) };
+    return v;
+}
+
+template <typename L>
+static inline Vec3Lanes<L> scale3(const Vec3Lanes<L> &a, typename L::Value s)
+{
+    Vec3Lanes<L> v = { L::mul(a.x, s), L::mul(a.y, s), L::mul(a.z, s) };
+    return v;
+}
+
+template <typename L>
+static inline typename L::Value dot3(const Vec3Lanes<L> &a, const Vec3Lanes<L> &b)
+{
+    return L::add(L::add(L::mul(a.x, b.x), L::mul(a.y, b.y)), L::mul(a.z, b.z));
+}
+
+template <typename L>
+static inline Vec3Lanes<L> cross3(const Vec3Lanes<L> &a, const Vec3Lanes<L> &b)
+{
+    Vec3Lanes<L> v = {
+        L::sub(L::mul(a.y, b.z), L::mul(b.y, a.z)),
+        L::sub(L::mul(a.z, b.x), L::mul(b.z, a.x)),
+        L::sub(L::mul(a.x, b.y), L::mul(b.x, a.y))
+    };
+    return v;
+}
+
+// L::width triangles starting at triangle t
+//  same operations in the same order as the scalar version always had
+template <typename L>
+static inline void tangentKernel(
+    const glm::vec3* vertices,
+    const glm::vec2* uvs,
+    const glm::vec3* normals,
+    glm::vec3* tangents,
+    glm::vec3* bitangents,
+    size_t t
+)
+{
+    typedef typename L::Value Value;
+    size_t i = t * 3;
+
+    // edges of the triangle : position delta
+    Vec3Lanes<L> v0 = loadVec3<L>(vertices + i + 0, 3);
+    Vec3Lanes<L> v1 = loadVec3<L>(vertices + i + 1, 3);
+    Vec3Lanes<L> v2 = loadVec3<L>(vertices + i + 2, 3);
+    Vec3Lanes<L> deltaPos1 = sub3<L>(v1, v0);
+    Vec3Lanes<L> deltaPos2 = sub3<L>(v2, v0);
+
+    // uv delta
+    const float* uv = &uvs[i].x;
+    Value uv0x = L::load(uv + 0, 6), uv0y = L::load(uv + 1, 6);
+    Value uv1x = L::load(uv + 2, 6), uv1y = L::load(uv + 3, 6);
+    Value uv2x = L::load(uv + 4, 6), uv2y = L::load(uv + 5, 6);
+    Value deltaUV1x = L::sub(uv1x, uv0x), deltaUV1y = L::sub(uv1y, uv0y);
+    Value deltaUV2x = L::sub(uv2x, uv0x), deltaUV2y = L::sub(uv2y, uv0y);
+
+    Value r = L::div(L::one(), L::sub(L::mul(deltaUV1x, deltaUV2y), L::mul(deltaUV1y, deltaUV2x)));
+    Vec3Lanes<L> tangent = scale3<L>(sub3<L>(scale3<L>(deltaPos1, deltaUV2y), scale3<L>(deltaPos2, deltaUV1y)), r);
+    Vec3Lanes<L> bitangent = scale3<L>(sub3<L>(scale3<L>(deltaPos2, deltaUV1x), scale3<L>(deltaPos1, deltaUV2x)), r);
+
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        Vec3Lanes<L> n = loadVec3<L>(normals + i + k, 3);
+
+        // gram-schmidt orthogonalize
+        Vec3Lanes<L> t = sub3<L>(tangent, scale3<L>(n, dot3<L>(n, tangent)));
+        t = scale3<L>(t, L::div(L::one(), L::sqrt(dot3<L>(t, t))));
+
+        // calculate handedness
+        Value handedness = dot3<L>(cross3<L>(n, t), bitangent);
+        t.x = L::flipSign(t.x, handedness);
+        t.y = L::flipSign(t.y, handedness);
+        t.z = L::flipSign(t.z, handedness);
+
+        // every vertex of the triangle gets the triangle's bitangent
+        //  they will be merged later ; in vboindexer.cpp
+        storeVec3<L>(tangents + i + k, 3, t);
+        storeVec3<L>(bitangents + i + k, 3, bitangent);
+    }
+}
+
+// triangles [begin, end) : Wide::width at a time, then one at a time
+template <typename Wide>
+static void tangentRange(
+    const glm::vec3* vertices,
+    const glm::vec2* uvs,
+    const glm::vec3* normals,
+    glm::vec3* tangents,
+    glm::vec3* bitangents,
+    size_t begin,
+    size_t end
+)
+{
+    size_t t = begin;
+    for (; t + Wide::width <= end; t += Wide::width)
+    {
+        tangentKernel<Wide>(vertices, uvs, normals, tangents, bitangents, t);
+    }
+    for (; t < end; t++)
+    {
+        tangentKernel<ScalarLanes>(vertices, uvs, normals, tangents, bitangents, t);
+    }
+}
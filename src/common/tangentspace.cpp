@@ -1,5 +1,132 @@
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
+#include "common/simd.hpp"
 #include "common/tangentspace.hpp"
 
+// triangles handled by one parallel block
+static const size_t tangentBlockSize = 16 * 1024;
+
+//
+// lanes : a few triangles side by side, one float per triangle
+//  the kernel below is written once against this interface
+
+struct ScalarLanes
+{
+    typedef float Value;
+    enum { width = 1 };
+
+    // element k of a lane comes from base[k * stride]
+    static Value load(const float* base, size_t) { return *base; }
+    static void store(float* base, size_t, Value v) { *base = v; }
+
+    static Value add(Value a, Value b) { return a + b; }
+    static Value sub(Value a, Value b) { return a - b; }
+    static Value mul(Value a, Value b) { return a * b; }
+    static Value div(Value a, Value b) { return a / b; }
+    static Value sqrt(Value a) { return sqrtf(a); }
+    static Value one() { return 1.f; }
+    // -v where negative < 0, v elsewhere
+    static Value flipSign(Value v, Value negative) { return negative < 0.f ? -v : v; }
+};
+
+#if defined(__SSE2__)
+
+struct WideLanes
+{
+    typedef __m128 Value;
+    enum { width = 4 };
+
+    static Value load(const float* base, size_t stride)
+    {
+        return _mm_set_ps(base[3 * stride], base[2 * stride], base[1 * stride], base[0]);
+    }
+    static void store(float* base, size_t stride, Value v)
+    {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, v);
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            base[k * stride] = lanes[k];
+        }
+    }
+
+    static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+    static Value div(Value a, Value b) { return _mm_div_ps(a, b); }
+    static Value sqrt(Value a) { return _mm_sqrt_ps(a); }
+    static Value one() { return _mm_set1_ps(1.f); }
+    static Value flipSign(Value v, Value negative)
+    {
+        Value mask = _mm_cmplt_ps(negative, _mm_setzero_ps());
+        return _mm_xor_ps(v, _mm_and_ps(mask, _mm_set1_ps(-0.f)));
+    }
+};
+
+#else
+
+// no vector unit the compiler targets
+typedef ScalarLanes WideLanes;
+
+#endif
+
+#include "tangentkernel.inl"
+
+#if defined(SIMD_DISPATCH)
+
+// 8 triangles at once, only called where the cpu has AVX2
+SIMD_BEGIN_AVX2
+namespace avx2
+{
+
+struct WideLanes
+{
+    typedef __m256 Value;
+    enum { width = 8 };
+
+    static Value load(const float* base, size_t stride)
+    {
+        return _mm256_set_ps(
+            base[7 * stride], base[6 * stride], base[5 * stride], base[4 * stride],
+            base[3 * stride], base[2 * stride], base[1 * stride], base[0]
+        );
+    }
+    static void store(float* base, size_t stride, Value v)
+    {
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, v);
+        for (unsigned int k = 0; k < 8; k++)
+        {
+            base[k * stride] = lanes[k];
+        }
+    }
+
+    static Value add(Value a, Value b) { return _mm256_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+    static Value div(Value a, Value b) { return _mm256_div_ps(a, b); }
+    static Value sqrt(Value a) { return _mm256_sqrt_ps(a); }
+    static Value one() { return _mm256_set1_ps(1.f); }
+    static Value flipSign(Value v, Value negative)
+    {
+        Value mask = _mm256_cmp_ps(negative, _mm256_setzero_ps(), _CMP_LT_OQ);
+        return _mm256_xor_ps(v, _mm256_and_ps(mask, _mm256_set1_ps(-0.f)));
+    }
+};
+
+#include "tangentkernel.inl"
+
+}
+SIMD_END
+
+#endif
+
 void computeTangentBasis(
     // inputs
     std::vector<glm::vec3>& vertices,
@@ -7,58 +134,171 @@ void computeTangentBasis(
     std::vector<glm::vec3>& normals,
     // outputs
     std::vector<glm::vec3>& tangents,
-    std::vector<glm::vec3>& bitangents
+    std::vector<glm::vec3>& bitangents,
+    unsigned int threadCount
 )
 {
-    for (unsigned int i = 0; i < vertices.size(); i += 3)
+    PROFILE_SCOPE("computeTangentBasis");
+    size_t triangleCount = vertices.size() / 3;
+    tangents.resize(vertices.size());
+    bitangents.resize(vertices.size());
+
+    const glm::vec3* in_vertices = vertices.data();
+    const glm::vec2* in_uvs = uvs.data();
+    const glm::vec3* in_normals = normals.data();
+    glm::vec3* out_tangents = tangents.data();
+    glm::vec3* out_bitangents = bitangents.data();
+
+    SIMDLevel level = simdLevel();
+    parallelFor(triangleCount, tangentBlockSize, [&](size_t begin, size_t end)
     {
-        // shortcuts for vertices
-        glm::vec3& v0 = vertices[i+0];
-        glm::vec3& v1 = vertices[i+1];
-        glm::vec3& v2 = vertices[i+2];
-
-        // shortcuts for uvs
-        glm::vec2& uv0 = uvs[i+0];
-        glm::vec2& uv1 = uvs[i+1];
-        glm::vec2& uv2 = uvs[i+2];
-
-        // edges of the triangle : position delta
-        glm::vec3 deltaPos1 = v1 - v0;
-        glm::vec3 deltaPos2 = v2 - v0;
-
-        // uv delta
-        glm::vec2 deltaUV1 = uv1 - uv0;
-        glm::vec2 deltaUV2 = uv2 - uv0;
-
-        float r = 1.f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-        glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
-        glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
-
-        // set the same tangent for all three vertices of the triangle
-        //  they will be merged later ; in vboindexer.cpp
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-
-        // same thing for binormals
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
+#if defined(SIMD_DISPATCH)
+        if (level >= SIMD_AVX2)
+        {
+            avx2::tangentRange<avx2::WideLanes>(in_vertices, in_uvs, in_normals, out_tangents, out_bitangents, begin, end);
+            return;
+        }
+#endif
+        if (level >= SIMD_SSE2)
+        {
+            tangentRange<WideLanes>(in_vertices, in_uvs, in_normals, out_tangents, out_bitangents, begin, end);
+        }
+        else
+        {
+            tangentRange<ScalarLanes>(in_vertices, in_uvs, in_normals, out_tangents, out_bitangents, begin, end);
+        }
+    }, threadCount);
+}
+
+// a unit vector orthogonal to n
+static glm::vec3 anyOrthogonal(const glm::vec3 &n)
+{
+    glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    glm::vec3 t = axis - n * glm::dot(n, axis);
+    float len = glm::length(t);
+    return len > 0.f ? t / len : glm::vec3(1.f, 0.f, 0.f);
+}
+
+// interior angle of the triangle at p0
+static float cornerAngle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+{
+    glm::vec3 e1 = p1 - p0;
+    glm::vec3 e2 = p2 - p0;
+    float len = glm::length(e1) * glm::length(e2);
+    if (len <= 0.f)
+    {
+        return 0.f;
     }
+    float c = glm::dot(e1, e2) / len;
+    c = c < -1.f ? -1.f : (c > 1.f ? 1.f : c);
+    return acosf(c);
+}
 
-    for (unsigned int i = 0 ; i < vertices.size(); i++)
+void computeIndexedTangentBasis(
+    // inputs, vertices may be added
+    std::vector<unsigned int>& indices,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    // outputs
+    std::vector<glm::vec3>& tangents,
+    std::vector<glm::vec3>& bitangents
+)
+{
+    PROFILE_SCOPE("computeIndexedTangentBasis");
+    static const unsigned int noVertex = 0xffffffffu;
+    size_t triangleCount = indices.size() / 3;
+
+    // UV tangent and winding of every triangle, 0 for degenerate UVs
+    std::vector<glm::vec3> faceTangents(triangleCount);
+    std::vector<signed char> faceSigns(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
     {
-        glm::vec3& n = normals[i];
-        glm::vec3& t = tangents[i];
-        glm::vec3& b = bitangents[i];
+        const unsigned int* tri = &indices[t * 3];
+        glm::vec3 deltaPos1 = vertices[tri[1]] - vertices[tri[0]];
+        glm::vec3 deltaPos2 = vertices[tri[2]] - vertices[tri[0]];
+        glm::vec2 deltaUV1 = uvs[tri[1]] - uvs[tri[0]];
+        glm::vec2 deltaUV2 = uvs[tri[2]] - uvs[tri[0]];
+
+        float det = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+        glm::vec3 tangent = deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y;
+        // the sign of det is the handedness ; dividing by it would only scale
+        if (det == 0.f || glm::dot(tangent, tangent) == 0.f)
+        {
+            faceSigns[t] = 0;
+            continue;
+        }
+        faceSigns[t] = det > 0.f ? 1 : -1;
+        faceTangents[t] = det > 0.f ? tangent : -tangent;
+    }
 
-        // gram-schmidt orthogonalize
-        t = glm::normalize(t - n * glm::dot(n, t));
+    // handedness of every vertex, taken from the first triangle that votes
+    //  triangles of the other handedness get a copy of the vertex
+    size_t vertexCount = vertices.size();
+    std::vector<signed char> vertexSigns(vertexCount, 0);
+    std::vector<unsigned int> mirrored(vertexCount, noVertex);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        signed char sign = faceSigns[t];
+        if (sign == 0)
+        {
+            continue;
+        }
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (vertexSigns[v] == 0)
+            {
+                vertexSigns[v] = sign;
+            }
+            else if (vertexSigns[v] != sign)
+            {
+                if (mirrored[v] == noVertex)
+                {
+                    mirrored[v] = (unsigned int)vertices.size();
+                    vertices.push_back(vertices[v]);
+                    uvs.push_back(uvs[v]);
+                    normals.push_back(normals[v]);
+                    vertexSigns.push_back(sign);
+                }
+                indices[t * 3 + k] = mirrored[v];
+            }
+        }
+    }
 
-        // calculate handedness
-        if (glm::dot(glm::cross(n, t), b) < 0.f)
+    // angle weighted sum of the face tangents, in each vertex's tangent plane
+    tangents.assign(vertices.size(), glm::vec3(0.f));
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (faceSigns[t] == 0)
         {
-            t = t * -1.f;
+            continue;
         }
+        const unsigned int* tri = &indices[t * 3];
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = tri[k];
+            const glm::vec3 &n = normals[v];
+            glm::vec3 projected = faceTangents[t] - n * glm::dot(n, faceTangents[t]);
+            float len = glm::length(projected);
+            if (len <= 0.f)
+            {
+                continue;
+            }
+            float angle = cornerAngle(vertices[v], vertices[tri[(k + 1) % 3]], vertices[tri[(k + 2) % 3]]);
+            tangents[v] += projected * (angle / len);
+        }
+    }
+
+    // normalize, orthogonalize once more and build the bitangents
+    bitangents.resize(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        const glm::vec3 &n = normals[v];
+        glm::vec3 t = tangents[v] - n * glm::dot(n, tangents[v]);
+        float len = glm::length(t);
+        t = len > 0.f ? t / len : anyOrthogonal(n);
+        tangents[v] = t;
+        bitangents[v] = glm::cross(n, t) * (vertexSigns[v] < 0 ? -1.f : 1.f);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,758 @@
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/parallel.hpp"
+#include "common/texcompress.hpp"
+
+// block rows handled by one parallel block
+static const size_t compressBlockRows = 4;
+
+//
+// BC1 colour
+
+// the 16 pixels of a block as floats, one array per channel
+struct ColorBlock
+{
+    float r[16];
+    float g[16];
+    float b[16];
+};
+
+static inline uint16_t packColor565(const float c[3])
+{
+    unsigned int r = (unsigned int)(c[0] * (31.f / 255.f) + 0.5f);
+    unsigned int g = (unsigned int)(c[1] * (63.f / 255.f) + 0.5f);
+    unsigned int b = (unsigned int)(c[2] * (31.f / 255.f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpackColor565(uint16_t c, unsigned char out[3])
+{
+    unsigned int r = (c >> 11) & 31;
+    unsigned int g = (c >> 5) & 63;
+    unsigned int b = c & 31;
+    out[0] = (unsigned char)((r << 3) | (r >> 2));
+    out[1] = (unsigned char)((g << 2) | (g >> 4));
+    out[2] = (unsigned char)((b << 3) | (b >> 2));
+}
+
+// the 4 colours of a BC1 block in 4-colour mode, as decoders compute them
+static void colorPalette(uint16_t c0, uint16_t c1, float palette[4][3])
+{
+    unsigned char e0[3], e1[3];
+    unpackColor565(c0, e0);
+    unpackColor565(c1, e1);
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        palette[0][k] = e0[k];
+        palette[1][k] = e1[k];
+        palette[2][k] = (float)((2 * e0[k] + e1[k]) / 3);
+        palette[3][k] = (float)((e0[k] + 2 * e1[k]) / 3);
+    }
+}
+
+// nearest palette entry of every pixel, returns the summed squared error
+//  the vector and scalar paths pick the same indices
+static float fitColorIndices(const ColorBlock &block, const float palette[4][3], unsigned char indices[16])
+{
+    float errors[16];
+#if defined(__SSE2__)
+    for (unsigned int i = 0; i < 16; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(block.r + i);
+        __m128 g = _mm_loadu_ps(block.g + i);
+        __m128 b = _mm_loadu_ps(block.b + i);
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int k = 0; k < 4; k++)
+        {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128i less = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            bestIndex = _mm_or_si128(_mm_andnot_si128(less, bestIndex), _mm_and_si128(less, _mm_set1_epi32(k)));
+        }
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, bestIndex);
+        _mm_storeu_ps(errors + i, best);
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            indices[i + j] = (unsigned char)lanes[j];
+        }
+    }
+#else
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float best = FLT_MAX;
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            float dr = block.r[i] - palette[k][0];
+            float dg = block.g[i] - palette[k][1];
+            float db = block.b[i] - palette[k][2];
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best)
+            {
+                best = d;
+                indices[i] = (unsigned char)k;
+            }
+        }
+        errors[i] = best;
+    }
+#endif
+    float total = 0.f;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        total += errors[i];
+    }
+    return total;
+}
+
+// an encoding candidate : quantized endpoints, indices and error
+struct ColorFit
+{
+    uint16_t c0, c1;
+    unsigned char indices[16];
+    float error;
+};
+
+static void evaluateEndpoints(const ColorBlock &block, const float e0[3], const float e1[3], ColorFit &fit)
+{
+    fit.c0 = packColor565(e0);
+    fit.c1 = packColor565(e1);
+    float palette[4][3];
+    colorPalette(fit.c0, fit.c1, palette);
+    fit.error = fitColorIndices(block, palette, fit.indices);
+}
+
+static inline float clampColor(float v)
+{
+    return v < 0.f ? 0.f : (v > 255.f ? 255.f : v);
+}
+
+// endpoints minimizing the error for the current indices
+//  returns false when the system is singular (all pixels on one index)
+static bool refitEndpoints(const ColorBlock &block, const unsigned char indices[16], float e0[3], float e1[3])
+{
+    static const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ax[3] = { 0.f, 0.f, 0.f }, bx[3] = { 0.f, 0.f, 0.f };
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float w = weights[indices[i]];
+        float v = 1.f - w;
+        aa += w * w;
+        ab += w * v;
+        bb += v * v;
+        const float p[3] = { block.r[i], block.g[i], block.b[i] };
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            ax[k] += w * p[k];
+            bx[k] += v * p[k];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+    {
+        return false;
+    }
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        e0[k] = clampColor((bb * ax[k] - ab * bx[k]) / det);
+        e1[k] = clampColor((aa * bx[k] - ab * ax[k]) / det);
+    }
+    return true;
+}
+
+// bounding box endpoints, along the diagonal the colours are spread on
+static void boxEndpoints(const ColorBlock &block, float e0[3], float e1[3])
+{
+    float lo[3] = { 255.f, 255.f, 255.f }, hi[3] = { 0.f, 0.f, 0.f };
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        const float p[3] = { block.r[i], block.g[i], block.b[i] };
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+            hi[k] = p[k] > hi[k] ? p[k] : hi[k];
+            mean[k] += p[k] / 16.f;
+        }
+    }
+    // flip red and blue against green where they are anti-correlated
+    float covRG = 0.f, covBG = 0.f;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        covRG += (block.r[i] - mean[0]) * (block.g[i] - mean[1]);
+        covBG += (block.b[i] - mean[2]) * (block.g[i] - mean[1]);
+    }
+    // inset by 1/16 of the range, the extremes are rarely hit exactly
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        float inset = (hi[k] - lo[k]) / 16.f;
+        e0[k] = hi[k] - inset;
+        e1[k] = lo[k] + inset;
+    }
+    if (covRG < 0.f)
+    {
+        float t = e0[0]; e0[0] = e1[0]; e1[0] = t;
+    }
+    if (covBG < 0.f)
+    {
+        float t = e0[2]; e0[2] = e1[2]; e1[2] = t;
+    }
+}
+
+// endpoints at the extremes of the colours along their principal axis
+static void axisEndpoints(const ColorBlock &block, float e0[3], float e1[3])
+{
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        mean[0] += block.r[i] / 16.f;
+        mean[1] += block.g[i] / 16.f;
+        mean[2] += block.b[i] / 16.f;
+    }
+    float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };     // rr rg rb gg gb bb
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float r = block.r[i] - mean[0];
+        float g = block.g[i] - mean[1];
+        float b = block.b[i] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // power iteration, from the covariance column of the widest channel : a
+    //  fixed start like (1, 1, 1) can be orthogonal to the axis and stay put
+    float axis[3] = { 1.f, 1.f, 1.f };
+    if (cov[0] >= cov[3] && cov[0] >= cov[5] && cov[0] > 0.f)
+    {
+        axis[0] = cov[0]; axis[1] = cov[1]; axis[2] = cov[2];
+    }
+    else if (cov[3] >= cov[5] && cov[3] > 0.f)
+    {
+        axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4];
+    }
+    else if (cov[5] > 0.f)
+    {
+        axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5];
+    }
+    for (unsigned int iteration = 0; iteration < 8; iteration++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float m = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+        if (m <= 0.f)
+        {
+            break;
+        }
+        axis[0] = x / m; axis[1] = y / m; axis[2] = z / m;
+    }
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        axis[k] /= len;
+    }
+
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float t = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] + (block.b[i] - mean[2]) * axis[2];
+        lo = t < lo ? t : lo;
+        hi = t > hi ? t : hi;
+    }
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        e0[k] = clampColor(mean[k] + axis[k] * hi);
+        e1[k] = clampColor(mean[k] + axis[k] * lo);
+    }
+}
+
+// refit from fit's indices while the error goes down
+static void refineFit(const ColorBlock &block, ColorFit &fit, unsigned int iterations)
+{
+    for (unsigned int iteration = 0; iteration < iterations; iteration++)
+    {
+        float e0[3], e1[3];
+        if (!refitEndpoints(block, fit.indices, e0, e1))
+        {
+            return;
+        }
+        ColorFit candidate;
+        evaluateEndpoints(block, e0, e1, candidate);
+        if (candidate.error >= fit.error)
+        {
+            return;
+        }
+        fit = candidate;
+    }
+}
+
+void encodeBC1Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality)
+{
+    ColorBlock block;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        block.r[i] = rgba[i * 4 + 0];
+        block.g[i] = rgba[i * 4 + 1];
+        block.b[i] = rgba[i * 4 + 2];
+    }
+
+    float e0[3], e1[3];
+    ColorFit fit;
+    if (quality == COMPRESS_FAST)
+    {
+        boxEndpoints(block, e0, e1);
+        evaluateEndpoints(block, e0, e1, fit);
+    }
+    else
+    {
+        axisEndpoints(block, e0, e1);
+        evaluateEndpoints(block, e0, e1, fit);
+        refineFit(block, fit, quality == COMPRESS_BEST ? 8 : 1);
+    }
+    if (quality == COMPRESS_BEST)
+    {
+        ColorFit box;
+        boxEndpoints(block, e0, e1);
+        evaluateEndpoints(block, e0, e1, box);
+        refineFit(block, box, 8);
+        if (box.error < fit.error)
+        {
+            fit = box;
+        }
+    }
+
+    // 4-colour mode needs c0 > c1
+    uint16_t c0 = fit.c0, c1 = fit.c1;
+    uint32_t bits = 0;
+    if (c0 == c1)
+    {
+        // a single colour, every index on c0
+    }
+    else
+    {
+        unsigned int flip = 0;
+        if (c0 < c1)
+        {
+            uint16_t t = c0; c0 = c1; c1 = t;
+            flip = 1;   // swaps 0 <-> 1 and 2 <-> 3
+        }
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            bits |= (uint32_t)(fit.indices[i] ^ flip) << (i * 2);
+        }
+    }
+
+    out[0] = (unsigned char)(c0 & 0xff);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xff);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (unsigned int k = 0; k < 4; k++)
+    {
+        out[4 + k] = (unsigned char)(bits >> (k * 8));
+    }
+}
+
+//
+// BC4 single channel
+
+// the 8 values of a BC4 block, as decoders compute them
+static void alphaPalette(unsigned int a0, unsigned int a1, int palette[8])
+{
+    palette[0] = (int)a0;
+    palette[1] = (int)a1;
+    if (a0 > a1)
+    {
+        for (unsigned int k = 1; k < 7; k++)
+        {
+            palette[k + 1] = (int)(((7 - k) * a0 + k * a1) / 7);
+        }
+    }
+    else
+    {
+        for (unsigned int k = 1; k < 5; k++)
+        {
+            palette[k + 1] = (int)(((5 - k) * a0 + k * a1) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static unsigned int fitAlphaIndices(const int values[16], unsigned int a0, unsigned int a1, unsigned char indices[16])
+{
+    int palette[8];
+    alphaPalette(a0, a1, palette);
+    unsigned int total = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        unsigned int best = 0xffffffffu;
+        for (unsigned int k = 0; k < 8; k++)
+        {
+            int d = values[i] - palette[k];
+            unsigned int e = (unsigned int)(d * d);
+            if (e < best)
+            {
+                best = e;
+                indices[i] = (unsigned char)k;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+void encodeBC4Block(const unsigned char* rgba, unsigned int channel, unsigned char* out, CompressQuality quality)
+{
+    int values[16];
+    int lo = 255, hi = 0;           // over all values
+    int innerLo = 255, innerHi = 0; // without 0 and 255, which the 6-value mode has for free
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        int v = rgba[i * 4 + channel];
+        values[i] = v;
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        if (v != 0 && v != 255)
+        {
+            innerLo = v < innerLo ? v : innerLo;
+            innerHi = v > innerHi ? v : innerHi;
+        }
+    }
+
+    // 8-value mode : a0 > a1
+    unsigned int bestA0 = (unsigned int)hi, bestA1 = (unsigned int)lo;
+    unsigned char bestIndices[16];
+    unsigned int bestError = fitAlphaIndices(values, bestA0, bestA1, bestIndices);
+
+    unsigned char indices[16];
+    if (quality != COMPRESS_FAST && innerLo <= innerHi)
+    {
+        // 6-value mode : a0 <= a1
+        unsigned int error = fitAlphaIndices(values, (unsigned int)innerLo, (unsigned int)innerHi, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestA0 = (unsigned int)innerLo;
+            bestA1 = (unsigned int)innerHi;
+            memcpy(bestIndices, indices, 16);
+        }
+    }
+    if (quality == COMPRESS_BEST && bestError > 0)
+    {
+        // pull the endpoints inwards a little in both modes
+        for (int d0 = 0; d0 <= 4; d0++)
+        {
+            for (int d1 = 0; d1 <= 4; d1++)
+            {
+                int a0 = hi - d0, a1 = lo + d1;
+                if (a0 > a1)
+                {
+                    unsigned int error = fitAlphaIndices(values, (unsigned int)a0, (unsigned int)a1, indices);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestA0 = (unsigned int)a0;
+                        bestA1 = (unsigned int)a1;
+                        memcpy(bestIndices, indices, 16);
+                    }
+                }
+                a0 = innerLo + d0;
+                a1 = innerHi - d1;
+                if (innerLo <= innerHi && a0 <= a1)
+                {
+                    unsigned int error = fitAlphaIndices(values, (unsigned int)a0, (unsigned int)a1, indices);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestA0 = (unsigned int)a0;
+                        bestA1 = (unsigned int)a1;
+                        memcpy(bestIndices, indices, 16);
+                    }
+                }
+            }
+        }
+    }
+
+    out[0] = (unsigned char)bestA0;
+    out[1] = (unsigned char)bestA1;
+    uint64_t bits = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        bits |= (uint64_t)bestIndices[i] << (i * 3);
+    }
+    for (unsigned int k = 0; k < 6; k++)
+    {
+        out[2 + k] = (unsigned char)(bits >> (k * 8));
+    }
+}
+
+void encodeBC3Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality)
+{
+    encodeBC4Block(rgba, 3, out, quality);
+    encodeBC1Block(rgba, out + 8, quality);
+}
+
+void encodeBC5Block(const unsigned char* rgba, unsigned char* out, CompressQuality quality)
+{
+    encodeBC4Block(rgba, 0, out, quality);
+    encodeBC4Block(rgba, 1, out + 8, quality);
+}
+
+//
+// decoding
+
+static void decodeBC1Colors(const unsigned char* block, unsigned char* rgba, bool fourColors)
+{
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+    unsigned char palette[4][4];
+    unpackColor565(c0, palette[0]);
+    unpackColor565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        if (fourColors || c0 > c1)
+        {
+            palette[2][k] = (unsigned char)((2 * palette[0][k] + palette[1][k]) / 3);
+            palette[3][k] = (unsigned char)((palette[0][k] + 2 * palette[1][k]) / 3);
+        }
+        else
+        {
+            palette[2][k] = (unsigned char)((palette[0][k] + palette[1][k]) / 2);
+            palette[3][k] = 0;
+        }
+    }
+    if (!fourColors && c0 <= c1)
+    {
+        palette[3][3] = 0;
+    }
+    uint32_t bits = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        unsigned int index = (bits >> (i * 2)) & 3;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            rgba[i * 4 + k] = palette[index][k];
+        }
+        if (!fourColors)
+        {
+            rgba[i * 4 + 3] = palette[index][3];
+        }
+    }
+}
+
+static void decodeBC4(const unsigned char* block, unsigned char* rgba, unsigned int channel)
+{
+    int palette[8];
+    alphaPalette(block[0], block[1], palette);
+    uint64_t bits = 0;
+    for (unsigned int k = 0; k < 6; k++)
+    {
+        bits |= (uint64_t)block[2 + k] << (k * 8);
+    }
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        rgba[i * 4 + channel] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+void decodeBlock(ImageFormat format, const unsigned char* block, unsigned char* rgba)
+{
+    switch (format)
+    {
+    case IMAGE_BC1:
+        decodeBC1Colors(block, rgba, false);
+        break;
+    case IMAGE_BC2:
+        // explicit 4-bit alpha
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            unsigned int a = (block[i / 2] >> ((i & 1) * 4)) & 15;
+            rgba[i * 4 + 3] = (unsigned char)(a * 17);
+        }
+        decodeBC1Colors(block + 8, rgba, true);
+        break;
+    case IMAGE_BC3:
+        decodeBC4(block, rgba, 3);
+        decodeBC1Colors(block + 8, rgba, true);
+        break;
+    case IMAGE_BC5:
+        decodeBC4(block, rgba, 0);
+        decodeBC4(block + 8, rgba, 1);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            rgba[i * 4 + 2] = 0;
+            rgba[i * 4 + 3] = 255;
+        }
+        break;
+    default:
+        memset(rgba, 0, 64);
+        break;
+    }
+}
+
+//
+// whole levels
+
+static unsigned int blockBytes(ImageFormat format)
+{
+    return format == IMAGE_BC1 ? 8 : 16;
+}
+
+void compressLevel(
+    const unsigned char* rgba,
+    unsigned int width,
+    unsigned int height,
+    ImageFormat format,
+    CompressQuality quality,
+    unsigned char* out,
+    unsigned int threadCount
+)
+{
+    unsigned int blocksX = (width + 3) / 4;
+    unsigned int blocksY = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+
+    parallelFor(blocksY, compressBlockRows, [&](size_t begin, size_t end)
+    {
+        unsigned char block[64];
+        for (size_t by = begin; by < end; by++)
+        {
+            for (unsigned int bx = 0; bx < blocksX; bx++)
+            {
+                // edge blocks repeat the last row and column
+                for (unsigned int y = 0; y < 4; y++)
+                {
+                    unsigned int sy = (unsigned int)by * 4 + y;
+                    sy = sy < height ? sy : height - 1;
+                    for (unsigned int x = 0; x < 4; x++)
+                    {
+                        unsigned int sx = bx * 4 + x;
+                        sx = sx < width ? sx : width - 1;
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                }
+
+                unsigned char* dst = out + ((size_t)by * blocksX + bx) * bytes;
+                switch (format)
+                {
+                case IMAGE_BC1:
+                    encodeBC1Block(block, dst, quality);
+                    break;
+                case IMAGE_BC5:
+                    encodeBC5Block(block, dst, quality);
+                    break;
+                default:
+                    encodeBC3Block(block, dst, quality);
+                    break;
+                }
+            }
+        }
+    }, threadCount);
+}
+
+void decompressLevel(
+    const unsigned char* blocks,
+    unsigned int width,
+    unsigned int height,
+    ImageFormat format,
+    unsigned char* rgba
+)
+{
+    unsigned int blocksX = (width + 3) / 4;
+    unsigned int blocksY = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+    unsigned char block[64];
+    for (unsigned int by = 0; by < blocksY; by++)
+    {
+        for (unsigned int bx = 0; bx < blocksX; bx++)
+        {
+            // alpha stays 255 where the format has none
+            memset(block, 255, sizeof(block));
+            decodeBlock(format, blocks + ((size_t)by * blocksX + bx) * bytes, block);
+            for (unsigned int y = 0; y < 4 && by * 4 + y < height; y++)
+            {
+                for (unsigned int x = 0; x < 4 && bx * 4 + x < width; x++)
+                {
+                    memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+}
+
+double computePSNR(const unsigned char* a, const unsigned char* b, size_t pixelCount, unsigned int channelCount)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        for (unsigned int k = 0; k < channelCount; k++)
+        {
+            double d = (double)a[i * 4 + k] - (double)b[i * 4 + k];
+            sum += d * d;
+        }
+    }
+    double mse = sum / ((double)pixelCount * channelCount);
+    if (mse <= 0.0)
+    {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+bool compressImage(
+    const Image &source,
+    ImageFormat format,
+    CompressQuality quality,
+    Image &image,
+    unsigned int threadCount
+)
+{
+    if (source.format != IMAGE_RGBA8 || source.levels.empty())
+    {
+        return false;
+    }
+    if (format != IMAGE_BC1 && format != IMAGE_BC3 && format != IMAGE_BC5)
+    {
+        return false;
+    }
+
+    image.format = format;
+    image.width = source.width;
+    image.height = source.height;
+    image.rowAlignment = 1;
+    image.file.data = NULL;
+    image.file.size = 0;
+    image.levels.clear();
+
+    // sizes first, the level views must not move afterwards
+    size_t total = 0;
+    for (unsigned int level = 0; level < source.levels.size(); level++)
+    {
+        total += imageLevelSize(format, source.levels[level].width, source.levels[level].height);
+    }
+    image.storage.resize(total);
+
+    size_t offset = 0;
+    for (unsigned int level = 0; level < source.levels.size(); level++)
+    {
+        const ImageLevel &from = source.levels[level];
+        size_t size = imageLevelSize(format, from.width, from.height);
+        compressLevel(from.data, from.width, from.height, format, quality, &image.storage[offset], threadCount);
+        ImageLevel view = { from.width, from.height, size, &image.storage[offset] };
+        image.levels.push_back(view);
+        offset += size;
+    }
+    return true;
+}
@@ -1,141 +1,236 @@
+#include <stddef.h>
+#include <algorithm>
+#include <string>
 #include <vector>
 #include <cstring>
 
 #include <GL/glew.h>
 
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
 #include "common/shader.hpp"
 #include "common/texture.hpp"
+#include "common/assetloader.hpp"
+#include "common/glstate.hpp"
+#include "common/profiler.hpp"
 
 #include "common/text2D.hpp"
 
-unsigned int Text2DTextureID;
-unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
+TextureAsset Text2DFont;        // resident once the font texture is uploaded
+unsigned int Text2DVertexArrayID;
+unsigned int Text2DInstanceBufferID;
 unsigned int Text2DShaderID;
 unsigned int Text2DUniformID;
 
-void initText2D(const char* texturePath)
+// one character : the vertex shader makes its quad out of it
+struct GlyphInstance
+{
+    short x, y;                 // lower left corner, in the [0..800][0..600] screen
+    unsigned short size;
+    unsigned short glyph;       // character code, 16x16 glyphs in the font texture
+};
+
+// what a printText2D() call of the frame asked for, kept from one frame to
+//  the next : the n-th call of a frame is compared with the n-th call of
+//  the frame before, and its instances only made again if it changed
+struct TextString
+{
+    std::string text;
+    int x, y, size;
+    std::vector<GlyphInstance> instances;
+};
+
+static std::vector<TextString> Text2DStrings;
+static unsigned int Text2DStringCount = 0;      // printText2D() calls this frame
+static unsigned int Text2DLastStringCount = 0;
+static bool Text2DChanged = true;
+
+// instances stream through a ring in one buffer, each frame after the
+//  last ; when it wraps the buffer is orphaned, so writes never wait for
+//  the frames still reading it
+static const size_t text2DRingSize = 1 << 19;   // bytes, 64K characters
+static size_t Text2DRingOffset = 0;
+static size_t Text2DDrawOffset = 0;             // where the last frame's instances are
+static unsigned int Text2DDrawCount = 0;
+
+static void setInstanceAttributes(size_t offset)
+{
+    // 1rst attribute : position, 2nd : size and glyph, once per character
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, sizeof(GlyphInstance),
+        (void*)(offset + offsetof(GlyphInstance, x)));
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(GlyphInstance),
+        (void*)(offset + offsetof(GlyphInstance, size)));
+}
+
+void initText2D(const char* texturePath, AssetLoader* loader)
 {
-    // initialize texture
-    Text2DTextureID = loadDDS(texturePath);
+    // initialize texture, text shows up once it is resident
+    if (loader)
+    {
+        loadTextureAsync(*loader, texturePath, Text2DFont);
+    }
+    else
+    {
+        Text2DFont.texture = loadDDS(texturePath);
+        Text2DFont.resident = true;
+    }
 
-    // initialize VBO
-    glGenBuffers(1, &Text2DVertexBufferID);
-    glGenBuffers(1, &Text2DUVBufferID);
+    // initialize the instance ring
+    glGenBuffers(1, &Text2DInstanceBufferID);
+    bindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+    glBufferData(GL_ARRAY_BUFFER, text2DRingSize, NULL, GL_STREAM_DRAW);
+    Text2DRingOffset = 0;
+    Text2DDrawCount = 0;
+
+    // the attributes advance once per instance, their offset moves with
+    //  the ring
+    glGenVertexArrays(1, &Text2DVertexArrayID);
+    bindVertexArray(Text2DVertexArrayID);
+    enableVertexAttribArray(0);
+    enableVertexAttribArray(1);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    setInstanceAttributes(0);
 
     // initialize shader
     Text2DShaderID = LoadShaders("shaders/TextVertexShader.vs", "shaders/TextVertexShader.fs");
 
     // initialize uniforms' IDs
     Text2DUniformID = glGetUniformLocation(Text2DShaderID, "myTextureSampler");
+    // set our "myTextureSampler" sampler to use Texture Unit 0, for good
+    useProgram(Text2DShaderID);
+    glUniform1i(Text2DUniformID, 0);
+
+    Text2DStrings.clear();
+    Text2DStringCount = 0;
+    Text2DLastStringCount = 0;
+    Text2DChanged = true;
 }
 
 void printText2D(const char* text, int x, int y, int size)
 {
-    unsigned int length = strlen(text);
+    unsigned int index = Text2DStringCount++;
+    if (index == Text2DStrings.size())
+    {
+        Text2DStrings.push_back(TextString());
+    }
+    else if (Text2DStrings[index].x == x && Text2DStrings[index].y == y &&
+             Text2DStrings[index].size == size && Text2DStrings[index].text == text)
+    {
+        return;
+    }
+
+    TextString &string = Text2DStrings[index];
+    string.text = text;
+    string.x = x;
+    string.y = y;
+    string.size = size;
+    Text2DChanged = true;
 
-    // fill buffers
-    std::vector<glm::vec2> vertices;
-    std::vector<glm::vec2> UVs;
+    unsigned int length = string.text.size();
+    string.instances.resize(length);
     for (unsigned int i = 0; i < length; i++)
     {
-        glm::vec2 vertex_up_left    = glm::vec2(x + i*size,         y + size);
-        glm::vec2 vertex_up_right   = glm::vec2(x + i*size + size,  y + size);
-        glm::vec2 vertex_down_right = glm::vec2(x + i*size + size,  y);
-        glm::vec2 vertex_down_left  = glm::vec2(x + i*size,         y);
-
-        vertices.push_back(vertex_up_left);
-        vertices.push_back(vertex_down_left);
-        vertices.push_back(vertex_up_right);
-
-        vertices.push_back(vertex_down_right);
-        vertices.push_back(vertex_up_right);
-        vertices.push_back(vertex_down_left);
-
-        char character = text[i];
-        float uv_x = (character % 16) / 16.f;       // funny calculation to get row and col
-        float uv_y = (character / 16) / 16.f;
-
-        glm::vec2 uv_up_left    = glm::vec2(uv_x,               uv_y);
-        glm::vec2 uv_up_right   = glm::vec2(uv_x + 1.f / 16.f,  uv_y);
-        glm::vec2 uv_down_right = glm::vec2(uv_x + 1.f / 16.f,  (uv_y + 1.f / 16.f));
-        glm::vec2 uv_down_left  = glm::vec2(uv_x,               (uv_y + 1.f / 16.f));
-
-        UVs.push_back(uv_up_left);
-        UVs.push_back(uv_down_left);
-        UVs.push_back(uv_up_right);
-
-        UVs.push_back(uv_down_right);
-        UVs.push_back(uv_up_right);
-        UVs.push_back(uv_down_left);
+        GlyphInstance &instance = string.instances[i];
+        instance.x = (short)(x + i*size);
+        instance.y = (short)y;
+        instance.size = (unsigned short)size;
+        instance.glyph = (unsigned char)string.text[i];
+    }
+}
+
+// copy this frame's instances in the ring, count them
+static unsigned int streamInstances()
+{
+    size_t count = 0;
+    for (unsigned int i = 0; i < Text2DStringCount; i++)
+    {
+        count += Text2DStrings[i].instances.size();
+    }
+    count = std::min(count, text2DRingSize / sizeof(GlyphInstance));
+    size_t bytes = count * sizeof(GlyphInstance);
+    if (count == 0)
+    {
+        return 0;
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-    glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
+    bindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+    if (Text2DRingOffset + bytes > text2DRingSize)
+    {
+        glBufferData(GL_ARRAY_BUFFER, text2DRingSize, NULL, GL_STREAM_DRAW);
+        Text2DRingOffset = 0;
+    }
+    // nothing in flight reads past the offset, no need to synchronize
+    GlyphInstance* mapped = (GlyphInstance*)glMapBufferRange(
+        GL_ARRAY_BUFFER, Text2DRingOffset, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped == NULL)
+    {
+        return 0;
+    }
+    size_t written = 0;
+    for (unsigned int i = 0; i < Text2DStringCount && written < count; i++)
+    {
+        const std::vector<GlyphInstance> &instances = Text2DStrings[i].instances;
+        size_t n = std::min(instances.size(), count - written);
+        memcpy(mapped + written, instances.data(), n * sizeof(GlyphInstance));
+        written += n;
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
 
-    // bind buffer
-    glUseProgram(Text2DShaderID);
+    Text2DDrawOffset = Text2DRingOffset;
+    Text2DRingOffset += bytes;
+    return (unsigned int)count;
+}
 
-    // bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
-    // set our "myTextureSampler" sampler to use Texture Unit 0
-    glUniform1i(Text2DUniformID, 0);
+void flushText2D()
+{
+    PROFILE_GPU_SCOPE("flushText2D");
+    // the same strings as last frame are already in the ring
+    if (Text2DChanged || Text2DStringCount != Text2DLastStringCount)
+    {
+        Text2DDrawCount = streamInstances();
+        bindVertexArray(Text2DVertexArrayID);
+        bindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+        setInstanceAttributes(Text2DDrawOffset);
+    }
+    Text2DLastStringCount = Text2DStringCount;
+    Text2DStringCount = 0;
+    Text2DChanged = false;
 
-    // 1rst attribute buffer : vertices
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-    glVertexAttribPointer(
-        0,          // index
-        2,          // size
-        GL_FLOAT,   // type
-        GL_FALSE,   // normalized?
-        0,          // stride
-        (void*)0    // ptr to the first vertex attribute in the array
-    );
+    if (!Text2DFont.resident || Text2DDrawCount == 0)
+    {
+        return;
+    }
 
-    // 2nd attribute buffer : UVs
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-    glVertexAttribPointer(
-        1,          // index
-        2,          // size
-        GL_FLOAT,   // type
-        GL_FALSE,   // normalized?
-        0,          // stride
-        (void*)0    // ptr to the first vertex attribute in the array
-    );
+    // bind buffer
+    useProgram(Text2DShaderID);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // bind texture
+    bindTextureUnit(0, GL_TEXTURE_2D, Text2DFont.texture);
 
-    // draw call
-    glDrawArrays(
-        GL_TRIANGLES,       // mode
-        0,                  // first?
-        vertices.size()     // size
-    );
+    bindVertexArray(Text2DVertexArrayID);
 
-    glDisable(GL_BLEND);
+    // blended over the scene ; what draws next sets the blending it needs
+    setCapability(GL_BLEND, true);
+    blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    // draw call : a quad per character, all the text at once
+    glDrawArraysInstanced(
+        GL_TRIANGLE_STRIP,  // mode
+        0,                  // first
+        4,                  // corners
+        Text2DDrawCount     // characters
+    );
 }
 
 void cleanupText2D()
 {
     // delete buffers
-    glDeleteBuffers(1, &Text2DVertexBufferID);
-    glDeleteBuffers(1, &Text2DUVBufferID);
+    deleteBuffers(1, &Text2DInstanceBufferID);
+    deleteVertexArrays(1, &Text2DVertexArrayID);
 
     // delete texture
-    glDeleteTextures(1, &Text2DTextureID);
+    deleteTextures(1, &Text2DFont.texture);
 
     // delete shader
-    glDeleteProgram(Text2DShaderID);
-}
\ No newline at end of file
+    deleteProgram(Text2DShaderID);
+}
@@ -1,207 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <common/glstate.hpp>
+#include <common/mipmap.hpp>
+#include <common/profiler.hpp>
 #include <common/texture.hpp>
 
-GLuint loadBMP(const char* imagepath)
-{
-    printf("Reading image %s\n", imagepath);
-
-    // data read from the header of the BMP file
-    unsigned char header[54];   // 54-bytes header of BMP file
-    unsigned int dataPos;       // position in the file where the actual data begins
-    unsigned int width, height;
-    unsigned int imageSize;     // = width * height * 3
-    // actual RGB data
-    unsigned char* data;
-
-    // open the file
-    FILE* file = fopen(imagepath, "rb");    // "rb" := read binary
-    if (!file) {
-        printf("%s could not opened. Are you in the right directory?\n", imagepath);
-        getchar();
-        return 0;
-    }
+// level offsets inside an unpack buffer
+static const size_t uploadAlignment = 16;
 
-    // read the header, i.e. the 54 first bytes
-    if (fread(header, 1, 54, file) != 54) {
-        printf("Not a correct BMP file (0)\n");
-        fclose(file);
-        return 0;
-    }
-    // a BMP file always begins with "BM"
-    if (header[0] != 'B' || header[1] != 'M') {
-        printf("Not a correct BMP file (1)\n");
-        fclose(file);
-        return 0;
-    }
-    // make sure this is a 24 bpp file
-    //  check https://en.wikipedia.org/wiki/BMP_file_format#Bitmap_file_header
-    if (*(int*)&(header[0x1E]) != 0) {          // compression method
-        printf("Not a correct BMP file (2)\n");
-        fclose(file);
-        return 0;
-    }
-    if (*(int*)&(header[0x1C]) != 24) {          // number of bits per pixel
-        printf("Not a correct BMP file (3)\n");
-        fclose(file);
-        return 0;
-    }
+// how long to wait for the GPU to release an unpack buffer, in ns
+static const GLuint64 uploadTimeout = 1000000000;
 
-    // read the information about the image
-    dataPos     = *(int*)&(header[0x0A]);       // offset, i.e. starting address
-    imageSize   = *(int*)&(header[0x22]);       // size of the raw bitmap data
-    width       = *(int*)&(header[0x12]);       // bitmap width in pixel
-    height      = *(int*)&(header[0x16]);       // bitmap height in pixel
+struct TextureFormat
+{
+    GLenum internalFormat;
+    GLenum format;          // uncompressed only
+    GLenum type;            // uncompressed only
+};
 
-    // if some BMP files are misformatted, guess missing information
-    if (imageSize == 0) {
-        imageSize = width * height * 3;     // 3: one byte for each Red, Green and Blue
-    }
-    if (dataPos == 0) {
-        dataPos = 54;                       // BMP header is done that way
+static TextureFormat textureFormat(ImageFormat format)
+{
+    TextureFormat result = { 0, 0, 0 };
+    switch (format)
+    {
+    case IMAGE_BGR8:
+        result.internalFormat = GL_RGB;
+        result.format = GL_BGR;
+        result.type = GL_UNSIGNED_BYTE;
+        break;
+    case IMAGE_RGBA8:
+        result.internalFormat = GL_RGBA8;
+        result.format = GL_RGBA;
+        result.type = GL_UNSIGNED_BYTE;
+        break;
+    case IMAGE_BC1:
+        result.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        break;
+    case IMAGE_BC2:
+        result.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        break;
+    case IMAGE_BC3:
+        result.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        break;
+    case IMAGE_BC5:
+        result.internalFormat = GL_COMPRESSED_RG_RGTC2;
+        break;
     }
+    return result;
+}
 
-    // create a buffer
-    data = new unsigned char[imageSize];
-
-    // read the actual data from the file into the buffer
-    fread(data, 1, imageSize, file);
-
-    // everything is in memory now, the file can be closed
-    fclose(file);
-
-    // CREATE one OpenGL texture
-    GLuint textureID;
-    glGenTextures(
-        1,          // number of texture names to be generated
-        &textureID  // array which stores the generated texture names  
-        );  
-
-    // BIND the newly created texture: all future texture functions will modify texture
-    glBindTexture(
-        GL_TEXTURE_2D,  // specify target
-        textureID       // texture name
+// specify one level of the bound texture from pixels, which is a pointer or,
+//  with an unpack buffer bound, an offset into it
+static void specifyLevel(const Image &image, unsigned int level, const void* pixels)
+{
+    TextureFormat format = textureFormat(image.format);
+    const ImageLevel &view = image.levels[level];
+    if (isCompressedFormat(image.format))
+    {
+        glCompressedTexImage2D(
+            GL_TEXTURE_2D,          // target texture
+            level,                  // level-of-detail (0 is base level)
+            format.internalFormat,  // format of image data
+            view.width, view.height,
+            0,                      // border
+            (GLsizei)view.size,     // number of unsigned bytes of image data
+            pixels                  // ptr to the compressed image data
         );
-
-    // FILL the image and give it to OpenGL
-    glTexImage2D(
-        GL_TEXTURE_2D,      // target texture
-        0,                  // level of detail
-        GL_RGB,             // internal format
-        width, height,      // texture image
-        0,                  // border
-        GL_BGR,             // data format
-        GL_UNSIGNED_BYTE,   // data type
-        data                // ptr to image data
+    }
+    else
+    {
+        glTexImage2D(
+            GL_TEXTURE_2D,          // target texture
+            level,                  // level of detail
+            format.internalFormat,  // internal format
+            view.width, view.height,
+            0,                      // border
+            format.format,          // data format
+            format.type,            // data type
+            pixels                  // ptr to image data
         );
-
-    // OpenGL has now copied the data
-    delete [] data;
-
-    // CONFIGURE it (poor filtering)
-    // glTexParameteri(
-    //     GL_TEXTURE_2D,          // target texture
-    //     GL_TEXTURE_MAG_FILTER,  // symbolic name
-    //     GL_NEAREST              // value of name
-    // );
-    // glTexParameteri(
-    //     GL_TEXTURE_2D,
-    //     GL_TEXTURE_MIN_FILTER,
-    //     GL_NEAREST
-    // );
-
-    // CONFIGURE it (trilinear filtering)
-    glTexParameteri(
-        GL_TEXTURE_2D,              // target texture
-        GL_TEXTURE_WRAP_S,          // symbolic name
-        GL_REPEAT                   // value of name
-    );
-    glTexParameteri(
-        GL_TEXTURE_2D,              // target texture
-        GL_TEXTURE_WRAP_T,          // symbolic name
-        GL_REPEAT                   // value of name
-    );
-    glTexParameteri(
-        GL_TEXTURE_2D,
-        GL_TEXTURE_MAG_FILTER,
-        GL_LINEAR
-    );
-    glTexParameteri(
-        GL_TEXTURE_2D,
-        GL_TEXTURE_MIN_FILTER,
-        GL_LINEAR_MIPMAP_LINEAR
-    );
-    // ... which requires mipmaps. -> generate them automatically
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // return the ID of the texture just created
-    return textureID;
+    }
 }
 
-GLuint loadDDS(const char* imagepath)
+void initTextureUploader(TextureUploader &uploader, unsigned int bufferCount, size_t bufferSize)
 {
-    printf("Reading image %s\n", imagepath);
-
-    constexpr unsigned int FOURCC_DXT1 = 0x31545844; // Equivalent to "DXT1" in ASCII
-    constexpr unsigned int FOURCC_DXT3 = 0x33545844; // Equivalent to "DXT3" in ASCII
-    constexpr unsigned int FOURCC_DXT5 = 0x35545844; // Equivalent to "DXT5" in ASCII
-
-    unsigned char header[124];
-
-    FILE* fp;
-
-    // try to open the file
-    fp = fopen(imagepath, "rb");
-    if (fp == NULL) {
-        printf("%s could not be open.\n", imagepath);
-        getchar();
-        return 0;
+    uploader.buffers.resize(bufferCount);
+    uploader.fences.assign(bufferCount, (GLsync)0);
+    uploader.bufferSize = bufferSize;
+    uploader.next = 0;
+
+    glGenBuffers(bufferCount, uploader.buffers.data());
+    for (unsigned int i = 0; i < bufferCount; i++)
+    {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader.buffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
     }
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
 
-    // verify the type of file
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        printf("Unknown file type\n");
-        fclose(fp);
-        return 0;
+// wait until the GPU is done reading from buffer i, for uploadTimeout at
+//  most ; returns false if it may still be reading, the fence is gone anyway
+static bool waitForBuffer(TextureUploader &uploader, unsigned int i)
+{
+    if (!uploader.fences[i])
+    {
+        return true;
     }
+    GLenum result = glClientWaitSync(uploader.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, uploadTimeout);
+    glDeleteSync(uploader.fences[i]);
+    uploader.fences[i] = 0;
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
 
-    // get the surface desc
-    // https://msdn.microsoft.com/en-us/library/bb943982.aspx
-    fread(&header, 124, 1, fp);
+void destroyTextureUploader(TextureUploader &uploader)
+{
+    for (unsigned int i = 0; i < uploader.buffers.size(); i++)
+    {
+        waitForBuffer(uploader, i);
+    }
+    if (!uploader.buffers.empty())
+    {
+        deleteBuffers((GLsizei)uploader.buffers.size(), uploader.buffers.data());
+    }
+    uploader.buffers.clear();
+    uploader.fences.clear();
+}
 
-    unsigned int height         = *(unsigned int*)&(header[8]);     // third WORD of DDS_HEADER struct
-    unsigned int width          = *(unsigned int*)&(header[12]);    // forth WORD
-    unsigned int linearSize     = *(unsigned int*)&(header[16]);    // fifth WORD
-    unsigned int mipMapCount    = *(unsigned int*)&(header[24]);    // seventh WORD
-    unsigned int fourCC         = *(unsigned int*)&(header[80]);    // third WORD in DDS_PIXELFORMAT
+// upload levels [first, last) through the next buffer of the ring,
+//  they fit in it together
+static void uploadLevels(TextureUploader &uploader, const Image &image, unsigned int first, unsigned int last)
+{
+    unsigned int slot = uploader.next;
+    uploader.next = (uploader.next + 1) % uploader.buffers.size();
+
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader.buffers[slot]);
+    if (!waitForBuffer(uploader, slot))
+    {
+        // timed out, the GPU may still read the old contents : the buffer
+        //  gets new storage, the driver frees the old one when it is done
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, uploader.bufferSize, NULL, GL_STREAM_DRAW);
+    }
+    // the buffer is free or new, no need to synchronize again
+    unsigned char* mapped = (unsigned char*)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, uploader.bufferSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped == NULL)
+    {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (unsigned int level = first; level < last; level++)
+        {
+            specifyLevel(image, level, image.levels[level].data);
+        }
+        return;
+    }
 
-    unsigned char* buffer;
-    unsigned int bufsize;
+    std::vector<size_t> offsets(last - first);
+    size_t offset = 0;
+    for (unsigned int level = first; level < last; level++)
+    {
+        offsets[level - first] = offset;
+        memcpy(mapped + offset, image.levels[level].data, image.levels[level].size);
+        offset = (offset + image.levels[level].size + uploadAlignment - 1) & ~(uploadAlignment - 1);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
-    // how big is it going to be including all mipmaps?
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    fclose(fp);
+    for (unsigned int level = first; level < last; level++)
+    {
+        specifyLevel(image, level, (const void*)offsets[level - first]);
+    }
+    uploader.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
 
-    // unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
-    switch (fourCC) {
-    case FOURCC_DXT1:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-        printf("Texture with format DXT1\n");
-        break;
-    case FOURCC_DXT3:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-        printf("Texture with format DXT3\n");
-        break;
-    case FOURCC_DXT5:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-        printf("Texture with format DXT5\n");
-        break;
-    default:
-        free(buffer);
-        printf("No known format\n");
+GLuint createTexture(const Image &image, TextureUploader* uploader)
+{
+    PROFILE_SCOPE("createTexture");
+    if (image.levels.empty())
+    {
         return 0;
     }
 
@@ -210,38 +186,83 @@ GLuint loadDDS(const char* imagepath)
     glGenTextures(1, &textureID);
 
     // BIND the created texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    bindTexture(GL_TEXTURE_2D, textureID);
     glPixelStorei(              // set pixel storage modes
         GL_UNPACK_ALIGNMENT,    // specifies the alignment requirements for the start of each pixel row in memory
-        1                       // 1 byte-alignment
+        image.rowAlignment
         );
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+    unsigned int levelCount = (unsigned int)image.levels.size();
+    unsigned int level = 0;
+    while (level < levelCount)
+    {
+        // as many consecutive levels as fit in one buffer
+        unsigned int last = level;
+        size_t size = 0;
+        while (uploader && last < levelCount && size + image.levels[last].size <= uploader->bufferSize)
+        {
+            size = (size + image.levels[last].size + uploadAlignment - 1) & ~(uploadAlignment - 1);
+            last++;
+        }
+
+        if (last > level)
+        {
+            uploadLevels(*uploader, image, level, last);
+            level = last;
+        }
+        else
+        {
+            // no uploader, or a level larger than its buffers
+            specifyLevel(image, level, image.levels[level].data);
+            level++;
+        }
+    }
 
-    // load the mipmaps
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) {
-        unsigned int size = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
-        glCompressedTexImage2D(
-            GL_TEXTURE_2D,      // target texture
-            level,              // level-of-detail (0 is base level)
-            format,             // format of image data
-            width, height,
-            0,                  // border
-            size,               // number of unsigned bytes of image data
-            buffer + offset     // ptr to the compressed image data
-        );
+    if (!isCompressedFormat(image.format))
+    {
+        // CONFIGURE it (trilinear filtering)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+    if (levelCount == 1 && !isCompressedFormat(image.format))
+    {
+        // ... which requires mipmaps ; buildMipmaps() should have made them,
+        //  let the driver do it for images that come without
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    else
+    {
+        // the texture is complete with the levels the image has
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    }
 
-        offset += size;
-        width /= 2;
-        height /= 2;
+    return textureID;
+}
 
-        // deal with non-power-of-two textures
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+GLuint loadTexture(const char* imagepath, TextureUploader* uploader, const MipSettings &mips)
+{
+    PROFILE_SCOPE_DETAIL("loadTexture", imagepath);
+    Image image;
+    if (!loadImage(imagepath, image))
+    {
+        return 0;
     }
+    // a BMP gets its mip chain on the CPU, filtered in linear space
+    buildMipmaps(image, mips);
+    // the data was copied, to GL or to an unpack buffer
+    GLuint textureID = createTexture(image, uploader);
+    freeImage(image);
+    return textureID;
+}
 
-    free(buffer);
+GLuint loadBMP(const char* imagepath)
+{
+    return loadTexture(imagepath);
+}
 
-    return textureID;
-}
\ No newline at end of file
+GLuint loadDDS(const char* imagepath)
+{
+    return loadTexture(imagepath);
+}
@@ -1,197 +1,836 @@
-#include <map>
-#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
 
+#include "common/parallel.hpp"
+#include "common/profiler.hpp"
 #include "common/vboindexer.hpp"
 
-struct PackedVertex
+// vertices handled by one parallel block, small meshes stay on one thread
+static const size_t weldBlockSize = 16 * 1024;
+
+// marks an empty hash table slot
+static const unsigned int noVertex = 0xffffffffu;
+
+// 1 / cell size of the spatial grid
+//  slightly larger cells than the 0.01 tolerance, so rounding can never put
+//  two near vertices more than one cell apart
+static const double gridScale = 99.0;
+
+// returns true if v1 can be considered equal to v2
+bool is_near(float v1, float v2)
 {
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec3 normal;
+    return fabs(v1 - v2) < 0.01f;
+}
+
+// the arrays being welded
+struct WeldInput
+{
+    const glm::vec3* positions;
+    const glm::vec2* uvs;
+    const glm::vec3* normals;
+    size_t count;
+};
 
-    bool operator<(const PackedVertex that) const
+// murmur3 finalizer
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t hashFloats(uint64_t h, const float* values, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
     {
-        return memcmp((void*)this, (void*)&that, sizeof(PackedVertex)) > 0;
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        h = mix64(h ^ (bits + 0x9e3779b97f4a7c15ULL + (h << 6)));
     }
+    return h;
+}
+
+static inline uint64_t hashVertex(const WeldInput &in, size_t i)
+{
+    uint64_t h = hashFloats(0, &in.positions[i].x, 3);
+    h = hashFloats(h, &in.uvs[i].x, 2);
+    return hashFloats(h, &in.normals[i].x, 3);
+}
+
+// bitwise equality, the same test the memcmp ordered std::map used to do
+static inline bool sameVertex(const WeldInput &in, size_t a, size_t b)
+{
+    return memcmp(&in.positions[a], &in.positions[b], sizeof(glm::vec3)) == 0 &&
+           memcmp(&in.uvs[a],       &in.uvs[b],       sizeof(glm::vec2)) == 0 &&
+           memcmp(&in.normals[a],   &in.normals[b],   sizeof(glm::vec3)) == 0;
+}
+
+// fixed-size records compared by a caller supplied hash and equality
+struct RecordInput
+{
+    const char* data;
+    size_t stride;
+    RecordHash hash;
+    RecordEqual equal;
+    size_t count;
 };
 
-// returns true if v1 can be considered equal to v2
-bool is_near(float v1, float v2)
+static inline uint64_t hashVertex(const RecordInput &in, size_t i)
 {
-    return fabs(v1 - v2) < 0.01f;
+    return in.hash(in.data + i * in.stride);
 }
 
-// searches through all already-exported vertices for a similar one
-//  similar := same position + same UVs + same normal
-bool getSimilarVertexIndex(
-        glm::vec3 &in_vertex,
-        glm::vec2 &in_uv,
-        glm::vec3 &in_normal,
+static inline bool sameVertex(const RecordInput &in, size_t a, size_t b)
+{
+    return in.equal(in.data + a * in.stride, in.data + b * in.stride);
+}
 
-        std::vector<glm::vec3> &out_vertices,
-        std::vector<glm::vec2> &out_uvs,
-        std::vector<glm::vec3> &out_normals,
-        unsigned short &result
-        )
+uint64_t hashBytes(const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t h = size;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = mix64(h ^ (word + 0x9e3779b97f4a7c15ULL + (h << 6)));
+    }
+    for (; i < size; i++)
+    {
+        h = mix64(h ^ (bytes[i] + 0x9e3779b97f4a7c15ULL + (h << 6)));
+    }
+    return h;
+}
+
+// similar := same position + same UVs + same normal, up to is_near()
+static inline bool nearVertex(const WeldInput &in, size_t a, size_t b)
+{
+    return is_near(in.positions[a].x, in.positions[b].x) &&
+           is_near(in.positions[a].y, in.positions[b].y) &&
+           is_near(in.positions[a].z, in.positions[b].z) &&
+           is_near(in.uvs[a].x,       in.uvs[b].x)       &&
+           is_near(in.uvs[a].y,       in.uvs[b].y)       &&
+           is_near(in.normals[a].x,   in.normals[b].x)   &&
+           is_near(in.normals[a].y,   in.normals[b].y)   &&
+           is_near(in.normals[a].z,   in.normals[b].z);
+}
+
+static inline size_t tableSizeFor(size_t count)
 {
-    // lame linear search
-    for (unsigned int i = 0; i < out_vertices.size(); i++)
+    size_t size = 16;
+    while (size < 2 * count)
     {
-        if (is_near(in_vertex.x, out_vertices[i].x) &&
-            is_near(in_vertex.y, out_vertices[i].y) &&
-            is_near(in_vertex.z, out_vertices[i].z) &&
-            is_near(in_uv.x,     out_uvs[i].x)      &&
-            is_near(in_uv.y,     out_uvs[i].y)      &&
-            is_near(in_normal.x, out_normals[i].x)  &&
-            is_near(in_normal.y, out_normals[i].y)  &&
-            is_near(in_normal.z, out_normals[i].z)   )
+        size *= 2;
+    }
+    return size;
+}
+
+// number the representatives in input order and point every other vertex
+//  at the number of its representative ; rep[i] <= i for all i
+static size_t numberRepresentatives(
+    const std::vector<unsigned int> &rep,
+    std::vector<unsigned int> &remap,
+    unsigned int threadCount
+    )
+{
+    size_t count = rep.size();
+    size_t blockCount = (count + weldBlockSize - 1) / weldBlockSize;
+
+    // representatives per block, turned into the first number of each block
+    std::vector<size_t> blockFirst(blockCount + 1, 0);
+    parallelFor(blockCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t b = first; b < last; b++)
         {
-             result = i;
-             return true;
+            size_t end = std::min(count, (b + 1) * weldBlockSize);
+            size_t reps = 0;
+            for (size_t i = b * weldBlockSize; i < end; i++)
+            {
+                reps += (rep[i] == i);
+            }
+            blockFirst[b + 1] = reps;
         }
+    }, threadCount);
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        blockFirst[b + 1] += blockFirst[b];
     }
 
-    // no other vertex could be used insted
-    // looks like we'll have to add it to the vbo
-    return false;
+    remap.resize(count);
+    parallelFor(blockCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t b = first; b < last; b++)
+        {
+            size_t end = std::min(count, (b + 1) * weldBlockSize);
+            unsigned int next = (unsigned int)blockFirst[b];
+            for (size_t i = b * weldBlockSize; i < end; i++)
+            {
+                if (rep[i] == i)
+                {
+                    remap[i] = next++;
+                }
+            }
+        }
+    }, threadCount);
+
+    // representatives are all numbered now, the rest follow them
+    parallelFor(count, weldBlockSize, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            if (rep[i] != i)
+            {
+                remap[i] = remap[rep[i]];
+            }
+        }
+    }, threadCount);
+
+    return blockFirst[blockCount];
 }
 
-void indexVBO_slow(
-        std::vector<glm::vec3> &in_vertices,
-        std::vector<glm::vec2> &in_uvs,
-        std::vector<glm::vec3> &in_normals,
+// open addressing hash table with linear probing, storing input indices
+template <typename Input>
+static size_t weldExact(const Input &in, std::vector<unsigned int> &remap)
+{
+    size_t mask = tableSizeFor(in.count) - 1;
+    std::vector<unsigned int> table(mask + 1, noVertex);
 
-        std::vector<unsigned short> &out_indices,
-        std::vector<glm::vec3> &out_vertices,
-        std::vector<glm::vec2> &out_uvs,
-        std::vector<glm::vec3> &out_normals
-        )
+    remap.resize(in.count);
+    unsigned int next = 0;
+    for (size_t i = 0; i < in.count; i++)
+    {
+        size_t slot = hashVertex(in, i) & mask;
+        while (table[slot] != noVertex && !sameVertex(in, table[slot], i))
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == noVertex)    // first time we see it, it needs to be added
+        {
+            table[slot] = (unsigned int)i;
+            remap[i] = next++;
+        }
+        else                            // already there, use it instead!
+        {
+            remap[i] = remap[table[slot]];
+        }
+    }
+    return next;
+}
+
+// the hash space is cut in partitions, each thread welds whole partitions
+//  with its own table, so no two threads ever touch the same slot
+template <typename Input>
+static size_t weldExactParallel(const Input &in, std::vector<unsigned int> &remap, unsigned int threadCount)
 {
-    // for each input vertex
-    for (unsigned int i = 0; i < in_vertices.size(); i++)
+    const unsigned int partitionBits = 6;
+    const size_t partitionCount = (size_t)1 << partitionBits;
+    size_t blockCount = (in.count + weldBlockSize - 1) / weldBlockSize;
+
+    std::vector<uint64_t> hashes(in.count);
+    std::vector<size_t> histogram(blockCount * partitionCount, 0);
+    parallelFor(blockCount, 1, [&](size_t first, size_t last)
     {
-        // try to find a similar vertex in out_XXXX
-        unsigned short index;
-        bool found = getSimilarVertexIndex(
-            in_vertices[i], in_uvs[i], in_normals[i], 
-            out_vertices, out_uvs, out_normals, index
-            );
+        for (size_t b = first; b < last; b++)
+        {
+            size_t end = std::min(in.count, (b + 1) * weldBlockSize);
+            for (size_t i = b * weldBlockSize; i < end; i++)
+            {
+                hashes[i] = hashVertex(in, i);
+                histogram[b * partitionCount + (hashes[i] >> (64 - partitionBits))]++;
+            }
+        }
+    }, threadCount);
 
-        if (found)  // a similar vertex is alreasdy in the VBO, use it instead
+    // stable counting sort of the vertices by partition
+    std::vector<size_t> partitionStart(partitionCount + 1, 0);
+    size_t offset = 0;
+    for (size_t p = 0; p < partitionCount; p++)
+    {
+        partitionStart[p] = offset;
+        for (size_t b = 0; b < blockCount; b++)
         {
-            out_indices.push_back(index);
+            size_t n = histogram[b * partitionCount + p];
+            histogram[b * partitionCount + p] = offset;
+            offset += n;
         }
-        else        // if not, it needs to be added in the output data
+    }
+    partitionStart[partitionCount] = offset;
+
+    std::vector<unsigned int> order(in.count);
+    parallelFor(blockCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t b = first; b < last; b++)
         {
-            out_vertices.push_back(in_vertices[i]);
-            out_uvs.push_back(in_uvs[i]);
-            out_normals.push_back(in_normals[i]);
-            out_indices.push_back((unsigned short)out_vertices.size() - 1);
+            size_t end = std::min(in.count, (b + 1) * weldBlockSize);
+            for (size_t i = b * weldBlockSize; i < end; i++)
+            {
+                order[histogram[b * partitionCount + (hashes[i] >> (64 - partitionBits))]++] = (unsigned int)i;
+            }
+        }
+    }, threadCount);
+
+    // find the first occurrence of every vertex, partition by partition
+    std::vector<unsigned int> rep(in.count);
+    parallelFor(partitionCount, 1, [&](size_t first, size_t last)
+    {
+        std::vector<unsigned int> table;
+        for (size_t p = first; p < last; p++)
+        {
+            size_t begin = partitionStart[p];
+            size_t end = partitionStart[p + 1];
+            size_t mask = tableSizeFor(end - begin) - 1;
+            table.assign(mask + 1, noVertex);
+
+            for (size_t k = begin; k < end; k++)
+            {
+                unsigned int i = order[k];
+                size_t slot = hashes[i] & mask;
+                while (table[slot] != noVertex && !sameVertex(in, table[slot], i))
+                {
+                    slot = (slot + 1) & mask;
+                }
+                if (table[slot] == noVertex)
+                {
+                    table[slot] = i;
+                }
+                rep[i] = table[slot];
+            }
         }
+    }, threadCount);
+
+    return numberRepresentatives(rep, remap, threadCount);
+}
+
+// integer coordinates of a grid cell
+struct GridCell
+{
+    int x, y, z;
+};
+
+static inline int gridCoordinate(float v)
+{
+    double c = floor((double)v * gridScale);
+    // far away vertices all land in the outermost cells, which is still correct
+    if (c < -1073741824.0) return -1073741824;
+    if (c >  1073741824.0) return  1073741824;
+    return (int)c;
+}
+
+static inline GridCell gridCellOf(const glm::vec3 &p)
+{
+    GridCell cell = { gridCoordinate(p.x), gridCoordinate(p.y), gridCoordinate(p.z) };
+    return cell;
+}
+
+static inline uint64_t hashCell(const GridCell &c)
+{
+    return mix64(((uint64_t)(uint32_t)c.x * 0x9e3779b97f4a7c15ULL) ^
+                 ((uint64_t)(uint32_t)c.y * 0xc2b2ae3d27d4eb4fULL) ^
+                 ((uint64_t)(uint32_t)c.z * 0x165667b19e3779f9ULL));
+}
+
+// open addressing table from grid cells to a value per cell
+struct GridTable
+{
+    std::vector<GridCell> cells;
+    std::vector<unsigned int> values;  // noVertex := empty slot
+    size_t mask;
+
+    void init(size_t count)
+    {
+        mask = tableSizeFor(count) - 1;
+        cells.resize(mask + 1);
+        values.assign(mask + 1, noVertex);
     }
+
+    // slot holding cell, or the empty slot where it would go
+    size_t find(const GridCell &c) const
+    {
+        size_t slot = hashCell(c) & mask;
+        while (values[slot] != noVertex &&
+               (cells[slot].x != c.x || cells[slot].y != c.y || cells[slot].z != c.z))
+        {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+};
+
+// representatives in a grid, those of a cell chained through nextInCell,
+//  newest first
+struct RepresentativeGrid
+{
+    GridTable table;
+    std::vector<unsigned int> nextInCell;
+
+    void init(size_t count)
+    {
+        table.init(count);
+        nextInCell.assign(count, noVertex);
+    }
+
+    // the oldest representative near vertex i, noVertex if none
+    unsigned int findNear(const WeldInput &in, size_t i, const GridCell &cell) const
+    {
+        unsigned int best = noVertex;
+        for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            GridCell neighbour = { cell.x + dx, cell.y + dy, cell.z + dz };
+            size_t slot = table.find(neighbour);
+            for (unsigned int j = table.values[slot]; j != noVertex; j = nextInCell[j])
+            {
+                if (j < best && nearVertex(in, i, j))
+                {
+                    best = j;
+                }
+            }
+        }
+        return best;
+    }
+
+    void add(size_t i, const GridCell &cell)
+    {
+        size_t slot = table.find(cell);
+        if (table.values[slot] == noVertex)
+        {
+            table.cells[slot] = cell;
+        }
+        nextInCell[i] = table.values[slot];
+        table.values[slot] = (unsigned int)i;
+    }
+};
+
+// greedy welding in input order, only representatives are put in the grid
+//  a vertex joins the oldest representative it is near to, exactly like the
+//  linear search through the output vertices did
+static size_t weldNear(const WeldInput &in, std::vector<unsigned int> &remap)
+{
+    RepresentativeGrid grid;
+    grid.init(in.count);
+
+    remap.resize(in.count);
+    unsigned int next = 0;
+    for (size_t i = 0; i < in.count; i++)
+    {
+        GridCell cell = gridCellOf(in.positions[i]);
+        unsigned int best = grid.findNear(in, i, cell);
+        if (best != noVertex)   // a similar vertex is already in the VBO, use it instead!
+        {
+            remap[i] = remap[best];
+        }
+        else                    // if not, it needs to be added in the output data
+        {
+            grid.add(i, cell);
+            remap[i] = next++;
+        }
+    }
+    return next;
 }
 
-bool getSimilarVertexIndex_fast(
-        PackedVertex &packed,
-        std::map<PackedVertex, unsigned short> &VertexToOutIndex,
-        unsigned short &result
-        )
+// the same welding, a batch of vertices at a time : the vertices of a batch
+//  look for representatives of the batches before in parallel, those are
+//  older than any of the batch's own so the oldest one found is the answer ;
+//  the few left then go through the grid in order, as weldNear() does
+//  only representatives are ever compared with
+static size_t weldNearParallel(const WeldInput &in, std::vector<unsigned int> &remap, unsigned int threadCount)
 {
-    auto it = VertexToOutIndex.find(packed);
-    if (it == VertexToOutIndex.end())
+    std::vector<GridCell> cellOf(in.count);
+    parallelFor(in.count, weldBlockSize, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            cellOf[i] = gridCellOf(in.positions[i]);
+        }
+    }, threadCount);
+
+    RepresentativeGrid grid;
+    grid.init(in.count);
+    std::vector<unsigned int> rep(in.count);
+    size_t batchSize = weldBlockSize * threadCount;
+    for (size_t batch = 0; batch < in.count; batch += batchSize)
     {
-        return false;
+        size_t batchEnd = std::min(in.count, batch + batchSize);
+        // the grid only holds older batches while this runs
+        parallelFor(batchEnd - batch, weldBlockSize, [&](size_t first, size_t last)
+        {
+            for (size_t i = batch + first; i < batch + last; i++)
+            {
+                rep[i] = grid.findNear(in, i, cellOf[i]);
+            }
+        }, threadCount);
+
+        for (size_t i = batch; i < batchEnd; i++)
+        {
+            if (rep[i] != noVertex)
+            {
+                continue;
+            }
+            rep[i] = grid.findNear(in, i, cellOf[i]);
+            if (rep[i] == noVertex)
+            {
+                grid.add(i, cellOf[i]);
+                rep[i] = (unsigned int)i;
+            }
+        }
     }
-    else {
-        result = it->second;
-        return true;
+
+    return numberRepresentatives(rep, remap, threadCount);
+}
+
+size_t weldVertices(
+    const std::vector<glm::vec3> &in_vertices,
+    const std::vector<glm::vec2> &in_uvs,
+    const std::vector<glm::vec3> &in_normals,
+    WeldMode mode,
+    std::vector<unsigned int> &out_remap,
+    unsigned int threadCount
+)
+{
+    WeldInput in = { in_vertices.data(), in_uvs.data(), in_normals.data(), in_vertices.size() };
+
+    if (threadCount == 0)
+    {
+        threadCount = hardwareThreadCount();
     }
+    bool parallel = threadCount > 1 && in.count > weldBlockSize;
+
+    if (mode == WELD_EXACT)
+    {
+        return parallel ? weldExactParallel(in, out_remap, threadCount) : weldExact(in, out_remap);
+    }
+    return parallel ? weldNearParallel(in, out_remap, threadCount) : weldNear(in, out_remap);
 }
 
-void indexVBO(
+size_t weldRecords(
+    const void* records,
+    size_t stride,
+    size_t count,
+    RecordHash hash,
+    RecordEqual equal,
+    std::vector<unsigned int> &out_remap,
+    unsigned int threadCount
+)
+{
+    RecordInput in = { (const char*)records, stride, hash, equal, count };
+
+    if (threadCount == 0)
+    {
+        threadCount = hardwareThreadCount();
+    }
+    if (threadCount > 1 && in.count > weldBlockSize)
+    {
+        return weldExactParallel(in, out_remap, threadCount);
+    }
+    return weldExact(in, out_remap);
+}
+
+// the indexers for any index type
+template <typename Index>
+static void indexVBOImpl(
         std::vector<glm::vec3> &in_vertices,
         std::vector<glm::vec2> &in_uvs,
         std::vector<glm::vec3> &in_normals,
 
-        std::vector<unsigned short> &out_indices,
+        std::vector<Index> &out_indices,
         std::vector<glm::vec3> &out_vertices,
         std::vector<glm::vec2> &out_uvs,
-        std::vector<glm::vec3> &out_normals
+        std::vector<glm::vec3> &out_normals,
+        unsigned int threadCount
         )
 {
-    std::map<PackedVertex, unsigned short> VertexToOutIndex;
+    PROFILE_SCOPE("indexVBO");
+    std::vector<unsigned int> remap;
+    size_t count = weldVertices(in_vertices, in_uvs, in_normals, WELD_EXACT, remap, threadCount);
 
-    // for eacht input vertex
-    for (unsigned int i = 0; i < in_vertices.size(); i++)
+    size_t base = out_vertices.size();
+    if (base + count > (size_t)(Index)-1 + 1)
     {
-        PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+        printf("indexVBO: %lu vertices don't fit in %u-bit indices\n",
+            (unsigned long)(base + count), (unsigned int)(8 * sizeof(Index)));
+    }
 
-        // try to find a similar vertex in out_XXXX
-        unsigned short index;
-        bool found = getSimilarVertexIndex_fast(packed, VertexToOutIndex, index);
+    out_vertices.reserve(base + count);
+    out_uvs.reserve(out_uvs.size() + count);
+    out_normals.reserve(out_normals.size() + count);
+    out_indices.reserve(out_indices.size() + in_vertices.size());
 
-        if (found)  // a similar vertex is already in the VBO, use it instead!
-        {
-            out_indices.push_back(index);
-        }
-        else        // if not, it needs to be added in the output data
+    // for each input vertex
+    for (unsigned int i = 0; i < in_vertices.size(); i++)
+    {
+        size_t index = base + remap[i];
+        if (index == out_vertices.size())   // first time we see it, add it to the output data
         {
             out_vertices.push_back(in_vertices[i]);
             out_uvs.push_back(in_uvs[i]);
             out_normals.push_back(in_normals[i]);
-            unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-            out_indices.push_back(newindex);
-            VertexToOutIndex[packed] = newindex;
         }
+        out_indices.push_back((Index)index);
     }
 }
 
-void indexVBO_TBN(
+template <typename Index>
+static void indexVBO_TBNImpl(
     std::vector<glm::vec3> &in_vertices,
     std::vector<glm::vec2> &in_uvs,
     std::vector<glm::vec3> &in_normals,
     std::vector<glm::vec3> &in_tangents,
     std::vector<glm::vec3> &in_bitangents,
 
-    std::vector<unsigned short> &out_indices,
+    std::vector<Index> &out_indices,
     std::vector<glm::vec3> &out_vertices,
     std::vector<glm::vec2> &out_uvs,
     std::vector<glm::vec3> &out_normals,
     std::vector<glm::vec3> &out_tangents,
-    std::vector<glm::vec3> &out_bitangents
+    std::vector<glm::vec3> &out_bitangents,
+    unsigned int threadCount
 )
 {
-    // for eacht input vertex
-    for (unsigned int i = 0; i < in_vertices.size(); i++)
+    PROFILE_SCOPE("indexVBO_TBN");
+    std::vector<unsigned int> remap;
+    size_t count = weldVertices(in_vertices, in_uvs, in_normals, WELD_NEAR, remap, threadCount);
+
+    size_t base = out_vertices.size();
+    if (base + count > (size_t)(Index)-1 + 1)
     {
-        // try to find a similar vertex in out_XXXX
-        unsigned short index;
-        bool found = getSimilarVertexIndex(
-            in_vertices[i], 
-            in_uvs[i], 
-            in_normals[i],
-            out_vertices,
-            out_uvs,
-            out_normals,
-            index
-            );
+        printf("indexVBO_TBN: %lu vertices don't fit in %u-bit indices\n",
+            (unsigned long)(base + count), (unsigned int)(8 * sizeof(Index)));
+    }
 
-        if (found)  // a similar vertex is already in the VBO, use it instead!
-        {
-            out_indices.push_back(index);
+    out_vertices.reserve(base + count);
+    out_uvs.reserve(out_uvs.size() + count);
+    out_normals.reserve(out_normals.size() + count);
+    out_tangents.reserve(out_tangents.size() + count);
+    out_bitangents.reserve(out_bitangents.size() + count);
+    out_indices.reserve(out_indices.size() + in_vertices.size());
 
-            // average the tangents and the bitangents
-            out_tangents[index] += in_tangents[i];
-            out_bitangents[index] += in_bitangents[i];
-        }
-        else        // if not, it needs to be added in the output data
+    // for each input vertex
+    for (unsigned int i = 0; i < in_vertices.size(); i++)
+    {
+        size_t index = base + remap[i];
+        if (index == out_vertices.size())   // first time we see it, add it to the output data
         {
             out_vertices.push_back(in_vertices[i]);
             out_uvs.push_back(in_uvs[i]);
             out_normals.push_back(in_normals[i]);
             out_tangents.push_back(in_tangents[i]);
             out_bitangents.push_back(in_bitangents[i]);
-            out_indices.push_back((unsigned short)out_vertices.size() - 1);
         }
+        else                                // merged, average the tangents and the bitangents
+        {
+            out_tangents[index] += in_tangents[i];
+            out_bitangents[index] += in_bitangents[i];
+        }
+        out_indices.push_back((Index)index);
+    }
+}
+
+void indexVBO(
+        std::vector<glm::vec3> &in_vertices,
+        std::vector<glm::vec2> &in_uvs,
+        std::vector<glm::vec3> &in_normals,
+
+        std::vector<unsigned short> &out_indices,
+        std::vector<glm::vec3> &out_vertices,
+        std::vector<glm::vec2> &out_uvs,
+        std::vector<glm::vec3> &out_normals,
+        unsigned int threadCount
+        )
+{
+    indexVBOImpl(in_vertices, in_uvs, in_normals,
+        out_indices, out_vertices, out_uvs, out_normals, threadCount);
+}
+
+void indexVBO(
+        std::vector<glm::vec3> &in_vertices,
+        std::vector<glm::vec2> &in_uvs,
+        std::vector<glm::vec3> &in_normals,
+
+        std::vector<unsigned int> &out_indices,
+        std::vector<glm::vec3> &out_vertices,
+        std::vector<glm::vec2> &out_uvs,
+        std::vector<glm::vec3> &out_normals,
+        unsigned int threadCount
+        )
+{
+    indexVBOImpl(in_vertices, in_uvs, in_normals,
+        out_indices, out_vertices, out_uvs, out_normals, threadCount);
+}
+
+void indexVBO_TBN(
+    std::vector<glm::vec3> &in_vertices,
+    std::vector<glm::vec2> &in_uvs,
+    std::vector<glm::vec3> &in_normals,
+    std::vector<glm::vec3> &in_tangents,
+    std::vector<glm::vec3> &in_bitangents,
+
+    std::vector<unsigned short> &out_indices,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    std::vector<glm::vec3> &out_tangents,
+    std::vector<glm::vec3> &out_bitangents,
+    unsigned int threadCount
+)
+{
+    indexVBO_TBNImpl(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+        out_indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents, threadCount);
+}
+
+void indexVBO_TBN(
+    std::vector<glm::vec3> &in_vertices,
+    std::vector<glm::vec2> &in_uvs,
+    std::vector<glm::vec3> &in_normals,
+    std::vector<glm::vec3> &in_tangents,
+    std::vector<glm::vec3> &in_bitangents,
+
+    std::vector<unsigned int> &out_indices,
+    std::vector<glm::vec3> &out_vertices,
+    std::vector<glm::vec2> &out_uvs,
+    std::vector<glm::vec3> &out_normals,
+    std::vector<glm::vec3> &out_tangents,
+    std::vector<glm::vec3> &out_bitangents,
+    unsigned int threadCount
+)
+{
+    indexVBO_TBNImpl(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+        out_indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents, threadCount);
+}
+
+// greedy split in triangle order : a sub-mesh is closed as soon as the next
+//  triangle would bring in more than maxVertices distinct vertices, or
+//  starts another range
+static void partitionIndices(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    unsigned int maxVertices,
+    const std::vector<unsigned int> &ranges,
+    IndexBuffer &out
+    )
+{
+    // local index of every vertex in the current sub-mesh, valid when
+    //  owner[v] is the current sub-mesh number
+    std::vector<unsigned int> owner(vertexCount, noVertex);
+    std::vector<unsigned int> local(vertexCount);
+
+    out.indices16.reserve(indices.size());
+    out.vertexRemap.clear();
+    out.subMeshes.clear();
+
+    SubMesh current = {0, 0, 0, 0};
+    unsigned int currentId = 0;
+    size_t nextRange = 1;
+    out.rangeSubMeshes.assign(1, 0);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        unsigned int missing = 0;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            missing += (owner[indices[t + k]] != currentId);
+        }
+        bool rangeStart = nextRange < ranges.size() && ranges[nextRange] <= t;
+        // a repeated vertex inside the triangle only counts once, being
+        //  pessimistic here just closes the sub-mesh a little earlier
+        if ((current.vertexCount + missing > maxVertices || rangeStart) && current.indexCount > 0)
+        {
+            out.subMeshes.push_back(current);
+            current.firstIndex += current.indexCount;
+            current.indexCount = 0;
+            current.baseVertex += current.vertexCount;
+            current.vertexCount = 0;
+            currentId++;
+        }
+        // empty ranges start where the next one does
+        while (nextRange < ranges.size() && ranges[nextRange] <= t)
+        {
+            out.rangeSubMeshes.push_back((unsigned int)out.subMeshes.size());
+            nextRange++;
+        }
+
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t + k];
+            if (owner[v] != currentId)
+            {
+                owner[v] = currentId;
+                local[v] = current.vertexCount++;
+                out.vertexRemap.push_back(v);
+            }
+            out.indices16.push_back((unsigned short)local[v]);
+        }
+        current.indexCount += 3;
+    }
+    if (current.indexCount > 0)
+    {
+        out.subMeshes.push_back(current);
+    }
+    for (; nextRange < ranges.size(); nextRange++)
+    {
+        out.rangeSubMeshes.push_back((unsigned int)out.subMeshes.size());
+    }
+}
+
+void buildIndexBuffer(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    bool split16,
+    IndexBuffer &out
+)
+{
+    buildIndexBuffer(indices, vertexCount, split16, std::vector<unsigned int>(1, 0), out);
+}
+
+void buildIndexBuffer(
+    const std::vector<unsigned int> &indices,
+    size_t vertexCount,
+    bool split16,
+    const std::vector<unsigned int> &ranges,
+    IndexBuffer &out
+)
+{
+    const size_t maxVertices16 = 65536;
+
+    out.indices16.clear();
+    out.indices32.clear();
+    out.vertexRemap.clear();
+    out.subMeshes.clear();
+    out.rangeSubMeshes.clear();
+
+    if (vertexCount > maxVertices16 && split16)
+    {
+        out.indexSize = 2;
+        partitionIndices(indices, vertexCount, maxVertices16, ranges, out);
+        printf("Split %lu vertices into %lu sub-meshes with 16-bit indices\n",
+            (unsigned long)vertexCount, (unsigned long)out.subMeshes.size());
+        return;
     }
-}
\ No newline at end of file
+
+    // a sub-mesh per range, all of them over every vertex
+    for (size_t r = 0; r < ranges.size(); r++)
+    {
+        unsigned int end = r + 1 < ranges.size() ? ranges[r + 1] : (unsigned int)indices.size();
+        SubMesh range = {ranges[r], end - ranges[r], 0, (unsigned int)vertexCount};
+        out.rangeSubMeshes.push_back((unsigned int)out.subMeshes.size());
+        out.subMeshes.push_back(range);
+    }
+
+    if (vertexCount <= maxVertices16)
+    {
+        out.indexSize = 2;
+        out.indices16.assign(indices.begin(), indices.end());
+    }
+    else
+    {
+        out.indexSize = 4;
+        out.indices32 = indices;
+    }
+}
@@ -0,0 +1,155 @@
+#include <math.h>
+
+#include "common/vertexformat.hpp"
+
+uint16_t packHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // NaN and infinity
+    if (exponent == 0xff)
+    {
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+
+    int e = (int)exponent - 127 + 15;
+    // too large : infinity
+    if (e >= 31)
+    {
+        return (uint16_t)(sign | 0x7c00);
+    }
+
+    // too small for a normal half : denormal or zero
+    if (e <= 0)
+    {
+        if (e < -10)
+        {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        unsigned int shift = (unsigned int)(14 - e);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    // a carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    {
+        half++;
+    }
+    return (uint16_t)(sign | half);
+}
+
+float unpackHalf(uint16_t value)
+{
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // renormalize the denormal
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static inline float signNotZero(float v)
+{
+    return v >= 0.f ? 1.f : -1.f;
+}
+
+glm::vec2 octEncode(const glm::vec3 &n)
+{
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 <= 0.f)
+    {
+        return glm::vec2(0.f, 0.f);
+    }
+    glm::vec2 p(n.x / l1, n.y / l1);
+    // the lower hemisphere is folded over the diagonals
+    if (n.z < 0.f)
+    {
+        p = glm::vec2(
+            (1.f - fabsf(p.y)) * signNotZero(p.x),
+            (1.f - fabsf(p.x)) * signNotZero(p.y)
+            );
+    }
+    return p;
+}
+
+glm::vec3 octDecode(const glm::vec2 &e)
+{
+    glm::vec3 n(e.x, e.y, 1.f - fabsf(e.x) - fabsf(e.y));
+    float t = n.z < 0.f ? -n.z : 0.f;
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
+int16_t packSnorm16(float value)
+{
+    value = value < -1.f ? -1.f : (value > 1.f ? 1.f : value);
+    return (int16_t)lrintf(value * 32767.f);
+}
+
+uint16_t packUnorm16(float value)
+{
+    value = value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+    return (uint16_t)lrintf(value * 65535.f);
+}
+
+// signed normalized value in a field of the given number of bits
+static inline uint32_t packSnormBits(float value, unsigned int bits)
+{
+    float maxValue = (float)((1 << (bits - 1)) - 1);
+    value = value < -1.f ? -1.f : (value > 1.f ? 1.f : value);
+    int32_t v = (int32_t)lrintf(value * maxValue);
+    return (uint32_t)v & ((1u << bits) - 1);
+}
+
+uint32_t packSnorm2_10_10_10(float x, float y, float z, float w)
+{
+    return packSnormBits(x, 10)
+        | (packSnormBits(y, 10) << 10)
+        | (packSnormBits(z, 10) << 20)
+        | (packSnormBits(w, 2) << 30);
+}
@@ -1,6 +1,9 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <float.h>
+#include <algorithm>
+#include <string>
 #include <vector>
 
 // include GLEW
@@ -10,6 +13,14 @@
 #include <GLFW/glfw3.h>
 GLFWwindow* window;
 
+// GL thread time spent on asset uploads per frame, in ms
+static const double uploadBudgetMs = 4.0;
+
+// an instance is drawn at the coarsest level of detail whose error stays
+//  under this many pixels, levels switch 25% past it either way
+static const float lodPixelError = 1.0f;
+static const float lodHysteresis = 0.25f;
+
 // Include GLM
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -21,376 +32,603 @@ GLFWwindow* window;
 #include <common/vboindexer.hpp>
 #include <common/text2D.hpp>
 #include <common/tangentspace.hpp>
+#include <common/meshcache.hpp>
+#include <common/vertexformat.hpp>
+#include <common/assetloader.hpp>
+#include <common/programcache.hpp>
+#include <common/shaderprogram.hpp>
+#include <common/glstate.hpp>
+#include <common/instancing.hpp>
+#include <common/meshpool.hpp>
+#include <common/scenegraph.hpp>
+#include <common/culling.hpp>
+#include <common/benchmark.hpp>
+#include <common/offscreen.hpp>
+#include <common/image.hpp>
+#include <common/profiler.hpp>
+#include <common/bvh.hpp>
+
+// the closest instance the ray hits, through the mesh's BVH in each
+//  instance's space, false if none
+static bool pickInstance(
+    const BVH &bvh, const InstanceBuffer &instances,
+    const glm::vec3 &origin, const glm::vec3 &direction,
+    unsigned int &instance, RayHit &hit)
+{
+    hit.t = FLT_MAX;
+    hit.triangle = noTriangle;
+    for (unsigned int i = 0; i < instanceCount(instances); i++)
+    {
+        // the same t along both rays, the direction is not renormalized
+        glm::mat4 toLocal = glm::inverse(instances.models[i]);
+        Ray ray;
+        ray.origin = glm::vec3(toLocal * glm::vec4(origin, 1.f));
+        ray.direction = glm::vec3(toLocal * glm::vec4(direction, 0.f));
+        ray.tMax = hit.t;
+        RayHit instanceHit;
+        if (intersectRay(bvh, ray, instanceHit))
+        {
+            hit = instanceHit;
+            instance = instances.handles[i];
+        }
+    }
+    return hit.triangle != noTriangle;
+}
 
-int main( void )
+int main( int argc, char** argv )
 {
+    // --bench : no window, a fixed number of frames and a report
+    BenchmarkSettings bench;
+    if (!parseBenchmarkArguments(argc, argv, bench))
+    {
+        return 1;
+    }
+    setProfilerThreadName("main");
+    OffscreenContext offscreen;
+    if (bench.enabled)
+    {
+        if (!createOffscreenContext(offscreen, bench.width, bench.height, bench.samples))
+        {
+            return -1;
+        }
+    }
 	// Initialise GLFW
-	if (!glfwInit()) 
+	else if (!glfwInit()) 
     {
 		fprintf( stderr, "Failed to initialize GLFW\n" );
 		getchar();
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // Open a window and create its OpenGL context
-	window = glfwCreateWindow( 640, 480, "TinyGLSL", NULL, NULL);
-	if (window == NULL) 
+    if (!bench.enabled)
     {
-		fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
-        getchar();
-		glfwTerminate();
-		return -1;
-	}
-	glfwMakeContextCurrent(window);
+		glfwWindowHint(GLFW_SAMPLES, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Open a window and create its OpenGL context
+		window = glfwCreateWindow( 640, 480, "TinyGLSL", NULL, NULL);
+		if (window == NULL) 
+        {
+			fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
+            getchar();
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+
+        // Initialize GLEW
+		glewExperimental = true; // Needed for core profile
+		if (glewInit() != GLEW_OK) 
+        {
+			fprintf(stderr, "Failed to initialize GLEW\n");
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
 
-    // Initialize GLEW
-	glewExperimental = true; // Needed for core profile
-	if (glewInit() != GLEW_OK) 
-    {
-		fprintf(stderr, "Failed to initialize GLEW\n");
-		getchar();
-		glfwTerminate();
-		return -1;
-	}
+        // Ensure we can capture the escape key being pressed below
+		glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
-    // Ensure we can capture the escape key being pressed below
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+        // hide the mouse and enable unlimited mouvement
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // hide the mouse and enable unlimited mouvement
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // set the mouse at the center of the screen
+        glfwPollEvents();
+        glfwSetCursorPos(window, 1024/2, 768/2);
+    }
 
-    // set the mouse at the center of the screen
-    glfwPollEvents();
-    glfwSetCursorPos(window, 1024/2, 768/2);
+    // GPU scopes from the first frame, read back a couple of frames late
+    startGPUProfiler();
 
 	// Dark blue background
 	glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
 
     // cull triangles which normal is not towards the camera
-    glEnable(GL_CULL_FACE);    // disable in case of opacity
+    setCapability(GL_CULL_FACE, true);     // disable in case of opacity
     // enable depth test
-    glEnable(GL_DEPTH_TEST);
+    setCapability(GL_DEPTH_TEST, true);
     // accept fragment if it is closer to the camera than the former one
     glDepthFunc(GL_LESS);
 
-    GLuint VertexArrayID;
-    glGenVertexArrays(1, &VertexArrayID);
-    glBindVertexArray(VertexArrayID);
-
-    // create and compile our GLSL program from the shaders
-    GLuint programID = LoadShaders("shaders/NormalMapping.vs", "shaders/NormalMapping.fs");
-
-    // get a handle for our "MVP" uniform 
-    GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-    GLuint ViewMatrixID = glGetUniformLocation(programID, "V");
-    GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
-    GLuint ModelView3x3MatrixID = glGetUniformLocation(programID, "MV3x3");
-
-    // load the texture
-    GLuint DiffuseTexture = loadDDS("textures/diffuse.DDS");
-    GLuint NormalTexture = loadBMP("textures/normal.bmp");
-    GLuint SpecularTexture = loadDDS("textures/specular.DDS");
-
-    // get a handle for "myTextureSampler" uniform
-    GLuint DiffuseTextureID = glGetUniformLocation(
-        programID,                  // program object
-        "DiffuseTextureSampler"     // name of uniform variable
-    );
-    GLuint NormalTextureID = glGetUniformLocation(
-        programID,                  // program object
-        "NormalTextureSampler"      // name of uniform variable
-    );
-    GLuint SpecularTextureID = glGetUniformLocation(
-        programID,                  // program object
-        "SpecularTextureSampler"    // name of uniform variable
-    );
-
-    // read our .obj file
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    bool res = loadOBJ("models/cylinder.obj", vertices, uvs, normals);
-    if (!res)
+    // every mesh in one vertex and one index buffer behind one vertex array,
+    //  drawn from a list of commands, at once where GL draws indirect
+    MeshPool meshPool;
+    initMeshPool(meshPool);
+    bool indirectDraws = indirectDrawsSupported();
+    DrawList drawList;
+    initDrawList(drawList, indirectDraws);
+    printf("Draws : %s\n", indirectDraws ?
+        "one glMultiDrawElementsIndirect per frame" : "one glDrawElementsInstancedBaseVertex per sub-mesh");
+    bool vertexArrayReady = false;
+
+    // the copies of the mesh, on a square grid around the first one at the
+    //  origin, 3 units apart, each a node under the grid's ; the scene moves
+    //  the instances, only what changes gets uploaded again
+    InstanceBuffer instances;
+    initInstanceBuffer(instances, bench.instances);
+    SceneGraph scene;
+    initSceneGraph(scene, bench.instances + 1);
+    unsigned int gridNode = addSceneNode(scene, noParent, glm::vec3(0.0f));
+    unsigned int gridSide = 1;
+    while (gridSide * gridSide < bench.instances)
     {
-        fprintf(stderr, "Failed to load .OBJ model\n");
-		getchar();
-		glfwTerminate();
-		return -1;
+        gridSide++;
+    }
+    for (unsigned int i = 0; i < bench.instances; i++)
+    {
+        int column = int(i % gridSide) - int(gridSide / 2);
+        int row = int(i / gridSide) - int(gridSide / 2);
+        if (i == 0)
+        {
+            column = row = 0;
+        }
+        else if (column == 0 && row == 0)
+        {
+            // where the first one is, takes its place on the grid
+            column = -int(gridSide / 2);
+            row = -int(gridSide / 2);
+        }
+        unsigned int node = addSceneNode(scene, gridNode, glm::vec3(3.0f * column, 0.0f, -3.0f * row));
+        attachInstance(scene, node, addInstance(instances, glm::mat4(1.0)));
     }
 
-    // calculate tangent basis
-    std::vector<glm::vec3> tangents;
-    std::vector<glm::vec3> bitangents;
-    computeTangentBasis(
-        vertices, uvs, normals, // inputs
-        tangents, bitangents    // outputs
-    );
-
-    // index VBO
-    std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    std::vector<glm::vec3> indexed_tangents;
-    std::vector<glm::vec3> indexed_bitangents;
-    indexVBO_TBN(
-        vertices, uvs, normals, tangents, bitangents,
-        indices, indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents, indexed_bitangents
-        );
-
-    //
-    // load it into a VBO
-
-    // identify our vertex buffer
-    GLuint vertexbuffer;
-    // generate one buffer, put identifier in vertexbuffer
-    glGenBuffers(1, &vertexbuffer);
-    // bind buffer object to specified buffer binding point
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-    // give our vertices to OpenGL
-    glBufferData(
-        GL_ARRAY_BUFFER, 
-        indexed_vertices.size() * sizeof(glm::vec3), 
-        &indexed_vertices[0], 
-        GL_STATIC_DRAW
-        );
-
-    GLuint uvbuffer;
-    glGenBuffers(1, &uvbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-    glBufferData(
-        GL_ARRAY_BUFFER, 
-        indexed_uvs.size() * sizeof(glm::vec2), 
-        &indexed_uvs[0], 
-        GL_STATIC_DRAW
-        );
-
-    GLuint normalbuffer;
-    glGenBuffers(1, &normalbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-    glBufferData(
-        GL_ARRAY_BUFFER, 
-        indexed_normals.size() * sizeof(glm::vec3), 
-        &indexed_normals[0], 
-        GL_STATIC_DRAW
-        );
-
-    GLuint tangentbuffer;
-    glGenBuffers(1, &tangentbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        indexed_tangents.size() * sizeof(glm::vec3),
-        &indexed_tangents[0],
-        GL_STATIC_DRAW
-    );
-
-    GLuint bitangentbuffer;
-    glGenBuffers(1, &bitangentbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        indexed_bitangents.size() * sizeof(glm::vec3),
-        &indexed_bitangents[0],
-        GL_STATIC_DRAW
-    );
-
-    // generate a buffer for the indices as well
-    GLuint elementbuffer;
-    glGenBuffers(1, &elementbuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-    glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER, 
-        indices.size() * sizeof(unsigned short), 
-        &indices[0], 
-        GL_STATIC_DRAW
-        );
+    // load every asset in the background : file I/O, decoding, tangents and
+    //  indexing on workers, the GL side a little every frame ; frames are
+    //  drawn from the start and each asset shows up once it is resident
+    double startTime = benchmarkTime();
+    AssetLoader loader;
+    startAssetLoader(loader);
+
+    // the threads the work of every frame is shared with, the main thread
+    //  takes part too ; started once, not on every frame, and none on a
+    //  single core where they would only take turns with the main thread
+    WorkerPool frameWorkerPool;
+    WorkerPool* frameWorkers = NULL;
+    if (hardwareThreadCount() > 1)
+    {
+        startWorkerPool(frameWorkerPool, hardwareThreadCount() - 1);
+        frameWorkers = &frameWorkerPool;
+    }
 
-    // get a handle for our "LightPosition" uniform
-    glUseProgram(programID);
-    GLuint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
+    // create and compile our GLSL program from the shaders
+    ShaderAsset program;
+    loadShadersAsync(loader, "shaders/NormalMapping.vs", "shaders/NormalMapping.fs", program,
+        indirectDraws ? "#define INDIRECT_DRAWS 1\n" : NULL);
+
+    // load the textures
+    TextureAsset DiffuseTexture;
+    TextureAsset NormalTexture;
+    TextureAsset SpecularTexture;
+    loadTextureAsync(loader, "textures/diffuse.DDS", DiffuseTexture);
+    // BC5 with its mips, from textures/normal.bmp by tools/texcompress
+    loadTextureAsync(loader, "textures/normal.DDS", NormalTexture, normalMipSettings);
+    loadTextureAsync(loader, "textures/specular.DDS", SpecularTexture, linearMipSettings);
+
+    // read our .obj file, through the binary mesh cache
+    //  the OBJ is only parsed, tangent'ed and indexed again when it changed
+    MeshAsset meshAsset;
+    std::future<bool> meshLoaded = loadMeshAsync(
+        loader, meshPool, "models/cylinder.obj", "models/cylinder.obj.meshcache", meshAsset);
 
     // initialize our little text library with the Holstein font
-    initText2D("textures/Holstein.DDS");     // contains hardcoded shaders
+    initText2D("textures/Holstein.DDS", &loader);     // contains hardcoded shaders
+
+    // the program and its uniforms, reflected once it is resident
+    ShaderProgram shader;
+    shader.program = 0;
+    int ViewProjectionMatrixID = -1;
+    int ViewMatrixID = -1;
+    int LightID = -1;
+    int FirstDrawID = -1;
 
     // for speed computation
-    double lastTime = glfwGetTime();
+    double lastTime = bench.enabled ? benchmarkTime() : glfwGetTime();
     int nbFrames = 0;
+    unsigned int uniformUploads = 0;
+    unsigned int uniformsSkipped = 0;
+    unsigned int stateCalls = 0;
+    unsigned int stateCallsSkipped = 0;
+    unsigned int instancesVisible = 0;
+    unsigned int instancesCulled = 0;
+    double trianglesDrawn = 0.0;
+    double drawCommands = 0.0;
+    // for picking, built on the first click
+    BVH meshBVH;
+    bool bvhBuilt = false;
+    bool mousePressed = false;
+    bool failed = false;
+
+    // --bench : frames are drawn until everything is resident, then the
+    //  warmup ones, then the measured ones
+    double loadTime = 0.0;
+    bool loaded = false;
+    unsigned int benchFrame = 0;        // frames drawn since loaded
+    FrameTimer frameTimer;
+    bool measuring = false;
+    std::vector<std::string> capturePaths;
+    std::vector<unsigned char> capture;
 
     do {
+        PROFILE_SCOPE("frame");
+        if (loaded && benchFrame == bench.warmupFrames)
+        {
+            // nothing from the warmup left in flight, nor in the counters
+            glFinish();
+            startFrameTimer(frameTimer);
+            measuring = true;
+            uniformUploads = 0;
+            uniformsSkipped = 0;
+            stateCalls = 0;
+            stateCallsSkipped = 0;
+            instancesVisible = 0;
+            instancesCulled = 0;
+            trianglesDrawn = 0.0;
+            drawCommands = 0.0;
+        }
+        if (measuring)
+        {
+            beginFrame(frameTimer);
+        }
+
         // measure speed
-        double currentTime = glfwGetTime();
+        double currentTime = bench.enabled ? benchmarkTime() : glfwGetTime();
         nbFrames++;
-        if (currentTime - lastTime >= 1.0)  // if last printf() was more then 1sec ago
+        if (!bench.enabled && currentTime - lastTime >= 1.0)  // if last printf() was more then 1sec ago
         {
             // printf and reset
-            printf("%f ms/frame\n", 1000.0 / double(nbFrames));
+            printf("%f ms/frame, %.1f uniform uploads (%.1f skipped), %.1f state calls (%.1f skipped), "
+                "%.1f instances visible (%.1f culled), %.0f triangles in %.1f draws per frame\n",
+                1000.0 / double(nbFrames),
+                uniformUploads / double(nbFrames), uniformsSkipped / double(nbFrames),
+                stateCalls / double(nbFrames), stateCallsSkipped / double(nbFrames),
+                instancesVisible / double(nbFrames), instancesCulled / double(nbFrames),
+                trianglesDrawn / double(nbFrames), drawCommands / double(nbFrames));
             nbFrames = 0;
+            uniformUploads = 0;
+            uniformsSkipped = 0;
+            stateCalls = 0;
+            stateCallsSkipped = 0;
+            instancesVisible = 0;
+            instancesCulled = 0;
+            trianglesDrawn = 0.0;
+            drawCommands = 0.0;
             lastTime += 1.0;    // deltaT is 1sec
         }
 
-        // clear the screen.
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // use our shader
-        glUseProgram(programID);
-
-        // compute the mvp matrix from keyboard and mouse input
-        computeMatricesFromInputs();
-        glm::mat4 ProjectionMatrix = getProjectionMatrix();
-        glm::mat4 ViewMatrix = getViewMatrix();
-        glm::mat4 ModelMatrix = glm::mat4(1.0);
-        glm::mat4 ModelViewMatrix = ViewMatrix * ModelMatrix;
-        glm::mat3 MV3x3Matrix = glm::mat3(ModelViewMatrix);
-        glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-        // send our transformation to the currently bound shader 
-        //  in the "MVP" uniform
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-        glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-        glUniformMatrix3fv(ModelView3x3MatrixID, 1, GL_FALSE, &MV3x3Matrix[0][0]);
-
-        glm::vec3 lightPos = glm::vec3(4,4,4);
-        glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-
-        // bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, DiffuseTexture);
-        // set "DiffuseTextureSampler" sampler to use Texture Unit 0
-        glUniform1i(DiffuseTextureID, 0);
-
-        // bind our normal texture in Texture unit 1
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, NormalTexture);
-        // set "NormalTextureSampler" sampler to use Texture Unit 1
-        glUniform1i(NormalTextureID, 1);
-
-        // bind our specular texture in Texture unit 2
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, SpecularTexture);
-        // set "NormalTextureSampler" sampler to use Texture Unit 2
-        glUniform1i(SpecularTextureID, 2);
-
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-        glVertexAttribPointer(
-            0,          // attribute 0, must match the layout in the shader
-            3,          // size
-            GL_FLOAT,   // type
-            GL_FALSE,   // normalized?
-            0,          // stride
-            (void*)0    // array buffer offset
-        );
-
-        // 2nd attribute buffer : colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-        glVertexAttribPointer(
-            1,          // attribute 1
-            2,          // size : U+V => 2
-            GL_FLOAT,   // type
-            GL_FALSE,   // normalized?
-            0,          // stride
-            (void*)0    // array buffer offset
-        );
+        // GL side of the loading, within its share of the frame
+        {
+            PROFILE_GPU_SCOPE("processUploads");
+            processUploads(loader, uploadBudgetMs);
+        }
 
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-        glVertexAttribPointer(
-            2,          // attribute 2
-            3,          // size : normals => 3
-            GL_FLOAT,   // type
-            GL_FALSE,   // normalized?
-            0,          // stride
-            (void*)0    // array buffer offset
-        );
+        if (meshLoaded.valid() &&
+            meshLoaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+            !meshLoaded.get())
+        {
+            fprintf(stderr, "Failed to load .OBJ model\n");
+            failed = true;
+            break;
+        }
 
-        // 4th attribute buffer : tangents
-        glEnableVertexAttribArray(3);
-        glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
-        glVertexAttribPointer(
-            3,          // attribute 3
-            3,          // size : normals => 3
-            GL_FLOAT,   // type
-            GL_FALSE,   // normalized?
-            0,          // stride
-            (void*)0    // array buffer offset
-        );
+        if (program.resident && shader.program == 0)
+        {
+            // the text shader went through the cache before this one
+            ProgramCacheStats cacheStats = programCacheStats();
+            printf("Program cache : %u hits, %u misses, %u rejected\n",
+                cacheStats.hits, cacheStats.misses, cacheStats.rejected);
+
+            // every active uniform, attribute and block, read back once
+            initShaderProgram(shader, program.program);
+
+            // get a handle for our "VP" uniform, the model matrices are
+            //  per instance
+            ViewProjectionMatrixID = findUniform(shader, "VP");
+            ViewMatrixID = findUniform(shader, "V");
+
+            // get a handle for our "LightPosition" uniform
+            LightID = findUniform(shader, "LightPosition_worldspace");
+
+            // which draw of the list it is, to dequantize the positions
+            FirstDrawID = findUniform(shader, "FirstDraw");
+
+            // the samplers read texture units 0, 1 and 2, for good, and
+            //  the draw data its own
+            bindSampler(shader, "DiffuseTextureSampler", 0);
+            bindSampler(shader, "NormalTextureSampler", 1);
+            bindSampler(shader, "SpecularTextureSampler", 2);
+            bindSampler(shader, "DrawDataSampler", drawDataTextureUnit);
+        }
 
-        // 5th attribute buffer : bitangents
-        glEnableVertexAttribArray(4);
-        glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
-        glVertexAttribPointer(
-            4,          // attribute 4
-            3,          // size : normals => 3
-            GL_FLOAT,   // type
-            GL_FALSE,   // normalized?
-            0,          // stride
-            (void*)0    // array buffer offset
-        );
+        // clear the screen.
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+        if (bench.enabled)
+        {
+            // the camera where it starts, every frame
+            computeMatricesFromCamera(float(bench.width) / float(bench.height));
+        }
+        else
+        {
+            // compute the mvp matrix from keyboard and mouse input
+            computeMatricesFromInputs();
+
+            // a left click picks what is under the cursor
+            bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+            if (pressed && !mousePressed && meshAsset.resident)
+            {
+                if (!bvhBuilt)
+                {
+                    buildBVH(meshBVH, meshAsset.file.mesh);
+                    bvhBuilt = true;
+                }
+                glm::vec3 origin, direction;
+                computeCursorRay(origin, direction);
+                unsigned int instance = 0;
+                RayHit hit;
+                if (pickInstance(meshBVH, instances, origin, direction, instance, hit))
+                {
+                    printf("Picked triangle %u of instance %u, %.2f units away\n", hit.triangle, instance, hit.t);
+                }
+            }
+            mousePressed = pressed;
+        }
 
-        // draw the triangles from the VBO
-        glDrawElements(
-            GL_TRIANGLES,       // mode
-            indices.size(),     // count
-            GL_UNSIGNED_SHORT,  // type
-            (void*)0            // element array buffer offset
-            );
+        // world transforms of what moved, and of the instances on them
+        updateSceneGraph(scene, frameWorkers);
+        updateSceneInstances(scene, instances);
 
-        // disable connection to the shader
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
-        glDisableVertexAttribArray(3);
-        glDisableVertexAttribArray(4);
+        if (shader.program != 0 && meshAsset.resident)
+        {
+            PROFILE_GPU_SCOPE("drawMesh");
+            const MeshData& mesh = meshAsset.file.mesh;
+
+            if (!vertexArrayReady)
+            {
+                // the instances are culled with the mesh's bounds
+                setInstanceBounds(instances, mesh.boundsMin, mesh.boundsMax);
+                vertexArrayReady = true;
+            }
+
+            glm::mat4 ProjectionMatrix = getProjectionMatrix();
+            glm::mat4 ViewMatrix = getViewMatrix();
+            glm::mat4 VP = ProjectionMatrix * ViewMatrix;
+
+            // the level of detail of every instance, from how far it is
+            int viewportHeight = int(bench.height);
+            if (!bench.enabled)
+            {
+                int viewportWidth;
+                glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+            }
+            LODSelection lodSelection = makeLODSelection(ViewMatrix, ProjectionMatrix,
+                (unsigned int)viewportHeight, lodPixelError, lodHysteresis);
+            selectInstanceLODs(instances, mesh, lodSelection, frameWorkers);
+
+            // the instances that changed, then only those in view
+            uploadInstances(instances);
+            CullStats cullStats = cullInstances(instances, extractFrustum(VP), frameWorkers);
+            instancesVisible += cullStats.visible;
+            instancesCulled += cullStats.culled;
+            bindVertexArray(meshPool.vertexArray);
+            setupInstanceAttributes(instances);
+
+            // opaque, whatever was drawn before
+            setCapability(GL_BLEND, false);
+
+            // use our shader
+            useProgram(shader.program);
+
+            // send our transformation to the currently bound shader 
+            //  in the "VP" uniform ; what did not change is not sent
+            setUniform(shader, ViewProjectionMatrixID, VP);
+            setUniform(shader, ViewMatrixID, ViewMatrix);
+
+            glm::vec3 lightPos = glm::vec3(4,4,4);
+            setUniform(shader, LightID, lightPos);
+
+            // bind our texture in Texture Unit 0, nothing until it is resident
+            bindTextureUnit(0, GL_TEXTURE_2D, DiffuseTexture.texture);
+
+            // bind our normal texture in Texture unit 1
+            bindTextureUnit(1, GL_TEXTURE_2D, NormalTexture.texture);
+
+            // bind our specular texture in Texture unit 2
+            bindTextureUnit(2, GL_TEXTURE_2D, SpecularTexture.texture);
+
+            // the instances of each level of detail at once, a command per
+            //  sub-mesh ; every mesh is in the pool's buffers, bound above
+            clearDrawList(drawList);
+            trianglesDrawn += addMeshDraws(drawList, meshPool, meshAsset.poolMesh, instances);
+            drawCommands += drawList.commands.size();
+            submitDraws(drawList, instances, shader, FirstDrawID);
+
+            uniformUploads += shader.uploads;
+            uniformsSkipped += shader.skipped;
+            resetUniformStats(shader);
+        }
 
         char text[256];
-        sprintf(text, "%.2f sec", glfwGetTime());
+        // benchmark frames are the same from one run to the next, at 60 Hz
+        sprintf(text, "%.2f sec", bench.enabled ? benchFrame / 60.0 : glfwGetTime());
         printText2D(
             text,   // text to be displayed
             10,     // position x
             500,    // position y
             30      // size
         );
+        // every string of the frame in one draw
+        flushText2D();
 
-        // Swap buffers
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        GLStateStats frameState = glStateStats();
+        stateCalls += frameState.issued;
+        stateCallsSkipped += frameState.skipped;
+        resetGLStateStats();
+
+        // the GPU scopes of this frame are all closed
+        profileFrame();
+
+        if (bench.enabled)
+        {
+            if (measuring)
+            {
+                endFrame(frameTimer);
+
+                // after the frame's times, reading it back stalls the pipeline
+                unsigned int frame = benchFrame - bench.warmupFrames;
+                if (std::binary_search(bench.captures.begin(), bench.captures.end(), frame))
+                {
+                    char path[1024];
+                    snprintf(path, sizeof(path), "%s_%04u.ppm", bench.capturePrefix.c_str(), frame);
+                    readOffscreenPixels(offscreen, capture);
+                    if (savePPM(path, capture.data(), offscreen.width, offscreen.height))
+                    {
+                        capturePaths.push_back(path);
+                    }
+                }
+            }
+            if (loaded)
+            {
+                benchFrame++;
+            }
+            else if (pendingAssets(loader) == 0)
+            {
+                // every asset done loading, the mesh must be drawable by now
+                if (!vertexArrayReady)
+                {
+                    fprintf(stderr, "Failed to load the scene\n");
+                    failed = true;
+                    break;
+                }
+                loaded = true;
+                loadTime = benchmarkTime() - startTime;
+                printf("Loaded in %.1f ms\n", loadTime * 1000.0);
+            }
+        }
+        else
+        {
+            // Swap buffers
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
 
     } // check if the ESC kez was pressed or the window closed
-    while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-            glfwWindowShouldClose(window) == 0);
-
-    // cleanup VBO
-    glDeleteBuffers(1, &vertexbuffer);
-    glDeleteBuffers(1, &uvbuffer);
-    glDeleteBuffers(1, &normalbuffer);
-    glDeleteBuffers(1, &tangentbuffer);
-    glDeleteBuffers(1, &bitangentbuffer);
-    glDeleteBuffers(1, &elementbuffer);
-    glDeleteProgram(programID);
-    glDeleteTextures(1, &DiffuseTexture);
-    glDeleteTextures(1, &NormalTexture);
-    glDeleteTextures(1, &SpecularTexture);
-    glDeleteVertexArrays(1, &VertexArrayID);
+    while (bench.enabled ? benchFrame < bench.warmupFrames + bench.frames :
+            (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+             glfwWindowShouldClose(window) == 0));
+
+    if (measuring)
+    {
+        stopFrameTimer(frameTimer);
+        if (!failed)
+        {
+            std::vector<std::pair<std::string, double> > counters;
+            counters.push_back(std::make_pair("uniformUploads", uniformUploads / double(bench.frames)));
+            counters.push_back(std::make_pair("uniformsSkipped", uniformsSkipped / double(bench.frames)));
+            counters.push_back(std::make_pair("stateCalls", stateCalls / double(bench.frames)));
+            counters.push_back(std::make_pair("stateCallsSkipped", stateCallsSkipped / double(bench.frames)));
+            counters.push_back(std::make_pair("instancesVisible", instancesVisible / double(bench.frames)));
+            counters.push_back(std::make_pair("instancesCulled", instancesCulled / double(bench.frames)));
+            counters.push_back(std::make_pair("triangles", trianglesDrawn / double(bench.frames)));
+            counters.push_back(std::make_pair("drawCommands", drawCommands / double(bench.frames)));
+
+            // rays against the mesh, from the camera, one per pixel
+            std::vector<std::pair<std::string, double> > metrics;
+            BVH bvh;
+            double bvhStart = benchmarkTime();
+            buildBVH(bvh, meshAsset.file.mesh);
+            double bvhTime = benchmarkTime() - bvhStart;
+            RayBenchmark rays = benchmarkRays(bvh, getViewMatrix(), getProjectionMatrix(), bench.width, bench.height);
+            metrics.push_back(std::make_pair("bvhBuildMs", bvhTime * 1000.0));
+            metrics.push_back(std::make_pair("bvhNodes", double(bvh.nodes.size())));
+            metrics.push_back(std::make_pair("rayHits", double(rays.hits)));
+            metrics.push_back(std::make_pair("singleRayMrays", rays.singleMrays));
+            metrics.push_back(std::make_pair("packetMrays", rays.packetMrays));
+            printf("BVH of %u nodes in %.1f ms : %.1f Mrays/s single, %.1f Mrays/s in packets\n",
+                (unsigned int)bvh.nodes.size(), bvhTime * 1000.0, rays.singleMrays, rays.packetMrays);
+
+            // a scene much bigger than this one, 1% of it moved
+            SceneBenchmark sceneUpdate = benchmarkSceneUpdate(1u << 20, 0.01f, frameWorkers);
+            metrics.push_back(std::make_pair("sceneNodes", double(sceneUpdate.nodes)));
+            metrics.push_back(std::make_pair("sceneNodesUpdated", double(sceneUpdate.updated)));
+            metrics.push_back(std::make_pair("sceneUpdateMs", sceneUpdate.updateMs));
+            printf("Scene of %u nodes, %u set : %u updated in %.3f ms\n",
+                sceneUpdate.nodes, sceneUpdate.dirty, sceneUpdate.updated, sceneUpdate.updateMs);
+
+            failed = !writeBenchmarkReport(bench, offscreen.samples, loadTime, frameTimer, counters, metrics, capturePaths);
+
+            TimeSummary frameTimes = summarizeTimes(frameTimer.frameTimes);
+            printf("%u frames : median %.3f ms, p95 %.3f ms, p99 %.3f ms, report in %s\n",
+                bench.frames, frameTimes.median, frameTimes.p95, frameTimes.p99, bench.reportPath.c_str());
+        }
+    }
+
+    // let the loads still in flight finish before anything is deleted
+    stopAssetLoader(loader);
+    if (frameWorkers)
+    {
+        stopWorkerPool(*frameWorkers);
+    }
+
+    // the frames still in flight, then the whole run as a trace
+    stopGPUProfiler();
+    if (!bench.tracePath.empty() && !writeChromeTrace(bench.tracePath.c_str()))
+    {
+        failed = true;
+    }
+
+    // cleanup the cache mapping the sub-meshes were read from
+    destroyMeshAsset(meshAsset);
+    if (shader.program != 0)
+    {
+        destroyShaderProgram(shader);
+    }
+    else
+    {
+        deleteProgram(program.program);
+    }
+    deleteTextures(1, &DiffuseTexture.texture);
+    deleteTextures(1, &NormalTexture.texture);
+    deleteTextures(1, &SpecularTexture.texture);
+    destroyDrawList(drawList);
+    destroyMeshPool(meshPool);
+    destroyInstanceBuffer(instances);
+    destroySceneGraph(scene);
 
     // delete the text's VBO, the shader and the texture
     cleanupText2D();
 
-    // close OpenGL window and terminate GLFW
-    glfwTerminate();
+    if (bench.enabled)
+    {
+        destroyOffscreenContext(offscreen);
+    }
+    else
+    {
+        // close OpenGL window and terminate GLFW
+        glfwTerminate();
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,314 @@
+// intersectRay() and intersectPacket() against every triangle tested one by
+//  one : every vector path the cpu has, partial packets, axis aligned and
+//  clipped rays, and a tree deeper than the traversal stack must find the
+//  closest hit the brute force finds
+//
+//  bvh_test ; exits 1 if anything failed
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/bvh.hpp>
+#include <common/simd.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+// rays this close to an edge, or to a nearer triangle, may go either way
+static const float edgeTolerance = 1e-4f;
+
+// Moller-Trumbore without the barycentric rejection, returns false only when
+//  the ray is parallel
+static bool rayTriangle(const glm::vec3* v, const Ray &ray, float &t, float &u, float &w)
+{
+    glm::vec3 e1 = v[1] - v[0];
+    glm::vec3 e2 = v[2] - v[0];
+    glm::vec3 p = glm::cross(ray.direction, e2);
+    float determinant = glm::dot(e1, p);
+    if (fabsf(determinant) < 1e-12f)
+    {
+        return false;
+    }
+    float inverse = 1.f / determinant;
+    glm::vec3 s = ray.origin - v[0];
+    u = glm::dot(s, p) * inverse;
+    glm::vec3 q = glm::cross(s, e1);
+    w = glm::dot(ray.direction, q) * inverse;
+    t = glm::dot(e2, q) * inverse;
+    return true;
+}
+
+// how far inside the triangle the barycentrics are, negative outside
+static float insideOf(float u, float w)
+{
+    return fminf(fminf(u, w), 1.f - u - w);
+}
+
+// the closest hit over all triangles ; ambiguous when another triangle,
+//  barely hit or barely missed, is about as near, or when the hit is about
+//  as far as the ray goes
+struct Expected
+{
+    bool hit;
+    uint32_t triangle;
+    float t, u, v;
+    bool ambiguous;
+};
+
+static Expected bruteForce(const std::vector<glm::vec3> &positions, const Ray &ray)
+{
+    Expected e = { false, noTriangle, ray.tMax, 0.f, 0.f, false };
+    for (size_t i = 0; i < positions.size(); i += 3)
+    {
+        float t, u, w;
+        if (rayTriangle(&positions[i], ray, t, u, w) && insideOf(u, w) >= 0.f && t >= 0.f && t < e.t)
+        {
+            e.hit = true;
+            e.triangle = (uint32_t)(i / 3);
+            e.t = t;
+            e.u = u;
+            e.v = w;
+        }
+    }
+    for (size_t i = 0; i < positions.size(); i += 3)
+    {
+        float t, u, w;
+        if (!rayTriangle(&positions[i], ray, t, u, w) || i / 3 == e.triangle)
+        {
+            continue;
+        }
+        float inside = insideOf(u, w);
+        if (inside <= -edgeTolerance)
+        {
+            continue;
+        }
+        if (fabsf(inside) < edgeTolerance ? t >= -edgeTolerance && t <= e.t * (1.f + edgeTolerance) :
+            fabsf(t - e.t) <= edgeTolerance * e.t || fabsf(t) <= edgeTolerance)
+        {
+            e.ambiguous = true;
+        }
+    }
+    if (e.hit && (fabsf(e.t - ray.tMax) <= edgeTolerance * ray.tMax || e.t <= edgeTolerance))
+    {
+        e.ambiguous = true;
+    }
+    return e;
+}
+
+// a hit matches when it names the expected triangle, at the distance and
+//  barycentrics the brute force finds
+static bool matches(const Expected &expected, bool hit, const RayHit &h)
+{
+    if (expected.ambiguous)
+    {
+        return true;
+    }
+    if (hit != expected.hit || h.triangle != expected.triangle)
+    {
+        return false;
+    }
+    if (!hit)
+    {
+        return true;
+    }
+    return fabsf(h.t - expected.t) <= 1e-4f * expected.t &&
+        fabsf(h.u - expected.u) <= 1e-3f && fabsf(h.v - expected.v) <= 1e-3f;
+}
+
+static float randomFloat()
+{
+    return (float)rand() / (float)RAND_MAX;
+}
+
+static glm::vec3 randomPoint(const glm::vec3 &lo, const glm::vec3 &hi)
+{
+    return lo + (hi - lo) * glm::vec3(randomFloat(), randomFloat(), randomFloat());
+}
+
+enum RayKind
+{
+    RAYS_COHERENT,      // from one corner towards the mesh
+    RAYS_RANDOM,        // any origin, any direction
+    RAYS_AXIS,          // along x, y or z, two direction components 0
+    RAYS_CLIPPED        // tMax short of most hits
+};
+
+static Ray makeRay(RayKind kind, const glm::vec3 &lo, const glm::vec3 &hi)
+{
+    glm::vec3 size = hi - lo;
+    Ray ray;
+    ray.tMax = 1e30f;
+    switch (kind)
+    {
+    case RAYS_COHERENT:
+        ray.origin = lo - size * 0.5f + size * 0.05f * glm::vec3(randomFloat(), randomFloat(), randomFloat());
+        ray.direction = glm::normalize(randomPoint(lo, hi) - ray.origin);
+        break;
+    case RAYS_RANDOM:
+        ray.origin = randomPoint(lo - size, hi + size);
+        ray.direction = randomPoint(lo, hi) - ray.origin;
+        ray.direction = randomFloat() < 0.3f ? -ray.direction : ray.direction;
+        break;
+    case RAYS_AXIS:
+    {
+        unsigned int axis = rand() % 3;
+        // inside the bounds across the axis, never on a box face
+        ray.origin = randomPoint(lo, hi) + size * 1e-3f * glm::vec3(0.37f, 0.71f, 0.53f);
+        ray.origin[axis] = rand() % 2 ? lo[axis] - size[axis] : hi[axis] + size[axis];
+        ray.direction = glm::vec3(0.f);
+        ray.direction[axis] = ray.origin[axis] < lo[axis] ? 1.f : -1.f;
+        break;
+    }
+    case RAYS_CLIPPED:
+        ray.origin = randomPoint(lo, hi);
+        ray.direction = glm::normalize(randomPoint(lo, hi) - ray.origin);
+        ray.tMax = glm::length(size) * 0.1f * randomFloat();
+        break;
+    }
+    return ray;
+}
+
+// rays one at a time and in packets of packetCount rays
+static bool castRays(const BVH &bvh, const std::vector<Ray> &rays, const std::vector<Expected> &expected,
+    size_t first, size_t count, unsigned int packetCount)
+{
+    bool passed = true;
+    for (size_t r = first; r < first + count; r += packetCount)
+    {
+        RayPacket packet;
+        packet.count = packetCount;
+        for (unsigned int j = 0; j < packetCount; j++)
+        {
+            setPacketRay(packet, j, rays[r + j]);
+        }
+
+        RayHit packetHits[rayPacketSize];
+        intersectPacket(bvh, packet, packetHits);
+        for (unsigned int j = 0; j < packetCount; j++)
+        {
+            RayHit hit;
+            bool single = intersectRay(bvh, rays[r + j], hit);
+            passed = passed && matches(expected[r + j], single, hit) &&
+                matches(expected[r + j], packetHits[j].triangle != noTriangle, packetHits[j]);
+        }
+    }
+    return passed;
+}
+
+static void testMesh(const char* name, const std::vector<glm::vec3> &positions, const glm::vec3 &lo, const glm::vec3 &hi, unsigned int minDepth)
+{
+    std::vector<uint32_t> indices(positions.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        indices[i] = (uint32_t)i;
+    }
+
+    // the tree doesn't depend on the thread count
+    BVH bvh, threaded;
+    buildBVH(bvh, positions.data(), indices.data(), positions.size() / 3, 1);
+    buildBVH(threaded, positions.data(), indices.data(), positions.size() / 3, 3);
+    bool same = bvh.nodes.size() == threaded.nodes.size() && bvh.triangles == threaded.triangles &&
+        memcmp(bvh.nodes.data(), threaded.nodes.data(), bvh.nodes.size() * sizeof(BVHNode)) == 0;
+
+    char what[160];
+    snprintf(what, sizeof(what), "%s : %u triangles, depth %u", name, (unsigned int)positions.size() / 3, bvh.depth);
+    check(same && bvh.depth >= minDepth, what);
+
+    setSIMDLevel(SIMD_AVX2);
+    SIMDLevel best = simdLevel();
+    static const RayKind kinds[] = { RAYS_COHERENT, RAYS_RANDOM, RAYS_AXIS, RAYS_CLIPPED };
+    static const char* kindNames[] = { "coherent", "random", "axis aligned", "clipped" };
+    for (unsigned int k = 0; k < 4; k++)
+    {
+        // full packets, then a partial one of every size
+        static const size_t packetRays = 800;
+        size_t rayCount = packetRays + rayPacketSize * (rayPacketSize - 1) / 2;
+        std::vector<Ray> rays(rayCount);
+        std::vector<Expected> expected(rayCount);
+        unsigned int ambiguous = 0;
+        for (size_t r = 0; r < rayCount; r++)
+        {
+            rays[r] = makeRay(kinds[k], lo, hi);
+            expected[r] = bruteForce(positions, rays[r]);
+            ambiguous += expected[r].ambiguous;
+        }
+
+        bool passed = true;
+        for (int l = SIMD_SCALAR; l <= best; l++)
+        {
+            setSIMDLevel((SIMDLevel)l);
+            bool level = castRays(bvh, rays, expected, 0, packetRays, rayPacketSize);
+            for (unsigned int count = 1, first = packetRays; count < rayPacketSize; first += count, count++)
+            {
+                level = castRays(bvh, rays, expected, first, count, count) && level;
+            }
+            if (!level)
+            {
+                printf("  level %d\n", l);
+            }
+            passed = passed && level;
+        }
+        snprintf(what, sizeof(what), "%s : %s rays, every level (%u too close to call)", name, kindNames[k], ambiguous);
+        check(passed, what);
+    }
+    setSIMDLevel(SIMD_AVX2);
+}
+
+int main()
+{
+    srand(1);
+
+    // small triangles all over the unit cube
+    std::vector<glm::vec3> positions;
+    for (unsigned int i = 0; i < 20000; i++)
+    {
+        glm::vec3 c(randomFloat(), randomFloat(), randomFloat());
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            positions.push_back(c + glm::vec3(randomFloat(), randomFloat(), randomFloat()) * 0.05f);
+        }
+    }
+    testMesh("random", positions, glm::vec3(0.f), glm::vec3(1.05f), 1);
+
+    // big triangles in a slab, and a chain of flat ones along x : the
+    //  chain has no area, so every split peels a single triangle off and
+    //  the tree is deeper than the traversal stack
+    positions.clear();
+    for (unsigned int i = 0; i < 200; i++)
+    {
+        glm::vec3 c(-2.f * randomFloat(), 100.f * randomFloat() - 50.f, 100.f * randomFloat() - 50.f);
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            positions.push_back(c + glm::vec3(randomFloat() * 2.f, randomFloat() * 20.f, randomFloat() * 20.f));
+        }
+    }
+    for (unsigned int i = 0; i < 120; i++)
+    {
+        float x = powf(1.1f, (float)i) * 1e-4f;
+        positions.push_back(glm::vec3(x, 0.f, 0.f));
+        positions.push_back(glm::vec3(x * 1.01f, 0.f, 0.f));
+        positions.push_back(glm::vec3(x * 1.02f, 0.f, 0.f));
+    }
+    testMesh("deep", positions, glm::vec3(-2.f, -50.f, -50.f), glm::vec3(10.f, 70.f, 70.f), 65);
+
+    // a single triangle, the root is a leaf
+    positions.clear();
+    positions.push_back(glm::vec3(0.f, 0.f, 0.f));
+    positions.push_back(glm::vec3(1.f, 0.f, 0.f));
+    positions.push_back(glm::vec3(0.f, 1.f, 0.f));
+    testMesh("one triangle", positions, glm::vec3(0.f, 0.f, -1.f), glm::vec3(1.f, 1.f, 1.f), 0);
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
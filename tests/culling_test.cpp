@@ -0,0 +1,177 @@
+// cullBounds() against one box and one plane at a time : every vector path
+//  the cpu has, the tails of every lane width and the worker pool must
+//  keep exactly the boxes the scalar test keeps
+//
+//  culling_test ; exits 1 if anything failed
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/culling.hpp>
+#include <common/parallel.hpp>
+#include <common/simd.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+// 1 inside, 0 outside, 2 too close to a plane to tell apart from rounding
+static unsigned char referenceVisible(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent, float tolerance)
+{
+    unsigned char result = 1;
+    for (unsigned int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = frustum.planes[p];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float radius = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+        if (distance + radius < -tolerance)
+        {
+            return 0;
+        }
+        if (distance + radius < tolerance)
+        {
+            result = 2;
+        }
+    }
+    return result;
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+// the levels up to the best one the cpu runs
+static std::vector<SIMDLevel> levels()
+{
+    setSIMDLevel(SIMD_AVX2);
+    SIMDLevel best = simdLevel();
+    std::vector<SIMDLevel> result;
+    for (int l = SIMD_SCALAR; l <= best; l++)
+    {
+        result.push_back((SIMDLevel)l);
+    }
+    return result;
+}
+
+// cull with every level, with and without the pool, against expected
+static bool cullAll(const BoundsSoA &bounds, const Frustum &frustum,
+    const std::vector<unsigned char> &expected, WorkerPool &workers)
+{
+    std::vector<SIMDLevel> runs = levels();
+    bool passed = true;
+    for (size_t l = 0; l < runs.size(); l++)
+    {
+        setSIMDLevel(runs[l]);
+        for (unsigned int pooled = 0; pooled < 2; pooled++)
+        {
+            std::vector<unsigned char> visible;
+            CullStats stats = cullBounds(bounds, frustum, visible, pooled ? &workers : NULL);
+            unsigned int count = 0;
+            bool same = visible.size() == bounds.count;
+            for (size_t i = 0; i < bounds.count && same; i++)
+            {
+                same = expected[i] == 2 || visible[i] == expected[i];
+                count += visible[i];
+            }
+            same = same && stats.visible == count && stats.visible + stats.culled == bounds.count;
+            if (!same)
+            {
+                printf("  %lu boxes, level %d%s\n", (unsigned long)bounds.count, (int)runs[l], pooled ? ", pooled" : "");
+                passed = false;
+            }
+        }
+    }
+    setSIMDLevel(SIMD_AVX2);
+    return passed;
+}
+
+static void testBoxCounts(WorkerPool &workers)
+{
+    // a perspective frustum, boxes all around it
+    glm::mat4 projection = glm::perspective(glm::radians(45.f), 4.f / 3.f, 0.1f, 100.f);
+    glm::mat4 view = glm::lookAt(glm::vec3(4.f, 3.f, 3.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    Frustum frustum = extractFrustum(projection * view);
+
+    // around every lane width and parallel block size
+    static const size_t counts[] = { 1, 3, 4, 5, 7, 8, 9, 17, 4095, 4096, 4097, 100003 };
+    bool passed = true;
+    unsigned int visible = 0, total = 0;
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        BoundsSoA bounds;
+        resizeBounds(bounds, counts[c]);
+        std::vector<unsigned char> expected(counts[c]);
+        for (size_t i = 0; i < counts[c]; i++)
+        {
+            glm::vec3 center(randomFloat(-40.f, 40.f), randomFloat(-40.f, 40.f), randomFloat(-40.f, 40.f));
+            glm::vec3 extent(randomFloat(0.f, 5.f), randomFloat(0.f, 5.f), randomFloat(0.f, 5.f));
+            setBounds(bounds, i, center, extent);
+            expected[i] = referenceVisible(frustum, center, extent, 1e-3f);
+            visible += expected[i] == 1;
+            total++;
+        }
+        passed = passed && cullAll(bounds, frustum, expected, workers);
+    }
+    check(passed, "random boxes around a perspective frustum, every count and level");
+    printf("  %u of %u boxes visible\n", visible, total);
+}
+
+static void testTouching(WorkerPool &workers)
+{
+    // planes and boxes on small integers, the arithmetic is exact : a box
+    //  touching a plane is inside, one a unit further out is not
+    Frustum frustum;
+    frustum.planes[0] = glm::vec4( 1.f,  0.f,  0.f, 10.f);
+    frustum.planes[1] = glm::vec4(-1.f,  0.f,  0.f, 10.f);
+    frustum.planes[2] = glm::vec4( 0.f,  1.f,  0.f, 20.f);
+    frustum.planes[3] = glm::vec4( 0.f, -1.f,  0.f, 20.f);
+    frustum.planes[4] = glm::vec4( 0.f,  0.f,  1.f, 30.f);
+    frustum.planes[5] = glm::vec4( 0.f,  0.f, -1.f, 30.f);
+
+    size_t count = 10000;
+    BoundsSoA bounds;
+    resizeBounds(bounds, count);
+    std::vector<unsigned char> expected(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center((float)(rand() % 41 - 20), (float)(rand() % 61 - 30), (float)(rand() % 81 - 40));
+        glm::vec3 extent((float)(rand() % 6), (float)(rand() % 6), (float)(rand() % 6));
+        setBounds(bounds, i, center, extent);
+        expected[i] = referenceVisible(frustum, center, extent, 0.f) == 0 ? 0 : 1;
+    }
+    check(cullAll(bounds, frustum, expected, workers), "boxes touching a plane are kept, every level");
+}
+
+static void testEmpty(WorkerPool &workers)
+{
+    BoundsSoA bounds;
+    resizeBounds(bounds, 0);
+    Frustum frustum = extractFrustum(glm::mat4(1.f));
+    std::vector<unsigned char> expected;
+    check(cullAll(bounds, frustum, expected, workers), "no boxes at all");
+}
+
+int main()
+{
+    srand(1);
+    WorkerPool workers;
+    startWorkerPool(workers, 3);
+
+    testBoxCounts(workers);
+    testTouching(workers);
+    testEmpty(workers);
+
+    stopWorkerPool(workers);
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
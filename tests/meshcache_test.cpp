@@ -0,0 +1,318 @@
+// buildMeshCache() and readMeshCache() : an image must read back as what
+//  was written, and any image that is stale, from another version, cut short
+//  or damaged must be turned down rather than pointed into ; then a miss and
+//  a hit of loadMeshCached() on a model must give the same mesh
+//
+//  meshcache_test ; exits 1 if anything failed
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/meshcache.hpp>
+#include <common/vboindexer.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+static const uint64_t sourceHash = 0x0123456789abcdefULL;
+static const uint64_t sourceSize = 4242;
+static const uint64_t lodSettings = 77;
+
+// a grid of side x side quads, the full mesh and a level with every other
+//  row of quads, in one image
+//  corners gets the position of every corner, the levels one after the other
+static void buildImage(unsigned int side, std::vector<char> &image,
+    std::vector<glm::vec3> &corners, std::vector<unsigned int> &ranges)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals, tangents, bitangents;
+    for (unsigned int y = 0; y <= side; y++)
+    {
+        for (unsigned int x = 0; x <= side; x++)
+        {
+            vertices.push_back(glm::vec3((float)x, (float)y, (float)((x * y) % 5)));
+            uvs.push_back(glm::vec2((float)x / side, (float)y / side));
+            normals.push_back(glm::vec3(0.f, 0.f, 1.f));
+            tangents.push_back(glm::vec3(1.f, 0.f, 0.f));
+            bitangents.push_back(glm::vec3(0.f, 1.f, 0.f));
+        }
+    }
+
+    ranges.assign(1, 0);
+    for (unsigned int level = 0; level < 2; level++)
+    {
+        if (level > 0)
+        {
+            ranges.push_back((unsigned int)indices.size());
+        }
+        for (unsigned int y = 0; y < side; y += level + 1)
+        {
+            for (unsigned int x = 0; x < side; x++)
+            {
+                unsigned int a = y * (side + 1) + x;
+                unsigned int quad[6] = { a, a + 1, a + side + 2, a, a + side + 2, a + side + 1 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    corners.clear();
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        corners.push_back(vertices[indices[i]]);
+    }
+
+    IndexBuffer indexBuffer;
+    buildIndexBuffer(indices, vertices.size(), true, ranges, indexBuffer);
+    remapVertexAttribute(vertices, indexBuffer.vertexRemap);
+    remapVertexAttribute(uvs, indexBuffer.vertexRemap);
+    remapVertexAttribute(normals, indexBuffer.vertexRemap);
+    remapVertexAttribute(tangents, indexBuffer.vertexRemap);
+    remapVertexAttribute(bitangents, indexBuffer.vertexRemap);
+
+    std::vector<MeshLOD> lods(2);
+    for (unsigned int l = 0; l < 2; l++)
+    {
+        unsigned int end = l + 1 < 2 ? indexBuffer.rangeSubMeshes[l + 1] : (unsigned int)indexBuffer.subMeshes.size();
+        lods[l].firstSubMesh = indexBuffer.rangeSubMeshes[l];
+        lods[l].subMeshCount = end - lods[l].firstSubMesh;
+        lods[l].indexCount = (l + 1 < 2 ? ranges[l + 1] : (unsigned int)indices.size()) - ranges[l];
+        lods[l].error = 0.5f * l;
+    }
+
+    buildMeshCache(sourceHash, sourceSize, vertices, uvs, normals, tangents, bitangents,
+        indexBuffer, lods, lodSettings, image);
+}
+
+static bool read(const std::vector<char> &image, size_t size, MeshData &mesh)
+{
+    return readMeshCache(image.data(), size, sourceHash, sourceSize, lodSettings, mesh);
+}
+
+// the index of every corner of the level, through its sub-meshes
+static bool levelIndices(const MeshData &mesh, unsigned int level, std::vector<unsigned int> &out)
+{
+    const MeshLOD &lod = mesh.lods[level];
+    for (unsigned int s = lod.firstSubMesh; s < lod.firstSubMesh + lod.subMeshCount; s++)
+    {
+        const SubMesh &subMesh = mesh.subMeshes[s];
+        for (unsigned int i = subMesh.firstIndex; i < subMesh.firstIndex + subMesh.indexCount; i++)
+        {
+            unsigned int index = mesh.indexSize == 2 ? ((const uint16_t*)mesh.indices)[i] : ((const uint32_t*)mesh.indices)[i];
+            if (index >= subMesh.vertexCount)
+            {
+                return false;
+            }
+            out.push_back(subMesh.baseVertex + index);
+        }
+    }
+    return out.size() == lod.indexCount;
+}
+
+static void testRoundTrip(unsigned int side, const char* what)
+{
+    std::vector<char> image;
+    std::vector<glm::vec3> corners;
+    std::vector<unsigned int> ranges;
+    buildImage(side, image, corners, ranges);
+
+    MeshData mesh;
+    bool passed = read(image, image.size(), mesh) && mesh.lodCount == 2 &&
+        mesh.boundsMin == glm::vec3(0.f, 0.f, 0.f) && mesh.boundsMax == glm::vec3((float)side, (float)side, 4.f) &&
+        mesh.lods[1].error == 0.5f && mesh.indexCount == corners.size();
+
+    // the same triangles, whatever sub-meshes they were split in
+    for (unsigned int l = 0; l < 2 && passed; l++)
+    {
+        std::vector<unsigned int> levelCorners;
+        passed = levelIndices(mesh, l, levelCorners);
+        size_t end = l + 1 < 2 ? ranges[l + 1] : corners.size();
+        passed = passed && levelCorners.size() == end - ranges[l];
+        for (size_t i = 0; i < levelCorners.size() && passed; i++)
+        {
+            passed = mesh.positions[levelCorners[i]] == corners[ranges[l] + i];
+        }
+    }
+    check(passed, what);
+}
+
+static void testRejected()
+{
+    std::vector<char> image;
+    std::vector<glm::vec3> corners;
+    std::vector<unsigned int> ranges;
+    buildImage(8, image, corners, ranges);
+    MeshData mesh;
+
+    check(read(image, image.size(), mesh), "a fresh image is accepted");
+    check(!readMeshCache(image.data(), image.size(), sourceHash + 1, sourceSize, lodSettings, mesh) &&
+          !readMeshCache(image.data(), image.size(), sourceHash, sourceSize + 1, lodSettings, mesh),
+          "an image of another source is stale");
+    check(!readMeshCache(image.data(), image.size(), sourceHash, sourceSize, lodSettings + 1, mesh),
+          "an image of other levels of detail is stale");
+
+    // offsets of the sections, from where a good read points ; the levels
+    //  come last, only alignment padding follows them
+    read(image, image.size(), mesh);
+    size_t indicesOffset = (const char*)mesh.indices - image.data();
+    size_t subMeshesOffset = (const char*)mesh.subMeshes - image.data();
+    size_t subMeshesEnd = subMeshesOffset + (mesh.lods[1].firstSubMesh + mesh.lods[1].subMeshCount) * sizeof(SubMesh);
+    size_t lodsOffset = (const char*)mesh.lods - image.data();
+    size_t lodsEnd = lodsOffset + mesh.lodCount * sizeof(MeshLOD);
+    size_t headerEnd = (const char*)mesh.positions - image.data();
+
+    bool passed = true;
+    for (size_t size = 0; size < lodsEnd && passed; size++)
+    {
+        passed = !read(image, size, mesh);
+    }
+    check(passed, "an image cut anywhere is turned down");
+
+    // magic, version, byte order and header size lead the header
+    passed = true;
+    for (size_t byte = 0; byte < 16 && passed; byte++)
+    {
+        std::vector<char> damaged(image);
+        damaged[byte] ^= 0x10;
+        passed = !read(damaged, damaged.size(), mesh);
+    }
+    check(passed, "an image of another format, version or byte order is turned down");
+
+    {
+        std::vector<char> damaged(image);
+        if (mesh.indexSize == 2)
+        {
+            uint16_t index = (uint16_t)mesh.subMeshes[0].vertexCount;
+            memcpy(&damaged[indicesOffset], &index, sizeof(index));
+        }
+        else
+        {
+            uint32_t index = mesh.subMeshes[0].vertexCount;
+            memcpy(&damaged[indicesOffset], &index, sizeof(index));
+        }
+        check(!read(damaged, damaged.size(), mesh), "an index past its sub-mesh's vertices is turned down");
+    }
+    {
+        std::vector<char> damaged(image);
+        ((SubMesh*)&damaged[subMeshesOffset])->indexCount += 3;
+        check(!read(damaged, damaged.size(), mesh), "sub-meshes that don't cover the indices are turned down");
+    }
+    {
+        std::vector<char> damaged(image);
+        ((MeshLOD*)&damaged[lodsOffset + sizeof(MeshLOD)])->firstSubMesh += 1;
+        check(!read(damaged, damaged.size(), mesh), "levels that aren't consecutive runs of sub-meshes are turned down");
+    }
+
+    // any byte of the header or of the tables changed : either turned down,
+    //  or everything it points to is still inside the image and valid
+    std::vector<size_t> bytes;
+    for (size_t byte = 0; byte < headerEnd; byte++)
+    {
+        bytes.push_back(byte);
+    }
+    for (size_t byte = subMeshesOffset; byte < subMeshesEnd; byte++)
+    {
+        bytes.push_back(byte);
+    }
+    for (size_t byte = lodsOffset; byte < lodsEnd; byte++)
+    {
+        bytes.push_back(byte);
+    }
+    passed = true;
+    for (size_t k = 0; k < bytes.size() && passed; k++)
+    {
+        static const unsigned char flips[] = { 0x01, 0x80, 0xff };
+        for (unsigned int f = 0; f < 3 && passed; f++)
+        {
+            std::vector<char> damaged(image);
+            damaged[bytes[k]] ^= flips[f];
+            MeshData damagedMesh;
+            if (!read(damaged, damaged.size(), damagedMesh))
+            {
+                continue;
+            }
+            const char* begin = damaged.data();
+            const char* end = begin + damaged.size();
+            passed = (const char*)damagedMesh.positions >= begin &&
+                (const char*)(damagedMesh.positions + damagedMesh.vertexCount) <= end &&
+                (const char*)damagedMesh.indices + (size_t)damagedMesh.indexCount * damagedMesh.indexSize <= end;
+            for (unsigned int l = 0; l < damagedMesh.lodCount && passed; l++)
+            {
+                std::vector<unsigned int> corners;
+                passed = levelIndices(damagedMesh, l, corners);
+                for (size_t i = 0; i < corners.size() && passed; i++)
+                {
+                    passed = corners[i] < damagedMesh.vertexCount;
+                }
+            }
+            if (!passed)
+            {
+                printf("  byte %lu ^ 0x%02x was accepted\n", (unsigned long)bytes[k], flips[f]);
+            }
+        }
+    }
+    check(passed, "a damaged header or table is turned down or still valid");
+}
+
+static bool sameMesh(const MeshData &a, const MeshData &b)
+{
+    return a.vertexCount == b.vertexCount && a.indexCount == b.indexCount &&
+        a.indexSize == b.indexSize && a.subMeshCount == b.subMeshCount && a.lodCount == b.lodCount &&
+        memcmp(a.positions, b.positions, a.vertexCount * sizeof(glm::vec3)) == 0 &&
+        memcmp(a.tangents, b.tangents, a.vertexCount * sizeof(glm::vec3)) == 0 &&
+        memcmp(a.indices, b.indices, (size_t)a.indexCount * a.indexSize) == 0 &&
+        memcmp(a.lods, b.lods, a.lodCount * sizeof(MeshLOD)) == 0 &&
+        memcmp(a.packedVertices, b.packedVertices, (size_t)a.vertexCount * a.vertexStride) == 0;
+}
+
+static void testLoad()
+{
+    const char* objPath = "models/suzanne.obj";
+    const char* cachePath = "tests/meshcache_test.meshcache";
+    remove(cachePath);
+
+    MeshFile miss, hit, rebuilt;
+    bool passed = loadMeshCached(objPath, cachePath, miss) && !miss.storage.empty();
+    passed = passed && loadMeshCached(objPath, cachePath, hit) && hit.storage.empty() && sameMesh(miss.mesh, hit.mesh);
+    check(passed, "a cache hit gives the mesh the miss built");
+
+    // a cache cut short on disk is built again
+    FILE* file = fopen(cachePath, "wb");
+    if (file != NULL)
+    {
+        fwrite(miss.storage.data(), 1, miss.storage.size() / 2, file);
+        fclose(file);
+    }
+    passed = passed && loadMeshCached(objPath, cachePath, rebuilt) && !rebuilt.storage.empty() && sameMesh(miss.mesh, rebuilt.mesh);
+    check(passed, "a damaged cache file is built again");
+
+    closeMeshFile(miss);
+    closeMeshFile(hit);
+    closeMeshFile(rebuilt);
+    remove(cachePath);
+}
+
+int main()
+{
+    srand(1);
+    testRoundTrip(8, "an image reads back as what was written");
+    // more than 65536 vertices, split in 16-bit sub-meshes
+    testRoundTrip(300, "a mesh split in sub-meshes reads back as what was written");
+    testRejected();
+    testLoad();
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// parseOBJ() on small files written by hand, every corner form and face
+//  size, against the triangles they must give ; then a file big enough to
+//  be split in chunks must parse the same on any thread count
+//
+//  objloader_test ; exits 1 if anything failed
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+static bool parseText(const std::string &text,
+    std::vector<glm::vec3> &vertices,
+    std::vector<glm::vec2> &uvs,
+    std::vector<glm::vec3> &normals,
+    unsigned int threadCount = 1)
+{
+    return parseOBJ(text.data(), text.size(), vertices, uvs, normals, NULL, threadCount);
+}
+
+static bool near(const glm::vec3 &a, const glm::vec3 &b)
+{
+    return fabsf(a.x - b.x) <= 1e-6f && fabsf(a.y - b.y) <= 1e-6f && fabsf(a.z - b.z) <= 1e-6f;
+}
+
+static bool near(const glm::vec2 &a, const glm::vec2 &b)
+{
+    return fabsf(a.x - b.x) <= 1e-6f && fabsf(a.y - b.y) <= 1e-6f;
+}
+
+// the corners of the triangles, as positions, UVs and normals
+struct Expected
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+};
+
+static bool matches(const Expected &expected,
+    const std::vector<glm::vec3> &vertices,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals)
+{
+    if (vertices.size() != expected.vertices.size() || uvs.size() != vertices.size() || normals.size() != vertices.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (!near(vertices[i], expected.vertices[i]) || !near(uvs[i], expected.uvs[i]) || !near(normals[i], expected.normals[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void addCorner(Expected &e, const glm::vec3 &v, const glm::vec2 &uv, const glm::vec3 &n)
+{
+    e.vertices.push_back(v);
+    e.uvs.push_back(uv);
+    e.normals.push_back(n);
+}
+
+static void testCornerForms()
+{
+    // a unit square in z = 0, the four forms of corners, the last face with
+    //  relative indices
+    const char* text =
+        "# comment\n"
+        "o square\n"
+        "v 0 0 0\n"
+        "v 1 0 0\r\n"
+        "v 1 1 0\n"
+        "v 0 1 0\n"
+        "\n"
+        "vt 0 0\n"
+        "vt 1 0\n"
+        "vt 1 1\n"
+        "vn 0 0 1\n"
+        "s off\n"
+        "f 1 2 3\n"
+        "f 1/1 2/2 3/3\n"
+        "f 1//1 2//1 3//1\n"
+        "f 1/1/1 2/2/1 3/3/1\n"
+        "f -4/-3/-1 -3/-2/-1 -2/-1/-1\n";
+
+    glm::vec3 p0(0.f, 0.f, 0.f), p1(1.f, 0.f, 0.f), p2(1.f, 1.f, 0.f);
+    // V comes out negated, for the DDS textures
+    glm::vec2 t0(0.f, 0.f), t1(1.f, 0.f), t2(1.f, -1.f), none(0.f, 0.f);
+    glm::vec3 up(0.f, 0.f, 1.f);
+
+    Expected e;
+    // no normals : the flat face normal, no UVs : (0, 0)
+    addCorner(e, p0, none, up); addCorner(e, p1, none, up); addCorner(e, p2, none, up);
+    addCorner(e, p0, t0, up); addCorner(e, p1, t1, up); addCorner(e, p2, t2, up);
+    addCorner(e, p0, none, up); addCorner(e, p1, none, up); addCorner(e, p2, none, up);
+    addCorner(e, p0, t0, up); addCorner(e, p1, t1, up); addCorner(e, p2, t2, up);
+    addCorner(e, p0, t0, up); addCorner(e, p1, t1, up); addCorner(e, p2, t2, up);
+
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    bool parsed = parseText(text, vertices, uvs, normals);
+    check(parsed && matches(e, vertices, uvs, normals), "v, v/vt, v//vn, v/vt/vn and negative indices");
+}
+
+static void testPolygons()
+{
+    // a quad and a pentagon, fan triangulated from their first corner
+    const char* text =
+        "v 0 0 0\n"
+        "v 2 0 0\n"
+        "v 2 2 0\n"
+        "v 0 2 0\n"
+        "v -1 1 0\n"
+        "f 1 2 3 4\n"
+        "f 1 2 3 4 5\n";
+
+    glm::vec3 p[5] = {
+        glm::vec3(0.f, 0.f, 0.f), glm::vec3(2.f, 0.f, 0.f), glm::vec3(2.f, 2.f, 0.f),
+        glm::vec3(0.f, 2.f, 0.f), glm::vec3(-1.f, 1.f, 0.f)
+    };
+    glm::vec2 none(0.f, 0.f);
+    glm::vec3 up(0.f, 0.f, 1.f);
+
+    Expected e;
+    unsigned int fans[][3] = { {0, 1, 2}, {0, 2, 3}, {0, 1, 2}, {0, 2, 3}, {0, 3, 4} };
+    for (unsigned int t = 0; t < 5; t++)
+    {
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            addCorner(e, p[fans[t][k]], none, up);
+        }
+    }
+
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    bool parsed = parseText(text, vertices, uvs, normals);
+    check(parsed && matches(e, vertices, uvs, normals), "quads and n-gons are fan triangulated");
+}
+
+static void testFloats()
+{
+    // the forms a float takes in the wild, against strtod()
+    const char* numbers[] = {
+        "0", "-0", "1", "-1", "+2.", ".5", "-.25", "3.14159265358979",
+        "1e3", "1E-3", "-2.5e+2", "6.02214076e23", "1.17549435e-38",
+        "123456789012345678901234", "0.000000000000000000012345"
+    };
+    size_t count = sizeof(numbers) / sizeof(numbers[0]);
+
+    bool passed = true;
+    // only positions used by a face come out, so one face per number
+    for (size_t i = 0; i < count && passed; i++)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        std::string text = std::string("v ") + numbers[i] + " 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 3\n";
+        passed = parseText(text, vertices, uvs, normals) && vertices.size() == 3;
+        float expected = (float)strtod(numbers[i], NULL);
+        passed = passed && fabsf(vertices[0].x - expected) <= fabsf(expected) * 1e-6f;
+        if (!passed)
+        {
+            printf("  %s read as %.9g\n", numbers[i], vertices.empty() ? 0.f : vertices[0].x);
+        }
+    }
+    check(passed, "floats : signs, no leading or trailing digits, exponents, long mantissas");
+}
+
+static void testErrors()
+{
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    check(!parseText("v 0 0 0\nv 1 0 0\nf 1 2 3\n", vertices, uvs, normals), "a face past the last position is an error");
+    check(!parseText("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/2 2/2 3/2\n", vertices, uvs, normals), "a missing UV is an error");
+    check(!parseText("v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 -3 -2\n", vertices, uvs, normals), "a relative index before the first position is an error");
+}
+
+static float randomFloat()
+{
+    return (float)rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+static void testThreads()
+{
+    // a grid of quads, several MB of text so that it is split in chunks
+    const unsigned int side = 200;
+    std::string text;
+    char line[128];
+    for (unsigned int y = 0; y <= side; y++)
+    {
+        for (unsigned int x = 0; x <= side; x++)
+        {
+            snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f 1\n",
+                (float)x, (float)y, randomFloat(), (float)x / side, (float)y / side, 0.1f * randomFloat(), 0.1f * randomFloat());
+            text += line;
+        }
+    }
+    for (unsigned int y = 0; y < side; y++)
+    {
+        for (unsigned int x = 0; x < side; x++)
+        {
+            unsigned int a = y * (side + 1) + x + 1;
+            unsigned int b = a + 1, c = a + side + 2, d = a + side + 1;
+            if ((x + y) % 2 == 0)
+            {
+                snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c, d, d, d);
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u\nf %u/%u %u/%u %u/%u\n", a, a, b, b, c, c, a, a, c, c, d, d);
+            }
+            text += line;
+        }
+    }
+
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    OBJLoadStats stats;
+    bool passed = parseOBJ(text.data(), text.size(), vertices, uvs, normals, &stats, 1) &&
+        vertices.size() == 6 * side * side && stats.triangles == 2 * side * side;
+
+    static const unsigned int threadCounts[] = { 2, 3, 0 };
+    for (size_t k = 0; k < sizeof(threadCounts) / sizeof(threadCounts[0]) && passed; k++)
+    {
+        std::vector<glm::vec3> threadedVertices, threadedNormals;
+        std::vector<glm::vec2> threadedUVs;
+        passed = parseText(text, threadedVertices, threadedUVs, threadedNormals, threadCounts[k]) &&
+            threadedVertices == vertices && threadedUVs == uvs && threadedNormals == normals;
+    }
+    check(passed, "a file in chunks parses the same on any thread count");
+}
+
+int main()
+{
+    srand(1);
+    testCornerForms();
+    testPolygons();
+    testFloats();
+    testErrors();
+    testThreads();
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,263 @@
+// updateSceneGraph() against every world matrix recomputed from the root
+//  down : with and without the worker pool, after nodes are set, moved and
+//  added, in small subtrees and in one big enough to be split by levels,
+//  the worlds must match and graph.changed must hold exactly the set nodes
+//  and everything below them, parents before their children
+//
+//  scenegraph_test ; exits 1 if anything failed
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <common/parallel.hpp>
+#include <common/scenegraph.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+// what the test knows of a node, by handle
+struct Node
+{
+    unsigned int parent;
+    glm::vec3 translation;
+    glm::vec3 axis;             // unit
+    float angle;
+    glm::vec3 scale;
+};
+
+// translation * rotation * scale, the rotation from Rodrigues' formula
+//  rather than from a quaternion
+static glm::mat4 localMatrix(const Node &node)
+{
+    float c = cosf(node.angle), s = sinf(node.angle), k = 1.f - c;
+    float x = node.axis.x, y = node.axis.y, z = node.axis.z;
+    glm::mat4 m(1.f);
+    m[0] = glm::vec4(c + x * x * k, y * x * k + z * s, z * x * k - y * s, 0.f) * node.scale.x;
+    m[1] = glm::vec4(x * y * k - z * s, c + y * y * k, z * y * k + x * s, 0.f) * node.scale.y;
+    m[2] = glm::vec4(x * z * k + y * s, y * z * k - x * s, c + z * z * k, 0.f) * node.scale.z;
+    m[3] = glm::vec4(node.translation, 1.f);
+    return m;
+}
+
+static unsigned int addNode(SceneGraph &graph, std::vector<Node> &nodes, const Node &node)
+{
+    nodes.push_back(node);
+    return addSceneNode(graph, node.parent, node.translation, glm::angleAxis(node.angle, node.axis), node.scale);
+}
+
+static void setNode(SceneGraph &graph, std::vector<Node> &nodes, std::vector<bool> &set, unsigned int handle)
+{
+    Node &node = nodes[handle];
+    node.translation += glm::vec3(0.1f, 0.f, -0.05f);
+    node.angle += 0.2f;
+    setSceneNodeTransform(graph, handle, node.translation, glm::angleAxis(node.angle, node.axis), node.scale);
+    set[handle] = true;
+}
+
+// the worlds and graph.changed after an update, against the nodes and the
+//  handles set since the one before ; parents are added before their
+//  children, so handle order is top down
+static bool matchesUpdate(const SceneGraph &graph, const std::vector<Node> &nodes, const std::vector<bool> &set, unsigned int &changedCount)
+{
+    size_t count = nodes.size();
+    std::vector<glm::mat4> worlds(count);
+    std::vector<bool> expected(count);
+    changedCount = 0;
+    bool worldsMatch = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int parent = nodes[i].parent;
+        glm::mat4 local = localMatrix(nodes[i]);
+        worlds[i] = parent == noParent ? local : worlds[parent] * local;
+        expected[i] = set[i] || (parent != noParent && expected[parent]);
+        changedCount += expected[i];
+
+        const glm::mat4 &world = sceneNodeWorld(graph, (unsigned int)i);
+        for (unsigned int c = 0; c < 4; c++)
+        {
+            for (unsigned int r = 0; r < 4; r++)
+            {
+                worldsMatch = worldsMatch && fabsf(world[c][r] - worlds[i][c][r]) <= 1e-3f * (1.f + fabsf(worlds[i][c][r]));
+            }
+        }
+    }
+
+    // each handle once, the expected ones only, a changed parent first
+    std::vector<size_t> position(count, graph.changed.size());
+    bool changedMatch = graph.changed.size() == changedCount;
+    for (size_t k = 0; k < graph.changed.size() && changedMatch; k++)
+    {
+        unsigned int handle = graph.changed[k];
+        changedMatch = handle < count && expected[handle] && position[handle] == graph.changed.size();
+        if (changedMatch)
+        {
+            position[handle] = k;
+            unsigned int parent = nodes[handle].parent;
+            changedMatch = parent == noParent || !expected[parent] || position[parent] < k;
+        }
+    }
+
+    // and the storage is breadth first again
+    bool ordered = sceneNodeCount(graph) == count;
+    for (size_t k = 0; k < count && ordered; k++)
+    {
+        ordered = graph.parents[k] == noParent || graph.parents[k] < k;
+    }
+    return worldsMatch && changedMatch && ordered;
+}
+
+static Node randomNode(unsigned int parent)
+{
+    Node node;
+    node.parent = parent;
+    node.translation = glm::vec3((float)(rand() % 7 - 3), (float)(rand() % 5), (float)(rand() % 3)) * 0.3f;
+    node.axis = glm::normalize(glm::vec3((float)(rand() % 5 + 1), (float)(rand() % 3 - 1), 1.f));
+    node.angle = (float)(rand() % 100) * 0.05f;
+    node.scale = glm::vec3(1.f + (float)(rand() % 3) * 0.1f, 1.f, 0.9f);
+    return node;
+}
+
+static void testForest(WorkerPool &workers)
+{
+    // a few thousand small trees, most nodes a few levels down
+    SceneGraph graph;
+    initSceneGraph(graph);
+    std::vector<Node> nodes;
+    bool handles = true;
+    for (unsigned int i = 0; i < 5000; i++)
+    {
+        unsigned int parent = i < 5 || rand() % 10 == 0 ? noParent : (unsigned int)(rand() % i);
+        handles = addNode(graph, nodes, randomNode(parent)) == i && handles;
+    }
+    check(handles, "forest : handles are given in order");
+
+    std::vector<bool> set(nodes.size(), true);
+    for (unsigned int round = 0; round < 8; round++)
+    {
+        const char* what = "everything, the first update";
+        if (round == 1)
+        {
+            what = "nothing set";
+        }
+        else if (round == 4)
+        {
+            // nodes added anywhere, some under set ones
+            what = "nodes added and set";
+            for (unsigned int k = 0; k < 100; k++)
+            {
+                if (k % 3 == 0)
+                {
+                    setNode(graph, nodes, set, (unsigned int)(rand() % nodes.size()));
+                }
+                unsigned int parent = k % 5 == 0 ? noParent : (unsigned int)(rand() % nodes.size());
+                addNode(graph, nodes, randomNode(parent));
+                set.push_back(true);
+            }
+        }
+        else if (round == 5)
+        {
+            what = "translations set";
+            for (unsigned int k = 0; k < 200; k++)
+            {
+                unsigned int handle = (unsigned int)(rand() % nodes.size());
+                nodes[handle].translation.y += 0.25f;
+                setSceneNodeTranslation(graph, handle, nodes[handle].translation);
+                set[handle] = true;
+            }
+        }
+        else if (round > 0)
+        {
+            // a node set twice, or set under another set one, counts once
+            what = "nodes set";
+            for (unsigned int k = 0; k < 60 * round; k++)
+            {
+                setNode(graph, nodes, set, (unsigned int)(rand() % nodes.size()));
+            }
+        }
+
+        for (unsigned int pooled = 0; pooled < 2; pooled++)
+        {
+            // the same update again on the other path : nothing is set then,
+            //  so set everything back the way the first one saw it
+            if (pooled)
+            {
+                for (size_t i = 0; i < nodes.size(); i++)
+                {
+                    if (set[i])
+                    {
+                        const Node &node = nodes[i];
+                        setSceneNodeTransform(graph, (unsigned int)i, node.translation, glm::angleAxis(node.angle, node.axis), node.scale);
+                    }
+                }
+            }
+            updateSceneGraph(graph, pooled ? &workers : NULL);
+            unsigned int changedCount;
+            bool passed = matchesUpdate(graph, nodes, set, changedCount);
+            char line[160];
+            snprintf(line, sizeof(line), "forest : %s, %u of %u nodes changed%s",
+                what, changedCount, (unsigned int)nodes.size(), pooled ? ", pooled" : "");
+            check(passed, line);
+        }
+        set.assign(nodes.size(), false);
+    }
+    destroySceneGraph(graph);
+}
+
+static void testWideTree(WorkerPool &workers)
+{
+    // 8 children per node : the levels below a set node near the top are
+    //  bigger than a block, and are split
+    SceneGraph graph;
+    initSceneGraph(graph, 80000);
+    std::vector<Node> nodes;
+    for (unsigned int i = 0; i < 80000; i++)
+    {
+        Node node = randomNode(i == 0 ? noParent : (i - 1) / 8);
+        node.scale = glm::vec3(1.f);
+        addNode(graph, nodes, node);
+    }
+    updateSceneGraph(graph);
+
+    // the root's first child with some of its subtree, and a few leaves
+    static const unsigned int picks[] = { 1, 9, 10, 75, 79999, 40000, 12345 };
+    for (unsigned int pooled = 0; pooled < 2; pooled++)
+    {
+        std::vector<bool> set(nodes.size(), false);
+        for (unsigned int k = 0; k < sizeof(picks) / sizeof(picks[0]); k++)
+        {
+            setNode(graph, nodes, set, picks[k]);
+        }
+        updateSceneGraph(graph, pooled ? &workers : NULL);
+        unsigned int changedCount;
+        bool passed = matchesUpdate(graph, nodes, set, changedCount);
+        char line[160];
+        snprintf(line, sizeof(line), "wide tree : %u of %u nodes changed%s",
+            changedCount, (unsigned int)nodes.size(), pooled ? ", pooled" : "");
+        check(passed && changedCount > 4 * 1024, line);
+    }
+    destroySceneGraph(graph);
+}
+
+int main()
+{
+    srand(1);
+    WorkerPool workers;
+    startWorkerPool(workers, 3);
+
+    testForest(workers);
+    testWideTree(workers);
+
+    stopWorkerPool(workers);
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
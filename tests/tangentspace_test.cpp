@@ -0,0 +1,184 @@
+// computeTangentBasis() against the original glm version : every vector
+//  path the cpu has, the scalar tail of every block and any thread count
+//  must give its result up to rounding
+//
+//  tangentspace_test ; exits 1 on the first mismatch
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/simd.hpp>
+#include <common/tangentspace.hpp>
+
+// computeTangentBasis() as it was before the lanes and the threads : glm,
+//  one triangle at a time
+static void referenceTangentBasis(
+    // inputs
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    // outputs
+    std::vector<glm::vec3>& tangents,
+    std::vector<glm::vec3>& bitangents
+)
+{
+    for (unsigned int i = 0; i < vertices.size(); i += 3)
+    {
+        // shortcuts for vertices
+        glm::vec3& v0 = vertices[i+0];
+        glm::vec3& v1 = vertices[i+1];
+        glm::vec3& v2 = vertices[i+2];
+
+        // shortcuts for uvs
+        glm::vec2& uv0 = uvs[i+0];
+        glm::vec2& uv1 = uvs[i+1];
+        glm::vec2& uv2 = uvs[i+2];
+
+        // edges of the triangle : position delta
+        glm::vec3 deltaPos1 = v1 - v0;
+        glm::vec3 deltaPos2 = v2 - v0;
+
+        // uv delta
+        glm::vec2 deltaUV1 = uv1 - uv0;
+        glm::vec2 deltaUV2 = uv2 - uv0;
+
+        float r = 1.f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+        glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+        glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+
+        // set the same tangent for all three vertices of the triangle
+        //  they will be merged later ; in vboindexer.cpp
+        tangents.push_back(tangent);
+        tangents.push_back(tangent);
+        tangents.push_back(tangent);
+
+        // same thing for binormals
+        bitangents.push_back(bitangent);
+        bitangents.push_back(bitangent);
+        bitangents.push_back(bitangent);
+    }
+
+    for (unsigned int i = 0 ; i < vertices.size(); i++)
+    {
+        glm::vec3& n = normals[i];
+        glm::vec3& t = tangents[i];
+        glm::vec3& b = bitangents[i];
+
+        // gram-schmidt orthogonalize
+        t = glm::normalize(t - n * glm::dot(n, t));
+
+        // calculate handedness
+        if (glm::dot(glm::cross(n, t), b) < 0.f)
+        {
+            t = t * -1.f;
+        }
+    }
+}
+
+static float randomFloat()
+{
+    return (float)rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+// triangleCount random triangles, UVs not degenerate, unit normals
+static void randomTriangles(
+    size_t triangleCount,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals
+)
+{
+    vertices.clear();
+    uvs.clear();
+    normals.clear();
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        glm::vec2 uv0(randomFloat(), randomFloat());
+        glm::vec2 uv1 = uv0 + glm::vec2(0.25f + 0.5f * fabsf(randomFloat()), 0.1f * randomFloat());
+        glm::vec2 uv2 = uv0 + glm::vec2(0.1f * randomFloat(), 0.25f + 0.5f * fabsf(randomFloat()));
+        // mirrored UVs on some triangles, for the other handedness
+        if (t % 3 == 0)
+        {
+            std::swap(uv1, uv2);
+        }
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            vertices.push_back(glm::vec3(randomFloat(), randomFloat(), randomFloat()) * 10.f);
+            glm::vec3 n(randomFloat(), randomFloat(), randomFloat() + 2.f);
+            normals.push_back(n / sqrtf(glm::dot(n, n)));
+        }
+        uvs.push_back(uv0);
+        uvs.push_back(uv1);
+        uvs.push_back(uv2);
+    }
+}
+
+// largest component difference between a and b
+static float maxDifference(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b)
+{
+    float difference = 0.f;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        glm::vec3 d = glm::abs(a[i] - b[i]);
+        difference = fmaxf(difference, fmaxf(d.x, fmaxf(d.y, d.z)));
+    }
+    return difference;
+}
+
+int main()
+{
+    // a few ulps of a unit vector, glm normalizes with its own rounding ;
+    //  the bitangents are not normalized, relative to their length
+    static const float tolerance = 1e-5f;
+    // fewer triangles than the lanes, remainders of every length, and more
+    //  than one parallel block
+    static const size_t triangleCounts[] = { 1, 3, 4, 5, 7, 8, 9, 1000, 16 * 1024 + 5, 100003 };
+    static const unsigned int threadCounts[] = { 1, 3, 0 };
+    static const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    static const char* levelNames[] = { "scalar", "sse2", "avx2" };
+    SIMDLevel best = simdLevel();
+
+    srand(1);
+    unsigned int failures = 0;
+    for (size_t c = 0; c < sizeof(triangleCounts) / sizeof(triangleCounts[0]); c++)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        randomTriangles(triangleCounts[c], vertices, uvs, normals);
+
+        std::vector<glm::vec3> expectedTangents, expectedBitangents;
+        referenceTangentBasis(vertices, uvs, normals, expectedTangents, expectedBitangents);
+        float bitangentScale = 0.f;
+        for (size_t i = 0; i < expectedBitangents.size(); i++)
+        {
+            bitangentScale = fmaxf(bitangentScale, glm::length(expectedBitangents[i]));
+        }
+
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]) && levels[l] <= best; l++)
+        {
+            setSIMDLevel(levels[l]);
+            for (size_t k = 0; k < sizeof(threadCounts) / sizeof(threadCounts[0]); k++)
+            {
+                std::vector<glm::vec3> tangents, bitangents;
+                computeTangentBasis(vertices, uvs, normals, tangents, bitangents, threadCounts[k]);
+
+                float tangentError = maxDifference(tangents, expectedTangents);
+                float bitangentError = maxDifference(bitangents, expectedBitangents) / fmaxf(bitangentScale, 1.f);
+                bool passed = tangents.size() == vertices.size() && bitangents.size() == vertices.size()
+                    && tangentError <= tolerance && bitangentError <= tolerance;
+                printf("%s : %u triangles, %s, %u threads, tangents off by %g, bitangents by %g\n",
+                    passed ? "ok" : "FAILED", (unsigned int)triangleCounts[c], levelNames[l], threadCounts[k],
+                    tangentError, bitangentError);
+                failures += passed ? 0 : 1;
+            }
+        }
+    }
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
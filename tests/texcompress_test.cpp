@@ -0,0 +1,355 @@
+// the BC1, BC3, BC4 and BC5 block encoders through decodeBlock() : blocks
+//  the formats hold exactly must come back exact, any other block within
+//  the error its endpoints allow, the better qualities never worse than the
+//  faster ones ; whole levels the same on any thread count
+//
+//  texcompress_test ; exits 1 if anything failed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <common/texcompress.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+static const CompressQuality qualities[] = { COMPRESS_FAST, COMPRESS_NORMAL, COMPRESS_BEST };
+static const unsigned int qualityCount = 3;
+
+// a colour that 565 holds exactly : 5 or 6 bits replicated into 8
+static unsigned char exact5(unsigned int v)
+{
+    return (unsigned char)((v << 3) | (v >> 2));
+}
+
+static unsigned char exact6(unsigned int v)
+{
+    return (unsigned char)((v << 2) | (v >> 4));
+}
+
+static void setPixel(unsigned char* rgba, unsigned int i, unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+{
+    rgba[i * 4 + 0] = (unsigned char)r;
+    rgba[i * 4 + 1] = (unsigned char)g;
+    rgba[i * 4 + 2] = (unsigned char)b;
+    rgba[i * 4 + 3] = (unsigned char)a;
+}
+
+// summed squared error over the first channelCount channels of a block
+static unsigned int blockError(const unsigned char* a, const unsigned char* b, unsigned int firstChannel, unsigned int channelCount)
+{
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        for (unsigned int k = firstChannel; k < firstChannel + channelCount; k++)
+        {
+            int d = (int)a[i * 4 + k] - (int)b[i * 4 + k];
+            sum += (unsigned int)(d * d);
+        }
+    }
+    return sum;
+}
+
+static unsigned int maxError(const unsigned char* a, const unsigned char* b, unsigned int channel)
+{
+    unsigned int worst = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        int d = (int)a[i * 4 + channel] - (int)b[i * 4 + channel];
+        unsigned int e = (unsigned int)(d < 0 ? -d : d);
+        worst = e > worst ? e : worst;
+    }
+    return worst;
+}
+
+static void roundTripBC1(const unsigned char* rgba, CompressQuality quality, unsigned char* decoded)
+{
+    unsigned char block[8];
+    encodeBC1Block(rgba, block, quality);
+    memset(decoded, 255, 64);
+    decodeBlock(IMAGE_BC1, block, decoded);
+}
+
+static void testDecodeBC1()
+{
+    // red and blue endpoints, c0 > c1 : 4 colours, indices 0 1 2 3 repeated
+    const unsigned char fourColors[8] = { 0x00, 0xf8, 0x1f, 0x00, 0xe4, 0xe4, 0xe4, 0xe4 };
+    // the same endpoints swapped, c0 <= c1 : 3 colours and transparent black
+    const unsigned char threeColors[8] = { 0x1f, 0x00, 0x00, 0xf8, 0xe4, 0xe4, 0xe4, 0xe4 };
+    const unsigned char expectedFour[4][4] = { {255, 0, 0, 255}, {0, 0, 255, 255}, {170, 0, 85, 255}, {85, 0, 170, 255} };
+    const unsigned char expectedThree[4][4] = { {0, 0, 255, 255}, {255, 0, 0, 255}, {127, 0, 127, 255}, {0, 0, 0, 0} };
+
+    unsigned char four[64], three[64];
+    decodeBlock(IMAGE_BC1, fourColors, four);
+    decodeBlock(IMAGE_BC1, threeColors, three);
+    bool passed = true;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        // 0xe4 : indices 0, 1, 2, 3 from the lowest bits
+        passed = passed && memcmp(four + i * 4, expectedFour[i % 4], 4) == 0 &&
+            memcmp(three + i * 4, expectedThree[i % 4], 4) == 0;
+    }
+    check(passed, "BC1 decodes 4-colour and 3-colour blocks as the format says");
+}
+
+static void testSingleColor()
+{
+    // every 565 colour comes back exact, any other within half a 565 step
+    bool exact = true, bounded = true;
+    for (unsigned int n = 0; n < 2000; n++)
+    {
+        unsigned char rgba[64], decoded[64];
+        unsigned int r = exact5(rand() % 32), g = exact6(rand() % 64), b = exact5(rand() % 32);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            setPixel(rgba, i, r, g, b, 255);
+        }
+        for (unsigned int q = 0; q < qualityCount; q++)
+        {
+            roundTripBC1(rgba, qualities[q], decoded);
+            exact = exact && blockError(rgba, decoded, 0, 4) == 0;
+        }
+
+        r = rand() % 256; g = rand() % 256; b = rand() % 256;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            setPixel(rgba, i, r, g, b, 255);
+        }
+        for (unsigned int q = 0; q < qualityCount; q++)
+        {
+            roundTripBC1(rgba, qualities[q], decoded);
+            bounded = bounded && maxError(rgba, decoded, 0) <= 4 && maxError(rgba, decoded, 1) <= 2 &&
+                maxError(rgba, decoded, 2) <= 4 && maxError(rgba, decoded, 3) == 0;
+        }
+    }
+    check(exact, "BC1 keeps single 565 colours exact");
+    check(bounded, "BC1 keeps any single colour within half a 565 step");
+}
+
+static void testTwoColors()
+{
+    // two 565 colours are the endpoints the principal axis finds, in any
+    //  direction (not only those with a component along grey)
+    bool passed = true;
+    for (unsigned int n = 0; n < 2000 && passed; n++)
+    {
+        unsigned char rgba[64], decoded[64];
+        unsigned int c[2][3];
+        for (unsigned int e = 0; e < 2; e++)
+        {
+            c[e][0] = exact5(rand() % 32);
+            c[e][1] = exact6(rand() % 64);
+            c[e][2] = exact5(rand() % 32);
+        }
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            unsigned int e = rand() % 2;
+            setPixel(rgba, i, c[e][0], c[e][1], c[e][2], 255);
+        }
+        for (unsigned int q = 1; q < qualityCount && passed; q++)
+        {
+            roundTripBC1(rgba, qualities[q], decoded);
+            passed = blockError(rgba, decoded, 0, 4) == 0;
+        }
+    }
+    check(passed, "BC1 keeps blocks of two 565 colours exact");
+}
+
+// a smooth block, a gradient between two random colours with some noise
+static void randomBlock(unsigned char* rgba)
+{
+    unsigned int from[4], to[4];
+    for (unsigned int k = 0; k < 4; k++)
+    {
+        from[k] = rand() % 256;
+        to[k] = rand() % 256;
+    }
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        unsigned int t = (i % 4 + i / 4) * 255 / 6;
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            int v = (int)((from[k] * (255 - t) + to[k] * t) / 255) + rand() % 9 - 4;
+            rgba[i * 4 + k] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+    }
+}
+
+static void testQualityOrder()
+{
+    // each quality starts from what the faster one found and only keeps
+    //  improvements, block by block
+    bool ordered = true;
+    unsigned int total[qualityCount] = { 0, 0, 0 };
+    for (unsigned int n = 0; n < 4000; n++)
+    {
+        unsigned char rgba[64], decoded[64];
+        randomBlock(rgba);
+        unsigned int error[qualityCount];
+        for (unsigned int q = 0; q < qualityCount; q++)
+        {
+            roundTripBC1(rgba, qualities[q], decoded);
+            error[q] = blockError(rgba, decoded, 0, 3);
+            total[q] += error[q];
+        }
+        ordered = ordered && error[2] <= error[1];
+    }
+    check(ordered && total[2] <= total[1] && total[1] <= total[0], "BC1 best <= normal <= fast");
+    printf("  squared error over all blocks : fast %u, normal %u, best %u\n", total[0], total[1], total[2]);
+}
+
+// the BC4 block of one channel, decoded into channel 0
+static void roundTripBC4(const unsigned char* rgba, unsigned int channel, CompressQuality quality, unsigned char* decoded)
+{
+    unsigned char block[16];
+    encodeBC4Block(rgba, channel, block, quality);
+    encodeBC4Block(rgba, channel, block + 8, quality);
+    decodeBlock(IMAGE_BC5, block, decoded);
+}
+
+static void testBC4()
+{
+    bool exact = true, bounded = true, ordered = true;
+    for (unsigned int n = 0; n < 4000; n++)
+    {
+        unsigned char rgba[64], expected[64], decoded[64];
+        randomBlock(rgba);
+        unsigned int channel = rand() % 4;
+
+        // the 8 values from lo to hi are at most (hi - lo) / 14 away, plus
+        //  rounding ; the other qualities may trade that for a lower sum
+        int lo = 255, hi = 0;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            int v = rgba[i * 4 + channel];
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+            expected[i * 4 + 0] = (unsigned char)v;
+        }
+        unsigned int previous = 0xffffffffu;
+        for (unsigned int q = 0; q < qualityCount; q++)
+        {
+            roundTripBC4(rgba, channel, qualities[q], decoded);
+            bounded = bounded && (qualities[q] != COMPRESS_FAST || maxError(expected, decoded, 0) <= (unsigned int)(hi - lo) / 14 + 1);
+            unsigned int error = blockError(expected, decoded, 0, 1);
+            ordered = ordered && error <= previous;
+            previous = error;
+        }
+
+        // 0, 255 and a ramp a, a + 4 ... a + 20 : the 6-value mode with
+        //  endpoints a and a + 20 holds them all
+        unsigned int a = rand() % 234 + 1;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            unsigned int k = i % 8;
+            rgba[i * 4 + channel] = (unsigned char)(k == 0 ? 0 : k == 1 ? 255 : a + 4 * (k - 2));
+        }
+        for (unsigned int q = 1; q < qualityCount; q++)
+        {
+            roundTripBC4(rgba, channel, qualities[q], decoded);
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                exact = exact && decoded[i * 4 + 0] == rgba[i * 4 + channel];
+            }
+        }
+    }
+    check(bounded, "BC4 fast stays within the interpolation step");
+    check(ordered, "BC4 best <= normal <= fast");
+    check(exact, "BC4 keeps 0, 255 and values on its 6-value ramp exact");
+}
+
+static void testBC3BC5()
+{
+    bool passed = true;
+    for (unsigned int n = 0; n < 1000 && passed; n++)
+    {
+        unsigned char rgba[64], decoded[64], colors[64], red[64], green[64], alpha[64], bc1[8], bc3[16], bc5[16];
+        randomBlock(rgba);
+        CompressQuality quality = qualities[n % qualityCount];
+
+        // BC3 : alpha as a BC4 block, colour as a BC1 block
+        encodeBC3Block(rgba, bc3, quality);
+        encodeBC1Block(rgba, bc1, quality);
+        passed = memcmp(bc3 + 8, bc1, 8) == 0;
+        decodeBlock(IMAGE_BC3, bc3, decoded);
+        decodeBlock(IMAGE_BC1, bc1, colors);
+        roundTripBC4(rgba, 3, quality, alpha);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            passed = passed && memcmp(decoded + i * 4, colors + i * 4, 3) == 0 && decoded[i * 4 + 3] == alpha[i * 4 + 0];
+        }
+
+        // BC5 : red and green as BC4 blocks, blue 0 and alpha 255
+        encodeBC5Block(rgba, bc5, quality);
+        decodeBlock(IMAGE_BC5, bc5, decoded);
+        roundTripBC4(rgba, 0, quality, red);
+        roundTripBC4(rgba, 1, quality, green);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            passed = passed && decoded[i * 4 + 0] == red[i * 4 + 0] && decoded[i * 4 + 1] == green[i * 4 + 0] &&
+                decoded[i * 4 + 2] == 0 && decoded[i * 4 + 3] == 255;
+        }
+    }
+    check(passed, "BC3 and BC5 are made of BC1 and BC4 blocks");
+}
+
+static void testLevels()
+{
+    // odd sizes, the edge blocks repeat the last row and column
+    const unsigned int width = 61, height = 37;
+    std::vector<unsigned char> rgba(width * height * 4);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            setPixel(&rgba[0], y * width + x, x * 255 / width, y * 255 / height, (x + y) * 2, 255 - x * 3);
+        }
+    }
+
+    static const ImageFormat formats[] = { IMAGE_BC1, IMAGE_BC3, IMAGE_BC5 };
+    static const unsigned int channels[] = { 3, 4, 2 };
+    static const unsigned int threadCounts[] = { 3, 0 };
+    size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+    bool same = true, close = true;
+    for (unsigned int f = 0; f < 3; f++)
+    {
+        size_t bytes = blocks * (formats[f] == IMAGE_BC1 ? 8 : 16);
+        std::vector<unsigned char> serial(bytes), threaded(bytes);
+        compressLevel(rgba.data(), width, height, formats[f], COMPRESS_NORMAL, serial.data(), 1);
+        for (unsigned int t = 0; t < 2; t++)
+        {
+            compressLevel(rgba.data(), width, height, formats[f], COMPRESS_NORMAL, threaded.data(), threadCounts[t]);
+            same = same && threaded == serial;
+        }
+
+        std::vector<unsigned char> decoded(rgba.size());
+        decompressLevel(serial.data(), width, height, formats[f], decoded.data());
+        double psnr = computePSNR(rgba.data(), decoded.data(), width * height, channels[f]);
+        printf("  format %d : %.1f dB\n", (int)formats[f], psnr);
+        close = close && psnr > 36.0;
+    }
+    check(same, "a level compresses the same on any thread count");
+    check(close, "smooth gradients compress above 36 dB");
+}
+
+int main()
+{
+    srand(1);
+    testDecodeBC1();
+    testSingleColor();
+    testTwoColors();
+    testQualityOrder();
+    testBC4();
+    testBC3BC5();
+    testLevels();
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+// weldVertices() and weldRecords() against the linear search through the
+//  output vertices they replaced : the same vertices must be merged, numbered
+//  in the same order, on any thread count
+//
+//  vboindexer_test ; exits 1 if anything failed
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/vboindexer.hpp>
+
+static unsigned int failures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s : %s\n", passed ? "ok" : "FAILED", what);
+    failures += passed ? 0 : 1;
+}
+
+// the tolerance test of the old indexer
+static bool referenceNear(float a, float b)
+{
+    return fabsf(a - b) < 0.01f;
+}
+
+static bool referenceSame(
+    const std::vector<glm::vec3> &vertices,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    WeldMode mode,
+    size_t a, size_t b)
+{
+    if (mode == WELD_EXACT)
+    {
+        return memcmp(&vertices[a], &vertices[b], sizeof(glm::vec3)) == 0 &&
+               memcmp(&uvs[a],      &uvs[b],      sizeof(glm::vec2)) == 0 &&
+               memcmp(&normals[a],  &normals[b],  sizeof(glm::vec3)) == 0;
+    }
+    return referenceNear(vertices[a].x, vertices[b].x) &&
+           referenceNear(vertices[a].y, vertices[b].y) &&
+           referenceNear(vertices[a].z, vertices[b].z) &&
+           referenceNear(uvs[a].x,      uvs[b].x)      &&
+           referenceNear(uvs[a].y,      uvs[b].y)      &&
+           referenceNear(normals[a].x,  normals[b].x)  &&
+           referenceNear(normals[a].y,  normals[b].y)  &&
+           referenceNear(normals[a].z,  normals[b].z);
+}
+
+// every vertex joins the first output vertex it matches, or is added
+static size_t referenceWeld(
+    const std::vector<glm::vec3> &vertices,
+    const std::vector<glm::vec2> &uvs,
+    const std::vector<glm::vec3> &normals,
+    WeldMode mode,
+    std::vector<unsigned int> &remap)
+{
+    std::vector<size_t> output;
+    remap.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        size_t k = 0;
+        while (k < output.size() && !referenceSame(vertices, uvs, normals, mode, output[k], i))
+        {
+            k++;
+        }
+        if (k == output.size())
+        {
+            output.push_back(i);
+        }
+        remap[i] = (unsigned int)k;
+    }
+    return output.size();
+}
+
+static float randomOffset()
+{
+    // on both sides of the 0.01 tolerance, and across grid cell borders
+    static const float offsets[] = { 0.f, 0.f, 0.004f, -0.004f, 0.0099f, -0.0099f, 0.0101f, -0.0101f, 0.017f };
+    return offsets[rand() % (sizeof(offsets) / sizeof(offsets[0]))];
+}
+
+// count vertices picked among distinct ones 0.03 apart, every component
+//  sometimes moved by an offset
+static void makeVertices(size_t count, size_t distinct, bool jitter,
+    std::vector<glm::vec3> &vertices,
+    std::vector<glm::vec2> &uvs,
+    std::vector<glm::vec3> &normals)
+{
+    vertices.resize(count);
+    uvs.resize(count);
+    normals.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        int k = rand() % (int)distinct;
+        vertices[i] = glm::vec3((float)(k % 17), (float)((k / 17) % 17), (float)(k / 289)) * 0.03f;
+        uvs[i] = glm::vec2((float)(k % 3) * 0.5f, 0.25f);
+        normals[i] = glm::vec3(0.f, (k % 2) ? -0.f : 0.f, 1.f);
+        if (jitter && rand() % 2)
+        {
+            vertices[i] += glm::vec3(randomOffset(), randomOffset(), randomOffset());
+            uvs[i].x += randomOffset();
+            uvs[i].y += randomOffset();
+            normals[i] += glm::vec3(randomOffset(), randomOffset(), randomOffset());
+        }
+    }
+    // a few very far away ones, they all land in the outermost grid cells
+    for (size_t i = 0; i < count; i += 997)
+    {
+        vertices[i] = glm::vec3(1e12f, -1e12f, 3e11f * (float)(rand() % 3));
+    }
+}
+
+static void testWeld(WeldMode mode, size_t count, size_t distinct, bool jitter, const char* what)
+{
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    makeVertices(count, distinct, jitter, vertices, uvs, normals);
+
+    std::vector<unsigned int> expected;
+    size_t expectedCount = referenceWeld(vertices, uvs, normals, mode, expected);
+
+    bool passed = true;
+    static const unsigned int threadCounts[] = { 1, 3, 0 };
+    for (size_t k = 0; k < sizeof(threadCounts) / sizeof(threadCounts[0]); k++)
+    {
+        std::vector<unsigned int> remap;
+        size_t weldedCount = weldVertices(vertices, uvs, normals, mode, remap, threadCounts[k]);
+        if (weldedCount != expectedCount || remap != expected)
+        {
+            printf("  %u threads : %lu vertices, %lu expected\n",
+                threadCounts[k], (unsigned long)weldedCount, (unsigned long)expectedCount);
+            passed = false;
+        }
+    }
+    check(passed, what);
+}
+
+// a record like a packed vertex, compared bytewise
+struct Record
+{
+    uint32_t words[4];
+};
+
+static uint64_t recordHash(const void* record)
+{
+    return hashBytes(record, sizeof(Record));
+}
+
+// every record in the same bucket, the probing has to do all the work
+static uint64_t collidingHash(const void*)
+{
+    return 42;
+}
+
+static bool recordEqual(const void* a, const void* b)
+{
+    return memcmp(a, b, sizeof(Record)) == 0;
+}
+
+static void testRecords(RecordHash hash, size_t count, size_t distinct, const char* what)
+{
+    std::vector<Record> records(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int k = (unsigned int)(rand() % (int)distinct);
+        Record r = { { k, k * 2654435761u, 0u, k % 5 } };
+        records[i] = r;
+    }
+
+    // first occurrence numbering
+    std::vector<unsigned int> expected(count);
+    std::vector<size_t> output;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t k = 0;
+        while (k < output.size() && !recordEqual(&records[output[k]], &records[i]))
+        {
+            k++;
+        }
+        if (k == output.size())
+        {
+            output.push_back(i);
+        }
+        expected[i] = (unsigned int)k;
+    }
+
+    bool passed = true;
+    static const unsigned int threadCounts[] = { 1, 3, 0 };
+    for (size_t k = 0; k < sizeof(threadCounts) / sizeof(threadCounts[0]); k++)
+    {
+        std::vector<unsigned int> remap;
+        size_t weldedCount = weldRecords(records.data(), sizeof(Record), count, hash, recordEqual, remap, threadCounts[k]);
+        passed = passed && weldedCount == output.size() && remap == expected;
+    }
+    check(passed, what);
+}
+
+int main()
+{
+    srand(1);
+    // more than one parallel block (16K vertices) so the threads have work
+    testWeld(WELD_EXACT, 40000, 3000, false, "exact welding of repeated vertices, 0 and -0 kept apart");
+    testWeld(WELD_EXACT, 40000, 3000, true, "exact welding of vertices moved by less than the tolerance");
+    testWeld(WELD_NEAR, 40000, 3000, false, "near welding of repeated vertices");
+    testWeld(WELD_NEAR, 40000, 3000, true, "near welding on both sides of the 0.01 tolerance");
+    testWeld(WELD_NEAR, 1000, 50, true, "near welding of a small mesh");
+    testRecords(recordHash, 40000, 3000, "records welded with hashBytes()");
+    testRecords(collidingHash, 20000, 100, "records welded with a hash that always collides");
+
+    printf("%s\n", failures == 0 ? "all passed" : "some failed");
+    return failures == 0 ? 0 : 1;
+}
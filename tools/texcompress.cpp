@@ -0,0 +1,126 @@
+// offline texture compressor : BMP in, block compressed DDS with a full mip
+//  chain out, ready for loadDDS()
+//
+//  texcompress [-bc1|-bc3|-bc5] [-fast|-best] [-normalmap] [-linear]
+//      [-box|-kaiser|-lanczos] [-threads n] input.bmp output.dds
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include <common/image.hpp>
+#include <common/mipmap.hpp>
+#include <common/texcompress.hpp>
+
+static void usage()
+{
+    printf("usage : texcompress [-bc1|-bc3|-bc5] [-fast|-best] [-normalmap] [-linear]\n");
+    printf("            [-box|-kaiser|-lanczos] [-threads n] input.bmp output.dds\n");
+    printf("  -bc1        colour, 4 bits per pixel (default)\n");
+    printf("  -bc3        colour and alpha, 8 bits per pixel\n");
+    printf("  -bc5        red and green only, for normal maps, 8 bits per pixel\n");
+    printf("  -fast/-best encoding speed against quality\n");
+    printf("  -normalmap  renormalize the vectors of every mip level\n");
+    printf("  -linear     colour is not sRGB, filter it as it is\n");
+    printf("  -box, -kaiser (default), -lanczos\n");
+    printf("              mip filter\n");
+    printf("  -threads n  worker threads, 0 uses every core (default)\n");
+}
+
+int main(int argc, char** argv)
+{
+    ImageFormat format = IMAGE_BC1;
+    CompressQuality quality = COMPRESS_NORMAL;
+    MipSettings mips = colorMipSettings;
+    bool normalMap = false;
+    bool linear = false;
+    unsigned int threadCount = 0;
+    const char* inputPath = NULL;
+    const char* outputPath = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-bc1") == 0)
+            format = IMAGE_BC1;
+        else if (strcmp(argv[i], "-bc3") == 0)
+            format = IMAGE_BC3;
+        else if (strcmp(argv[i], "-bc5") == 0)
+            format = IMAGE_BC5;
+        else if (strcmp(argv[i], "-fast") == 0)
+            quality = COMPRESS_FAST;
+        else if (strcmp(argv[i], "-best") == 0)
+            quality = COMPRESS_BEST;
+        else if (strcmp(argv[i], "-normalmap") == 0)
+            normalMap = true;
+        else if (strcmp(argv[i], "-linear") == 0)
+            linear = true;
+        else if (strcmp(argv[i], "-box") == 0)
+            mips.filter = MIP_FILTER_BOX;
+        else if (strcmp(argv[i], "-kaiser") == 0)
+            mips.filter = MIP_FILTER_KAISER;
+        else if (strcmp(argv[i], "-lanczos") == 0)
+            mips.filter = MIP_FILTER_LANCZOS;
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            threadCount = (unsigned int)atoi(argv[++i]);
+        else if (inputPath == NULL)
+            inputPath = argv[i];
+        else if (outputPath == NULL)
+            outputPath = argv[i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (inputPath == NULL || outputPath == NULL)
+    {
+        usage();
+        return 1;
+    }
+    mips.srgb = !normalMap && !linear;
+    mips.normalMap = normalMap;
+
+    Image source;
+    if (!loadImage(inputPath, source))
+    {
+        return 1;
+    }
+    std::vector<unsigned char> rgba;
+    if (!convertToRGBA8(source, rgba))
+    {
+        printf("%s is already compressed\n", inputPath);
+        freeImage(source);
+        return 1;
+    }
+    unsigned int width = source.width;
+    unsigned int height = source.height;
+    freeImage(source);
+
+    auto startTime = std::chrono::steady_clock::now();
+    Image chain;
+    generateMipmaps(rgba.data(), width, height, mips, chain, threadCount);
+    double mipTime = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - startTime).count();
+
+    Image image;
+    if (!compressImage(chain, format, quality, image, threadCount))
+    {
+        return 1;
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - startTime).count();
+
+    // quality of the base level, over the channels the format keeps
+    std::vector<unsigned char> decoded(rgba.size());
+    decompressLevel(image.levels[0].data, width, height, format, decoded.data());
+    unsigned int channelCount = format == IMAGE_BC5 ? 2 : (format == IMAGE_BC3 ? 4 : 3);
+    double psnr = computePSNR(rgba.data(), decoded.data(), (size_t)width * height, channelCount);
+
+    printf("%ux%u, %u levels, %u -> %u bytes in %.1f ms (mips %.1f ms), PSNR %.2f dB\n",
+        width, height, (unsigned int)image.levels.size(),
+        (unsigned int)rgba.size(), (unsigned int)image.storage.size(), elapsed, mipTime, psnr);
+
+    return saveDDS(outputPath, image) ? 0 : 1;
+}